@@ -0,0 +1,191 @@
+/*
+ * @file board.h
+ * @brief Pin and timer channel map of the dashboard board
+ * @details This module is the header file for the board.c module. Every GPIO pin and
+ * 			timer channel in use is listed here once. The tables are expanded at compile
+ * 			time into the register images of each port, and a pin or channel booked twice
+ * 			fails the build.
+ *
+ * @author: Aeron Lahoylahoy
+ * @date: June 27, 2024
+ */
+
+#ifndef BOARD_H_
+#define BOARD_H_
+
+#include "stm32f4xx.h"
+#include "port_pin_define.h"
+#include "controls.h"
+#include "rotary_encoder.h"
+#include "sonar.h"
+#include "speed_sensor.h"
+#include "i2c_master.h"
+#include "ili9341.h"
+
+/* Ports written by boardInit() (GPIOA to GPIOC), pins not listed become analog (lowest leakage) */
+#define BOARD_WRITTEN(port) ((port) == GPIOA || (port) == GPIOB || (port) == GPIOC)
+
+/* Pin Fields */
+#define BOARD_MODE_IN 0b00
+#define BOARD_MODE_OUT 0b01
+#define BOARD_MODE_AF 0b10
+#define BOARD_MODE_ANALOG 0b11
+
+#define BOARD_TYPE_PP 0 /* push-pull */
+#define BOARD_TYPE_OD 1 /* open drain */
+
+#define BOARD_SPEED_LOW 0b00
+#define BOARD_SPEED_MEDIUM 0b01
+#define BOARD_SPEED_FAST 0b10
+#define BOARD_SPEED_HIGH 0b11
+
+#define BOARD_PULL_NONE 0b00
+#define BOARD_PULL_UP 0b01
+#define BOARD_PULL_DOWN 0b10
+
+/*
+ * Pin map: X(p, name, port, pin, mode, type, speed, pull, af, level)
+ * port and pin are the owning module's macros, so the map and the module can't disagree.
+ * level is the output latch loaded before the pin is switched to an output.
+ */
+#define BOARD_PINS(X, p) \
+	/* Debug */ \
+	X(p, SWDIO, PORTA, 13, AF, PP, HIGH, UP, 0, 0) \
+	X(p, SWCLK, PORTA, 14, AF, PP, LOW, DOWN, 0, 0) \
+	X(p, SWO, PORTB, 3, AF, PP, HIGH, NONE, 0, 0) \
+	/* Buttons and switches (debounced, active low) */ \
+	X(p, WATCH_DOG, WATCH_DOG_PORT, WATCH_DOG_PIN, IN, PP, LOW, UP, 0, 0) \
+	X(p, TURN_RIGHT, TURN_SIGNAL_PORT, TURN_RIGHT_PIN, IN, PP, LOW, UP, 0, 0) \
+	X(p, TURN_LEFT, TURN_SIGNAL_PORT, TURN_LEFT_PIN, IN, PP, LOW, UP, 0, 0) \
+	X(p, RESET_BUTTON, RESET_BUTTON_PORT, RESET_BUTTON_PIN, IN, PP, LOW, UP, 0, 0) \
+	X(p, BLUETOOTH_BUTTON, BLUETOOTH_BUTTON_PORT, BLUETOOTH_BUTTON_PIN, IN, PP, LOW, UP, 0, 0) \
+	X(p, MENU_BUTTON, MENU_BUTTON_PORT, MENU_BUTTON_PIN, IN, PP, LOW, UP, 0, 0) \
+	X(p, ENCODER_SW, ENCODER_PORT, ENCODER_SW_PIN, IN, PP, LOW, UP, 0, 0) \
+	X(p, ENCODER_CLK, ENCODER_PORT, ENCODER_CLK_PIN, IN, PP, LOW, UP, 0, 0) \
+	X(p, ENCODER_DT, ENCODER_PORT, ENCODER_DT_PIN, IN, PP, LOW, UP, 0, 0) \
+	/* Outputs */ \
+	X(p, BLUETOOTH_ENABLE, BLUETOOTH_ENABLE_PORT, BLUETOOTH_ENABLE_PIN, OUT, PP, LOW, NONE, 0, 1) /* high = bluetooth off */ \
+	/* Analog and timers */ \
+	X(p, PHOTOSENSOR, PHOTOSENSOR_PORT, PHOTOSENSOR_PIN, ANALOG, PP, LOW, NONE, 0, 0) /* ADC1 IN1 */ \
+	X(p, BACKLIGHT, LED_PORT, LED_PIN, AF, PP, LOW, NONE, 2, 0) /* TIM3 CH2 */ \
+	X(p, HALL, HALL_PORT, HALL_PIN, AF, PP, LOW, UP, 2, 0) /* TIM4 CH1 */ \
+	/* I2C1 */ \
+	X(p, I2C_SCL, I2C_PORT, I2C_SCL_PIN, AF, OD, LOW, UP, 4, 0) \
+	X(p, I2C_SDA, I2C_PORT, I2C_SDA_PIN, AF, OD, LOW, UP, 4, 0) \
+	/* Sonar */ \
+	X(p, SONAR_TRIG, SONAR_TRIG_PORT, SONAR_TRIG_PIN, OUT, PP, LOW, NONE, 0, 0) \
+	X(p, SONAR_ECHO, SONAR_ECHO_PORT, SONAR_ECHO_PIN, AF, PP, LOW, NONE, 2, 0) /* TIM3 CH1 */ \
+	BOARD_PINS_SONAR1(X, p) \
+	BOARD_PINS_SONAR2(X, p) \
+	BOARD_PINS_SONAR3(X, p) \
+	/* LCD (8-bit parallel, bit-banged) */ \
+	X(p, LCD_RST, LCD_RST_PORT, LCD_RST, OUT, PP, LOW, NONE, 0, 0) \
+	X(p, LCD_CS, LCD_CS_PORT, LCD_CS, OUT, PP, LOW, NONE, 0, 1) \
+	X(p, LCD_RS, LCD_RS_PORT, LCD_RS, OUT, PP, LOW, NONE, 0, 1) \
+	X(p, LCD_WR, LCD_WR_PORT, LCD_WR, OUT, PP, LOW, NONE, 0, 1) \
+	X(p, LCD_RD, LCD_RD_PORT, LCD_RD, OUT, PP, LOW, NONE, 0, 1) \
+	X(p, LCD_D0, LCD_D0_PORT, LCD_D0, OUT, PP, LOW, NONE, 0, 0) \
+	X(p, LCD_D1, LCD_D1_PORT, LCD_D1, OUT, PP, LOW, NONE, 0, 0) \
+	X(p, LCD_D2, LCD_D2_PORT, LCD_D2, OUT, PP, LOW, NONE, 0, 0) \
+	X(p, LCD_D3, LCD_D3_PORT, LCD_D3, OUT, PP, LOW, NONE, 0, 0) \
+	X(p, LCD_D4, LCD_D4_PORT, LCD_D4, OUT, PP, LOW, NONE, 0, 0) \
+	X(p, LCD_D5, LCD_D5_PORT, LCD_D5, OUT, PP, LOW, NONE, 0, 0) \
+	X(p, LCD_D6, LCD_D6_PORT, LCD_D6, OUT, PP, LOW, NONE, 0, 0) \
+	X(p, LCD_D7, LCD_D7_PORT, LCD_D7, OUT, PP, LOW, NONE, 0, 0)
+
+#if SONAR_COUNT > 1
+#define BOARD_PINS_SONAR1(X, p) \
+	X(p, SONAR1_TRIG, SONAR1_TRIG_PORT, SONAR1_TRIG_PIN, OUT, PP, LOW, NONE, 0, 0) \
+	X(p, SONAR1_ECHO, SONAR1_ECHO_PORT, SONAR1_ECHO_PIN, AF, PP, LOW, NONE, 9, 0) /* TIM12 CH1 */
+#else
+#define BOARD_PINS_SONAR1(X, p)
+#endif
+
+#if SONAR_COUNT > 2
+#define BOARD_PINS_SONAR2(X, p) \
+	X(p, SONAR2_TRIG, SONAR2_TRIG_PORT, SONAR2_TRIG_PIN, OUT, PP, LOW, NONE, 0, 0) \
+	X(p, SONAR2_ECHO, SONAR2_ECHO_PORT, SONAR2_ECHO_PIN, AF, PP, LOW, NONE, 9, 0) /* TIM12 CH2 */
+#else
+#define BOARD_PINS_SONAR2(X, p)
+#endif
+
+#if SONAR_COUNT > 3
+#define BOARD_PINS_SONAR3(X, p) \
+	X(p, SONAR3_TRIG, SONAR3_TRIG_PORT, SONAR3_TRIG_PIN, OUT, PP, LOW, NONE, 0, 0) \
+	X(p, SONAR3_ECHO, SONAR3_ECHO_PORT, SONAR3_ECHO_PIN, AF, PP, LOW, NONE, 3, 0) /* TIM9 CH1 */
+#else
+#define BOARD_PINS_SONAR3(X, p)
+#endif
+
+/*
+ * Timer channel map: X(name, timer, channel)
+ * Internal compare channels are listed too, so they can't be handed out again.
+ */
+#define BOARD_TIMER_CHANNELS(X) \
+	X(SONAR_SLOT, 2, 1)	  /* trigger pulse end */ \
+	X(SONAR_ECHO, 3, 1)	  /* echo capture, shares the TIM3 base */ \
+	X(BACKLIGHT, 3, 2)	  /* PWM, shares the TIM3 base */ \
+	X(HALL, 4, 1)		  /* pulse capture */ \
+	X(IDLE_WAKE, 5, 1)	  /* timebase wake-up compare */ \
+	BOARD_CHANNELS_SONAR1(X) \
+	BOARD_CHANNELS_SONAR2(X) \
+	BOARD_CHANNELS_SONAR3(X)
+
+#if SONAR_COUNT > 1
+#define BOARD_CHANNELS_SONAR1(X) X(SONAR1_ECHO, 12, 1)
+#else
+#define BOARD_CHANNELS_SONAR1(X)
+#endif
+
+#if SONAR_COUNT > 2
+#define BOARD_CHANNELS_SONAR2(X) X(SONAR2_ECHO, 12, 2)
+#else
+#define BOARD_CHANNELS_SONAR2(X)
+#endif
+
+#if SONAR_COUNT > 3
+#define BOARD_CHANNELS_SONAR3(X) X(SONAR3_ECHO, 9, 1)
+#else
+#define BOARD_CHANNELS_SONAR3(X)
+#endif
+
+/* Shared TIM3 base: 1 MHz, owned by boardInit(); channel inits only touch their own channel */
+#define BOARD_TIM3_PERIOD 10000 /* backlight PWM period (us), echo captures extend over it */
+
+/* Register Images */
+#define BOARD_ON(p, port) ((port) == (p))
+#define BOARD_PIN_MASK(p, name, port, pin, mode, type, speed, pull, af, level) | (BOARD_ON(p, port) ? (0b11UL << ((pin) * 2)) : 0)
+#define BOARD_PIN_MODER(p, name, port, pin, mode, type, speed, pull, af, level) | (BOARD_ON(p, port) ? ((uint32_t)BOARD_MODE_##mode << ((pin) * 2)) : 0)
+#define BOARD_PIN_OTYPER(p, name, port, pin, mode, type, speed, pull, af, level) | (BOARD_ON(p, port) ? ((uint32_t)BOARD_TYPE_##type << (pin)) : 0)
+#define BOARD_PIN_OSPEEDR(p, name, port, pin, mode, type, speed, pull, af, level) | (BOARD_ON(p, port) ? ((uint32_t)BOARD_SPEED_##speed << ((pin) * 2)) : 0)
+#define BOARD_PIN_PUPDR(p, name, port, pin, mode, type, speed, pull, af, level) | (BOARD_ON(p, port) ? ((uint32_t)BOARD_PULL_##pull << ((pin) * 2)) : 0)
+#define BOARD_PIN_AFRL(p, name, port, pin, mode, type, speed, pull, af, level) | ((BOARD_ON(p, port) && (pin) < 8) ? ((uint32_t)(af) << (((pin) & 7) * 4)) : 0)
+#define BOARD_PIN_AFRH(p, name, port, pin, mode, type, speed, pull, af, level) | ((BOARD_ON(p, port) && (pin) >= 8) ? ((uint32_t)(af) << (((pin) & 7) * 4)) : 0)
+#define BOARD_PIN_ODR(p, name, port, pin, mode, type, speed, pull, af, level) | (BOARD_ON(p, port) ? ((uint32_t)(level) << (pin)) : 0)
+
+#define BOARD_MODER(p) ((0xFFFFFFFFUL & ~(0 BOARD_PINS(BOARD_PIN_MASK, p))) | (0 BOARD_PINS(BOARD_PIN_MODER, p)))
+#define BOARD_OTYPER(p) (0 BOARD_PINS(BOARD_PIN_OTYPER, p))
+#define BOARD_OSPEEDR(p) (0 BOARD_PINS(BOARD_PIN_OSPEEDR, p))
+#define BOARD_PUPDR(p) (0 BOARD_PINS(BOARD_PIN_PUPDR, p))
+#define BOARD_AFRL(p) (0 BOARD_PINS(BOARD_PIN_AFRL, p))
+#define BOARD_AFRH(p) (0 BOARD_PINS(BOARD_PIN_AFRH, p))
+#define BOARD_ODR(p) (0 BOARD_PINS(BOARD_PIN_ODR, p))
+
+/* Double Booking: a bit set twice makes the sum differ from the OR */
+#define BOARD_PIN_SUM(p, name, port, pin, mode, type, speed, pull, af, level) + (BOARD_ON(p, port) ? (0b1ULL << (pin)) : 0)
+#define BOARD_PIN_OR(p, name, port, pin, mode, type, speed, pull, af, level) | (BOARD_ON(p, port) ? (0b1ULL << (pin)) : 0)
+#define BOARD_PINS_UNIQUE(p) ((0 BOARD_PINS(BOARD_PIN_SUM, p)) == (0 BOARD_PINS(BOARD_PIN_OR, p)))
+
+/* Unwritten Port: a module moved to a port boardInit() doesn't configure */
+#define BOARD_PIN_UNWRITTEN(p, name, port, pin, mode, type, speed, pull, af, level) + !BOARD_WRITTEN(port)
+#define BOARD_PINS_WRITTEN ((0 BOARD_PINS(BOARD_PIN_UNWRITTEN, 0)) == 0)
+
+#define BOARD_CHANNEL_BIT(timer, channel) (0b1ULL << ((timer) * 4 + (channel) - 1))
+#define BOARD_CHANNEL_SUM(name, timer, channel) + BOARD_CHANNEL_BIT(timer, channel)
+#define BOARD_CHANNEL_OR(name, timer, channel) | BOARD_CHANNEL_BIT(timer, channel)
+#define BOARD_CHANNELS_UNIQUE ((0 BOARD_TIMER_CHANNELS(BOARD_CHANNEL_SUM)) == (0 BOARD_TIMER_CHANNELS(BOARD_CHANNEL_OR)))
+
+/* Board Functions */
+void boardInit(void);
+
+#endif /* BOARD_H_ */
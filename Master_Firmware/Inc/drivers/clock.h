@@ -0,0 +1,78 @@
+/*
+ * @file clock.h
+ * @brief System clock configuration
+ * @details This module is the header file for the clock.c module. Every bus, timer and
+ * 			peripheral rate in the firmware is derived from the values below.
+ *
+ * @author: Aeron Lahoylahoy
+ * @date: June 27, 2024
+ */
+
+#ifndef CLOCK_H_
+#define CLOCK_H_
+
+#include "stm32f4xx.h"
+
+/* PLL from HSI: 16 MHz / M * N / P */
+#define CLOCK_HSI_HZ 16000000
+#define CLOCK_PLL_M 16	/* 1 MHz PLL input */
+#define CLOCK_PLL_N 360 /* 360 MHz VCO */
+#define CLOCK_PLL_P 2
+#define CLOCK_PLL_Q 8
+
+/* Bus Prescalers */
+#define CLOCK_AHB_DIV 1
+#define CLOCK_APB1_DIV 4
+#define CLOCK_APB2_DIV 2
+
+/* Derived Clocks */
+#define CLOCK_VCO_HZ (CLOCK_HSI_HZ / CLOCK_PLL_M * CLOCK_PLL_N)
+#define CLOCK_SYSCLK_HZ (CLOCK_VCO_HZ / CLOCK_PLL_P)
+#define CLOCK_HCLK_HZ (CLOCK_SYSCLK_HZ / CLOCK_AHB_DIV)
+#define CLOCK_PCLK1_HZ (CLOCK_HCLK_HZ / CLOCK_APB1_DIV)
+#define CLOCK_PCLK2_HZ (CLOCK_HCLK_HZ / CLOCK_APB2_DIV)
+
+/* Timers run at twice the APB clock when the APB is divided */
+#define CLOCK_TIM_APB1_HZ (CLOCK_APB1_DIV == 1 ? CLOCK_PCLK1_HZ : 2 * CLOCK_PCLK1_HZ)
+#define CLOCK_TIM_APB2_HZ (CLOCK_APB2_DIV == 1 ? CLOCK_PCLK2_HZ : 2 * CLOCK_PCLK2_HZ)
+
+/* Timer prescaler for a counting rate */
+#define CLOCK_PSC(timerHz, countHz) ((timerHz) / (countHz) - 1)
+#define CLOCK_APB1_PSC_1MHZ CLOCK_PSC(CLOCK_TIM_APB1_HZ, 1000000)	/* TIM2-7, TIM12-14 */
+#define CLOCK_APB2_PSC_1MHZ CLOCK_PSC(CLOCK_TIM_APB2_HZ, 1000000)	/* TIM1, TIM8-11 */
+#define CLOCK_APB1_PSC_10KHZ CLOCK_PSC(CLOCK_TIM_APB1_HZ, 10000)
+
+/* Flash wait states at 2.7-3.6 V: one per 30 MHz */
+#define CLOCK_FLASH_LATENCY ((CLOCK_HCLK_HZ - 1) / 30000000)
+
+/* ADC clock from APB2, 36 MHz max */
+#define CLOCK_ADC_DIV (CLOCK_PCLK2_HZ <= 72000000 ? 2 : CLOCK_PCLK2_HZ <= 144000000 ? 4 : 6)
+#define CLOCK_ADC_PRE (CLOCK_ADC_DIV / 2 - 1)
+
+/* Code run from SRAM: the .ramfunc section of STM32F446RETX_FLASH.ld, copied from flash
+   by the startup code. Build with -DRAMFUNC_IN_FLASH=1 to leave it in flash and compare
+   the profiler's cycle counts (tools/ramfunc_report.sh) */
+#ifndef RAMFUNC_IN_FLASH
+#define RAMFUNC_IN_FLASH 0
+#endif
+#if RAMFUNC_IN_FLASH
+#define RAMFUNC __attribute__((noinline, used))
+#else
+#define RAMFUNC __attribute__((section(".ramfunc"), noinline, used))
+#endif
+
+/* Limits (RM0390) */
+_Static_assert(CLOCK_HSI_HZ / CLOCK_PLL_M >= 1000000 && CLOCK_HSI_HZ / CLOCK_PLL_M <= 2000000, "PLL input out of range");
+_Static_assert(CLOCK_VCO_HZ >= 100000000 && CLOCK_VCO_HZ <= 432000000, "PLL VCO out of range");
+_Static_assert(CLOCK_SYSCLK_HZ <= 180000000, "SYSCLK above 180 MHz");
+_Static_assert(CLOCK_PCLK1_HZ <= 45000000, "APB1 above 45 MHz");
+_Static_assert(CLOCK_PCLK2_HZ <= 90000000, "APB2 above 90 MHz");
+_Static_assert(CLOCK_PCLK2_HZ / CLOCK_ADC_DIV <= 36000000, "ADC clock above 36 MHz");
+_Static_assert(CLOCK_FLASH_LATENCY <= 5, "Flash latency out of range");
+_Static_assert(CLOCK_APB1_PSC_1MHZ <= 0xFFFF && CLOCK_APB2_PSC_1MHZ <= 0xFFFF && CLOCK_APB1_PSC_10KHZ <= 0xFFFF, "Timer prescaler above 16 bits");
+_Static_assert(CLOCK_TIM_APB1_HZ % 1000000 == 0 && CLOCK_TIM_APB2_HZ % 1000000 == 0, "Timer clock not a whole number of MHz");
+
+/* Clock Functions */
+void clockInit(void);
+
+#endif /* CLOCK_H_ */
@@ -0,0 +1,30 @@
+/*
+ * @file exti.h
+ * @brief Table driven external interrupt lines
+ * @details This module is the header file for the exti.c module
+ *
+ * @author: Aeron Lahoylahoy
+ * @date: June 27, 2024
+ */
+
+#ifndef EXTI_H_
+#define EXTI_H_
+
+#include "stm32f4xx.h"
+#include "stm32f446xx.h"
+
+/* Trigger Edges */
+#define EXTI_FALLING 0b01
+#define EXTI_RISING 0b10
+#define EXTI_BOTH 0b11
+
+#define EXTI_LINES 16
+
+/* Line Handler, called from interrupt context with the pending bit already cleared */
+typedef void (*ExtiCallback)(void);
+
+/* EXTI Functions */
+void extiRegister(GPIO_TypeDef *Port, int Pin, int edges, ExtiCallback callback);
+void extiDispatch(uint32_t lines);
+
+#endif /* EXTI_H_ */
@@ -0,0 +1,42 @@
+/*
+ * @file flags.h
+ * @brief Event flags shared between the interrupts and the main loop
+ * @details This module is the header file for the flags.c module
+ *
+ * @author: Aeron Lahoylahoy
+ * @date: June 27, 2024
+ */
+
+#ifndef FLAGS_H_
+#define FLAGS_H_
+
+#include "stm32f4xx.h"
+
+/* Flag Bits */
+#define FLAG_TURN 0				/* turn signal switch moved */
+#define FLAG_RESET_MILES 1		/* odometer reset pressed */
+#define FLAG_BLUETOOTH 2		/* bluetooth button pressed, TIM7 blinks the icon */
+#define FLAG_BLUETOOTH_COUNT 3
+#define FLAG_MENU_BUTTON 4
+#define FLAG_WATCHDOG 5			/* watchdog test button, hold off the refresh */
+#define FLAG_MILE 6				/* TIM7: one second passed, send speed and store miles */
+#define FLAG_LINK_POLL 7		/* TIM7: poll the slave status */
+#define FLAG_ENCODER_SW 8		/* encoder push button */
+#define FLAG_COUNT 9
+
+/* Bit-band alias of one bit in SRAM: each bit has its own word, written in one bus cycle */
+#define BITBAND_SRAM(addr, bit) (*(volatile uint32_t *)(SRAM1_BB_BASE + (((uint32_t)(addr) - SRAM1_BASE) << 5) + ((bit) << 2)))
+#define FLAG_BIT(flag) BITBAND_SRAM(&flagWord, (flag))
+
+/* Single bit access, atomic against any interrupt without masking */
+#define flagSet(flag) (FLAG_BIT(flag) = 1)
+#define flagClear(flag) (FLAG_BIT(flag) = 0)
+#define flagTest(flag) (FLAG_BIT(flag))
+
+extern volatile uint32_t flagWord;
+
+/* Flag Functions */
+int flagTake(int flag);
+uint32_t flagTakeAll(uint32_t mask);
+
+#endif /* FLAGS_H_ */
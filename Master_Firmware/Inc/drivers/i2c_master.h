@@ -12,13 +12,60 @@
 
 #include "stm32f4xx.h"
 #include "port_pin_define.h"
+#include "clock.h"
+
+/* Pins: SCL PB8, SDA PB9 (AF4) */
+#define I2C_PORT PORTB
+#define I2C_SCL_PIN PIN8
+#define I2C_SDA_PIN PIN9
+
+/* Bus Clock */
+#ifndef I2C_PCLK1_HZ
+#define I2C_PCLK1_HZ CLOCK_PCLK1_HZ /* APB1 */
+#endif
+#ifndef I2C_SPEED_HZ
+#define I2C_SPEED_HZ 100000 /* 100000 standard mode, up to 400000 fast mode */
+#endif
+
+#define I2C_FREQ_MHZ (I2C_PCLK1_HZ / 1000000)
+#if I2C_SPEED_HZ > 100000
+/* Fast mode, Tlow = 2 * Thigh */
+#define I2C_CCR_VALUE (0x8000 | (I2C_PCLK1_HZ / (3 * I2C_SPEED_HZ)))
+#define I2C_TRISE_VALUE (I2C_FREQ_MHZ * 300 / 1000 + 1) /* 300 ns */
+#else
+#define I2C_CCR_VALUE (I2C_PCLK1_HZ / (2 * I2C_SPEED_HZ))
+#define I2C_TRISE_VALUE (I2C_FREQ_MHZ + 1) /* 1000 ns */
+#endif
+
+_Static_assert(I2C_FREQ_MHZ >= 2 && I2C_FREQ_MHZ <= 50, "I2C peripheral clock out of range");
+_Static_assert((I2C_CCR_VALUE & 0xFFF) >= (I2C_SPEED_HZ > 100000 ? 1 : 4), "I2C CCR below minimum");
+
+/* 16-bit register (memory) address, sent high byte first: 24C32 and larger EEPROMs */
+#define I2C_MADDR16_FLAG 0x10000
+#define I2C_MADDR16(addr) (I2C_MADDR16_FLAG | ((addr) & 0xFFFF))
+
+/* Bus time of one byte with its ACK (9 clocks) in us */
+#define I2C_BYTE_US ((9 * 1000000 + I2C_SPEED_HZ - 1) / I2C_SPEED_HZ)
+
+/* Longest wait for one flag: a byte plus the slave stretching SCL */
+#ifndef I2C_TIMEOUT_US
+#define I2C_TIMEOUT_US 2000
+#endif
+
+/* Transfer Results, the same values as I2C_RESULT_x in i2c_profiler.h */
+#define I2C_OK 0
+#define I2C_ERR_NACK 1	  /* address or data byte not acknowledged */
+#define I2C_ERR_TIMEOUT 2 /* bus stuck busy or SCL held low */
 
 /* I2C Variables */
 extern char slave; // For the 2nd STM32
 
 /* I2C Master Functions */
 void masterConfig(void);
-int I2C1_byteRead(char saddr, char maddr, char *data);
-int I2C1_byteWrite(char saddr, char maddr, char data);
+int I2C1_byteRead(char saddr, int maddr, char *data);
+int I2C1_byteWrite(char saddr, int maddr, char data);
+int I2C1_burstWrite(char saddr, int maddr, int n, char *data);
+int I2C1_burstRead(char saddr, int maddr, int n, char *data);
+int I2C1_probe(char saddr);
 
 #endif /* I2C_MASTER_H_ */
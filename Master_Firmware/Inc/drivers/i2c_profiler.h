@@ -0,0 +1,113 @@
+/*
+ * @file i2c_profiler.h
+ * @brief I2C bus utilisation and latency profiler
+ * @details This module is the header file for the i2c_profiler.c module.
+ * 			Build with -DI2C_PROFILE=1 to enable. When disabled every hook below expands
+ * 			to nothing and i2c_profiler.c is empty.
+ *
+ * @author: Aeron Lahoylahoy
+ * @date: June 27, 2024
+ */
+
+#ifndef I2C_PROFILER_H_
+#define I2C_PROFILER_H_
+
+#include "stm32f4xx.h"
+
+#ifndef I2C_PROFILE
+#define I2C_PROFILE 0
+#endif
+
+/* Call Site Tags */
+#define I2C_TAG_NONE 0
+#define I2C_TAG_WARNING 1	  /* urgent link frames: sonar warning */
+#define I2C_TAG_LINK_STATE 2  /* speed and odometer link frames */
+#define I2C_TAG_LINK_POLL 3	  /* slave status register file */
+#define I2C_TAG_EEPROM 4	  /* settings and mileage writes */
+#define I2C_TAG_EEPROM_POLL 5 /* write cycle ACK polling */
+#define I2C_TAG_SAVED_DATA 6  /* readSavedData */
+#define I2C_TAG_GET_TIME 7
+#define I2C_TAG_READ_TEMP 8
+#define I2C_TAG_SET_CLOCK 9	  /* changeTime, changeDate */
+#define I2C_TAG_TURN 10		  /* urgent link frames: turn signal */
+#define I2C_TAG_COUNT 11
+
+/* Directions */
+#define I2C_DIR_WRITE 0
+#define I2C_DIR_READ 1
+#define I2C_DIR_PROBE 2
+
+/* Results */
+#define I2C_RESULT_OK 0
+#define I2C_RESULT_NACK 1
+#define I2C_RESULT_TIMEOUT 2
+
+#if I2C_PROFILE
+
+#include "timebase.h"
+
+/* Sizes */
+#define I2C_PROFILE_LOG 32		/* last transactions kept */
+#define I2C_PROFILE_DEVICES 4
+#define I2C_PROFILE_CONTEXTS 4	/* UI states: MENUSTATE..TEMPSTATE */
+#define I2C_HIST_BINS 8			/* <64us, <128us, ... <4096us, >=4096us */
+
+/* One Transaction */
+typedef struct
+{
+	uint8_t saddr;
+	uint16_t maddr;
+	uint8_t dir;
+	uint8_t n;
+	uint8_t tag;
+	uint8_t context;
+	uint8_t result;
+	uint32_t start; /* us */
+	uint32_t end;	/* us */
+} I2CProfileRecord;
+
+/* Aggregate Counters */
+typedef struct
+{
+	uint32_t count;
+	uint32_t bytes;
+	uint32_t busyUs;
+	uint32_t wireUs; /* bytes on the wire at I2C_SPEED_HZ */
+	uint32_t maxUs;
+	uint32_t nacks; /* NACKed or timed out */
+	uint16_t hist[I2C_HIST_BINS];
+} I2CProfileStats;
+
+extern I2CProfileRecord i2cProfileLog[I2C_PROFILE_LOG];
+extern int i2cProfileHead;
+extern uint8_t i2cProfileDeviceAddr[I2C_PROFILE_DEVICES];
+extern I2CProfileStats i2cProfileDevice[I2C_PROFILE_DEVICES];
+extern I2CProfileStats i2cProfileTagStats[I2C_TAG_COUNT];
+extern uint32_t i2cProfileBusy[I2C_PROFILE_CONTEXTS][I2C_TAG_COUNT];
+extern uint32_t i2cProfileSince;
+extern uint8_t i2cProfileTag;
+extern uint8_t i2cProfileContext;
+extern int i2cProfileDumpFlag;
+
+/* Profiler Functions */
+void i2cProfileReset(void);
+void i2cProfileRecord(char saddr, int maddr, int dir, int n, uint32_t start, uint32_t end, int result);
+void i2cProfileDump(void);
+
+/* Hooks */
+#define I2C_PROFILE_TAG(tag) (i2cProfileTag = (tag))
+#define I2C_PROFILE_CONTEXT(ctx) (i2cProfileContext = (ctx), i2cProfileTag = I2C_TAG_NONE)
+#define I2C_PROFILE_BEGIN() uint32_t i2cProfileStart = getMicros()
+#define I2C_PROFILE_END(saddr, maddr, dir, n, result) \
+	i2cProfileRecord((saddr), (maddr), (dir), (n), i2cProfileStart, getMicros(), (result))
+
+#else
+
+#define I2C_PROFILE_TAG(tag) ((void)0)
+#define I2C_PROFILE_CONTEXT(ctx) ((void)0)
+#define I2C_PROFILE_BEGIN()
+#define I2C_PROFILE_END(saddr, maddr, dir, n, result) ((void)0)
+
+#endif /* I2C_PROFILE */
+
+#endif /* I2C_PROFILER_H_ */
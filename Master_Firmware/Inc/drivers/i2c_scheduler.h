@@ -0,0 +1,83 @@
+/*
+ * @file i2c_scheduler.h
+ * @brief Priority and deadline ordered I2C transaction queue
+ * @details This module is the header file for the i2c_scheduler.c module
+ *
+ * @author: Aeron Lahoylahoy
+ * @date: June 27, 2024
+ */
+
+#ifndef I2C_SCHEDULER_H_
+#define I2C_SCHEDULER_H_
+
+#include "stm32f4xx.h"
+#include "i2c_profiler.h"
+
+/* Priority Classes */
+#define I2C_PRIO_URGENT 0	  /* sonar warning, turn signals */
+#define I2C_PRIO_NORMAL 1	  /* speed and odometer updates */
+#define I2C_PRIO_BACKGROUND 2 /* EEPROM writes */
+#define I2C_PRIO_COUNT 3
+
+/* Deadline of each class after submission (us) */
+#define I2C_DEADLINE_URGENT 2000
+#define I2C_DEADLINE_NORMAL 50000
+#define I2C_DEADLINE_BACKGROUND 1000000
+
+/* Queue Sizes */
+#define I2C_QUEUE_SIZE 16
+#define I2C_JOB_MAX 16
+#define I2C_DEVICE_MAX 4
+
+/* Write cycle busy polling */
+#define I2C_BUSY_POLL_US 1000 /* address probe period while a device is busy, and the
+								 bus task re-release period while a write waits */
+#define I2C_BUSY_TIMEOUT_US 20000
+
+/* Background jobs run per i2cService() call */
+#define I2C_BACKGROUND_PER_SERVICE 1
+
+/* Queued Write */
+typedef struct
+{
+	uint8_t used;
+	uint8_t prio;
+	char saddr;
+	int maddr; /* I2C_MADDR16() for 16-bit addresses */
+	uint8_t n;
+	uint8_t tag; /* I2C_TAG_x of the call site */
+	char data[I2C_JOB_MAX];
+	uint32_t submitted; /* us */
+	uint32_t deadline;	/* us */
+} I2CJob;
+
+/* Device with a write cycle (EEPROM) */
+typedef struct
+{
+	char saddr;
+	uint8_t busy;
+	uint32_t busySince;
+	uint32_t lastProbe;
+} I2CDevice;
+
+/* Per Class Statistics */
+typedef struct
+{
+	uint32_t count;
+	uint32_t latencyMax; /* submit to completion, us */
+	uint32_t latencyLast;
+	uint32_t missed;	 /* completed after the deadline */
+	uint32_t coalesced;	 /* replaced a pending write to the same register */
+	uint32_t dropped;	 /* queue full */
+	uint32_t failed;	 /* NACKed or timed out, not retried */
+} I2CStats;
+
+extern I2CStats i2cStats[I2C_PRIO_COUNT];
+
+/* Scheduler Functions */
+void i2cSchedulerInit(void);
+void i2cRegisterDevice(char saddr);
+int i2cSubmitWrite(char saddr, int maddr, int n, char *data, int prio, int tag);
+void i2cService(void);
+
+#endif /* I2C_SCHEDULER_H_ */
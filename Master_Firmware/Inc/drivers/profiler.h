@@ -0,0 +1,109 @@
+/*
+ * @file profiler.h
+ * @brief Cycle counting profiler for tasks, interrupts and draw calls
+ * @details This module is the header file for the profiler.c module.
+ * 			Build with -DPROFILE=1 to enable. When disabled every hook below expands
+ * 			to nothing and profiler.c is empty.
+ *
+ * 			The counter source is DWT CYCCNT. A host build supplies its own by defining
+ * 			PROFILE_CYCLES(), PROFILE_COUNTER_INIT(), PROFILE_CLOCK_HZ and PROFILE_PUTC(c)
+ * 			before this header (e.g. with -include), and the same zones are measured there.
+ *
+ * @author: Aeron Lahoylahoy
+ * @date: June 27, 2024
+ */
+
+#ifndef PROFILER_H_
+#define PROFILER_H_
+
+#include <stdint.h>
+
+#ifndef PROFILE
+#define PROFILE 0
+#endif
+
+/* Zones */
+#define PROF_ZONE_TASK_BUS 0 /* scheduler tasks, in SCHED_TASK_x order */
+#define PROF_ZONE_TASK_SPEED 1
+#define PROF_ZONE_TASK_CONTROLS 2
+#define PROF_ZONE_TASK_SONAR 3
+#define PROF_ZONE_TASK_UI 4
+#define PROF_ZONE_TASK_RTC 5
+#define PROF_ZONE_SOFT_TIMERS 6
+#define PROF_ZONE_ISR_UI_TICK 7	   /* TIM7 */
+#define PROF_ZONE_ISR_EXTI 8	   /* all EXTI vectors */
+#define PROF_ZONE_ISR_BUTTONS 9	   /* TIM6 debouncer */
+#define PROF_ZONE_ISR_HALL 10	   /* TIM4 */
+#define PROF_ZONE_ISR_SONAR_SLOT 11 /* TIM2 */
+#define PROF_ZONE_ISR_SONAR_ECHO 12 /* TIM3, TIM12, TIM9 */
+#define PROF_ZONE_ISR_PHOTO 13	   /* DMA2 Stream 0 */
+#define PROF_ZONE_ISR_TIMEBASE 14  /* TIM5 */
+#define PROF_ZONE_DRAW_CLEAR 15	   /* display.c draw calls */
+#define PROF_ZONE_DRAW_MENU 16
+#define PROF_ZONE_DRAW_BLINK 17
+#define PROF_ZONE_DRAW_SCREEN 18
+#define PROF_ZONE_DRAW_TIME 19
+#define PROF_ZONE_DRAW_DATE 20
+#define PROF_ZONE_DRAW_BLUETOOTH 21
+#define PROF_ZONE_COUNT 22
+
+#if PROFILE
+
+/* Counter Source */
+#ifndef PROFILE_CYCLES
+#include "stm32f4xx.h"
+#include "clock.h"
+#define PROFILE_CYCLES() (DWT->CYCCNT)
+#define PROFILE_COUNTER_INIT() \
+	(CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk, DWT->CYCCNT = 0, DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk)
+#define PROFILE_CLOCK_HZ CLOCK_HCLK_HZ
+#define PROFILE_PUTC(c) ITM_SendChar(c)
+#endif
+
+/* Histogram: bin 0 < 64 cycles, then one bin per power of two, the last one open */
+#define PROFILE_HIST_SHIFT 6
+#define PROFILE_HIST_BINS 18
+
+/* Per Zone Counters */
+typedef struct
+{
+	uint32_t count;
+	uint32_t min; /* cycles */
+	uint32_t max;
+	uint64_t total;
+	uint16_t hist[PROFILE_HIST_BINS];
+} ProfileZone;
+
+/* Scoped Zone */
+typedef struct
+{
+	uint8_t zone;
+	uint32_t start;
+} ProfileScope;
+
+extern ProfileZone profileZones[PROF_ZONE_COUNT];
+extern uint32_t profileSince;
+extern int profileDumpFlag;
+
+/* Profiler Functions */
+void profileInit(void);
+void profileReset(void);
+void profileRecord(int zone, uint32_t cycles);
+void profileScopeEnd(ProfileScope *scope);
+void profileDump(void);
+
+/* Hooks */
+#define PROFILE_ZONE(zone) \
+	ProfileScope profileScope __attribute__((cleanup(profileScopeEnd))) = {(zone), PROFILE_CYCLES()}
+#define PROFILE_BEGIN() uint32_t profileStart = PROFILE_CYCLES()
+#define PROFILE_END(zone) profileRecord((zone), PROFILE_CYCLES() - profileStart)
+
+#else
+
+#define PROFILE_ZONE(zone)
+#define PROFILE_BEGIN()
+#define PROFILE_END(zone) ((void)0)
+
+#endif /* PROFILE */
+
+#endif /* PROFILER_H_ */
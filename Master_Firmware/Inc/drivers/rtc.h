@@ -53,7 +53,7 @@ extern int dateArray[2];
 extern int monthArray[2];
 extern int yearArray[2];
 
-/* Temp Variables */
+/* Temp Variables: whole degrees C, hundredths */
 extern int rtcTempArray[2];
 
 /* Extra Variables */
@@ -0,0 +1,39 @@
+/*
+ * @file soft_timer.h
+ * @brief Software timers on a timing wheel
+ * @details This module is the header file for the soft_timer.c module
+ *
+ * @author: Aeron Lahoylahoy
+ * @date: June 27, 2024
+ */
+
+#ifndef SOFT_TIMER_H_
+#define SOFT_TIMER_H_
+
+#include "stm32f4xx.h"
+
+/* Wheel */
+#define SOFT_TIMER_TICK_US 1000 /* resolution */
+#define SOFT_TIMER_SLOTS 32		/* one turn = 32 ms, power of two */
+#define SOFT_TIMER_NONE 0xFFFFFFFFFFFFFFFFULL
+
+typedef void (*SoftTimerCallback)(void);
+
+/* Timer, owned by the caller (static storage) */
+typedef struct SoftTimer
+{
+	struct SoftTimer *next;
+	uint64_t expiry; /* getMicros64() */
+	uint32_t period; /* us, 0 = one-shot */
+	SoftTimerCallback callback;
+	uint8_t slot;
+	uint8_t active;
+} SoftTimer;
+
+/* Soft Timer Functions (main loop only) */
+void softTimerStart(SoftTimer *t, uint32_t delayUs, uint32_t periodUs, SoftTimerCallback callback);
+void softTimerStop(SoftTimer *t);
+void softTimerService(void);
+uint64_t softTimerNextDue(void);
+
+#endif /* SOFT_TIMER_H_ */
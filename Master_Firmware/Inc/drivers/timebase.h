@@ -0,0 +1,26 @@
+/*
+ * @file timebase.h
+ * @brief Free-running microsecond timebase
+ * @details This module is the header file for the timebase.c module
+ *
+ * @author: Aeron Lahoylahoy
+ * @date: June 27, 2024
+ */
+
+#ifndef TIMEBASE_H_
+#define TIMEBASE_H_
+
+#include "stm32f4xx.h"
+
+/* Timebase Functions */
+void timebaseInit(void);
+uint32_t getMicros(void);
+uint64_t getMicros64(void);
+uint64_t deadlineAfter(uint32_t us);
+int deadlinePassed(uint64_t deadline);
+uint32_t deadlineRemaining(uint64_t deadline);
+void timebaseSleepUntil(uint64_t deadline);
+void timebaseWakeAt(uint32_t us);
+void TIM5_IRQHandler(void);
+
+#endif /* TIMEBASE_H_ */
@@ -2,6 +2,7 @@
  * @file button_functions.h
  * @brief GPIO button initialization and software debouncing utilities
  * @details Provides common functions for configuring GPIO pins as inputs with external interrupts (EXTI)
+ * 			and the 1 ms vertical counter debouncer
  * 
  * @author: Aeron Lahoylahoy
  * @date: June 27, 2024
@@ -13,8 +14,30 @@
 #include "stm32f4xx.h"
 #include "stm32f446xx.h"
 #include "port_pin_define.h"
+#include "exti.h"
 
-void buttonInit(GPIO_TypeDef *Port, int Pin);
+/* Debouncer */
+#define BUTTON_PORTS 3		  /* GPIOA..GPIOC */
+#define BUTTON_EVENTS 16	  /* event queue length, power of two */
+#define BUTTON_PORT_INDEX(Port) (((uint32_t)(Port) - GPIOA_BASE) >> 10)
+
+/* Button Event */
+typedef struct
+{
+	uint8_t port;	/* 0 = GPIOA, 1 = GPIOB, ... */
+	uint8_t pin;
+	uint8_t pressed; /* 1 = press (pin low), 0 = release */
+	uint32_t time;	/* ms since debounceInit() */
+} ButtonEvent;
+
+extern volatile uint32_t buttonTicks;
+extern uint16_t buttonState[BUTTON_PORTS];
+extern uint32_t buttonEventsLost;
+
+void buttonInit(GPIO_TypeDef *Port, int Pin, int edges, ExtiCallback callback);
+void buttonInputInit(GPIO_TypeDef *Port, int Pin);
+void debounceInit(void);
+int buttonGetEvent(ButtonEvent *event);
 int debounceButton(GPIO_TypeDef *Port, int Pin);
 
 #endif /* BUTTON_FUNCTIONS_H_ */
@@ -26,7 +26,6 @@
 #define BLUETOOTH_BUTTON_PORT PORTA
 #define RESET_BUTTON_PORT PORTA
 
-#define BLUETOOTH_ENABLE_CLK Aclk
 #define BLUETOOTH_ENABLE_PORT PORTA
 
 #define RESET_BUTTON_PIN PIN9
@@ -42,63 +41,66 @@
 #define WATCH_DOG_PIN PIN4
 
 /* Photo Sensor */
-#define PHOTOSENSOR_CLK Aclk
 #define PHOTOSENSOR_PORT PORTA
 #define PHOTOSENSOR_PIN PIN1
 
 /* LED Brightness */
-#define LED_CLK Bclk
 #define LED_PORT PORTB
 #define LED_PIN PIN5
 
+/* Photo Sensor Sampling */
+#define PHOTO_SAMPLES 64		/* DMA ring, one interrupt per half */
+#define PHOTO_SAMPLE_US 1000	/* TIM8 conversion trigger period */
+#define PHOTO_EMA_SHIFT 2		/* exponential filter weight 1/4 per half buffer */
+
+/* Backlight Curve */
+#define PHOTO_LEVELS 8
+#define PHOTO_BAND (4096 / PHOTO_LEVELS)
+#define PHOTO_HYSTERESIS 64		/* ADC counts past a band edge before the level changes */
+#define PHOTO_SLEW_STEP 200		/* duty change per 32 ms update, full swing in ~1.5 s */
+
 /* Photo Sensor */
-extern  int adcVal;
-extern float voltage;
-extern const int max_adc_value;
+extern int adcVal;
+extern uint16_t photoSamples[PHOTO_SAMPLES];
+extern int32_t photoFilterQ8;
+extern int photoLevel;
+extern int ledDuty;
+extern const uint16_t ledBrightness[PHOTO_LEVELS];
 
 /* Bluetooth */
-extern int bluetoothFlag;
 extern int bluetoothCounter;
 extern int bluetoothEnable;
-extern int bluetoothCountFlag;
 extern int bluetoothDisplay;
 
 /* Turn Signal */
 extern int turnSignal;
-extern int turnFlag;
 
-/* Watch Dog Variables */
-extern int watchDogFlag;
-extern int flag;
+/* Button Events */
+#define BUTTON_EVENT_IS(event, Port, Pin) ((event).port == BUTTON_PORT_INDEX(Port) && (event).pin == (Pin))
 
 /** Function Prototypes **/
 /* Turn Signal */
 void turnSignalSWInit(void);
-void turnSignalButtonInit(GPIO_TypeDef *Port, int Pin);
 
 /* Reset Miles */
 void resetButtonInit(void);
 
 /* Bluetooth */
 void bluetoothButtonInit(void);
-void bluetoothEnableInit(void);
 
 /* Display */
 void menuButtonInit(void);
 
-/* Watch Dog Reset */
-void watchDogInit(void);
+/* Watch Dog Button */
 void watchDogButtonInit(void);
-void watchDogCheck(void);
 
 /* Photor Sensor */
 void photosensorInit(void);
 void ledInit(void);
-void read_photosensor(void);
 void ledControl(void);
+void DMA2_Stream0_IRQHandler(void);
 
-/* Handler */
-void EXTI9_5_IRQHandler(void);
-void EXTI15_10_IRQHandler(void);
+/* Buttons */
+void handleButtons(void);
 
 #endif /* CONTROLS_H_ */
@@ -47,8 +47,6 @@ extern int chooseDate;
 extern int chooseTemp;
 extern int resetFlag;
 extern int displayFlag;
-extern int timeCount;
-extern int trigger;
 extern int mileCounter;
 extern int menuScreen;
 
@@ -68,5 +66,7 @@ void changeTime(void);
 void sendChangeTime(void);
 void decimalBinary(void);
 void printTimeToLCD(int time);
+void displayUpdate(void);
+void displayClock(void);
 
 #endif /* DISPLAY_H_ */
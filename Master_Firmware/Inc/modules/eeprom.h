@@ -10,15 +10,18 @@
 #ifndef EEPROM_H_
 #define EEPROM_H_
 
+#include "stm32f4xx.h"
+
 extern char mileEEPROM;
 extern char mileSaved;
 extern int traveledMiles;
+extern int storedMiles;
 extern char mileMemory;
 
-void getCumulativeMiles(void);
-int convertEEPROM(void);
 int convertToMiles(void);
+uint32_t odometerTenths(void);
 void storeMiles(void);
+void eepromWrite(char maddr, char data);
 void sendMessages(void);
 void readSavedData(void);
 void readMiles(void);
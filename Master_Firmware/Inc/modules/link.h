@@ -0,0 +1,105 @@
+/*
+ * @file link.h
+ * @brief Master/slave link protocol
+ * @details This module is the header file for the link.c module.
+ * 			Every update to the slave is one framed I2C write to register LINK_REG_FRAME:
+ *
+ * 			| LEN | TYPE | SEQ | PAYLOAD ... | CHK |
+ *
+ * 			LEN counts TYPE, SEQ and PAYLOAD. CHK makes the byte sum of LEN..CHK zero.
+ * 			Multi-byte fields are little endian. Must match Slave_Firmware/Inc/modules/link.h
+ *
+ * @author: Aeron Lahoylahoy
+ * @date: June 27, 2024
+ */
+
+#ifndef LINK_H_
+#define LINK_H_
+
+#include "stm32f4xx.h"
+
+#define LINK_VERSION 1
+
+/* Slave Registers */
+#define LINK_REG_FRAME 0x00	 /* write: frames */
+#define LINK_REG_STATUS 0x10 /* read: status register file */
+
+/* Status Register File (offsets from LINK_REG_STATUS, little endian) */
+#define LINK_STATUS_VERSION 0
+#define LINK_STATUS_LAST_SEQ 1
+#define LINK_STATUS_NEEDLE_RPM 2  /* speedCount1, 2 bytes */
+#define LINK_STATUS_NEEDLE_MPH 4  /* speedCount2, 2 bytes */
+#define LINK_STATUS_TARGET_RPM 6  /* rpm, 2 bytes */
+#define LINK_STATUS_TARGET_MPH 8  /* mph, 2 bytes */
+#define LINK_STATUS_FRAME_ERRORS 10
+#define LINK_STATUS_OVERRUNS 11
+#define LINK_STATUS_BUS_ERRORS 12
+#define LINK_STATUS_RESET_CAUSE 13 /* RCC->CSR[31:24] at boot */
+#define LINK_STATUS_CPU_LOAD 14  /* percent busy over the last second */
+#define LINK_STATUS_SIZE 15
+
+/* Status poll period in TIM7 ticks (250 ms) */
+#define LINK_POLL_TICKS 4
+
+/* Message Types */
+#define LINK_MSG_STATE 0x01
+
+/* Frame Sizes */
+#define LINK_HEADER_SIZE 3	/* LEN, TYPE, SEQ */
+#define LINK_STATE_SIZE 11	/* speed(2) rpm(2) turn(1) warning(1) flags(1) odometer(4) */
+#define LINK_FRAME_MAX 16
+
+/* Turn State */
+#define LINK_TURN_NONE 0
+#define LINK_TURN_RIGHT 1
+#define LINK_TURN_LEFT 2
+
+/* Flags */
+#define LINK_FLAG_WATCHDOG 0x01 /* Watch dog test requested on the master */
+
+/* Dashboard State Snapshot */
+typedef struct
+{
+	uint16_t speed;	   /* 0.1 mph */
+	uint16_t rpm;	   /* wheel rpm */
+	uint8_t turn;	   /* LINK_TURN_x */
+	uint8_t warning;   /* 1 = obstacle close */
+	uint8_t flags;	   /* LINK_FLAG_x */
+	uint32_t odometer; /* 0.1 mile */
+} LinkState;
+
+/* Slave Status Register File */
+typedef struct
+{
+	uint8_t version;
+	uint8_t lastSeq;	/* last frame the slave applied */
+	uint16_t needleRpm; /* speedCount1 */
+	uint16_t needleMph; /* speedCount2 */
+	uint16_t targetRpm;
+	uint16_t targetMph;
+	uint8_t frameErrors;
+	uint8_t overruns;
+	uint8_t busErrors;
+	uint8_t resetCause;
+	uint8_t cpuLoad;
+} LinkStatus;
+
+extern LinkState linkState;
+extern LinkStatus linkStatus;
+extern uint8_t linkSeq;
+extern int linkDirty;
+extern int linkResyncCount;
+extern int linkUrgent; /* I2C_TAG_x of an urgent change, I2C_TAG_NONE if none */
+
+/* Link Functions */
+char linkChecksum(char *buf, int n);
+int linkBuildState(char *frame);
+void linkSendState(void);
+int linkPollStatus(void);
+void linkService(void);
+void linkSetSpeed(uint32_t mphQ16, uint32_t rpmQ16);
+void linkSetTurn(int turn);
+void linkSetWarning(int warning);
+void linkSetOdometer(uint32_t tenths);
+
+#endif /* LINK_H_ */
@@ -10,8 +10,26 @@
 #ifndef ROTARY_ENCODER_H_
 #define ROTARY_ENCODER_H_
 
+#include "stm32f4xx.h"
+#include "port_pin_define.h"
+
+/* Pins */
+#define ENCODER_PORT PORTB
+#define ENCODER_SW_PIN PIN0
+#define ENCODER_CLK_PIN PIN1
+#define ENCODER_DT_PIN PIN2
+
+/* Quadrature Decoding */
+#define ENCODER_AB() (((ENCODER_PORT->IDR >> ENCODER_CLK_PIN) & 0b1) << 1 | ((ENCODER_PORT->IDR >> ENCODER_DT_PIN) & 0b1))
+#define ENCODER_STEPS_PER_DETENT 4 /* full Gray cycle per click */
+
+/* Acceleration (time between detents) */
+#define ENCODER_FAST_US 30000
+#define ENCODER_FAST_STEP 5
+#define ENCODER_MEDIUM_US 80000
+#define ENCODER_MEDIUM_STEP 2
+
 /* Rotary Encoder Global Variables */
-extern int encoderSW_Flag;
 extern int encoderCLK_Flag;
 extern int CounterClockwise_Count;
 extern int Clockwise_Count;
@@ -22,14 +40,15 @@ extern int blink;
 extern int CCW;
 extern int CW;
 
+extern volatile int32_t encoderSteps;
+
 /* Rotary Encoder Functions */
 void rotaryEncoderInit(void);
 void encoderSW_Init(void);
 void encoderCLK_Init(void);
 void encoderDT_Init(void);
-
-/* Interrupt Functions */
-extern void EXTI0_IRQHandler(void);
-extern void EXTI1_IRQHandler(void);
+void encoderSwitchPressed(void);
+void encoderEdge(void);
+void encoderService(void);
 
 #endif /* ROTARY_ENCODER_H_ */
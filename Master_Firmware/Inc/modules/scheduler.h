@@ -0,0 +1,65 @@
+/*
+ * @file scheduler.h
+ * @brief Cooperative rate based task scheduler for the main loop
+ * @details This module is the header file for the scheduler.c module
+ *
+ * @author: Aeron Lahoylahoy
+ * @date: June 27, 2024
+ */
+
+#ifndef SCHEDULER_H_
+#define SCHEDULER_H_
+
+#include "stm32f4xx.h"
+
+/* Tasks, in priority order */
+#define SCHED_TASK_BUS 0	  /* link and I2C queue: on a change, a queued write or its soft timer */
+#define SCHED_TASK_SPEED 1	  /* on a new hall period */
+#define SCHED_TASK_CONTROLS 2 /* buttons, encoder, control messages */
+#define SCHED_TASK_SONAR 3
+#define SCHED_TASK_UI 4
+#define SCHED_TASK_RTC 5
+#define SCHED_TASK_COUNT 6
+
+/* Rates (us), 0 = every pass */
+#define SCHED_PERIOD_CONTROLS 10000 /* 100 Hz */
+#define SCHED_PERIOD_SONAR 66667	/* 15 Hz */
+#define SCHED_PERIOD_UI 100000		/* 10 Hz */
+#define SCHED_PERIOD_RTC 1000000	/* 1 Hz */
+
+/* Idle */
+#define SCHED_IDLE_MIN_US 50		   /* don't sleep for less */
+#define SCHED_LOAD_WINDOW_US 1000000 /* utilisation window */
+
+/* Task Kinds */
+#define SCHED_PERIODIC 0
+#define SCHED_EVENT 1
+
+/* Task Record */
+typedef struct
+{
+	void (*run)(void);
+	uint8_t kind;
+	uint32_t period; /* us */
+	uint32_t next;	 /* us of the next release */
+	uint32_t runs;
+	uint32_t runLast; /* us */
+	uint32_t runMax;  /* us */
+	uint32_t overruns; /* released a full period late, or ran longer than its period */
+} SchedTask;
+
+extern SchedTask schedTasks[SCHED_TASK_COUNT];
+extern volatile uint32_t schedPending;
+
+/* Utilisation */
+extern uint32_t schedSleepUs;	 /* total time asleep */
+extern uint32_t schedSleeps;	 /* WFI entries */
+extern uint8_t schedCpuLoad;	 /* percent busy over the last window */
+
+/* Scheduler Functions */
+void schedulerInit(void);
+void schedulerSignal(int task);
+void schedulerRun(void);
+void schedulerIdle(void);
+
+#endif /* SCHEDULER_H_ */
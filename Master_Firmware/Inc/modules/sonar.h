@@ -15,18 +15,93 @@
 #include "stm32f446xx.h"
 
 /* Definitions */
+#ifndef SONAR_COUNT
+#define SONAR_COUNT 1 /* sensors fitted, 1 to 4 */
+#endif
+
+/* Sensor 0: trigger PA5, echo PB4 (TIM3 CH1, AF2) */
 #define SONAR_TRIG_PORT PORTA
 #define SONAR_ECHO_PORT PORTB
 #define SONAR_TRIG_PIN PIN5
 #define SONAR_ECHO_PIN PIN4
-#define SONAR_TRIG_CLK Aclk
-#define SONAR_ECHO_CLK Bclk
+
+/* Sensor 1: trigger PB12, echo PB14 (TIM12 CH1, AF9) */
+#define SONAR1_TRIG_PORT PORTB
+#define SONAR1_ECHO_PORT PORTB
+#define SONAR1_TRIG_PIN PIN12
+#define SONAR1_ECHO_PIN PIN14
+
+/* Sensor 2: trigger PB13, echo PB15 (TIM12 CH2, AF9) */
+#define SONAR2_TRIG_PORT PORTB
+#define SONAR2_ECHO_PORT PORTB
+#define SONAR2_TRIG_PIN PIN13
+#define SONAR2_ECHO_PIN PIN15
+
+/* Sensor 3: trigger PA3, echo PA2 (TIM9 CH1, AF3) */
+#define SONAR3_TRIG_PORT PORTA
+#define SONAR3_ECHO_PORT PORTA
+#define SONAR3_TRIG_PIN PIN3
+#define SONAR3_ECHO_PIN PIN2
+
+/* Ping Scheduling (TIM2 at 1 MHz) */
+#define SONAR_SLOT_US 40000 /* listening window, longer than a no-obstacle echo (38 ms) */
+#define SONAR_TRIG_US 10	/* trigger pulse */
+#define SONAR_NO_ECHO 0x7FFF /* published when a window closes without a complete echo */
+
+/* Distance Filter (tenths of an inch) */
+#define SONAR_MEDIAN_LEN 5	/* median window in echoes, odd */
+#define SONAR_EMA_SHIFT 2	/* exponential filter weight 1/4 */
+#define SONAR_MAX_DISTANCE 1000
+
+/* Warning Hysteresis */
+#define SONAR_WARN_ON 95		/* warn below 9.5 in */
+#define SONAR_WARN_OFF 120		/* clear above 12 in */
+#define SONAR_MIN_DWELL_US 300000 /* minimum time between warning transitions */
+
+/* Sensor Configuration */
+typedef struct
+{
+	GPIO_TypeDef *trigPort;
+	uint8_t trigPin;
+	GPIO_TypeDef *echoPort;
+	uint8_t echoPin;
+	uint8_t group;	  /* sensors in different groups can't hear each other and may ping together */
+	uint8_t interval; /* ping every n slots */
+} SonarConfig;
+
+/* Sensor State */
+typedef struct
+{
+	/* Capture, written by the interrupts */
+	uint32_t riseHigh;
+	uint32_t riseLow;
+	uint8_t armed;	   /* rising edge seen */
+	uint8_t listening; /* inside this sensor's window */
+	volatile uint32_t echoUs;
+	volatile int raw;  /* tenths of an inch, or SONAR_NO_ECHO */
+	volatile uint32_t seq;
+	uint32_t nextSlot;
+	uint32_t pings;
+
+	/* Filter, main loop only */
+	uint32_t seqSeen;
+	int window[SONAR_MEDIAN_LEN];
+	int windowIndex;
+	int windowCount;
+	int32_t filterQ8;
+	int distance; /* tenths of an inch */
+	int valid;	  /* 0 = nothing in range */
+} SonarSensor;
 
 /* Sonar Global Variables */
-extern double current;
-extern double last;
-extern double timeElapsed;
-extern double distance;
+extern const SonarConfig sonarConfig[SONAR_COUNT];
+extern SonarSensor sonarSensors[SONAR_COUNT];
+extern uint32_t sonarSlot;
+
+extern int distance; /* nearest obstacle, tenths of an inch */
+extern int sonarNearest; /* sensor index of the nearest obstacle, -1 = none */
+extern int sonarWarning;
+extern uint32_t sonarWarningToggles;
 
 extern int checkDistance;
 
@@ -34,8 +109,8 @@ extern int checkDistance;
 void sonarInit(void);
 void sonarTrigger_Init(void);
 void sonarEcho_Init(void);
-void readEcho(void);
-void calculateDistance(double time);
+void calculateDistance(int sensor, int raw);
+int sonarWarningUpdate(void);
 void checkWarningSignal(void);
 
 #endif /* SONAR_H_ */
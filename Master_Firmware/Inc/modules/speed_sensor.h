@@ -13,34 +13,43 @@
 #include "stm32f4xx.h"
 #include "stm32f446xx.h"
 #include "port_pin_define.h"
+#include "clock.h"
 #include "math.h"
 
+/* Hall Sensor: PB6 (TIM4 CH1, AF2) */
+#define HALL_PORT PORTB
+#define HALL_PIN PIN6
+
+/* Hall Capture */
+#define HALL_PSC CLOCK_APB1_PSC_1MHZ /* TIM4 at 1 MHz */
+#define HALL_PULSES_PER_REV 2
+#define HALL_STALL_US 900000		 /* no pulse for this long = stopped */
+
+/* Wheel Constants */
+#define WHEEL_CIRCUMFERENCE_UFT 9435000ULL /* micro-feet, 2 * 3.145 * 1.5 ft */
+#define WHEEL_CIRCUMFERENCE_FT (WHEEL_CIRCUMFERENCE_UFT / 1000000.0)
+#define TENTH_MILE_UFT 528000000ULL		   /* micro-feet in 0.1 mile */
+#define HALL_FILTER_LEN 4 /* moving average length in pulses, power of two */
+
+/* Q16 speed = constant / average pulse period (us), folded at compile time */
+#define HALL_RPM_K_Q16 ((uint64_t)(60000000.0 * 65536.0 / HALL_PULSES_PER_REV))
+#define HALL_MPH_K_Q16 ((uint64_t)(3600000000.0 * 65536.0 * WHEEL_CIRCUMFERENCE_FT / (5280.0 * HALL_PULSES_PER_REV)))
+#define SPEED_MAX_MPH_Q16 (100UL << 16)
+
 /* Mile Input */
-extern int hallEffectFlag;
-extern float rpm;
-extern float mph;
-extern double startTime;
-extern double endTime;
-extern float cumulativeMiles;
-extern float rpmAverage;
-extern float rpmSum;
-extern int rpmSumCounter;
-extern int resetMilesFlag = 0;
-
-extern int mileCounter;
-extern int mileFlag;
-
-extern int speedVal[20];
-extern int speedIndex;
+extern volatile uint32_t hallPeriodUs;
+extern volatile uint64_t odometerPulses;
+extern volatile uint64_t tripPulses;
+extern uint32_t speedRpmQ16;
+extern uint32_t speedMphQ16;
 
 /* Hall Effect */
-void hallSensorInit(void);
 void rpmReaderInit(void);
 void calculateRPM(void);
-void calculateMPH(void);
-void updateCumulativeMiles(void);
+uint64_t speedReadPulses(volatile uint64_t *counter);
+void speedResetPulses(volatile uint64_t *counter);
+uint32_t pulsesToTenths(uint64_t pulses);
 void readMiles(void);
 void sendMiles(void);
-void clearAccumulatedMiles(void);
 
 #endif /* SPEED_SENSOR_H_ */
@@ -0,0 +1,52 @@
+/*
+ * @file watchdog.h
+ * @brief Watchdog supervisor for the periodic tasks
+ * @details This module is the header file for the watchdog.c module
+ *
+ * @author: Aeron Lahoylahoy
+ * @date: June 27, 2024
+ */
+
+#ifndef WATCHDOG_H_
+#define WATCHDOG_H_
+
+#include "stm32f4xx.h"
+
+/* Supervised Tasks */
+#define WDG_TASK_LOOP 0	   /* main loop pass, rendering included */
+#define WDG_TASK_SONAR 1   /* a sonar window closed (TIM2 slots and captures alive) */
+#define WDG_TASK_I2C 2	   /* I2C queue serviced */
+#define WDG_TASK_UI_TICK 3 /* TIM7 250 ms tick */
+#define WDG_TASK_COUNT 4
+
+/* Check-in Budgets (us) */
+#define WDG_BUDGET_LOOP 500000
+#define WDG_BUDGET_SONAR 500000
+#define WDG_BUDGET_I2C 500000
+#define WDG_BUDGET_UI_TICK 600000
+
+/* IWDG: LSI / 8 = 4 kHz, reload 4000 = 1 s */
+#define WDG_PRESCALER 0x01
+#define WDG_RELOAD (4000 - 1)
+
+/* Task Record */
+typedef struct
+{
+	uint32_t budget;	/* us, 0 = not registered */
+	uint32_t last;		/* us of the last check-in */
+	uint32_t worst;		/* longest interval between check-ins, us */
+	uint32_t checkins;
+	uint32_t overruns;	/* supervisor passes that found this task late */
+} WatchDogTask;
+
+extern WatchDogTask watchDogTasks[WDG_TASK_COUNT];
+extern uint32_t watchDogKicks;
+extern uint32_t watchDogHolds; /* passes without a kick */
+
+/* Watch Dog Functions */
+void watchDogInit(void);
+void watchDogRegister(int task, uint32_t budgetUs);
+void watchDogCheckIn(int task);
+void watchDogCheck(void);
+
+#endif /* WATCHDOG_H_ */
@@ -9,6 +9,7 @@
 
 #include "bitmap_typedefs.h"
 #include <stm32f446xx.h>
+#include "clock.h"
 
 /*****************************************************************************/
 //                               USER DEFINES
@@ -179,7 +180,14 @@
 #define RESET_LCD_RST LCD_RST_PORT->BSRR |= 1U << (LCD_RST + 16)
 #define RESET_LCD_CS  LCD_CS_PORT->BSRR |= 1U << (LCD_CS + 16)
 #define RESET_LCD_RS  LCD_RS_PORT->BSRR |= 1U << (LCD_RS + 16)
-#define RESET_LCD_WR  LCD_WR_PORT->BSRR |= 1U << (LCD_WR + 16)
+/* WR low time: the core outruns the ILI9341 write cycle (twrl 15 ns, twc 66 ns) at full clock */
+#define LCD_WR_LOW_NS 40
+#define LCD_WR_NOPS ((CLOCK_HCLK_HZ / 1000000 * LCD_WR_LOW_NS + 999) / 1000)
+/* Data setup before WR falls (tdst 10 ns) */
+#define LCD_SETUP_NS 10
+#define LCD_SETUP_NOPS ((CLOCK_HCLK_HZ / 1000000 * LCD_SETUP_NS + 999) / 1000)
+#define LCD_DATA_SETUP do { for (int setupNop = 0; setupNop < LCD_SETUP_NOPS; setupNop++) __NOP(); } while (0)
+#define RESET_LCD_WR  do { LCD_WR_PORT->BSRR |= 1U << (LCD_WR + 16); for (int wrNop = 0; wrNop < LCD_WR_NOPS; wrNop++) __NOP(); } while (0)
 #define RESET_LCD_RD  LCD_RD_PORT->BSRR |= 1U << (LCD_RD + 16)
 #define RESET_LCD_D0  LCD_D0_PORT->BSRR |= 1U << (LCD_D0 + 16)
 #define RESET_LCD_D1  LCD_D1_PORT->BSRR |= 1U << (LCD_D1 + 16)
@@ -200,15 +208,6 @@
 /*****************************************************************************/
 //                           USER FUNCTION PROTOTYPE
 /*****************************************************************************/
-/// @brief Initializes SysTick timer for delays.
-void SysTick_Init(void);
-
-/// @brief Delays a given number of milliseconds.
-/// @param n is number of milliseconds to delay.
-void delayMS(uint16_t n);
-
-void delayMicroS(uint16_t n);
-
 /// @brief Set an area for drawing on the display.
 /// @param x1 is start column address.
 /// @param y1 is start row address.
@@ -247,11 +246,12 @@ void Invert_Display(void);
 /// @param rotation Values 0, 1, 2, 3. Else, default to Portrait.
 void Rotate_Display(uint8_t rotation);
 
-/// @brief Initialize the display driver.
+/// @brief Start the display power-up sequence. Its waits run from a soft timer.
 void Display_Init(void);
 
-/// @brief Sets up the GPIO pin modes of the display pins.
-void GPIO_PinMode_Setup(void);
+/// @brief Check whether the power-up sequence has finished.
+/// @return 1 once the display can be drawn on.
+uint8_t Display_Ready(void);
 
 /// @brief Sends an 8-bit command to the display.
 /// @param command is the command to send.
@@ -0,0 +1,61 @@
+/*
+ * @file 	board.c
+ * @brief 	Applies the board pin map
+ * @details The register images of each port are constants built from the tables in board.h,
+ * 			so a port is configured with one write per register instead of a read-modify-write
+ * 			per pin spread over the module inits. The output latch and alternate functions are
+ * 			loaded before MODER, so no pin glitches on the way.
+ *
+ * @note 	Modules still own their peripherals; they no longer touch GPIO configuration.
+ *
+ * @author: Aeron Lahoylahoy
+ * @date: June 27, 2024
+ */
+#include "stm32f4xx.h"
+#include "board.h"
+#include "clock.h"
+
+/* A pin or timer channel booked twice, or a pin on an unwritten port, is a build error */
+_Static_assert(BOARD_PINS_UNIQUE(GPIOA), "GPIOA pin booked twice in BOARD_PINS");
+_Static_assert(BOARD_PINS_UNIQUE(GPIOB), "GPIOB pin booked twice in BOARD_PINS");
+_Static_assert(BOARD_PINS_UNIQUE(GPIOC), "GPIOC pin booked twice in BOARD_PINS");
+_Static_assert(BOARD_PINS_WRITTEN, "BOARD_PINS pin on a port boardInit() doesn't write");
+_Static_assert(BOARD_CHANNELS_UNIQUE, "timer channel booked twice in BOARD_TIMER_CHANNELS");
+
+/* Writes the images of one port */
+#define BOARD_APPLY(p)                   \
+	do                                   \
+	{                                    \
+		(p)->ODR = BOARD_ODR(p);         \
+		(p)->OTYPER = BOARD_OTYPER(p);   \
+		(p)->OSPEEDR = BOARD_OSPEEDR(p); \
+		(p)->PUPDR = BOARD_PUPDR(p);     \
+		(p)->AFR[0] = BOARD_AFRL(p);     \
+		(p)->AFR[1] = BOARD_AFRH(p);     \
+		(p)->MODER = BOARD_MODER(p);     \
+	} while (0)
+
+/*
+ * @brief Function that configures every mapped pin and the shared TIM3 base
+ * @param None
+ * @return None
+ */
+void boardInit(void)
+{
+	RCC->AHB1ENR |= (0b1 << 0) | (0b1 << 1) | (0b1 << 2); /*GPIOA, GPIOB, GPIOC Clocks*/
+	__DSB();
+
+	BOARD_APPLY(GPIOA);
+	BOARD_APPLY(GPIOB);
+	BOARD_APPLY(GPIOC);
+
+	/* TIM3: echo capture on CH1 and backlight PWM on CH2 share one 1 MHz base */
+	RCC->APB1ENR |= (0b1 << 1);		/*TIM3 Clock*/
+	TIM3->CR1 = 0;
+	TIM3->PSC = CLOCK_APB1_PSC_1MHZ;	/*Scale down to 1MHz*/
+	TIM3->ARR = BOARD_TIM3_PERIOD - 1;
+	TIM3->CNT = 0;
+	TIM3->EGR = 1;					/*Load prescaler*/
+	TIM3->SR = 0;
+	TIM3->CR1 = 1;					/*Enable Timer*/
+}
@@ -0,0 +1,63 @@
+/*
+ * @file 	clock.c
+ * @brief 	System clock configuration
+ * @details Brings the core from the 16 MHz HSI up to CLOCK_SYSCLK_HZ through the PLL.
+ * 			Flash wait states, prefetch and the ART instruction and data caches are
+ * 			set before the switch. 180 MHz needs the regulator in over-drive.
+ *
+ * @author: Aeron Lahoylahoy
+ * @date: June 27, 2024
+ */
+#include "stm32f4xx.h"
+#include "clock.h"
+
+/*
+ * @brief Function that switches SYSCLK to the PLL and sets the bus prescalers
+ * @param None
+ * @return None
+ */
+void clockInit(void)
+{
+	/* Regulator scale 1 */
+	RCC->APB1ENR |= RCC_APB1ENR_PWREN;
+	PWR->CR |= PWR_CR_VOS;
+
+	/* Flash: wait states, then reset and enable the ART caches and prefetch */
+	FLASH->ACR = CLOCK_FLASH_LATENCY;
+	while ((FLASH->ACR & FLASH_ACR_LATENCY) != CLOCK_FLASH_LATENCY)
+		;
+	FLASH->ACR |= FLASH_ACR_ICRST | FLASH_ACR_DCRST; /*Caches must be off to reset*/
+	FLASH->ACR &= ~(FLASH_ACR_ICRST | FLASH_ACR_DCRST);
+	FLASH->ACR |= FLASH_ACR_PRFTEN | FLASH_ACR_ICEN | FLASH_ACR_DCEN;
+
+	/* PLL from HSI */
+	RCC->CR &= ~RCC_CR_PLLON;
+	RCC->PLLCFGR = (CLOCK_PLL_M << RCC_PLLCFGR_PLLM_Pos)
+				 | (CLOCK_PLL_N << RCC_PLLCFGR_PLLN_Pos)
+				 | ((CLOCK_PLL_P / 2 - 1) << RCC_PLLCFGR_PLLP_Pos)
+				 | (CLOCK_PLL_Q << RCC_PLLCFGR_PLLQ_Pos)
+				 | (2 << RCC_PLLCFGR_PLLR_Pos);	/*Reset value, unused*/
+	RCC->CR |= RCC_CR_PLLON;
+	while (!(RCC->CR & RCC_CR_PLLRDY))
+		;
+
+	/* Over-drive above 168 MHz */
+	if (CLOCK_HCLK_HZ > 168000000)
+	{
+		PWR->CR |= PWR_CR_ODEN;
+		while (!(PWR->CSR & PWR_CSR_ODRDY))
+			;
+		PWR->CR |= PWR_CR_ODSWEN;
+		while (!(PWR->CSR & PWR_CSR_ODSWRDY))
+			;
+	}
+
+	/* Bus prescalers, then switch */
+	RCC->CFGR = (RCC->CFGR & ~(RCC_CFGR_HPRE | RCC_CFGR_PPRE1 | RCC_CFGR_PPRE2))
+			  | (CLOCK_AHB_DIV == 1 ? 0 : (0b1000 | (__builtin_ctz(CLOCK_AHB_DIV) - 1))) << RCC_CFGR_HPRE_Pos
+			  | (CLOCK_APB1_DIV == 1 ? 0 : (0b100 | (__builtin_ctz(CLOCK_APB1_DIV) - 1))) << RCC_CFGR_PPRE1_Pos
+			  | (CLOCK_APB2_DIV == 1 ? 0 : (0b100 | (__builtin_ctz(CLOCK_APB2_DIV) - 1))) << RCC_CFGR_PPRE2_Pos;
+	RCC->CFGR = (RCC->CFGR & ~RCC_CFGR_SW) | RCC_CFGR_SW_PLL;
+	while ((RCC->CFGR & RCC_CFGR_SWS) != RCC_CFGR_SWS_PLL)
+		;
+}
@@ -0,0 +1,101 @@
+/*
+ * @file 	exti.c
+ * @brief 	Table driven external interrupt lines
+ * @details One registration point for every GPIO interrupt. The EXTICR slot,
+ * 			shift and NVIC line are computed from the pin, and each line has
+ * 			its own callback. The shared handlers (EXTI9_5, EXTI15_10) take the
+ * 			pending lines as one bitmask and walk it with count leading zeros,
+ * 			so the entry cost doesn't depend on which line fired.
+ *
+ * @author: Aeron Lahoylahoy
+ * @date: June 27, 2024
+ */
+#include "stm32f4xx.h"
+#include "exti.h"
+#include "clock.h"
+#include "profiler.h"
+
+/* Line Masks of the shared vectors */
+#define EXTI_LINES_9_5 0x03E0
+#define EXTI_LINES_15_10 0xFC00
+
+static ExtiCallback extiCallbacks[EXTI_LINES];
+
+static const IRQn_Type extiIrq[EXTI_LINES] = {
+	EXTI0_IRQn, EXTI1_IRQn, EXTI2_IRQn, EXTI3_IRQn, EXTI4_IRQn,
+	EXTI9_5_IRQn, EXTI9_5_IRQn, EXTI9_5_IRQn, EXTI9_5_IRQn, EXTI9_5_IRQn,
+	EXTI15_10_IRQn, EXTI15_10_IRQn, EXTI15_10_IRQn, EXTI15_10_IRQn, EXTI15_10_IRQn, EXTI15_10_IRQn};
+
+/*
+ * @brief Function that routes a GPIO pin to its EXTI line and installs the line handler
+ * @param Port: GPIO port (PORTA to PORTK), already configured as input
+ * @param Pin: GPIO pin number (0-15)
+ * @param edges: EXTI_FALLING, EXTI_RISING or EXTI_BOTH
+ * @param callback: line handler
+ * @return None
+ */
+void extiRegister(GPIO_TypeDef *Port, int Pin, int edges, ExtiCallback callback)
+{
+	uint32_t port = ((uint32_t)Port - GPIOA_BASE) >> 10; /*GPIOx blocks are 1 KB apart*/
+	uint32_t shift = (Pin & 0x3) * 4;
+
+	RCC->APB2ENR |= 0x4000; /*Set Interrupt Clock*/
+
+	extiCallbacks[Pin] = callback;
+
+	SYSCFG->EXTICR[Pin >> 2] &= ~(0xF << shift);
+	SYSCFG->EXTICR[Pin >> 2] |= (port << shift);
+
+	if (edges & EXTI_FALLING)
+		EXTI->FTSR |= (0b1 << Pin);
+	else
+		EXTI->FTSR &= ~(0b1 << Pin);
+
+	if (edges & EXTI_RISING)
+		EXTI->RTSR |= (0b1 << Pin);
+	else
+		EXTI->RTSR &= ~(0b1 << Pin);
+
+	EXTI->PR = (0b1 << Pin); /*Drop a stale edge*/
+	EXTI->IMR |= (0b1 << Pin);
+
+	NVIC_EnableIRQ(extiIrq[Pin]);
+}
+
+/*
+ * @brief Function that clears and runs the pending lines of one vector
+ * @param lines: mask of the lines served by the calling vector
+ * @return None
+ */
+RAMFUNC void extiDispatch(uint32_t lines)
+{
+	PROFILE_ZONE(PROF_ZONE_ISR_EXTI);
+
+	uint32_t pending = EXTI->PR & EXTI->IMR & lines;
+	uint32_t line;
+
+	/* Clear first so an edge during the callback pends again */
+	EXTI->PR = pending;
+
+	while (pending)
+	{
+		line = 31 - __CLZ(pending);
+		pending &= ~(0b1 << line);
+
+		if (extiCallbacks[line])
+			extiCallbacks[line]();
+	}
+}
+
+/*
+ * @brief EXTI Interrupt Handlers
+ * @param None
+ * @return None
+ */
+void EXTI0_IRQHandler(void) { extiDispatch(0b1 << 0); }
+void EXTI1_IRQHandler(void) { extiDispatch(0b1 << 1); }
+void EXTI2_IRQHandler(void) { extiDispatch(0b1 << 2); }
+void EXTI3_IRQHandler(void) { extiDispatch(0b1 << 3); }
+void EXTI4_IRQHandler(void) { extiDispatch(0b1 << 4); }
+void EXTI9_5_IRQHandler(void) { extiDispatch(EXTI_LINES_9_5); }
+void EXTI15_10_IRQHandler(void) { extiDispatch(EXTI_LINES_15_10); }
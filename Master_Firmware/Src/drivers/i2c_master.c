@@ -0,0 +1,407 @@
+/*
+ * @file 	i2c_master.c
+ * @brief 	I2C master driver for STM32F4xx
+ * @details Provides blocking single byte and burst transfers on I2C1 (PB8 SCL, PB9 SDA)
+ * 			for the RTC, the EEPROM and the slave STM32.
+ *
+ * 			Every flag wait is bounded by I2C_TIMEOUT_US, and the address phase waits for
+ * 			ADDR or AF, so a slave that NACKs or holds the bus returns an error instead of
+ * 			hanging the caller. A failed transfer ends with a STOP.
+ *
+ * @note 	Bus speed and APB1 clock are set in i2c_master.h (I2C_SPEED_HZ, I2C_PCLK1_HZ)
+ *
+ * @author 	Aeron Lahoylahoy
+ * @date   	June 27, 2024
+ */
+#include "stm32f4xx.h"
+#include "i2c_master.h"
+#include "i2c_profiler.h"
+#include "timebase.h"
+
+_Static_assert(I2C_ERR_NACK == I2C_RESULT_NACK && I2C_ERR_TIMEOUT == I2C_RESULT_TIMEOUT,
+			   "I2C results are passed to the profiler as they are");
+
+/* I2C Variables */
+char slave = 0x32; // For the 2nd STM32
+
+/*
+ * @brief Function that initializes the I2C1 peripheral in master mode
+ * @param None
+ * @return None
+ */
+void masterConfig(void)
+{
+	/* SCL and SDA (open drain, AF4) are set up by boardInit() */
+
+	/* I2C Configurations */
+	RCC->APB1ENR |= 0x200000; /*Bit 21 to enable I2C1 clock*/
+	I2C1->CR1 = 0x8000;		  /*Reset*/
+	I2C1->CR1 &= ~0x8000;	  /*Clear reset*/
+	I2C1->CR2 = I2C_FREQ_MHZ;	  /*Peripheral clock in MHz*/
+	I2C1->CCR = I2C_CCR_VALUE;	  /*Bus speed*/
+	I2C1->TRISE = I2C_TRISE_VALUE; /*Maximum rise time*/
+	I2C1->CR1 |= 0x1;		  /*Enable I2C*/
+}
+
+/*
+ * @brief Function that waits for any of a set of SR1 flags
+ * @details The time is taken before SR1 is read, so an interrupt that runs long between
+ * 			the two can't make a flag that is already set look like a timeout.
+ * @param flags: SR1 bits
+ * @return I2C_OK, I2C_ERR_NACK on an acknowledge failure, I2C_ERR_TIMEOUT
+ */
+static int I2C1_wait(uint32_t flags)
+{
+	uint32_t start = getMicros();
+	uint32_t elapsed;
+	uint32_t sr1;
+
+	do
+	{
+		elapsed = getMicros() - start;
+		sr1 = I2C1->SR1;
+		if (sr1 & 0x400)
+			return I2C_ERR_NACK;
+		if (sr1 & flags)
+			return I2C_OK;
+	} while (elapsed < I2C_TIMEOUT_US);
+
+	return I2C_ERR_TIMEOUT;
+}
+
+/*
+ * @brief Function that waits until the bus is free
+ * @param None
+ * @return I2C_OK, I2C_ERR_TIMEOUT
+ */
+static int I2C1_waitIdle(void)
+{
+	uint32_t start = getMicros();
+	uint32_t elapsed;
+
+	do
+	{
+		elapsed = getMicros() - start;
+		if (!(I2C1->SR2 & 2))
+			return I2C_OK;
+	} while (elapsed < I2C_TIMEOUT_US);
+
+	return I2C_ERR_TIMEOUT;
+}
+
+/*
+ * @brief Function that sends a (repeated) start and the slave address
+ * @details Returns with ADDR still set, so the caller picks the moment it is cleared.
+ * @param addr: slave address byte, 7-bit address shifted left with the R/W bit
+ * @return I2C_OK, I2C_ERR_NACK, I2C_ERR_TIMEOUT
+ */
+static int I2C1_start(char addr)
+{
+	int result;
+
+	I2C1->CR1 |= 0x100; /*Generate start*/
+	result = I2C1_wait(1);
+	if (result != I2C_OK)
+		return result; /*Start flag never set*/
+
+	I2C1->DR = addr; /*Transmit slave address*/
+	return I2C1_wait(2); /*Wait until addr or acknowledge failure flag is set*/
+}
+
+/*
+ * @brief Function that ends a failed transfer
+ * @details Clears AF and sets STOP while the peripheral is still master. If the bus
+ * 			doesn't come free (a slave holding SDA or SCL), the peripheral is reset so
+ * 			the next transfer isn't stuck behind its BUSY flag.
+ * @param None
+ * @return None
+ */
+static void I2C1_abort(void)
+{
+	I2C1->SR1 &= ~0x400;		 /*Clear acknowledge failure*/
+	I2C1->CR1 &= ~(0x800 | 0x400); /*Disable POS and Acknowledge*/
+	if (I2C1->SR2 & 1)
+		I2C1->CR1 |= 0x200; /*Generate stop*/
+
+	if (I2C1_waitIdle() != I2C_OK)
+		masterConfig();
+}
+
+/*
+ * @brief Function that sends the register (memory) address, high byte first for 16-bit addresses
+ * @param maddr: register address, or I2C_MADDR16(address)
+ * @return I2C_OK, I2C_ERR_NACK, I2C_ERR_TIMEOUT
+ */
+static int I2C1_sendAddress(int maddr)
+{
+	int result;
+
+	if (maddr & I2C_MADDR16_FLAG)
+	{
+		result = I2C1_wait(0x80); /*Wait until data register empty*/
+		if (result != I2C_OK)
+			return result;
+		I2C1->DR = (maddr >> 8) & 0xFF; /*Send memory address, high byte*/
+	}
+
+	result = I2C1_wait(0x80); /*Wait until data register empty*/
+	if (result != I2C_OK)
+		return result;
+	I2C1->DR = maddr & 0xFF; /*Send memory address*/
+
+	return I2C_OK;
+}
+
+/*
+ * @brief Function that reads one byte from a register of a slave device
+ * @param saddr: 7-bit slave address
+ * @param maddr: register (memory) address inside the slave, I2C_MADDR16() for 16-bit addresses
+ * @param data: location the byte is stored in
+ * @return I2C_OK, I2C_ERR_NACK, I2C_ERR_TIMEOUT
+ */
+int I2C1_byteRead(char saddr, int maddr, char *data)
+{
+	return I2C1_burstRead(saddr, maddr, 1, data);
+}
+
+/*
+ * @brief Function that writes one byte to a register of a slave device
+ * @param saddr: 7-bit slave address
+ * @param maddr: register (memory) address inside the slave, I2C_MADDR16() for 16-bit addresses
+ * @param data: byte to write
+ * @return I2C_OK, I2C_ERR_NACK, I2C_ERR_TIMEOUT
+ */
+int I2C1_byteWrite(char saddr, int maddr, char data)
+{
+	return I2C1_burstWrite(saddr, maddr, 1, &data);
+}
+
+/*
+ * @brief Function that writes the register address and data of a burst write
+ * @param saddr: 7-bit slave address
+ * @param maddr: first register (memory) address inside the slave
+ * @param n: number of bytes to write
+ * @param data: bytes to write
+ * @return I2C_OK, I2C_ERR_NACK, I2C_ERR_TIMEOUT
+ */
+static int I2C1_write(char saddr, int maddr, int n, char *data)
+{
+	int result;
+
+	result = I2C1_waitIdle(); /*Wait until bus not busy*/
+	if (result != I2C_OK)
+		return result;
+
+	I2C1->CR1 &= ~0x800; /*Disable POS*/
+	result = I2C1_start(saddr << 1); /*Slave address + Write*/
+	if (result != I2C_OK)
+		return result;
+	(void)I2C1->SR2; /*Clear addr flag*/
+
+	result = I2C1_sendAddress(maddr);
+	if (result != I2C_OK)
+		return result;
+
+	/* Write all the data */
+	for (int i = 0; i < n; i++)
+	{
+		result = I2C1_wait(0x80); /*Wait until data register empty*/
+		if (result != I2C_OK)
+			return result;
+		I2C1->DR = *data++; /*Transmit data*/
+	}
+
+	result = I2C1_wait(4); /*Wait until transfer finished*/
+	if (result != I2C_OK)
+		return result;
+	I2C1->CR1 |= 0x200; /*Generate stop*/
+
+	return I2C_OK;
+}
+
+/*
+ * @brief Function that writes n bytes to consecutive registers of a slave device in one transaction
+ * @param saddr: 7-bit slave address
+ * @param maddr: first register (memory) address inside the slave, I2C_MADDR16() for 16-bit addresses
+ * @param n: number of bytes to write
+ * @param data: bytes to write
+ * @return I2C_OK, I2C_ERR_NACK, I2C_ERR_TIMEOUT
+ */
+int I2C1_burstWrite(char saddr, int maddr, int n, char *data)
+{
+	int result;
+	I2C_PROFILE_BEGIN();
+
+	result = I2C1_write(saddr, maddr, n, data);
+	if (result != I2C_OK)
+		I2C1_abort();
+
+	I2C_PROFILE_END(saddr, maddr, I2C_DIR_WRITE, n, result);
+
+	return result;
+}
+
+/*
+ * @brief Function that addresses the slave and receives the bytes of a burst read
+ * @details Follows the RM0390 master receiver sequences, so the last byte is always NACKed
+ * 			and nothing is clocked in after it:
+ * 			n = 1: ACK cleared before ADDR, STOP right after
+ * 			n = 2: POS, so the NACK lands on the second byte; STOP once both are in (BTF)
+ * 			n > 2: ACK until three bytes are left, then BTF paces the NACK and the STOP
+ * 			ACK is set before START: with POS the first byte is acknowledged with the ACK
+ * 			the peripheral held when the address went out, not the one set during ADDR.
+ * 			Clearing ADDR and setting STOP run with interrupts masked so an ISR can't
+ * 			stretch the gap past the byte the NACK belongs to.
+ * @param saddr: 7-bit slave address
+ * @param maddr: first register (memory) address inside the slave
+ * @param n: number of bytes to read
+ * @param data: location the bytes are stored in
+ * @return I2C_OK, I2C_ERR_NACK, I2C_ERR_TIMEOUT
+ */
+static int I2C1_read(char saddr, int maddr, int n, char *data)
+{
+	uint32_t primask;
+	int result;
+
+	result = I2C1_waitIdle(); /*Wait until bus not busy*/
+	if (result != I2C_OK)
+		return result;
+
+	I2C1->CR1 &= ~0x800; /*Disable POS*/
+	I2C1->CR1 |= 0x400;	 /*Enable Acknowledge, latched with the read address for POS*/
+	result = I2C1_start(saddr << 1); /*Slave address + Write*/
+	if (result != I2C_OK)
+		return result;
+	(void)I2C1->SR2; /*Clear addr flag*/
+
+	result = I2C1_sendAddress(maddr);
+	if (result != I2C_OK)
+		return result;
+	result = I2C1_wait(0x80); /*Wait until data register empty*/
+	if (result != I2C_OK)
+		return result;
+
+	result = I2C1_start(saddr << 1 | 1); /*Restart, slave address + Read*/
+	if (result != I2C_OK)
+		return result;
+
+	if (n == 1)
+	{
+		I2C1->CR1 &= ~0x400; /*Disable Acknowledge*/
+		primask = __get_PRIMASK();
+		__disable_irq();
+		(void)I2C1->SR2;	/*Clear addr flag*/
+		I2C1->CR1 |= 0x200; /*Generate stop after data received*/
+		__set_PRIMASK(primask);
+
+		result = I2C1_wait(0x40); /*Wait until RXNE flag is set*/
+		if (result != I2C_OK)
+			return result;
+		*data = I2C1->DR; /*Read data from DR*/
+	}
+	else if (n == 2)
+	{
+		I2C1->CR1 |= 0x800;	 /*POS: ACK bit applies to the next byte*/
+		I2C1->CR1 &= ~0x400; /*Disable Acknowledge*/
+		(void)I2C1->SR2;	 /*Clear addr flag*/
+
+		result = I2C1_wait(4); /*Wait until both bytes are in (BTF)*/
+		if (result != I2C_OK)
+			return result;
+		primask = __get_PRIMASK();
+		__disable_irq();
+		I2C1->CR1 |= 0x200; /*Generate stop*/
+		*data++ = I2C1->DR;
+		__set_PRIMASK(primask);
+		*data = I2C1->DR; /*POS is cleared before the next START*/
+	}
+	else
+	{
+		(void)I2C1->SR2; /*Clear addr flag*/
+
+		for (int i = n; i > 3; i--)
+		{
+			result = I2C1_wait(0x40); /*Wait until RXNE flag is set*/
+			if (result != I2C_OK)
+				return result;
+			*data++ = I2C1->DR; /*Read data from DR*/
+		}
+
+		/* Three left: byte n-2 in DR, n-1 in the shift register, clock stretched */
+		result = I2C1_wait(4); /*Wait until BTF*/
+		if (result != I2C_OK)
+			return result;
+		I2C1->CR1 &= ~0x400; /*Disable Acknowledge, byte n is NACKed*/
+		*data++ = I2C1->DR;	 /*Byte n-2*/
+
+		result = I2C1_wait(4); /*Wait until BTF: n-1 in DR, n in the shift register*/
+		if (result != I2C_OK)
+			return result;
+		primask = __get_PRIMASK();
+		__disable_irq();
+		I2C1->CR1 |= 0x200; /*Generate stop*/
+		*data++ = I2C1->DR; /*Byte n-1*/
+		__set_PRIMASK(primask);
+
+		result = I2C1_wait(0x40); /*Wait until RXNE flag is set*/
+		if (result != I2C_OK)
+			return result;
+		*data = I2C1->DR; /*Byte n*/
+	}
+
+	return I2C_OK;
+}
+
+/*
+ * @brief Function that reads n bytes from consecutive registers of a slave device in one transaction
+ * @details The bytes are only valid if I2C_OK is returned.
+ * @param saddr: 7-bit slave address
+ * @param maddr: first register (memory) address inside the slave, I2C_MADDR16() for 16-bit addresses
+ * @param n: number of bytes to read
+ * @param data: location the bytes are stored in
+ * @return I2C_OK, I2C_ERR_NACK, I2C_ERR_TIMEOUT
+ */
+int I2C1_burstRead(char saddr, int maddr, int n, char *data)
+{
+	int result;
+	I2C_PROFILE_BEGIN();
+
+	result = I2C1_read(saddr, maddr, n, data);
+	if (result != I2C_OK)
+		I2C1_abort();
+
+	I2C_PROFILE_END(saddr, maddr, I2C_DIR_READ, n, result);
+
+	return result;
+}
+
+/*
+ * @brief Function that addresses a slave device without transferring data
+ * @details Used for write-cycle ACK polling: an EEPROM does not acknowledge its
+ * 			address until the internal write has finished.
+ * @param saddr: 7-bit slave address
+ * @return 1 if the device acknowledged, 0 if it did not or the bus timed out
+ */
+int I2C1_probe(char saddr)
+{
+	int result;
+	I2C_PROFILE_BEGIN();
+
+	result = I2C1_waitIdle(); /*Wait until bus not busy*/
+	if (result == I2C_OK)
+		result = I2C1_start(saddr << 1); /*Slave address + Write*/
+
+	if (result == I2C_OK)
+	{
+		(void)I2C1->SR2;	/*Clear addr flag*/
+		I2C1->CR1 |= 0x200; /*Generate stop*/
+	}
+	else
+	{
+		I2C1_abort();
+	}
+
+	I2C_PROFILE_END(saddr, 0, I2C_DIR_PROBE, 0, result);
+
+	return result == I2C_OK;
+}
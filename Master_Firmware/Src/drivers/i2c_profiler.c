@@ -0,0 +1,231 @@
+/*
+ * @file 	i2c_profiler.c
+ * @brief 	I2C bus utilisation and latency profiler
+ * @details The I2C master driver reports every transaction here: device, register,
+ * 			direction, length, start and end time, result, the call site tag and the UI
+ * 			state it ran in. The last I2C_PROFILE_LOG transactions are kept in a ring and
+ * 			everything is aggregated per device, per tag and per UI state.
+ *
+ * 			i2cProfileDump() prints the counters over ITM (SWO), so no pins are needed.
+ *
+ * @note 	Only built with -DI2C_PROFILE=1
+ *
+ * @author: Aeron Lahoylahoy
+ * @date: June 27, 2024
+ */
+#include "stm32f4xx.h"
+#include "i2c_master.h"
+#include "i2c_profiler.h"
+
+#if I2C_PROFILE
+
+#include "stdio.h"
+
+/* Profiler Variables */
+I2CProfileRecord i2cProfileLog[I2C_PROFILE_LOG];
+int i2cProfileHead = 0;
+uint8_t i2cProfileDeviceAddr[I2C_PROFILE_DEVICES];
+I2CProfileStats i2cProfileDevice[I2C_PROFILE_DEVICES];
+I2CProfileStats i2cProfileTagStats[I2C_TAG_COUNT];
+uint32_t i2cProfileBusy[I2C_PROFILE_CONTEXTS][I2C_TAG_COUNT];
+uint32_t i2cProfileSince = 0;
+uint8_t i2cProfileTag = I2C_TAG_NONE;
+uint8_t i2cProfileContext = 0;
+int i2cProfileDumpFlag = 0; /* set from the debugger to dump from the main loop */
+
+static const char *i2cTagNames[I2C_TAG_COUNT] = {
+	"none", "warning", "link", "poll", "eeprom", "ee-poll", "saved", "time", "temp", "clock", "turn",
+};
+
+/*
+ * @brief Function that clears all counters and starts a new measurement window
+ * @param None
+ * @return None
+ */
+void i2cProfileReset(void)
+{
+	uint8_t *p;
+
+	p = (uint8_t *)i2cProfileDevice;
+	for (unsigned int i = 0; i < sizeof(i2cProfileDevice); i++)
+		p[i] = 0;
+	p = (uint8_t *)i2cProfileTagStats;
+	for (unsigned int i = 0; i < sizeof(i2cProfileTagStats); i++)
+		p[i] = 0;
+	p = (uint8_t *)i2cProfileBusy;
+	for (unsigned int i = 0; i < sizeof(i2cProfileBusy); i++)
+		p[i] = 0;
+
+	for (int i = 0; i < I2C_PROFILE_DEVICES; i++)
+		i2cProfileDeviceAddr[i] = 0;
+
+	i2cProfileHead = 0;
+	i2cProfileSince = getMicros();
+}
+
+/*
+ * @brief Function that adds one transaction to a set of counters
+ * @param stats: counters to update
+ * @param n: bytes transferred
+ * @param wire: bytes on the wire, including addresses and register
+ * @param us: duration in microseconds
+ * @param result: I2C_RESULT_x
+ * @return None
+ */
+static void i2cProfileAccumulate(I2CProfileStats *stats, int n, int wire, uint32_t us, int result)
+{
+	uint32_t v = us >> 6;
+	int bin = v ? 32 - __CLZ(v) : 0;
+
+	if (bin >= I2C_HIST_BINS)
+		bin = I2C_HIST_BINS - 1;
+
+	stats->count++;
+	stats->bytes += n;
+	stats->busyUs += us;
+	stats->wireUs += wire * I2C_BYTE_US;
+	if (us > stats->maxUs)
+		stats->maxUs = us;
+	if (result != I2C_RESULT_OK)
+		stats->nacks++;
+	if (stats->hist[bin] != 0xFFFF)
+		stats->hist[bin]++;
+}
+
+/*
+ * @brief Function that records one transaction. Called by the I2C master driver.
+ * @param saddr: 7-bit slave address
+ * @param maddr: register (memory) address
+ * @param dir: I2C_DIR_x
+ * @param n: bytes transferred
+ * @param start: start time (us)
+ * @param end: end time (us)
+ * @param result: I2C_RESULT_x
+ * @return None
+ */
+void i2cProfileRecord(char saddr, int maddr, int dir, int n, uint32_t start, uint32_t end, int result)
+{
+	I2CProfileRecord *rec = &i2cProfileLog[i2cProfileHead];
+	uint32_t us = end - start;
+	int wire;
+	int dev;
+
+	rec->saddr = saddr;
+	rec->maddr = maddr;
+	rec->dir = dir;
+	rec->n = n;
+	rec->tag = i2cProfileTag;
+	rec->context = i2cProfileContext;
+	rec->result = result;
+	rec->start = start;
+	rec->end = end;
+	i2cProfileHead = (i2cProfileHead + 1) % I2C_PROFILE_LOG;
+
+	/* Address and register, plus the repeated address of a read */
+	if (dir == I2C_DIR_PROBE)
+		wire = 1;
+	else if (dir == I2C_DIR_READ)
+		wire = 3 + n;
+	else
+		wire = 2 + n;
+	if (maddr & I2C_MADDR16_FLAG)
+		wire++;
+
+	/* Find or add the device, the last slot collects the rest */
+	for (dev = 0; dev < I2C_PROFILE_DEVICES - 1; dev++)
+	{
+		if (i2cProfileDeviceAddr[dev] == (uint8_t)saddr || i2cProfileDeviceAddr[dev] == 0)
+			break;
+	}
+	i2cProfileDeviceAddr[dev] = saddr;
+
+	i2cProfileAccumulate(&i2cProfileDevice[dev], n, wire, us, result);
+	i2cProfileAccumulate(&i2cProfileTagStats[i2cProfileTag], n, wire, us, result);
+
+	if (i2cProfileContext < I2C_PROFILE_CONTEXTS)
+		i2cProfileBusy[i2cProfileContext][i2cProfileTag] += us;
+}
+
+/*
+ * @brief Function that sends a string over ITM stimulus port 0
+ * @param s: string to send
+ * @return None
+ */
+static void i2cProfilePuts(const char *s)
+{
+	while (*s)
+		ITM_SendChar(*s++);
+}
+
+/*
+ * @brief Function that prints one set of counters
+ * @param name: row label
+ * @param stats: counters to print
+ * @return None
+ */
+static void i2cProfilePrintStats(const char *name, I2CProfileStats *stats)
+{
+	char line[112];
+
+	if (stats->count == 0)
+		return;
+
+	sprintf(line, "%-8s n=%lu B=%lu busy=%luus wire=%luus max=%luus nack=%lu |",
+			name, stats->count, stats->bytes, stats->busyUs, stats->wireUs, stats->maxUs, stats->nacks);
+	i2cProfilePuts(line);
+	for (int i = 0; i < I2C_HIST_BINS; i++)
+	{
+		sprintf(line, " %u", stats->hist[i]);
+		i2cProfilePuts(line);
+	}
+	i2cProfilePuts("\n");
+}
+
+/*
+ * @brief Function that prints bus utilisation, per device, per tag and per UI state counters
+ * @param None
+ * @return None
+ */
+void i2cProfileDump(void)
+{
+	char line[96];
+	char name[8];
+	uint32_t window = getMicros() - i2cProfileSince;
+	uint32_t busy = 0;
+
+	for (int i = 0; i < I2C_TAG_COUNT; i++)
+		busy += i2cProfileTagStats[i].busyUs;
+
+	sprintf(line, "I2C busy %luus of %luus (%lu.%lu%%)\n", busy, window,
+			window ? (uint32_t)((uint64_t)busy * 100 / window) : 0,
+			window ? (uint32_t)((uint64_t)busy * 1000 / window % 10) : 0);
+	i2cProfilePuts(line);
+	i2cProfilePuts("hist bins: <64 <128 <256 <512 <1k <2k <4k >=4k us\n");
+
+	for (int i = 0; i < I2C_PROFILE_DEVICES; i++)
+	{
+		sprintf(name, "0x%02X", i2cProfileDeviceAddr[i]);
+		i2cProfilePrintStats(name, &i2cProfileDevice[i]);
+	}
+
+	for (int i = 0; i < I2C_TAG_COUNT; i++)
+		i2cProfilePrintStats(i2cTagNames[i], &i2cProfileTagStats[i]);
+
+	/* Busy time per UI state and tag */
+	for (int c = 0; c < I2C_PROFILE_CONTEXTS; c++)
+	{
+		sprintf(line, "state %d:", c);
+		i2cProfilePuts(line);
+		for (int i = 0; i < I2C_TAG_COUNT; i++)
+		{
+			if (i2cProfileBusy[c][i])
+			{
+				sprintf(line, " %s=%luus", i2cTagNames[i], i2cProfileBusy[c][i]);
+				i2cProfilePuts(line);
+			}
+		}
+		i2cProfilePuts("\n");
+	}
+}
+
+#endif /* I2C_PROFILE */
@@ -0,0 +1,343 @@
+/*
+ * @file 	i2c_scheduler.c
+ * @brief 	Priority and deadline ordered I2C transaction queue
+ * @details Writes are queued with a priority class instead of going straight to the
+ * 			blocking I2C master. i2cService() runs them earliest deadline first, where the
+ * 			deadline is the submit time plus the budget of the class, so a sonar warning
+ * 			overtakes any EEPROM traffic that is waiting.
+ *
+ * 			Devices with a write cycle (the EEPROM) are registered and marked busy after
+ * 			every write. While busy they are ACK polled with a single address probe per
+ * 			I2C_BUSY_POLL_US and their jobs are skipped, so the bus stays free for the
+ * 			slave instead of spinning on the EEPROM for the 5 ms write cycle.
+ *
+ * 			A write to a register that already has a pending write replaces its data
+ * 			(the EEPROM state byte is saved on every pass of the main loop).
+ *
+ * 			Submitting a write releases the bus task. While writes are left waiting (busy
+ * 			device, background limit) a one-shot soft timer releases it again after
+ * 			I2C_BUSY_POLL_US, or at the earliest deadline if that comes first. With an
+ * 			empty queue nothing wakes the CPU for the bus.
+ *
+ * @note 	Latency from submit to completion is kept per class in i2cStats
+ *
+ * @author: Aeron Lahoylahoy
+ * @date: June 27, 2024
+ */
+#include "stm32f4xx.h"
+#include "i2c_master.h"
+#include "i2c_scheduler.h"
+#include "timebase.h"
+#include "soft_timer.h"
+#include "scheduler.h"
+
+/* Scheduler Variables */
+I2CJob i2cQueue[I2C_QUEUE_SIZE];
+I2CDevice i2cDevices[I2C_DEVICE_MAX];
+int i2cDeviceCount = 0;
+I2CStats i2cStats[I2C_PRIO_COUNT];
+
+static const uint32_t i2cDeadline[I2C_PRIO_COUNT] = {
+	I2C_DEADLINE_URGENT,
+	I2C_DEADLINE_NORMAL,
+	I2C_DEADLINE_BACKGROUND,
+};
+
+static SoftTimer i2cWakeTimer; /* re-releases the bus task while writes wait */
+
+/*
+ * @brief Function that clears the queue, the device table and the statistics
+ * @param None
+ * @return None
+ */
+void i2cSchedulerInit(void)
+{
+	for (int i = 0; i < I2C_QUEUE_SIZE; i++)
+		i2cQueue[i].used = 0;
+
+	for (int i = 0; i < I2C_PRIO_COUNT; i++)
+	{
+		i2cStats[i].count = 0;
+		i2cStats[i].latencyMax = 0;
+		i2cStats[i].latencyLast = 0;
+		i2cStats[i].missed = 0;
+		i2cStats[i].coalesced = 0;
+		i2cStats[i].dropped = 0;
+		i2cStats[i].failed = 0;
+	}
+
+	i2cDeviceCount = 0;
+}
+
+/*
+ * @brief Function that registers a device that is busy for a write cycle after each write
+ * @param saddr: 7-bit slave address
+ * @return None
+ */
+void i2cRegisterDevice(char saddr)
+{
+	if (i2cDeviceCount >= I2C_DEVICE_MAX)
+		return;
+
+	i2cDevices[i2cDeviceCount].saddr = saddr;
+	i2cDevices[i2cDeviceCount].busy = 0;
+	i2cDeviceCount++;
+}
+
+/*
+ * @brief Function that finds a registered device
+ * @param saddr: 7-bit slave address
+ * @return Device entry, or 0 if the device has no write cycle
+ */
+static I2CDevice *i2cFindDevice(char saddr)
+{
+	for (int i = 0; i < i2cDeviceCount; i++)
+	{
+		if (i2cDevices[i].saddr == saddr)
+			return &i2cDevices[i];
+	}
+
+	return 0;
+}
+
+/*
+ * @brief Function that queues a register write
+ * @details Safe to call from interrupts (storeMiles runs in TIM7)
+ * @param saddr: 7-bit slave address
+ * @param maddr: first register (memory) address inside the slave
+ * @param n: number of bytes, at most I2C_JOB_MAX
+ * @param data: bytes to write, copied into the queue
+ * @param prio: I2C_PRIO_URGENT, I2C_PRIO_NORMAL or I2C_PRIO_BACKGROUND
+ * @param tag: I2C_TAG_x of the call site, for the profiler
+ * @return 0 if queued, -1 if the queue is full or the write is too long
+ */
+int i2cSubmitWrite(char saddr, int maddr, int n, char *data, int prio, int tag)
+{
+	uint32_t now = getMicros();
+	uint32_t deadline = now + i2cDeadline[prio];
+	uint32_t primask;
+	I2CJob *job = 0;
+
+	if (n > I2C_JOB_MAX)
+		return -1;
+
+	primask = __get_PRIMASK();
+	__disable_irq();
+
+	/* Replace a pending write to the same registers */
+	for (int i = 0; i < I2C_QUEUE_SIZE; i++)
+	{
+		if (i2cQueue[i].used && i2cQueue[i].saddr == saddr && i2cQueue[i].maddr == maddr && i2cQueue[i].n == n)
+		{
+			job = &i2cQueue[i];
+			for (int j = 0; j < n; j++)
+				job->data[j] = data[j];
+
+			/* Keep the earlier deadline and the higher class, the data is the latest caller's */
+			if ((int32_t)(deadline - job->deadline) < 0)
+				job->deadline = deadline;
+			if (prio < job->prio)
+				job->prio = prio;
+			job->tag = tag;
+
+			i2cStats[prio].coalesced++;
+			__set_PRIMASK(primask);
+			schedulerSignal(SCHED_TASK_BUS);
+			return 0;
+		}
+	}
+
+	for (int i = 0; i < I2C_QUEUE_SIZE; i++)
+	{
+		if (!i2cQueue[i].used)
+		{
+			job = &i2cQueue[i];
+			break;
+		}
+	}
+
+	if (job == 0)
+	{
+		i2cStats[prio].dropped++;
+		__set_PRIMASK(primask);
+		return -1;
+	}
+
+	job->saddr = saddr;
+	job->maddr = maddr;
+	job->n = n;
+	for (int j = 0; j < n; j++)
+		job->data[j] = data[j];
+	job->prio = prio;
+	job->tag = tag;
+	job->submitted = now;
+	job->deadline = deadline;
+	job->used = 1;
+
+	__set_PRIMASK(primask);
+	schedulerSignal(SCHED_TASK_BUS);
+	return 0;
+}
+
+/*
+ * @brief Soft timer callback that releases the bus task
+ * @param None
+ * @return None
+ */
+static void i2cWake(void)
+{
+	schedulerSignal(SCHED_TASK_BUS);
+}
+
+/*
+ * @brief Function that arms the wake timer while writes are left in the queue
+ * @param None
+ * @return None
+ */
+static void i2cRearm(void)
+{
+	uint32_t now = getMicros();
+	uint32_t delay = I2C_BUSY_POLL_US;
+	int32_t left;
+	int waiting = 0;
+
+	for (int i = 0; i < I2C_QUEUE_SIZE; i++)
+	{
+		if (!i2cQueue[i].used)
+			continue;
+
+		waiting = 1;
+		left = (int32_t)(i2cQueue[i].deadline - now);
+		if (left > 0 && (uint32_t)left < delay)
+			delay = left;
+	}
+
+	if (waiting)
+		softTimerStart(&i2cWakeTimer, delay, 0, i2cWake);
+	else
+		softTimerStop(&i2cWakeTimer);
+}
+
+/*
+ * @brief Function that ACK polls busy devices, at most once per I2C_BUSY_POLL_US each
+ * @param None
+ * @return None
+ */
+static void i2cPollDevices(void)
+{
+	uint32_t now = getMicros();
+
+	for (int i = 0; i < i2cDeviceCount; i++)
+	{
+		I2CDevice *dev = &i2cDevices[i];
+
+		if (!dev->busy || (now - dev->lastProbe) < I2C_BUSY_POLL_US)
+			continue;
+
+		dev->lastProbe = now;
+		I2C_PROFILE_TAG(I2C_TAG_EEPROM_POLL);
+		if (I2C1_probe(dev->saddr) || (now - dev->busySince) > I2C_BUSY_TIMEOUT_US)
+			dev->busy = 0;
+	}
+}
+
+/*
+ * @brief Function that picks the runnable job with the earliest deadline
+ * @param background: 1 if background jobs may still run in this service pass
+ * @return Queue index, or -1 if nothing can run
+ */
+static int i2cNextJob(int background)
+{
+	int next = -1;
+
+	for (int i = 0; i < I2C_QUEUE_SIZE; i++)
+	{
+		I2CJob *job = &i2cQueue[i];
+		I2CDevice *dev;
+
+		if (!job->used)
+			continue;
+		if (job->prio == I2C_PRIO_BACKGROUND && !background)
+			continue;
+
+		dev = i2cFindDevice(job->saddr);
+		if (dev && dev->busy)
+			continue;
+
+		if (next < 0)
+			next = i;
+		else
+		{
+			int32_t diff = (int32_t)(job->deadline - i2cQueue[next].deadline);
+			if (diff < 0 || (diff == 0 && job->prio < i2cQueue[next].prio))
+				next = i;
+		}
+	}
+
+	return next;
+}
+
+/*
+ * @brief Function that runs queued writes in deadline order until nothing can run.
+ * 		  At most I2C_BACKGROUND_PER_SERVICE background writes run per call.
+ * 		  Main loop only (bus task): it arms a soft timer for what is left.
+ * @param None
+ * @return None
+ */
+void i2cService(void)
+{
+	int background = 0;
+	I2CJob job;
+	I2CDevice *dev;
+	uint32_t primask;
+	uint32_t done;
+	uint32_t latency;
+	int result;
+	int next;
+
+	while (1)
+	{
+		i2cPollDevices();
+
+		primask = __get_PRIMASK();
+		__disable_irq();
+		next = i2cNextJob(background < I2C_BACKGROUND_PER_SERVICE);
+		if (next >= 0)
+		{
+			job = i2cQueue[next];
+			i2cQueue[next].used = 0;
+		}
+		__set_PRIMASK(primask);
+
+		if (next < 0)
+			break;
+
+		I2C_PROFILE_TAG(job.tag);
+		result = I2C1_burstWrite(job.saddr, job.maddr, job.n, job.data);
+		done = getMicros();
+
+		/* Write cycle starts at the stop condition; a failed write never started one */
+		dev = i2cFindDevice(job.saddr);
+		if (dev && result == I2C_OK)
+		{
+			dev->busy = 1;
+			dev->busySince = done;
+			dev->lastProbe = done;
+		}
+
+		latency = done - job.submitted;
+		i2cStats[job.prio].count++;
+		i2cStats[job.prio].latencyLast = latency;
+		if (latency > i2cStats[job.prio].latencyMax)
+			i2cStats[job.prio].latencyMax = latency;
+		if ((int32_t)(done - job.deadline) > 0)
+			i2cStats[job.prio].missed++;
+		if (result != I2C_OK)
+			i2cStats[job.prio].failed++;
+
+		if (job.prio == I2C_PRIO_BACKGROUND)
+			background++;
+	}
+
+	i2cRearm();
+}
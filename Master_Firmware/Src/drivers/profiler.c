@@ -0,0 +1,148 @@
+/*
+ * @file 	profiler.c
+ * @brief 	Cycle counting profiler for tasks, interrupts and draw calls
+ * @details Each zone keeps count, min, max, total and a log2 histogram of its run time
+ * 			in core cycles, in a fixed table. A zone costs two counter reads and one
+ * 			profileRecord() call. Zones are inclusive: a zone interrupted by an ISR also
+ * 			counts the ISR's time.
+ *
+ * 			profileDump() prints the table over ITM (SWO), one line per zone that ran.
+ *
+ * @note 	Only built with -DPROFILE=1
+ *
+ * @author: Aeron Lahoylahoy
+ * @date: June 27, 2024
+ */
+#include "profiler.h"
+
+#if PROFILE
+
+#include "stdio.h"
+
+/* Profiler Variables */
+ProfileZone profileZones[PROF_ZONE_COUNT];
+uint32_t profileSince = 0;
+int profileDumpFlag = 0; /* set from the debugger to dump from the main loop */
+
+static const char *profileZoneNames[PROF_ZONE_COUNT] = {
+	"bus", "speed", "controls", "sonar", "ui", "rtc", "timers",
+	"isr-tim7", "isr-exti", "isr-btn", "isr-hall", "isr-slot", "isr-echo", "isr-photo", "isr-tb",
+	"clear", "menu", "blink", "screen", "time", "date", "bt",
+};
+
+/*
+ * @brief Function that starts the cycle counter and clears the table
+ * @param None
+ * @return None
+ */
+void profileInit(void)
+{
+	PROFILE_COUNTER_INIT();
+	profileReset();
+}
+
+/*
+ * @brief Function that clears all zones and starts a new measurement window
+ * @param None
+ * @return None
+ */
+void profileReset(void)
+{
+	uint8_t *p = (uint8_t *)profileZones;
+
+	for (unsigned int i = 0; i < sizeof(profileZones); i++)
+		p[i] = 0;
+	for (int i = 0; i < PROF_ZONE_COUNT; i++)
+		profileZones[i].min = 0xFFFFFFFF;
+
+	profileSince = PROFILE_CYCLES();
+}
+
+/*
+ * @brief Function that adds one run to a zone
+ * @param zone: PROF_ZONE_x
+ * @param cycles: run time in core cycles
+ * @return None
+ */
+void profileRecord(int zone, uint32_t cycles)
+{
+	ProfileZone *z = &profileZones[zone];
+	uint32_t v = cycles >> PROFILE_HIST_SHIFT;
+	int bin = v ? 32 - __builtin_clz(v) : 0;
+
+	if (bin >= PROFILE_HIST_BINS)
+		bin = PROFILE_HIST_BINS - 1;
+
+	z->count++;
+	z->total += cycles;
+	if (cycles < z->min)
+		z->min = cycles;
+	if (cycles > z->max)
+		z->max = cycles;
+	if (z->hist[bin] != 0xFFFF)
+		z->hist[bin]++;
+}
+
+/*
+ * @brief Function that closes a PROFILE_ZONE() when it goes out of scope
+ * @param scope: the scope's start record
+ * @return None
+ */
+void profileScopeEnd(ProfileScope *scope)
+{
+	profileRecord(scope->zone, PROFILE_CYCLES() - scope->start);
+}
+
+/*
+ * @brief Function that sends a string to the profiler output
+ * @param s: string to send
+ * @return None
+ */
+static void profilePuts(const char *s)
+{
+	while (*s)
+		PROFILE_PUTC(*s++);
+}
+
+/*
+ * @brief Function that prints every zone that ran since the last reset
+ * @details One line per zone: count, min, mean and max cycles, total share of the
+ * 			window, then the histogram bins. The window is 32-bit cycles, so reset no more
+ * 			than ~23 s (at 180 MHz) before dumping.
+ * @param None
+ * @return None
+ */
+void profileDump(void)
+{
+	char line[112];
+	uint32_t window = PROFILE_CYCLES() - profileSince;
+	ProfileZone *z;
+
+	sprintf(line, "profile window %lu cycles (%lu us)\n", (unsigned long)window,
+			(unsigned long)((uint64_t)window * 1000000 / PROFILE_CLOCK_HZ));
+	profilePuts(line);
+	sprintf(line, "hist bins: <%d cycles, then x2 each, last open\n", 1 << PROFILE_HIST_SHIFT);
+	profilePuts(line);
+
+	for (int i = 0; i < PROF_ZONE_COUNT; i++)
+	{
+		z = &profileZones[i];
+		if (z->count == 0)
+			continue;
+
+		sprintf(line, "%-9s n=%lu min=%lu mean=%lu max=%lu share=%lu.%lu%% |",
+				profileZoneNames[i], (unsigned long)z->count, (unsigned long)z->min,
+				(unsigned long)(z->total / z->count), (unsigned long)z->max,
+				window ? (unsigned long)(z->total * 100 / window) : 0,
+				window ? (unsigned long)(z->total * 1000 / window % 10) : 0);
+		profilePuts(line);
+		for (int b = 0; b < PROFILE_HIST_BINS; b++)
+		{
+			sprintf(line, " %u", z->hist[b]);
+			profilePuts(line);
+		}
+		profilePuts("\n");
+	}
+}
+
+#endif /* PROFILE */
@@ -14,6 +14,7 @@
 #include "stm32f4xx.h"
 #include "RTC.h"
 #include "i2c_master.h"
+#include "i2c_profiler.h"
 #include "port_pin_define.h"
 
 /* RTC Address */
@@ -71,14 +72,17 @@ int rtcTempArray[2];
  */
 void readTemp(void)
 {
+	I2C_PROFILE_TAG(I2C_TAG_READ_TEMP);
+
 	/* Upper byte shows integer temp values */
 	I2C1_byteRead(rtcAddress, upperTempM, &upperTempR);
 
 	/* Lower byte shows the fractional temp values */
 	I2C1_byteRead(rtcAddress, lowerTempM, &lowerTempR);
 
-	rtcTempArray[0] = (((upperTempR & 0x70) >> 4) * 10) + (upperTempR & 0x0F);
-	rtcTempArray[1] = (((lowerTempR & 0xC0) >> 4) * 10);
+	/* Two's complement whole degrees, then quarter degrees in bits 7:6 (not BCD) */
+	rtcTempArray[0] = (signed char)upperTempR;
+	rtcTempArray[1] = ((lowerTempR & 0xC0) >> 6) * 25;
 }
 
 /*
@@ -128,6 +132,7 @@ void getDay(void)
  */
 void getTime(void)
 {
+	I2C_PROFILE_TAG(I2C_TAG_GET_TIME);
 	I2C1_byteRead(rtcAddress, secM, &secR);
 	I2C1_byteRead(rtcAddress, minM, &minR);
 	I2C1_byteRead(rtcAddress, hourM, &hourR);
@@ -154,7 +159,7 @@ void binaryDecimal(void)
 	day = (((dayR & 0xF0) >> 4) * 10) + (dayR & 0x0F);
 	date = (((dateR & 0x30) >> 4) * 10) + (dateR & 0x0F);
 	month = (((monthR & 0x10) >> 4) * 10) + (monthR & 0x0F);
-	year = (((yearR & 0x70) >> 4) * 10) + (yearR & 0x0F);
+	year = (((yearR & 0xF0) >> 4) * 10) + (yearR & 0x0F);
 
 	secArray[0] = (secR & 0x70) >> 4;
 	secArray[1] = (secR & 0x0F);
@@ -171,7 +176,7 @@ void binaryDecimal(void)
 	monthArray[0] = (monthR & 0x10) >> 4;
 	monthArray[1] = (monthR & 0x0F);
 
-	yearArray[0] = (yearR & 0x70) >> 4;
+	yearArray[0] = (yearR & 0xF0) >> 4;
 	yearArray[1] = (yearR & 0x0F);
 
 	/* Gets the hour for AM or PM */
@@ -0,0 +1,163 @@
+/*
+ * @file 	soft_timer.c
+ * @brief 	Software timers on a timing wheel
+ * @details Each running timer hangs in the wheel slot of its expiry tick. softTimerService()
+ * 			walks only the slots of the ticks passed since the last call and fires the
+ * 			timers that are due; timers for a later turn of the wheel stay in place. Expiry
+ * 			times are 64-bit, so a timer never fires early on a counter wrap.
+ *
+ * @note 	Timers and callbacks belong to the main loop: the scheduler services the wheel
+ * 			every pass and sleeps until softTimerNextDue(). Interrupts must not use them.
+ *
+ * @author: Aeron Lahoylahoy
+ * @date: June 27, 2024
+ */
+#include "stm32f4xx.h"
+#include "soft_timer.h"
+#include "timebase.h"
+
+static SoftTimer *softTimerWheel[SOFT_TIMER_SLOTS];
+static SoftTimer *softTimerDue = 0; /* slot being fired, off the wheel */
+static uint64_t softTimerTick = 0; /* last tick serviced */
+
+/*
+ * @brief Function that hangs a timer in the slot of its expiry tick
+ * @details A tick that was already serviced goes to the next one, so it isn't missed.
+ * @param t: timer with its expiry set
+ * @return None
+ */
+static void softTimerInsert(SoftTimer *t)
+{
+	uint64_t tick = t->expiry / SOFT_TIMER_TICK_US;
+
+	if (tick <= softTimerTick)
+		tick = softTimerTick + 1;
+
+	t->slot = tick & (SOFT_TIMER_SLOTS - 1);
+	t->next = softTimerWheel[t->slot];
+	softTimerWheel[t->slot] = t;
+	t->active = 1;
+}
+
+/*
+ * @brief Function that starts or restarts a timer
+ * @param t: timer
+ * @param delayUs: time to the first callback
+ * @param periodUs: time between callbacks after that, 0 = one-shot
+ * @param callback: run from softTimerService()
+ * @return None
+ */
+void softTimerStart(SoftTimer *t, uint32_t delayUs, uint32_t periodUs, SoftTimerCallback callback)
+{
+	softTimerStop(t);
+
+	t->expiry = deadlineAfter(delayUs);
+	t->period = periodUs;
+	t->callback = callback;
+	softTimerInsert(t);
+}
+
+/*
+ * @brief Function that unlinks a timer from a list
+ * @param link: head of the list
+ * @param t: timer
+ * @return 1 if the timer was in the list
+ */
+static int softTimerUnlink(SoftTimer **link, SoftTimer *t)
+{
+	for (; *link; link = &(*link)->next)
+	{
+		if (*link == t)
+		{
+			*link = t->next;
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/*
+ * @brief Function that stops a timer; nothing happens if it isn't running
+ * @details A callback may stop a timer of the slot being fired, which is off the wheel.
+ * @param t: timer
+ * @return None
+ */
+void softTimerStop(SoftTimer *t)
+{
+	if (!t->active)
+		return;
+
+	if (!softTimerUnlink(&softTimerWheel[t->slot], t))
+		softTimerUnlink(&softTimerDue, t);
+	t->active = 0;
+}
+
+/*
+ * @brief Function that fires every due timer. Runs once per scheduler pass.
+ * @param None
+ * @return None
+ */
+void softTimerService(void)
+{
+	uint64_t now = getMicros64();
+	uint64_t nowTick = now / SOFT_TIMER_TICK_US;
+	SoftTimer *t;
+
+	/* After a long gap every slot is visited once */
+	if (nowTick - softTimerTick > SOFT_TIMER_SLOTS)
+		softTimerTick = nowTick - SOFT_TIMER_SLOTS;
+
+	while (softTimerTick < nowTick)
+	{
+		softTimerTick++;
+
+		/* Take the slot off the wheel: callbacks may start and stop timers */
+		softTimerDue = softTimerWheel[softTimerTick & (SOFT_TIMER_SLOTS - 1)];
+		softTimerWheel[softTimerTick & (SOFT_TIMER_SLOTS - 1)] = 0;
+
+		while ((t = softTimerDue) != 0)
+		{
+			softTimerDue = t->next;
+			t->active = 0;
+
+			if (t->expiry > now)
+			{
+				softTimerInsert(t); /* a later turn */
+				continue;
+			}
+
+			if (t->period)
+			{
+				/* Keep the rate, but don't fire a backlog */
+				t->expiry += t->period;
+				if (t->expiry <= now)
+					t->expiry = now + t->period;
+				softTimerInsert(t);
+			}
+			t->callback();
+		}
+	}
+}
+
+/*
+ * @brief Function that returns when softTimerService() will next have work
+ * @param None
+ * @return getMicros64() value, SOFT_TIMER_NONE if no timer runs
+ */
+uint64_t softTimerNextDue(void)
+{
+	uint64_t due = SOFT_TIMER_NONE;
+	uint64_t at;
+
+	for (int i = 0; i < SOFT_TIMER_SLOTS; i++)
+	{
+		for (SoftTimer *t = softTimerWheel[i]; t; t = t->next)
+		{
+			/* Fired on the first tick boundary after the expiry */
+			at = (t->expiry / SOFT_TIMER_TICK_US + 1) * SOFT_TIMER_TICK_US;
+			if (at < due)
+				due = at;
+		}
+	}
+	return due;
+}
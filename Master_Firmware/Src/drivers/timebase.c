@@ -0,0 +1,167 @@
+/*
+ * @file 	timebase.c
+ * @brief 	Free-running microsecond timebase
+ * @details TIM5 (32-bit) counts microseconds and wraps every ~71 minutes.
+ * 			Short intervals are taken with unsigned subtraction so the wrap is harmless.
+ * 			The update interrupt counts the wraps, which extends the count to 64 bits
+ * 			for deadlines that must never wrap.
+ * 			CC1 is the idle wake-up: it is armed for the next deadline only, so
+ * 			there's no periodic tick while the CPU sleeps.
+ *
+ * @author: Aeron Lahoylahoy
+ * @date: June 27, 2024
+ */
+#include "stm32f4xx.h"
+#include "timebase.h"
+#include "clock.h"
+#include "profiler.h"
+
+static volatile uint32_t timebaseWraps = 0; /* upper 32 bits of the microsecond count */
+
+/*
+ * @brief Function that starts TIM5 as a free-running 1 MHz counter
+ * @param None
+ * @return None
+ */
+void timebaseInit(void)
+{
+	RCC->APB1ENR |= (0b1 << 3); /*TIM5 Clock*/
+	TIM5->CR1 = 0;
+	TIM5->PSC = CLOCK_APB1_PSC_1MHZ; /*Scale down to 1MHz*/
+	TIM5->ARR = 0xFFFFFFFF;		/*Full 32-bit range*/
+	TIM5->CNT = 0;
+	TIM5->EGR = 1;				/*Load prescaler*/
+	TIM5->SR = 0;
+	TIM5->DIER = (0b1 << 0);	/*Update interrupt counts the wraps*/
+	TIM5->CR1 |= (1 << 0);		/*Enable Timer*/
+	NVIC_EnableIRQ(TIM5_IRQn);
+}
+
+/*
+ * @brief Function that returns the current time
+ * @param None
+ * @return Microseconds since timebaseInit()
+ */
+uint32_t getMicros(void)
+{
+	return TIM5->CNT;
+}
+
+/*
+ * @brief Function that returns the current time without wrapping
+ * @details Safe with interrupts masked: a wrap whose interrupt hasn't run yet is
+ * 			recognised from the pending update flag.
+ * @param None
+ * @return Microseconds since timebaseInit()
+ */
+uint64_t getMicros64(void)
+{
+	uint32_t primask = __get_PRIMASK();
+	uint32_t high;
+	uint32_t low;
+
+	__disable_irq();
+	high = timebaseWraps;
+	low = TIM5->CNT;
+	if ((TIM5->SR & 0b1) && (low < 0x80000000))
+		high++;		/*Wrapped, interrupt still pending*/
+	__set_PRIMASK(primask);
+
+	return ((uint64_t)high << 32) | low;
+}
+
+/*
+ * @brief Function that returns a deadline some time from now
+ * @param us: microseconds from now
+ * @return getMicros64() value of the deadline
+ */
+uint64_t deadlineAfter(uint32_t us)
+{
+	return getMicros64() + us;
+}
+
+/*
+ * @brief Function that checks a deadline
+ * @param deadline: getMicros64() value
+ * @return 1 once the deadline has passed
+ */
+int deadlinePassed(uint64_t deadline)
+{
+	return getMicros64() >= deadline;
+}
+
+/*
+ * @brief Function that returns the time left to a deadline
+ * @param deadline: getMicros64() value
+ * @return Microseconds left, 0 if passed, clipped to 32 bits
+ */
+uint32_t deadlineRemaining(uint64_t deadline)
+{
+	uint64_t now = getMicros64();
+
+	if (now >= deadline)
+		return 0;
+	if (deadline - now > 0xFFFFFFFF)
+		return 0xFFFFFFFF;
+	return deadline - now;
+}
+
+/*
+ * @brief Function that sleeps (WFI) until a deadline
+ * @details Interrupts keep running while waiting; use it only where there's nothing else to do.
+ * @param deadline: getMicros64() value
+ * @return None
+ */
+void timebaseSleepUntil(uint64_t deadline)
+{
+	uint32_t primask = __get_PRIMASK();
+	uint32_t left;
+
+	while ((left = deadlineRemaining(deadline)) > 0)
+	{
+		if (left > 0x7FFFFFFF)
+			left = 0x7FFFFFFF;
+
+		__disable_irq();
+		timebaseWakeAt(getMicros() + left);
+		__DSB();
+		__WFI();
+		__set_PRIMASK(primask);
+	}
+}
+
+/*
+ * @brief Function that arms a one-shot interrupt at an absolute time
+ * @param us: getMicros() value to wake at
+ * @return None
+ */
+void timebaseWakeAt(uint32_t us)
+{
+	TIM5->CCR1 = us;
+	TIM5->SR = ~(0b1 << 1);		/*Clear CC1IF*/
+	TIM5->DIER |= (0b1 << 1);	/*CC1 interrupt*/
+}
+
+/*
+ * @brief Interrupt handler for TIM5: counter wrap and idle wake-up
+ * @param None
+ * @return None
+ */
+void TIM5_IRQHandler(void)
+{
+	PROFILE_ZONE(PROF_ZONE_ISR_TIMEBASE);
+
+	uint32_t sr = TIM5->SR;
+
+	if (sr & 0b1)
+	{
+		TIM5->SR = ~0b1;
+		timebaseWraps++;
+	}
+
+	if ((sr & (0b1 << 1)) && (TIM5->DIER & (0b1 << 1)))
+	{
+		TIM5->DIER &= ~(0b1 << 1);
+		TIM5->SR = ~(0b1 << 1);
+	}
+}
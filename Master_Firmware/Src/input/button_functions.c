@@ -2,11 +2,14 @@
  * @file 	button_functions.c
  * @brief 	GPIO button initialization and software debouncing utilities
  * @details Provides common functions for configuring GPIO pins as inputs with external interrupts (EXTI)
- * 			and simple polling-based debouncing
+ * 			and a parallel debouncer for all buttons.
  *
- * @note 	Interrupt configuration uses both falling and rising edges where needed, but
- * 		 	falling edge is default for most buttons
- * 		 	Debounce uses a simple polling counter (30 samples, threshold > 20 low)
+ * @note 	TIM6 samples every registered port once per millisecond. Each port is debounced as a
+ * 			whole with a 2-bit vertical counter per pin (one bit of the counter in cnt0, the other
+ * 			in cnt1), so a pin changes state after 4 equal samples that differ from it, and the
+ * 			cost is a few logic operations per port regardless of the number of buttons.
+ * 			Every change is queued as a timestamped press/release event for the main loop.
+ * 			Buttons are active low (pull up).
  *
  * @author 	Aeron Lahoylahoy
  * @date   	June 27, 2024
@@ -14,88 +17,143 @@
 
 
 #include "button_functions.h"
+#include "clock.h"
+#include "profiler.h"
+
+/* Debouncer Variables */
+volatile uint32_t buttonTicks = 0;
+uint16_t buttonMask[BUTTON_PORTS];
+uint16_t buttonState[BUTTON_PORTS];	/* debounced IDR */
+uint16_t buttonCnt0[BUTTON_PORTS];
+uint16_t buttonCnt1[BUTTON_PORTS];
+
+ButtonEvent buttonQueue[BUTTON_EVENTS];
+volatile int buttonHead = 0;
+volatile int buttonTail = 0;
+uint32_t buttonEventsLost = 0;
+
+static GPIO_TypeDef *const buttonPorts[BUTTON_PORTS] = {GPIOA, GPIOB, GPIOC};
 
 /*
-* @brief Function that initializes a GPIO pin as input with EXTI interrupt.
+* @brief Function that routes a pulled-up input to its EXTI interrupt.
+* @details The pin itself is configured by boardInit().
 * @param Port: GPIO port (e.g., PORTA, PORTB, etc.)
 * @param Pin: GPIO pin number (0-15)
+* @param edges: EXTI_FALLING, EXTI_RISING or EXTI_BOTH
+* @param callback: line handler, run in interrupt context
 */
-void buttonInit(GPIO_TypeDef *Port, int Pin)
+void buttonInit(GPIO_TypeDef *Port, int Pin, int edges, ExtiCallback callback)
 {
-	/*Variables*/
-	int array = 0;
-	int line = 0;
-	int shift = 0;
-
-	if(Port == PORTA){
-		RCC->AHB1ENR |= Aclk;		/*Set GPIOx Clock*/
-		line = 0x0;
-	}
-	else if(Port == PORTB){
-		RCC->AHB1ENR |= Bclk;		/*Set GPIOx Clock*/
-		line = 0x1;
-	}
-	else if(Port == PORTC){
-		RCC->AHB1ENR |= Cclk;		/*Set GPIOx Clock*/
-		line = 0x2;
+	extiRegister(Port, Pin, edges, callback);
+}
+
+/*
+* @brief Function that hands a pulled-up input to the debouncer.
+* @details The pin itself is configured by boardInit().
+* @param Port: GPIO port (PORTA to PORTC)
+* @param Pin: GPIO pin number (0-15)
+*/
+void buttonInputInit(GPIO_TypeDef *Port, int Pin)
+{
+	int index = BUTTON_PORT_INDEX(Port);
+
+	/*Start from the current level, no event at power up*/
+	buttonState[index] = (buttonState[index] & ~(0b1 << Pin)) | (Port->IDR & (0b1 << Pin));
+	buttonMask[index] |= (0b1 << Pin);
+}
+
+/*
+ * @brief Function that starts the 1 ms debounce sampler on TIM6
+ * @param None
+ * @return None
+ */
+void debounceInit(void)
+{
+	RCC->APB1ENR |= (0b1 << 4); /*TIM6 Clock*/
+	TIM6->PSC = CLOCK_APB1_PSC_1MHZ; /*Scale down to 1MHz*/
+	TIM6->ARR = 1000 - 1;		/*1 ms*/
+	TIM6->CNT = 0;
+	TIM6->EGR = 1;
+	TIM6->SR = 0;
+	TIM6->DIER |= 1;			/*Update interrupt*/
+	NVIC_EnableIRQ(TIM6_DAC_IRQn);
+	TIM6->CR1 |= 1;				/*Enable Timer*/
+}
+
+/*
+ * @brief Interrupt handler for TIM6: samples and debounces all registered ports
+ * @param None
+ * @return None
+ */
+RAMFUNC void TIM6_DAC_IRQHandler(void)
+{
+	PROFILE_ZONE(PROF_ZONE_ISR_BUTTONS);
+
+	TIM6->SR = 0;
+	buttonTicks++;
+
+	for (int p = 0; p < BUTTON_PORTS; p++)
+	{
+		uint16_t delta;
+		uint16_t toggle;
+
+		if (!buttonMask[p])
+			continue;
+
+		/* Vertical counter: counts 4 samples that differ from the debounced state */
+		delta = (buttonPorts[p]->IDR ^ buttonState[p]) & buttonMask[p];
+		buttonCnt1[p] = (buttonCnt1[p] ^ buttonCnt0[p]) & delta;
+		buttonCnt0[p] = ~buttonCnt0[p] & delta;
+		toggle = delta & ~(buttonCnt0[p] | buttonCnt1[p]);
+		buttonState[p] ^= toggle;
+
+		/* One event per pin that changed */
+		while (toggle)
+		{
+			int pin = 31 - __CLZ(toggle);
+			int next = (buttonHead + 1) & (BUTTON_EVENTS - 1);
+
+			toggle &= ~(0b1 << pin);
+			if (next == buttonTail)
+			{
+				buttonEventsLost++;
+				continue;
+			}
+
+			buttonQueue[buttonHead].port = p;
+			buttonQueue[buttonHead].pin = pin;
+			buttonQueue[buttonHead].pressed = !(buttonState[p] & (0b1 << pin));
+			buttonQueue[buttonHead].time = buttonTicks;
+			__DMB(); /*Event written before it is published*/
+			buttonHead = next;
+		}
 	}
-  RCC->APB2ENR |= 0x4000;		/*Set Interrupt Clock*/
-
-	/*GPIO Initilization*/
-	Port->MODER &= ~(0b11 << (Pin * 2));  /*Clear*/
-	Port->MODER |= (0b00 << (Pin * 2));		/*Input*/
-	Port->PUPDR |= (0b01 << (Pin * 2));		/*Pull up*/
-
-
-	/*Define array based on Pin*/
-	if(Pin < 4) array = 0;
-	else if((Pin < 8) && (Pin > 3)) array = 1;
-	else if((Pin < 12) && (Pin > 7)) array = 2;
-	else if((Pin < 16) && (Pin > 11)) array = 3;
-
-	/*Interrupts Initialization*/
-	if ((Pin == 0) | (Pin == 4) | (Pin == 8) | (Pin == 12)) shift  = 0;
-	else if ((Pin == 1) | (Pin == 5) | (Pin == 9) | (Pin == 13)) shift  = 1;
-	else if ((Pin == 2) | (Pin == 6) | (Pin == 10) | (Pin == 14)) shift  = 2;
-	else if ((Pin == 3) | (Pin == 7) | (Pin == 11) | (Pin == 15))  shift  = 3;
-
-	SYSCFG->EXTICR[array] &= ~(0xF << (shift * 4));
-	SYSCFG->EXTICR[array] |= (line << (shift * 4));
-	EXTI->IMR |= (0b1 << Pin);
-	EXTI->FTSR |= (0b1 << Pin);
-	//EXTI->RTSR |= (0b1 << Pin);	/* Include for turn signal switch */
-
-	/*Enable Interrupts*/
-	if(Pin == 0) NVIC_EnableIRQ(EXTI0_IRQn);
-	else if(Pin == 1) NVIC_EnableIRQ(EXTI1_IRQn);
-	else if(Pin == 2) NVIC_EnableIRQ(EXTI2_IRQn);
-	else if(Pin == 3) NVIC_EnableIRQ(EXTI3_IRQn);
-	else if(Pin == 4) NVIC_EnableIRQ(EXTI4_IRQn);
-	else if((Pin < 10) && (Pin > 4)) NVIC_EnableIRQ(EXTI9_5_IRQn);
-	else if((Pin < 16) && (Pin > 9)) NVIC_EnableIRQ(EXTI15_10_IRQn);
 }
 
 /*
- * @brief Function that debounces a button by checking the IDR of the inputted Port and Pin parameters.
+ * @brief Function that takes the oldest button event
+ * @param event: location the event is copied to
+ * @return 1 if an event was taken, 0 if the queue is empty
+ */
+int buttonGetEvent(ButtonEvent *event)
+{
+	if (buttonTail == buttonHead)
+		return 0;
+
+	*event = buttonQueue[buttonTail];
+	__DMB();
+	buttonTail = (buttonTail + 1) & (BUTTON_EVENTS - 1);
+
+	return 1;
+}
+
+/*
+ * @brief Function that returns the debounced level of a button registered with buttonInputInit().
  * @param Port: GPIO port (e.g., PORTA, PORTB, etc.)
  * @param Pin: GPIO pin number (0-15)
  * @return 1 if button is pressed, 0 otherwise
  */
 int debounceButton(GPIO_TypeDef *Port, int Pin)
 {
-	int count = 0;
-
-	/* Checks Port and Pin parameter IDR 30 times */
-	for (int i = 0; i < 30; i++)
-	{
-		/* Checks if Port and Pin paramter is low  */
-		if (!(Port->IDR & (0b1 << Pin)))
-			count++;
-		// delayMsCounter(1);
-	}
-
-	/* Valid reading only if 20 good IDR values */
-	if (count > 20)
-		return 1;
-	return 0;
+	return !(buttonState[BUTTON_PORT_INDEX(Port)] & (0b1 << Pin));
 }
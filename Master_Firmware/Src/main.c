@@ -32,12 +32,21 @@
 
 /* Peripherals and Drivers */
 #include "i2c_master.h"
+#include "i2c_scheduler.h"
+#include "i2c_profiler.h"
+#include "timebase.h"
+#include "soft_timer.h"
+#include "clock.h"
+#include "board.h"
 #include "button_functions.h"
 #include "rtc.h"
 #include "sonar.h"
 #include "rotary_encoder.h"
 #include "eeprom.h"
 #include "speed_sensor.h"
+#include "watchdog.h"
+#include "scheduler.h"
+#include "profiler.h"
 
 int main(void)
 
@@ -46,33 +55,36 @@ int main(void)
 	/* System Init */
 	__disable_irq();
 
+	clockInit(); // 180 MHz PLL, flash wait states and caches
+	boardInit(); // Every pin from the board map, shared TIM3 base
+#if PROFILE
+	profileInit(); // DWT cycle counter
+#endif
 	masterConfig(); // I2C Master Config
+	timebaseInit(); // Microsecond Timebase
+	i2cSchedulerInit(); // I2C Transaction Queue
+	i2cRegisterDevice(mileEEPROM); // EEPROM write cycle polling
 	turnSignalSWInit(); // Turn Signal Switch Init
-	SysTick_Init(); // SysTick Init
-	Display_Init(); // LCD Display Init
+	Display_Init(); // LCD power-up, its waits run from a soft timer
 	sonarInit(); // Sonar Init
 	rotaryEncoderInit(); // Rotary Encoder Init
 	resetButtonInit(); // Reset Button Init
+	debounceInit(); // 1 ms Button Sampler
 
 	/* Mile */
 	rpmReaderInit();
-	hallSensorInit();
 
 	/* Timer 7 */
 	TIM7_Init();
 
 	/* Bluetooth */
 	bluetoothButtonInit();
-	bluetoothEnableInit();
 
 	/* Display */
 	menuButtonInit();
 
-	/* Sonar */
-	sonarInit();
-
-	/* Watch Dog Reset */
-	watchDogInit();
+	/* Watch Dog Button */
+	watchDogButtonInit();
 
 	/* Photosensor */
 	photosensorInit();
@@ -80,272 +92,73 @@ int main(void)
 
 	/* Set interrupt priority */
 	NVIC_SetPriority(TIM7_IRQn, 1);
-    NVIC_SetPriority(EXTI9_5_IRQn, 2);
-    NVIC_SetPriority(EXTI15_10_IRQn, 3);
+    NVIC_SetPriority(TIM4_IRQn, 2);
+    NVIC_SetPriority(TIM3_IRQn, 2);
+    NVIC_SetPriority(TIM2_IRQn, 2); // sonar slots, same level as the echo captures
+    NVIC_SetPriority(TIM8_BRK_TIM12_IRQn, 2);
+    NVIC_SetPriority(TIM1_BRK_TIM9_IRQn, 2);
+    NVIC_SetPriority(TIM6_DAC_IRQn, 3); // button sampler
+    NVIC_SetPriority(EXTI1_IRQn, 3); // encoder decoder
+    NVIC_SetPriority(EXTI2_IRQn, 3);
+    NVIC_SetPriority(DMA2_Stream0_IRQn, 3); // photosensor
+    NVIC_SetPriority(TIM5_IRQn, 3); // timebase wrap, idle wake-up
 
 	__enable_irq();
 
+	/* The LCD power-up waits overlap the init above; sleep out what's left */
+	while (!Display_Ready())
+	{
+		softTimerService();
+		timebaseSleepUntil(softTimerNextDue());
+	}
+
 	Rotate_Display(2);
 	displayLogo();
 
 	/* Read Previous Data */
 	readSavedData();
 
-	/* Watch Dog Reset */
+	/* Watch Dog Supervisor */
+	watchDogRegister(WDG_TASK_LOOP, WDG_BUDGET_LOOP);
+	watchDogRegister(WDG_TASK_SONAR, WDG_BUDGET_SONAR);
+	watchDogRegister(WDG_TASK_I2C, WDG_BUDGET_I2C);
+	watchDogRegister(WDG_TASK_UI_TICK, WDG_BUDGET_UI_TICK);
 	watchDogInit();
 
+	/* Task Rates */
+	schedulerInit();
+
 	/* Main Loop */
 	while (1)
 	{
-		switch (state)
-		{
-		case MENUSTATE:
-
-			/* read Sonar */
-			checkWarningSignal();
-
-			/* read mph */
-			readMiles();
-
-			/* watch dog check */
-			watchDogCheck();
-
-			/* Photo Sensor */
-			read_photosensor();
-
-			/* Bluetooth */
-			displayBluetooth(ICON);
-
-			if (menuFlag)
-			{
-				// Fill_Screen(BLACK);
-				Fill_Rect(0, 0, 240, 225, BLACK);
-				displayMenu();
-				menuFlag = 0;
-			}
-
-			if (blinkMenuFlag)
-			{
-				blinkMenu();
-
-				/* Move to the chosen menu */
-				if (blinkMenuFlag == 2)
-				{
-					displayFlag = 1;
-					if (count == 0)
-						state = TIMESTATE;
-					if (count == 1)
-						state = DATESTATE;
-					if (count == 2)
-						state = TEMPSTATE;
-					blinkMenuFlag = 0;
-				}
-				else
-					state = MENUSTATE;
-			}
-
-			/* Save state into EEPROM */
-			I2C1_byteWrite(mileEEPROM, 1, state);
-			sendMessages();
-
-			break;
-
-		case TIMESTATE:
-
-			/* Read sonar */
-			checkWarningSignal();
-
-			/* Read Mph */
-			readMiles();
-
-			/* Watch dog check */
-			watchDogCheck();
-
-			/* Photo Sensor */
-			read_photosensor();
-
-			/* Bluetooth */
-			displayBluetooth(ICON);
-
-			/* Read Sonar */
-			checkWarningSignal();
-
-			/* read mph */
-			readMiles();
-
-			if (displayFlag)
-			{
-				Fill_Rect(0, 0, 240, 225, BLACK);
-				getTime();
-				printToLCD(TIME);
-				displayFlag = 0;
-			}
-
-			/* Change time */
-			if (changeTimeFlag)
-			{
-				changeTime();
-			}
-			else
-			{
+		/* Attribute I2C time to the UI state */
+		I2C_PROFILE_CONTEXT(state);
 
-				/* Update time */
-				if (trigger)
-				{
-					timeCount++;
-					if (timeCount == 4)
-					{
-						getTime();
-						printToLCD(TIME);
-						timeCount = 0;
-					}
-					trigger = 0;
-				}
-			}
+		/* Refresh the IWDG only if every task checked in on time */
+		watchDogCheckIn(WDG_TASK_LOOP);
+		watchDogCheck();
 
-			/* Reset for Menu state */
-			if (menuScreen)
-			{
-				state = MENUSTATE;
-				blinkMenuFlag = 0;
-				chooseMenu = 0;
-				menuScreen = 0;
-				count = 0;
-				menuFlag = 1;
-			}
-			else
-				state = TIMESTATE;
-
-			/* Save State into EEPROM */
-			I2C1_byteWrite(mileEEPROM, 1, state);
-			sendMessages();
-
-			break;
-
-		case DATESTATE:
-
-			/* Check Sonar */
-			checkWarningSignal();
-
-			/* Read mph */
-			readMiles();
-
-			/* Watch dog cehck */
-			watchDogCheck();
-
-			/* Photo Sensor */
-			read_photosensor();
-
-			/* Bluetooth */
-			displayBluetooth(ICON);
-
-			if (displayFlag)
-			{
-				Fill_Rect(0, 0, 240, 225, BLACK);
-				getTime();
-				printToLCD(DATE);
-				displayFlag = 0;
-			}
-
-			/* Change time */
-			if (changeDateFlag)
-			{
-				changeDate();
-			}
-			else
-			{
-
-				/* Update Date */
-				if (trigger)
-				{
-					timeCount++;
-					if (timeCount == 4)
-					{
-						getTime();
-						printToLCD(DATE);
-						timeCount = 0;
-					}
-					trigger = 0;
-				}
-			}
-
-			/* Reset for Menu state */
-			if (menuScreen)
-			{
-				state = MENUSTATE;
-				blinkMenuFlag = 0;
-				chooseMenu = 0;
-				count = 0;
-				menuFlag = 1;
-				menuScreen = 0;
-			}
-			else
-				state = DATESTATE;
-
-			/* Save State into EEPROM */
-			I2C1_byteWrite(mileEEPROM, 1, state);
-			sendMessages();
-
-			break;
-
-		case TEMPSTATE:
-
-			/* Read Sonar */
-			checkWarningSignal();
-
-			/* Read mph */
-			readMiles();
-
-			/* Watch dog check */
-			watchDogCheck();
-
-			/* Photo Sensor */
-			read_photosensor();
-
-			/* Bluetooth */
-			displayBluetooth(ICON);
-
-			if (displayFlag)
-			{
-				Fill_Rect(0, 0, 240, 225, BLACK);
-				getTime();
-				printToLCD(TEMP);
-				displayFlag = 0;
-			}
+#if I2C_PROFILE
+		if (i2cProfileDumpFlag)
+		{
+			i2cProfileDump();
+			i2cProfileDumpFlag = 0;
+		}
+#endif
 
-			/* Update time */
-			if (trigger)
-			{
-				timeCount++;
-				if (timeCount == 4)
-				{
-					readTemp();
-					printToLCD(TEMP);
-					timeCount = 0;
-				}
-				trigger = 0;
-			}
+#if PROFILE
+		if (profileDumpFlag)
+		{
+			profileDumpFlag = 0;
+			profileDump();
+			profileReset();
+		}
+#endif
 
-			/* Reset for Menu state */
-			if (menuScreen)
-			{
-				CW = 0;
-				CCW = 0;
-				state = MENUSTATE;
-				blinkMenuFlag = 0;
-				chooseMenu = 0;
-				count = 0;
-				menuFlag = 1;
-				menuScreen = 0;
-			}
-			else
-				state = TEMPSTATE;
+		/* Sensors, controls and rendering at their own rates */
+		schedulerRun();
 
-			/* Save State into EEPROM */
-			I2C1_byteWrite(mileEEPROM, 1, state);	
-			sendMessages();
-			
-			break;
-		}
+		/* Sleep until the next release or interrupt */
+		schedulerIdle();
 	}
 }
\ No newline at end of file
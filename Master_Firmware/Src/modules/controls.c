@@ -1,7 +1,7 @@
 /*
  * @file 	controls.c
  * @brief 	Control module for button and switch initialization and interrupt handling
- * @details This module provides functions to initialize buttons and switches with EXTI interrupts for:
+ * @details This module provides functions to initialize buttons and switches as debounced inputs for:
  * 			- Menu navigation button
  * 			- Turn signal switch (left/right)
  * 			- Reset button
@@ -17,362 +17,249 @@
 #include "Display.h"
 #include "eeprom.h"
 #include "speed_sensor.h"
+#include "link.h"
+#include "rotary_encoder.h"
+#include "clock.h"
+#include "board.h"
+#include "profiler.h"
+#include "flags.h"
 
 /* Variables */
-int bluetoothFlag = 0;
 int bluetoothCounter = 0;
-int bluetoothCountFlag = 0;
 int bluetoothEnable = 0;
 int bluetoothDisplay = 0;
 
 int turnSignal = NO_TURN;
-int turnFlag = 0;
-
-/* Watch Dog */
-int watchDogFlag = 0;
-int flag = 0;
 
 /* Photosensor */
-int adcVal;
-float voltage;
-const int max_adc_value = 4095; /*ADC 12-bit resolution*/
+int adcVal; /* filtered reading, 0 to 4095 */
+uint16_t photoSamples[PHOTO_SAMPLES];
+int32_t photoFilterQ8 = 0;
+int photoLevel = PHOTO_LEVELS - 1;
+int ledDuty = 10000;
 
-/* Menu Display */
-int menuButtonFlag = 0;
+/* Backlight duty (of 10000) for each light level, darkest first; perceptual curve */
+const uint16_t ledBrightness[PHOTO_LEVELS] = {600, 1000, 1600, 2500, 3700, 5300, 7400, 10000};
 
 /*
- * @brief Function that initializes the menu button with EXTI interrupt.
+ * @brief Function that initializes the menu button as a debounced input.
  * @param None
  * @return None
  */
 void menuButtonInit(void)
 {
-	buttonInit(MENU_BUTTON_PORT, MENU_BUTTON_PIN);
+	buttonInputInit(MENU_BUTTON_PORT, MENU_BUTTON_PIN);
 }
 
 /*
- * @brief Function that initializes the turn signal switches with EXTI interrupts.
+ * @brief Function that initializes the turn signal switches as debounced inputs.
  * @param None
  * @return None
  */
 void turnSignalSWInit(void)
 {
-	turnSignalButtonInit(TURN_SIGNAL_PORT, TURN_RIGHT_PIN);
-	turnSignalButtonInit(TURN_SIGNAL_PORT, TURN_LEFT_PIN);
+	buttonInputInit(TURN_SIGNAL_PORT, TURN_RIGHT_PIN);
+	buttonInputInit(TURN_SIGNAL_PORT, TURN_LEFT_PIN);
 }
 
 /*
- * @brief Function that initializes a turn signal switch GPIO pin as input with EXTI interrupt.
- * @param Port: GPIO port (e.g., PORTA, PORTB, etc.)
- * @param Pin: GPIO pin number (0-15)
- * @return None
- */
-void turnSignalButtonInit(GPIO_TypeDef *Port, int Pin)
-{
-	/*Variables*/
-	int array = 0;
-	int line = 0;
-	int shift = 0;
-
-	if (Port == PORTA)
-	{
-		RCC->AHB1ENR |= Aclk; /*Set GPIOx Clock*/
-		line = 0x0;
-	}
-	else if (Port == PORTB)
-	{
-		RCC->AHB1ENR |= Bclk; /*Set GPIOx Clock*/
-		line = 0x1;
-	}
-	else if (Port == PORTC)
-	{
-		RCC->AHB1ENR |= Cclk; /*Set GPIOx Clock*/
-		line = 0x2;
-	}
-	RCC->APB2ENR |= 0x4000; /*Set Interrupt Clock*/
-
-	/*GPIO Initilization*/
-	Port->MODER &= ~(0b11 << (Pin * 2)); /*Clear*/
-	Port->MODER |= (0b00 << (Pin * 2));	 /*Input*/
-	Port->PUPDR |= (0b01 << (Pin * 2));	 /*Pull up*/
-
-	/*Define array based on Pin*/
-	if (Pin < 4)
-		array = 0;
-	else if ((Pin < 8) && (Pin > 3))
-		array = 1;
-	else if ((Pin < 12) && (Pin > 7))
-		array = 2;
-	else if ((Pin < 16) && (Pin > 11))
-		array = 3;
-
-	/*Interrupts Initialization*/
-	if ((Pin == 0) | (Pin == 4) | (Pin == 8) | (Pin == 12))
-		shift = 0;
-	else if ((Pin == 1) | (Pin == 5) | (Pin == 9) | (Pin == 13))
-		shift = 1;
-	else if ((Pin == 2) | (Pin == 6) | (Pin == 10) | (Pin == 14))
-		shift = 2;
-	else if ((Pin == 3) | (Pin == 7) | (Pin == 11) | (Pin == 15))
-		shift = 3;
-
-	SYSCFG->EXTICR[array] &= ~(0xF << (shift * 4));
-	SYSCFG->EXTICR[array] |= (line << (shift * 4));
-	EXTI->IMR |= (0b1 << Pin);
-	EXTI->FTSR |= (0b1 << Pin);
-	EXTI->RTSR |= (0b1 << Pin); /* Include for turn signal switch */
-
-	/*Enable Interrupts*/
-	if (Pin == 0)
-		NVIC_EnableIRQ(EXTI0_IRQn);
-	else if (Pin == 1)
-		NVIC_EnableIRQ(EXTI1_IRQn);
-	else if (Pin == 2)
-		NVIC_EnableIRQ(EXTI2_IRQn);
-	else if (Pin == 3)
-		NVIC_EnableIRQ(EXTI3_IRQn);
-	else if (Pin == 4)
-		NVIC_EnableIRQ(EXTI4_IRQn);
-	else if ((Pin < 10) && (Pin > 4))
-		NVIC_EnableIRQ(EXTI9_5_IRQn);
-	else if ((Pin < 16) && (Pin > 9))
-		NVIC_EnableIRQ(EXTI15_10_IRQn);
-}
-
-/*
- * @brief Function that initializes the reset button with EXTI interrupt.
+ * @brief Function that initializes the reset button as a debounced input.
  * @param None
  * @return None
  */
 void resetButtonInit(void)
 {
-	buttonInit(RESET_BUTTON_PORT, RESET_BUTTON_PIN);
-}
-
-/*
- * @brief Function that initializes the Bluetooth enable button with EXTI interrupt.
- * @param None
- * @return None
- */
-void bluetoothEnableInit(void)
-{
-
-	RCC->AHB1ENR |= BLUETOOTH_ENABLE_CLK;
-	BLUETOOTH_ENABLE_PORT->MODER &= ~(0b11 << (BLUETOOTH_ENABLE_PIN * 2)); // clear
-	BLUETOOTH_ENABLE_PORT->MODER |= (0b01 << (BLUETOOTH_ENABLE_PIN * 2));  // output
-
-	BLUETOOTH_ENABLE_PORT->ODR |= (0b1 << BLUETOOTH_ENABLE_PIN); // PIN High (Bluetooth OFF)
+	buttonInputInit(RESET_BUTTON_PORT, RESET_BUTTON_PIN);
 }
 
 /*
- * @brief Function that initializes the Bluetooth button with EXTI interrupt.
+ * @brief Function that initializes the Bluetooth button as a debounced input.
  * @param None
  * @return None
  */
 void bluetoothButtonInit(void)
 {
-	buttonInit(BLUETOOTH_BUTTON_PORT, BLUETOOTH_BUTTON_PIN);
+	buttonInputInit(BLUETOOTH_BUTTON_PORT, BLUETOOTH_BUTTON_PIN);
 }
 
 /*
- * @brief Function that reads the photosensor value using ADC, calculates voltage, and adjusts LED brightness.
+ * @brief Function that initializes the photosensor pin, ADC1, DMA2 and the TIM8 sample clock.
+ * @details TIM8 triggers a conversion every millisecond and DMA2 Stream 0 stores it in a
+ * 			circular buffer. Each half buffer raises one interrupt, so the main loop never waits on the ADC.
  * @param None
  * @return None
  */
-void read_photosensor(void)
+void photosensorInit(void)
 {
+	/* PA1 is left in analog mode by boardInit() */
 
-	ADC1->CR2 |= 0x40000000; /*Starts Conversion*/
-	while (!(ADC1->SR & 2))
+	/*DMA2 Stream 0 Channel 0: ADC1 to photoSamples*/
+	RCC->AHB1ENR |= (0b1 << 22); /*Enable DMA2*/
+	DMA2_Stream0->CR = 0;
+	while (DMA2_Stream0->CR & 1)
 		;
-	adcVal = ADC1->DR;
-
-	/* watch dog check */
-	watchDogCheck();
-
-	/*Calculate Voltage*/
-	voltage = (adcVal * 3.3) / max_adc_value;
-	ledControl();
-}
-
-/*
- * @brief Function that initializes the photosensor GPIO pin and ADC.
- * @param None
- * @return None
- */
-void photosensorInit(void)
-{
-	RCC->AHB1ENR |= PHOTOSENSOR_CLK;
-	PHOTOSENSOR_PORT->MODER &= ~(0b11 << (PHOTOSENSOR_PIN * 2)); /*Clear*/
-	PHOTOSENSOR_PORT->MODER |= (0b11 << (PHOTOSENSOR_PIN * 2));	 /*Analog Mode*/
+	DMA2->LIFCR = 0x3D;							 /*Clear Stream 0 flags*/
+	DMA2_Stream0->PAR = (uint32_t)&ADC1->DR;
+	DMA2_Stream0->M0AR = (uint32_t)photoSamples;
+	DMA2_Stream0->NDTR = PHOTO_SAMPLES;
+	DMA2_Stream0->CR = (0b01 << 13) | (0b01 << 11) /*16-bit memory and peripheral*/
+					   | (1 << 10) | (1 << 8)		/*Memory increment, Circular*/
+					   | (1 << 4) | (1 << 3);		/*Transfer complete and half transfer interrupts*/
+	DMA2_Stream0->CR |= 1;						 /*Enable Stream*/
+	NVIC_EnableIRQ(DMA2_Stream0_IRQn);
 
 	/*ADC1*/
-	RCC->APB2ENR |= 0x100; /*Enable ADC1*/
-	ADC1->CR1 |= 0x1;	   /*0b0001 AIN1 - 12-bit resolution*/
-	ADC1->CR2 |= 0x0;	   /*Single Conversion Mode, Right Alignment*/
-	ADC1->SQR3 |= 0x1;	   /*Conversion Sequence at CH1*/
-	ADC1->CR2 |= 1;		   /*Enable ADC*/
+	RCC->APB2ENR |= 0x100;		   /*Enable ADC1*/
+	ADC->CCR = (ADC->CCR & ~ADC_CCR_ADCPRE) | (CLOCK_ADC_PRE << ADC_CCR_ADCPRE_Pos); /*ADC clock 36 MHz max*/
+	ADC1->CR1 = 0;				   /*12-bit resolution*/
+	ADC1->SMPR2 |= (0b111 << 3);   /*CH1 480 cycles, high impedance divider*/
+	ADC1->SQR1 = 0;				   /*One conversion*/
+	ADC1->SQR3 = 0x1;			   /*Conversion Sequence at CH1*/
+	ADC1->CR2 = (0b01 << 28)	   /*Trigger on rising edge*/
+				| (0b1110 << 24)   /*TIM8 TRGO*/
+				| (1 << 9) | (1 << 8); /*DMA requests continue, DMA mode*/
+	ADC1->CR2 |= 1;				   /*Enable ADC*/
+
+	/*TIM8: 1 kHz conversion trigger*/
+	RCC->APB2ENR |= (0b1 << 1); /*TIM8 Clock*/
+	TIM8->PSC = CLOCK_APB2_PSC_1MHZ; /*Scale down to 1MHz*/
+	TIM8->ARR = PHOTO_SAMPLE_US - 1;
+	TIM8->CR2 = (0b010 << 4);	/*TRGO on update*/
+	TIM8->CR1 |= (1 << 0);		/*Enable Timer*/
 }
 
 /*
- * @brief Function that initializes the LED GPIO pin and Timer for PWM control.
+ * @brief Interrupt handler for DMA2 Stream 0: half of the photosensor buffer is ready
+ * @details Averages the finished half, filters it and updates the backlight.
  * @param None
  * @return None
  */
-void ledInit(void)
+void DMA2_Stream0_IRQHandler(void)
 {
+	PROFILE_ZONE(PROF_ZONE_ISR_PHOTO);
+
+	uint32_t isr = DMA2->LISR;
+	const uint16_t *half;
+	uint32_t sum = 0;
 
-	/* GPIO Port A Pin 5 PWM Output Initilization */
-	RCC->AHB1ENR |= LED_CLK;
-	LED_PORT->MODER &= ~(0b11 << (LED_PIN * 2)); // Clear
-	LED_PORT->MODER |= (0b10 << (LED_PIN * 2));	 // Set AF
+	if (isr & (1 << 4)) /*Half Transfer*/
+		half = &photoSamples[0];
+	else if (isr & (1 << 5)) /*Transfer Complete*/
+		half = &photoSamples[PHOTO_SAMPLES / 2];
+	else
+	{
+		DMA2->LIFCR = 0x3D;
+		return;
+	}
+	DMA2->LIFCR = 0x3D; /*Clear Stream 0 flags*/
 
-	/* Initilize TIM5 CH 1 */
-	// AFR[0] = includes Pins 0-7
-	// AFR[1] = includes PIns 8-15
-	// Each Pin has 4 bits to set which AFR 0-15
-	LED_PORT->AFR[0] &= ~0x00F00000;
-	LED_PORT->AFR[0] |= 0x00200000; /*0b0001 = 1 (AF1) on Pin 5*/
+	for (int i = 0; i < PHOTO_SAMPLES / 2; i++)
+		sum += half[i];
 
-	/* Enable TIM2 Clock */
-	RCC->APB1ENR |= (0b1 << 1); /*TIM3 Clock*/
-	TIM3->PSC = 16 - 1;			/*Scale down to 1MHz*/
-	TIM3->ARR = 10000 - 1;		/*Reload count 10000*/
+	/* Box average, then exponential filter in Q8 */
+	sum /= PHOTO_SAMPLES / 2;
+	if (!photoFilterQ8)
+		photoFilterQ8 = sum << 8;
+	photoFilterQ8 += ((int32_t)(sum << 8) - photoFilterQ8) >> PHOTO_EMA_SHIFT;
+	adcVal = photoFilterQ8 >> 8;
 
-	/* Set PWM */
-	TIM3->CNT = 0;			/*Clear*/
-	TIM3->CCMR1 |= 0x6000;	/*PWM Mode 1 (0b110)*/
-	TIM3->CCER |= (1 << 4); /*Enable PWM output*/
-	TIM3->CCR2 = 10000;		/*Pulse width (CCR1/ARR) = Duty Cycle*/
-	TIM3->CR1 |= (1 << 0);	/*Enable Timer*/
+	ledControl();
 }
 
 /*
- * @brief Function that initializes the Watchdog Timer.
+ * @brief Function that maps the filtered light level to a backlight duty and slews toward it.
+ * @details A level only changes once the reading is PHOTO_HYSTERESIS counts past its band,
+ * 			and the duty moves at most PHOTO_SLEW_STEP per update.
  * @param None
  * @return None
  */
-void watchDogInit(void)
+void ledControl(void)
 {
+	int upper = (photoLevel + 1) * PHOTO_BAND;
+	int lower = photoLevel * PHOTO_BAND;
+	int target;
+
+	/* Hysteresis on the band edges */
+	if (adcVal >= upper + PHOTO_HYSTERESIS && photoLevel < PHOTO_LEVELS - 1)
+		photoLevel = adcVal / PHOTO_BAND;
+	else if (adcVal < lower - PHOTO_HYSTERESIS && photoLevel > 0)
+		photoLevel = adcVal / PHOTO_BAND;
+
+	/* Slew limited move to the curve */
+	target = ledBrightness[photoLevel];
+	if (ledDuty < target - PHOTO_SLEW_STEP)
+		ledDuty += PHOTO_SLEW_STEP;
+	else if (ledDuty > target + PHOTO_SLEW_STEP)
+		ledDuty -= PHOTO_SLEW_STEP;
+	else
+		ledDuty = target;
 
-	IWDG->KR |= 0x5555;	   // config key for watchdog timer
-	IWDG->PR |= 0x01;	   // set 8 divider (1 second)
-	IWDG->RLR |= 1024 - 1; // resets 1 second
-	IWDG->KR |= 0xCCCC;	   // enable watchdog timer
+	TIM3->CCR2 = ledDuty;
 }
 
 /*
- * @brief Function that initializes the Watchdog button GPIO pin.
+ * @brief Function that starts the backlight PWM on TIM3 CH2.
+ * @details PB5 and the shared 1 MHz TIM3 base are set up by boardInit(); only CH2 is touched here.
  * @param None
  * @return None
  */
-void watchDogButtonInit(void)
+void ledInit(void)
 {
-	buttonInit(WATCH_DOG_PORT, WATCH_DOG_PIN);
+	/* Set PWM */
+	TIM3->CCR2 = BOARD_TIM3_PERIOD;	/*Pulse width (CCR2/ARR) = Duty Cycle*/
+	TIM3->CCMR1 = (TIM3->CCMR1 & ~0xFF00) | 0x6000;	/*PWM Mode 1 (0b110)*/
+	TIM3->CCER |= (1 << 4); /*Enable PWM output*/
 }
 
 /*
- * @brief Function that checks the watchdog flag and resets the watchdog timer.
+ * @brief Function that initializes the Watchdog button as a debounced input.
  * @param None
  * @return None
  */
-void watchDogCheck(void)
+void watchDogButtonInit(void)
 {
-	if (watchDogFlag)
-	{
-		I2C1_byteWrite(slave, 0, 0x91);
-		if (!flag)
-		{
-			IWDG->KR |= 0xAAAA; // enable watchdog timer
-			flag = 1;
-		}
-	}
-	else
-	{
-		IWDG->KR |= 0xAAAA; // enable watchdog timer
-	}
+	buttonInputInit(WATCH_DOG_PORT, WATCH_DOG_PIN);
 }
 
 /*
- * @brief Interrupt handler for EXTI lines 15 to 10.
+ * @brief Function that turns debounced button events into the control flags.
  * @param None
  * @return None
  */
-void EXTI15_10_IRQHandler(void)
+void handleButtons(void)
 {
+	ButtonEvent event;
 
-	/* BLUETOOTH */
-	if (EXTI->PR & (0b1 << BLUETOOTH_BUTTON_PIN))
+	while (buttonGetEvent(&event))
 	{
-		bluetoothFlag = 1;
-		bluetoothCountFlag = 1;
-		EXTI->PR |= (0b1 << BLUETOOTH_BUTTON_PIN);
-	}
+		/* Turn signal switch acts on both edges */
+		if (BUTTON_EVENT_IS(event, TURN_SIGNAL_PORT, TURN_RIGHT_PIN) || BUTTON_EVENT_IS(event, TURN_SIGNAL_PORT, TURN_LEFT_PIN))
+			flagSet(FLAG_TURN);
 
-	/* MENU On Display */
-	if (EXTI->PR & (0b1 << MENU_BUTTON_PIN))
-	{
-		menuButtonFlag = 1;
-		EXTI->PR |= (0b1 << MENU_BUTTON_PIN);
-	}
+		if (!event.pressed)
+			continue;
 
-	/* Watch Dog */
-	if (EXTI->PR & (0b1 << WATCH_DOG_PIN))
-	{
-		if (debounceButton(WATCH_DOG_PORT, WATCH_DOG_PIN))
+		/* Reset Button to Reset the odometer accumulated miles */
+		if (BUTTON_EVENT_IS(event, RESET_BUTTON_PORT, RESET_BUTTON_PIN))
+			flagSet(FLAG_RESET_MILES);
+
+		/* BLUETOOTH */
+		if (BUTTON_EVENT_IS(event, BLUETOOTH_BUTTON_PORT, BLUETOOTH_BUTTON_PIN))
 		{
-			watchDogFlag = 1;
+			flagSet(FLAG_BLUETOOTH);
+			flagSet(FLAG_BLUETOOTH_COUNT);
 		}
 
-		EXTI->PR |= (0b1 << WATCH_DOG_PIN);
-	}
-}
-
-/*
- * @brief Interrupt handler for EXTI lines 9 to 5.
- * @param None
- * @return None
- */
-void EXTI9_5_IRQHandler(void)
-{
+		/* MENU On Display */
+		if (BUTTON_EVENT_IS(event, MENU_BUTTON_PORT, MENU_BUTTON_PIN))
+			flagSet(FLAG_MENU_BUTTON);
 
-	/* Only want to trigger a blink on falling edge */
-	if (EXTI->PR & (0b1 << TURN_RIGHT_PIN))
-	{
-		turnFlag = 1;
-		EXTI->PR |= (0b1 << TURN_RIGHT_PIN);
-	}
-
-	if (EXTI->PR & (0b1 << TURN_LEFT_PIN))
-	{
-		turnFlag = 1;
-		EXTI->PR |= (0b1 << TURN_LEFT_PIN);
-	}
+		/* Watch Dog */
+		if (BUTTON_EVENT_IS(event, WATCH_DOG_PORT, WATCH_DOG_PIN))
+			flagSet(FLAG_WATCHDOG);
 
-	/* Reset Button to Reset the odometer accumulated miles */
-	if (EXTI->PR & (0b1 << RESET_BUTTON_PIN))
-	{
-		resetMilesFlag = 1;
-		EXTI->PR |= (0b1 << RESET_BUTTON_PIN);
-	}
-
-	/* Hall Effect Sensor */
-	if (EXTI->PR & (0b1 << 8))
-	{
-
-		if (debounceButton(PORTA, PIN8))
-		{
-			hallEffectFlag++;
-			if (hallEffectFlag > 2)
-				hallEffectFlag = 2;
-		}
-		EXTI->PR |= (0b1 << 8);
-	}
-
-	/* Miles */
-	if (EXTI->PR & (0b1 << 8))
-	{
-		speedSensorHallDetected();
-		EXTI->PR |= (0b1 << 8);
+		/* Rotary encoder push button */
+		if (BUTTON_EVENT_IS(event, ENCODER_PORT, ENCODER_SW_PIN))
+			encoderSwitchPressed();
 	}
 }
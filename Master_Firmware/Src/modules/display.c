@@ -25,6 +25,13 @@
 #include "controls.h"
 #include "eeprom.h"
 #include "i2c_master.h"
+#include "i2c_profiler.h"
+#include "link.h"
+#include "watchdog.h"
+#include "clock.h"
+#include "flags.h"
+#include "profiler.h"
+#include "scheduler.h"
 
 /* Time, Date, Temp Variables */
 int arrayTimePos[50];
@@ -49,12 +56,11 @@ int chooseDate = 0;
 int chooseTemp = 0;
 int resetFlag = 0;
 int displayFlag = 0;
-int timeCount = 0;
 
 int menuScreen = 0;
 
-int trigger = 0;
 int mileCounter = 0;
+int linkPollCounter = 0;
 
 int state = MENUSTATE;
 
@@ -65,6 +71,8 @@ int state = MENUSTATE;
  */
 void displayBluetooth(int n)
 {
+	PROFILE_ZONE(PROF_ZONE_DRAW_BLUETOOTH);
+
 	char msg[50] = "Bluetooth";
 	int offsetX = 0;
 
@@ -95,6 +103,8 @@ void displayBluetooth(int n)
  */
 void displayMenu(void)
 {
+	PROFILE_ZONE(PROF_ZONE_DRAW_MENU);
+
 	char menu[50];
 	int posInitial = (240 / 2) - 30;
 	int posX = posInitial;
@@ -148,6 +158,8 @@ void displayMenu(void)
  */
 void blinkDisplay(int n)
 {
+	PROFILE_ZONE(PROF_ZONE_DRAW_BLINK);
+
 	char menu[50];
 
 	switch (n)
@@ -203,6 +215,8 @@ void blinkDisplay(int n)
  */
 void printToLCD(int menu)
 {
+	PROFILE_ZONE(PROF_ZONE_DRAW_SCREEN);
+
 	char msg[50];
 	char timeMsg[50] = "TIME";
 	char dateMsg[50] = "DATE";
@@ -287,6 +301,8 @@ void printToLCD(int menu)
  */
 void blinkMenu(void)
 {
+	PROFILE_ZONE(PROF_ZONE_DRAW_BLINK);
+
 	count = abs(CCW - CW);
 	if (count > 3)
 		count = 0;
@@ -343,8 +359,8 @@ void TIM7_Init(void)
 	TIM7->DIER |= 1U;
 
 	TIM7->CNT = 0;
-	TIM7->PSC = 16000 - 1;
-	TIM7->ARR = 250 - 1;
+	TIM7->PSC = CLOCK_APB1_PSC_10KHZ;	/*10 kHz*/
+	TIM7->ARR = 2500 - 1;				/*250 ms*/
 
 	TIM7->CR1 |= 0b1;
 
@@ -353,16 +369,17 @@ void TIM7_Init(void)
 
 void TIM7_IRQHandler(void)
 {
+	PROFILE_ZONE(PROF_ZONE_ISR_UI_TICK);
+
+	watchDogCheckIn(WDG_TASK_UI_TICK);
+
 	/* DISPLAY */
 	blink++;
 	if (blink > 2)
 		blink = 0;
 
-	/* Update time */
-	trigger = 1;
-
 	/* bluetooth */
-	if (bluetoothFlag)
+	if (flagTest(FLAG_BLUETOOTH))
 	{
 		displayBluetooth(0);
 
@@ -371,29 +388,26 @@ void TIM7_IRQHandler(void)
 		{
 			displayBluetooth(1);
 			bluetoothCounter = 0;
-			bluetoothFlag = 0;
+			flagClear(FLAG_BLUETOOTH);
 		}
 	}
 
-	mileCounter++;
-	/* Motor */
-	if (mileCounter == 2)
+	/* Slave status poll */
+	linkPollCounter++;
+	if (linkPollCounter >= LINK_POLL_TICKS)
 	{
-		sendMiles();
+		flagSet(FLAG_LINK_POLL);
+		linkPollCounter = 0;
 	}
 
+	/* Bus task every tick, also when idle: it checks in WDG_TASK_I2C */
+	schedulerSignal(SCHED_TASK_BUS);
+
+	/* Speed, odometer and mile storage run in the main loop once a second */
+	mileCounter++;
 	if (mileCounter == 4)
 	{
-		/* write to EEPROM */
-		updateCumulativeMiles();
-		if (cumulativeMiles > 1)
-		{
-			storeMiles();
-
-			I2C1_byteWrite(slave, 0, 0x11);
-			// I2C1_byteWrite(slave, 0, 0x11);
-			cumulativeMiles = 0;
-		}
+		flagSet(FLAG_MILE);
 		mileCounter = 0;
 	}
 
@@ -507,6 +521,8 @@ void changeDate(void)
  */
 void printDateToLCD(int date)
 {
+	PROFILE_ZONE(PROF_ZONE_DRAW_DATE);
+
 	char msg[50];
 	int offsetX = 0;
 
@@ -556,6 +572,7 @@ void sendChangeDate(void)
 	char msgDate = (dateArray[0] << 4) | dateArray[1];
 	char msgYear = (yearArray[0] << 4) | yearArray[1];
 
+	I2C_PROFILE_TAG(I2C_TAG_SET_CLOCK);
 	I2C1_byteWrite(rtcAddress, monthM, msgMonth);
 	I2C1_byteWrite(rtcAddress, dateM, msgDate);
 	I2C1_byteWrite(rtcAddress, yearM, msgYear);
@@ -677,6 +694,8 @@ void sendChangeTime(void)
 	char msgHour;
 	char msgMin;
 
+	I2C_PROFILE_TAG(I2C_TAG_SET_CLOCK);
+
 	if (ampmFlag == 1)
 	{
 		msgHour = 0b1100000 | (hourArray[0] << 4) | hourArray[1];
@@ -699,6 +718,8 @@ void sendChangeTime(void)
  */
 void printTimeToLCD(int time)
 {
+	PROFILE_ZONE(PROF_ZONE_DRAW_TIME);
+
 	char msg[50];
 	int offsetX = 0;
 
@@ -740,3 +761,152 @@ void printTimeToLCD(int time)
 		break;
 	}
 }
+
+/*
+ * @brief Function that draws the current screen and handles menu navigation. Runs as the 10 Hz UI task.
+ * @param None
+ * @return None
+ */
+void displayUpdate(void)
+{
+	static int savedState = -1;
+
+	/* Bluetooth */
+	displayBluetooth(ICON);
+
+	switch (state)
+	{
+	case MENUSTATE:
+
+		if (menuFlag)
+		{
+			// Fill_Screen(BLACK);
+			PROFILE_BEGIN();
+			Fill_Rect(0, 0, 240, 225, BLACK);
+			PROFILE_END(PROF_ZONE_DRAW_CLEAR);
+			displayMenu();
+			menuFlag = 0;
+		}
+
+		if (blinkMenuFlag)
+		{
+			blinkMenu();
+
+			/* Move to the chosen menu */
+			if (blinkMenuFlag == 2)
+			{
+				displayFlag = 1;
+				if (count == 0)
+					state = TIMESTATE;
+				if (count == 1)
+					state = DATESTATE;
+				if (count == 2)
+					state = TEMPSTATE;
+				blinkMenuFlag = 0;
+			}
+		}
+		break;
+
+	case TIMESTATE:
+
+		if (displayFlag)
+		{
+			PROFILE_BEGIN();
+			Fill_Rect(0, 0, 240, 225, BLACK);
+			PROFILE_END(PROF_ZONE_DRAW_CLEAR);
+			getTime();
+			printToLCD(TIME);
+			displayFlag = 0;
+		}
+
+		/* Change time */
+		if (changeTimeFlag)
+			changeTime();
+		break;
+
+	case DATESTATE:
+
+		if (displayFlag)
+		{
+			PROFILE_BEGIN();
+			Fill_Rect(0, 0, 240, 225, BLACK);
+			PROFILE_END(PROF_ZONE_DRAW_CLEAR);
+			getTime();
+			printToLCD(DATE);
+			displayFlag = 0;
+		}
+
+		/* Change date */
+		if (changeDateFlag)
+			changeDate();
+		break;
+
+	case TEMPSTATE:
+
+		if (displayFlag)
+		{
+			PROFILE_BEGIN();
+			Fill_Rect(0, 0, 240, 225, BLACK);
+			PROFILE_END(PROF_ZONE_DRAW_CLEAR);
+			getTime();
+			printToLCD(TEMP);
+			displayFlag = 0;
+		}
+		break;
+	}
+
+	/* Reset for Menu state */
+	if (menuScreen && state != MENUSTATE)
+	{
+		if (state == TEMPSTATE)
+		{
+			CW = 0;
+			CCW = 0;
+		}
+		state = MENUSTATE;
+		blinkMenuFlag = 0;
+		chooseMenu = 0;
+		count = 0;
+		menuFlag = 1;
+	}
+	menuScreen = 0;
+
+	/* Save state into EEPROM */
+	if (state != savedState)
+	{
+		eepromWrite(1, state);
+		savedState = state;
+	}
+}
+
+/*
+ * @brief Function that refreshes the time, date or temperature screen. Runs as the 1 Hz RTC task.
+ * @param None
+ * @return None
+ */
+void displayClock(void)
+{
+	switch (state)
+	{
+	case TIMESTATE:
+		if (!changeTimeFlag)
+		{
+			getTime();
+			printToLCD(TIME);
+		}
+		break;
+
+	case DATESTATE:
+		if (!changeDateFlag)
+		{
+			getTime();
+			printToLCD(DATE);
+		}
+		break;
+
+	case TEMPSTATE:
+		readTemp();
+		printToLCD(TEMP);
+		break;
+	}
+}
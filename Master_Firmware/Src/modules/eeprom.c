@@ -6,7 +6,7 @@
  *
  * @note 	Uses BCD format for storing mileage values (tens and units)
  * 			Stores mileage in increments, with rollover handling
- * 			EEPROM device address: 0x57
+ * 			EEPROM device address: 0x57 (AT24C32, 16-bit memory addresses)
  * 
  * @author: Aeron Lahoylahoy
  * @date:  June 27, 2024
@@ -14,6 +14,9 @@
 #include "stm32f4xx.h"
 #include "stm32f446xx.h"
 #include "i2c_master.h"
+#include "i2c_scheduler.h"
+#include "i2c_profiler.h"
+#include "flags.h"
 #include "eeprom.h"
 #include "controls.h"
 #include "display.h"
@@ -21,24 +24,16 @@
 #include "port_pin_define.h"
 #include "speed_sensor.h"
 #include "ili9341.h"
+#include "link.h"
+#include "rotary_encoder.h"
+#include "button_functions.h"
 
 /* Variables for EEPROM operations */
 char mileEEPROM = 0x57; // address
 char mileMemory = 0;
 char mileSaved = 0;
-int traveledMiles = 0;
-
-/*
- * @brief Function that retrieves cumulative mileage from EEPROM and converts it to integer miles.
- * @param None
- * @return None
-*/
-void getCumulativeMiles(void){
-
-	I2C1_byteRead(mileEEPROM, 0, &mileSaved);
-	traveledMiles = traveledMiles + convertToMiles();
-
-}
+int traveledMiles = 0; // whole miles read from EEPROM at boot
+int storedMiles = 0;   // whole miles last written to EEPROM
 
 /*
  * @brief Function that converts BCD format mileage to integer miles.
@@ -54,21 +49,39 @@ int convertToMiles(void){
 }
 
 /*
- * @brief Function that stores the current mileage in EEPROM.
+ * @brief Function that returns the odometer: stored whole miles plus the pulses counted since.
+ * @param None
+ * @return Odometer in 0.1 mile
+ */
+uint32_t odometerTenths(void){
+
+	return traveledMiles * 10 + pulsesToTenths(speedReadPulses(&odometerPulses));
+}
+
+/*
+ * @brief Function that stores the whole miles in EEPROM (BCD) when they change.
  * @param None
  * @return None
  */
 void storeMiles(void){
-	static char increment;
-	static char memory;
+	int miles = odometerTenths() / 10;
 
-	increment++;
-
-	if(increment > 255){
-		memory++;
+	if (miles != storedMiles){
+		storedMiles = miles;
+		eepromWrite(4, (((miles / 10) % 10) << 4) | (miles % 10));
 	}
+}
+
+/*
+ * @brief Function that queues a background write of one EEPROM byte.
+ * @details The scheduler waits out the write cycle by ACK polling, so callers never block on it.
+ * @param maddr: EEPROM address
+ * @param data: byte to store
+ * @return None
+ */
+void eepromWrite(char maddr, char data){
 
-	I2C1_byteWrite(mileEEPROM, memory, increment);
+	i2cSubmitWrite(mileEEPROM, I2C_MADDR16(maddr), 1, &data, I2C_PRIO_BACKGROUND, I2C_TAG_EEPROM);
 }
 
 /*
@@ -80,14 +93,21 @@ void readSavedData(void)
 {
     char prevData;
 
+    I2C_PROFILE_TAG(I2C_TAG_SAVED_DATA);
+
     for (int i = 0; i < 5; i++)
     {
-        I2C1_byteRead(mileEEPROM, i, &prevData);
+        I2C1_byteRead(mileEEPROM, I2C_MADDR16(i), &prevData);
 
         /* Turn Signal */
         if (i == 0)
         {
-            I2C1_byteWrite(slave, 0, prevData);
+            if (prevData == 0x41)
+                linkSetTurn(LINK_TURN_RIGHT);
+            else if (prevData == 0x42)
+                linkSetTurn(LINK_TURN_LEFT);
+            else
+                linkSetTurn(LINK_TURN_NONE);
         }
 
         /* Display */
@@ -111,146 +131,94 @@ void readSavedData(void)
         /* MILES LOG */
         if (i == 4)
         {
-            traveledMiles = traveledMiles + convertToMiles();
-            if (traveledMiles == 0)
-            {
-                I2C1_byteWrite(slave, 0, 0x10);
-            }
-            else
-            {
-
-                for (int i = 0; i < traveledMiles; i++)
-                {
-                    I2C1_byteWrite(slave, 0, 0x11);
-                    for (int j = 0; j < 500; j++)
-                        ;
-                }
-            }
+            mileSaved = prevData;
+            traveledMiles = convertToMiles();
+            storedMiles = traveledMiles;
+            linkSetOdometer(traveledMiles * 10);
         }
     }
+
+    /* Restore the slave with one snapshot */
+    linkSendState();
+    i2cService();
 }
 
 /*
-* @brief Function that reads the current mileage from the speed sensor and updates RPM and MPH.
+ * @brief Function that updates RPM and MPH from the hall sensor period measured by TIM4.
  * @param None
  * @return None
  */
 void readMiles(void)
 {
-
-    if (hallEffectFlag == 0)
-    {
-        TIM4->CR1 = 0; // turn off timer
-        TIM4->CNT = 0;
-        rpmAverage = 0;
-        endTime = 0;
-        mph = 0;
-        // calculateRPM();
-    }
-
-    if (hallEffectFlag == 1)
-    {
-        TIM4->CR1 = 1; // start timer
-
-        if (TIM4->CNT > 9000)
-        { // half a second 32500 , 16250
-            //			TIM4->CR1 = 0; // turn off timer
-            //			TIM4->CNT = 0;
-            //			//rpmAverage = 0;
-            //			endTime = 0;
-            //			calculateRPM();
-            hallEffectFlag = 0;
-        }
-    }
-
-    else if (hallEffectFlag == 2)
-    {
-        TIM4->CR1 = 0; // turn off timer
-        endTime = TIM4->CNT;
-        calculateRPM();
-        // calculateMPH();
-        TIM4->CR1 = 0; // turn off timer
-        TIM4->CNT = 0;
-        hallEffectFlag = 1;
-    }
+    calculateRPM();
 }
 
 /*
- * @brief Function that sends the current mileage index to the motor controller.
+ * @brief Function that updates the speed and odometer sent to the motor controller.
  * @param None
  * @return None
  */
 void sendMiles(void)
 {
-
-    for (int i = 0; i < 20; i++)
-    {
-
-        if (mph == 0)
-        {
-            speedIndex = 0;
-        }
-        else if ((mph <= speedVal[i]) && (mph > speedVal[i - 1]))
-            speedIndex = i;
-    }
-
-    if (speedIndex > 9)
-    {
-        I2C1_byteWrite(slave, 0, 0x50 | (speedIndex - 10));
-    }
-    else
-        I2C1_byteWrite(slave, 0, 0x30 | speedIndex);
+    linkSetSpeed(speedMphQ16, speedRpmQ16);
+    linkSetOdometer(odometerTenths());
 }
 
 /*
- * @brief Function that sends control messages based on button states.
+ * @brief Function that sends control messages based on button states. Runs as the controls task.
  * @param None
  * @return None
  */
 void sendMessages(void)
 {
+    static int savedBluetooth = -1;
+    static int bluetoothShown = 0;
+
+    /* Debounced button events to control flags */
+    handleButtons();
+
+    /* Encoder detents to the menu and editors */
+    encoderService();
 
     /* Turn Signal */
-    if (turnFlag)
+    if (flagTake(FLAG_TURN))
     {
-        if (debounceButton(PORTA, TURN_RIGHT_PIN))
+        if (debounceButton(TURN_SIGNAL_PORT, TURN_RIGHT_PIN))
         {
 
-            I2C1_byteWrite(slave, 0, 0x41);
-            delayMS(1);
+            linkSetTurn(LINK_TURN_RIGHT);
             /* Save this to EEPROM */
-            I2C1_byteWrite(mileEEPROM, 0, 0x41);
+            eepromWrite(0, 0x41);
         }
 
-        else if (debounceButton(PORTA, TURN_LEFT_PIN))
+        else if (debounceButton(TURN_SIGNAL_PORT, TURN_LEFT_PIN))
         {
 
-            I2C1_byteWrite(slave, 0, 0x42);
-            delayMS(1);
-            I2C1_byteWrite(mileEEPROM, 0, 0x42);
+            linkSetTurn(LINK_TURN_LEFT);
+            eepromWrite(0, 0x42);
         }
         else
         {
-            I2C1_byteWrite(slave, 0, 0x43);
+            linkSetTurn(LINK_TURN_NONE);
         }
-        turnFlag = 0;
     }
 
     /* Mile Reset */
-    if (resetMilesFlag)
+    if (flagTake(FLAG_RESET_MILES))
     {
         if (debounceButton(RESET_BUTTON_PORT, RESET_BUTTON_PIN))
         {
             // I2C1_byteWrite(slave, 0, 0x21);
-            I2C1_byteWrite(mileEEPROM, 4, 0);
-            I2C1_byteWrite(slave, 0, 0x10); // sends the reset command
+            eepromWrite(4, 0);
             traveledMiles = 0;
+            storedMiles = 0;
+            speedResetPulses(&odometerPulses);
+            linkSetOdometer(0);
         }
-        resetMilesFlag = 0;
     }
 
     /* Bluetooth */
-    if (bluetoothFlag)
+    if (flagTake(FLAG_BLUETOOTH))
     {
         if (debounceButton(BLUETOOTH_BUTTON_PORT, BLUETOOTH_BUTTON_PIN))
         {
@@ -262,67 +230,55 @@ void sendMessages(void)
                 bluetoothEnable = 0;
             }
         }
-        bluetoothFlag = 0;
     }
 
-    /* Bluetooth Display */
-    if (bluetoothEnable == 1)
+    /* Bluetooth setting: saved, and the icon cleared, only when it changes */
+    if (bluetoothEnable != savedBluetooth)
     {
+        eepromWrite(2, bluetoothEnable ? 0x01 : 0x00);
+        savedBluetooth = bluetoothEnable;
 
-        if (bluetoothCounter == 1)
+        if (bluetoothEnable == 0)
+        {
+            Fill_Rect((240 / 2) - 25, 225, 50, 55, BLACK);
+            flagClear(FLAG_BLUETOOTH_COUNT);
+            bluetoothDisplay = 0;
+        }
+    }
+
+    /* Bluetooth Display: once per blink, not on every pass */
+    if (bluetoothEnable == 1)
+    {
+        if (bluetoothCounter == 1 && !bluetoothShown)
         {
             displayBluetooth(DISPLAY);
-            /* Saves the value to the eeprom */
-            I2C1_byteWrite(mileEEPROM, 2, 0x01);
+            bluetoothShown = 1;
         }
         else if (bluetoothCounter > 5)
         {
             displayBluetooth(CLEAR);
             bluetoothCounter = 0;
-            bluetoothCountFlag = 0;
+            flagClear(FLAG_BLUETOOTH_COUNT);
             bluetoothDisplay = 1;
         }
-    }
-    else if (bluetoothEnable == 0)
-    {
-        Fill_Rect((240 / 2) - 25, 225, 50, 55, BLACK);
-        I2C1_byteWrite(mileEEPROM, 2, 0x00);
-        bluetoothCountFlag = 0;
-        bluetoothDisplay = 0;
+
+        if (bluetoothCounter != 1)
+            bluetoothShown = 0;
     }
 
     /* Menu Button */
-    if (debounceButton(MENU_BUTTON_PORT, MENU_BUTTON_PIN))
+    if (flagTake(FLAG_MENU_BUTTON))
     {
         if (state != MENUSTATE)
             menuScreen = 1;
         // state = MENUSTATE;
     }
 
-    if (mileFlag)
+    /* Once a second: speed and odometer to the slave, whole miles to EEPROM */
+    if (flagTake(FLAG_MILE))
     {
-        mileCounter++;
-        /* Motor */
-        if (mileCounter == 3)
-        {
-            sendMiles();
-        }
-
-        if (mileCounter == 4)
-        {
-            /* write to EEPROM */
-            updateCumulativeMiles();
-            if (cumulativeMiles > 1)
-            {
-                storeMiles();
-
-                I2C1_byteWrite(slave, 0, 0x11);
-                // I2C1_byteWrite(slave, 0, 0x11);
-                cumulativeMiles = 0;
-            }
-            mileCounter = 0;
-        }
-        mileFlag = 0;
+        sendMiles();
+        storeMiles();
     }
 }
 
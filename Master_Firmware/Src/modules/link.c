@@ -0,0 +1,214 @@
+/*
+ * @file 	link.c
+ * @brief 	Master side of the master/slave link protocol
+ * @details Keeps one snapshot of everything the slave displays (speed, rpm, turn signal,
+ * 			sonar warning, odometer) and sends it as a single framed I2C write.
+ * 			The snapshot is only sent when a field changed, or when the slave status
+ * 			register file shows it has not applied the last frame (lost frame, slave reset).
+ * 			Frames carrying a turn signal or warning change are queued as urgent.
+ * 			Every change releases the bus task, which sends it.
+ *
+ * @note 	Frame and register layout are described in link.h
+ *
+ * @author: Aeron Lahoylahoy
+ * @date: June 27, 2024
+ */
+#include "stm32f4xx.h"
+#include "i2c_master.h"
+#include "i2c_scheduler.h"
+#include "i2c_profiler.h"
+#include "link.h"
+#include "flags.h"
+#include "scheduler.h"
+
+/* Link Variables */
+LinkState linkState = {0, 0, LINK_TURN_NONE, 0, 0, 0};
+LinkStatus linkStatus;
+uint8_t linkSeq = 0;
+int linkDirty = 1;
+int linkResyncCount = 0;
+int linkUrgent = I2C_TAG_NONE; /* tag of the change that made the frame urgent */
+
+/*
+ * @brief Function that computes the frame checksum
+ * @param buf: bytes to sum
+ * @param n: number of bytes
+ * @return Byte that makes the sum of buf and itself zero
+ */
+char linkChecksum(char *buf, int n)
+{
+	char sum = 0;
+
+	for (int i = 0; i < n; i++)
+		sum += buf[i];
+
+	return -sum;
+}
+
+/*
+ * @brief Function that packs the current snapshot into a state frame
+ * @param frame: buffer of at least LINK_FRAME_MAX bytes
+ * @return Number of bytes in the frame
+ */
+int linkBuildState(char *frame)
+{
+	int n = 0;
+
+	frame[n++] = LINK_HEADER_SIZE - 1 + LINK_STATE_SIZE; /* LEN */
+	frame[n++] = LINK_MSG_STATE;
+	/* Sequence 0 is what the slave reports after a reset */
+	if (++linkSeq == 0)
+		linkSeq = 1;
+	frame[n++] = linkSeq;
+
+	frame[n++] = linkState.speed & 0xFF;
+	frame[n++] = linkState.speed >> 8;
+	frame[n++] = linkState.rpm & 0xFF;
+	frame[n++] = linkState.rpm >> 8;
+	frame[n++] = linkState.turn;
+	frame[n++] = linkState.warning;
+	frame[n++] = linkState.flags;
+	frame[n++] = linkState.odometer & 0xFF;
+	frame[n++] = (linkState.odometer >> 8) & 0xFF;
+	frame[n++] = (linkState.odometer >> 16) & 0xFF;
+	frame[n++] = linkState.odometer >> 24;
+
+	frame[n] = linkChecksum(frame, n);
+	n++;
+
+	return n;
+}
+
+/*
+ * @brief Function that queues the full snapshot for the slave as one I2C transaction
+ * @param None
+ * @return None
+ */
+void linkSendState(void)
+{
+	char frame[LINK_FRAME_MAX];
+	int n = linkBuildState(frame);
+
+	if (linkUrgent)
+		i2cSubmitWrite(slave, LINK_REG_FRAME, n, frame, I2C_PRIO_URGENT, linkUrgent);
+	else
+		i2cSubmitWrite(slave, LINK_REG_FRAME, n, frame, I2C_PRIO_NORMAL, I2C_TAG_LINK_STATE);
+	linkDirty = 0;
+	linkUrgent = I2C_TAG_NONE;
+}
+
+/*
+ * @brief Function that reads the slave status register file into linkStatus
+ * @param None
+ * @return 1 if the slave has applied the last frame sent, 0 if it is stale or didn't answer
+ */
+int linkPollStatus(void)
+{
+	uint8_t regs[LINK_STATUS_SIZE];
+
+	I2C_PROFILE_TAG(I2C_TAG_LINK_POLL);
+	if (I2C1_burstRead(slave, LINK_REG_STATUS, LINK_STATUS_SIZE, (char *)regs) != I2C_OK)
+		return 0; /*NACK or timeout, linkStatus keeps the last good poll*/
+
+	linkStatus.version = regs[LINK_STATUS_VERSION];
+	linkStatus.lastSeq = regs[LINK_STATUS_LAST_SEQ];
+	linkStatus.needleRpm = regs[LINK_STATUS_NEEDLE_RPM] | (regs[LINK_STATUS_NEEDLE_RPM + 1] << 8);
+	linkStatus.needleMph = regs[LINK_STATUS_NEEDLE_MPH] | (regs[LINK_STATUS_NEEDLE_MPH + 1] << 8);
+	linkStatus.targetRpm = regs[LINK_STATUS_TARGET_RPM] | (regs[LINK_STATUS_TARGET_RPM + 1] << 8);
+	linkStatus.targetMph = regs[LINK_STATUS_TARGET_MPH] | (regs[LINK_STATUS_TARGET_MPH + 1] << 8);
+	linkStatus.frameErrors = regs[LINK_STATUS_FRAME_ERRORS];
+	linkStatus.overruns = regs[LINK_STATUS_OVERRUNS];
+	linkStatus.busErrors = regs[LINK_STATUS_BUS_ERRORS];
+	linkStatus.resetCause = regs[LINK_STATUS_RESET_CAUSE];
+	linkStatus.cpuLoad = regs[LINK_STATUS_CPU_LOAD];
+
+	return (linkStatus.version == LINK_VERSION) && (linkStatus.lastSeq == linkSeq);
+}
+
+/*
+ * @brief Function that sends the snapshot if it changed, and resynchronises the slave
+ * 		  when the periodic status poll shows it missed a frame
+ * @param None
+ * @return None
+ */
+void linkService(void)
+{
+	if (flagTake(FLAG_LINK_POLL))
+	{
+		if (!linkPollStatus())
+		{
+			linkResyncCount++;
+			linkDirty = 1;
+		}
+	}
+
+	if (linkDirty)
+		linkSendState();
+}
+
+/*
+ * @brief Function that updates the speed fields of the snapshot
+ * @param mphQ16: vehicle speed in mph, Q16
+ * @param rpmQ16: wheel rpm, Q16
+ * @return None
+ */
+void linkSetSpeed(uint32_t mphQ16, uint32_t rpmQ16)
+{
+	uint16_t speed = (mphQ16 * 10 + 0x8000) >> 16;
+	uint16_t wheel = (rpmQ16 + 0x8000) >> 16;
+
+	if ((linkState.speed != speed) || (linkState.rpm != wheel))
+	{
+		linkState.speed = speed;
+		linkState.rpm = wheel;
+		linkDirty = 1;
+		schedulerSignal(SCHED_TASK_BUS);
+	}
+}
+
+/*
+ * @brief Function that updates the turn signal field of the snapshot
+ * @param turn: LINK_TURN_NONE, LINK_TURN_RIGHT or LINK_TURN_LEFT
+ * @return None
+ */
+void linkSetTurn(int turn)
+{
+	if (linkState.turn != turn)
+	{
+		linkState.turn = turn;
+		linkDirty = 1;
+		linkUrgent = I2C_TAG_TURN;
+		schedulerSignal(SCHED_TASK_BUS);
+	}
+}
+
+/*
+ * @brief Function that updates the sonar warning field of the snapshot
+ * @param warning: 1 if an obstacle is close, 0 otherwise
+ * @return None
+ */
+void linkSetWarning(int warning)
+{
+	if (linkState.warning != warning)
+	{
+		linkState.warning = warning;
+		linkDirty = 1;
+		linkUrgent = I2C_TAG_WARNING;
+		schedulerSignal(SCHED_TASK_BUS);
+	}
+}
+
+/*
+ * @brief Function that updates the odometer field of the snapshot
+ * @param tenths: odometer in 0.1 mile
+ * @return None
+ */
+void linkSetOdometer(uint32_t tenths)
+{
+	if (linkState.odometer != tenths)
+	{
+		linkState.odometer = tenths;
+		linkDirty = 1;
+		schedulerSignal(SCHED_TASK_BUS);
+	}
+}
@@ -13,9 +13,11 @@
 #include "button_functions.h"
 #include "iLI9341.h"
 #include "rtc.h"
+#include "timebase.h"
+#include "clock.h"
+#include "flags.h"
 
 /* Rotary Encoder Global Variables */
-int encoderSW_Flag = 0;
 int encoderCLK_Flag;
 int CounterClockwise_Count = 0;
 int Clockwise_Count = 0;
@@ -26,6 +28,19 @@ int blink;
 int CCW;
 int CW;
 
+/* Quadrature Decoder */
+volatile int32_t encoderSteps = 0; /* quarter steps, clockwise positive */
+uint8_t encoderState = 0;		   /* previous AB << 2 | current AB */
+int32_t encoderDetentStep = 0;	   /* steps already turned into detents */
+uint32_t encoderLastDetent = 0;
+
+/* Previous and current AB to step: 0 = no move or invalid */
+static const int8_t encoderTable[16] = {
+	0, -1, 1, 0,
+	1, 0, 0, -1,
+	-1, 0, 0, 1,
+	0, 1, -1, 0};
+
 /*
  * @brief Function that initializes the rotary encoder
  * @param None
@@ -40,32 +55,13 @@ void rotaryEncoderInit(void)
 }
 
 /*
- * @brief Function that initializes the SW pin on the Rotary Encoder
+ * @brief Function that initializes the SW pin on the Rotary Encoder as a debounced input
  * @param None
  * @return None
  */
 void encoderSW_Init(void)
 {
-
-	// Set GPIOC Clock
-	RCC->AHB1ENR |= Bclk;
-
-	// Set Interrupt Clock
-	RCC->APB2ENR |= 0x4000;
-
-	// GPIOC Initilization
-	GPIOB->MODER &= ~(0b11 << (PIN0 * 2));
-	GPIOB->MODER |= (0b00 << (PIN0 * 2));
-	GPIOB->PUPDR |= (0b01 << (PIN0 * 2));
-
-	// Interrupt Initilization
-	SYSCFG->EXTICR[0] &= ~0x000F; // Clear
-	SYSCFG->EXTICR[0] |= 0x0001;  // Port C on EXTI 0
-	EXTI->IMR |= (0b1 << PIN0);	  // Interrupt Mask on PIN 0
-	EXTI->FTSR |= (0b1 << PIN0);  // Falling edge on PIN 0
-
-	// Enable Interrupt for Pin 0
-	NVIC_EnableIRQ(EXTI0_IRQn);
+	buttonInputInit(ENCODER_PORT, ENCODER_SW_PIN);
 }
 
 /*
@@ -75,26 +71,7 @@ void encoderSW_Init(void)
  */
 void encoderCLK_Init(void)
 {
-
-	// Set GPIOC Clock
-	RCC->AHB1ENR |= Bclk;
-
-	// Set Interrupt Clock
-	RCC->APB2ENR |= 0x4000;
-
-	// GPIOC Initilization
-	GPIOB->MODER &= ~(0b11 << (PIN1 * 2));
-	GPIOB->MODER |= (0b00 << (PIN1 * 2));
-	GPIOB->PUPDR |= (0b01 << (PIN1 * 2));
-
-	// Interrupt Initilization
-	SYSCFG->EXTICR[0] &= ~0x00F0; // Clear
-	SYSCFG->EXTICR[0] |= 0x0010;  // Port C on EXTI 1
-	EXTI->IMR |= (0b1 << PIN1);	  // Interrupt Mask on PIN 1
-	EXTI->FTSR |= (0b1 << PIN1);  // Falling edge on PIN 1
-
-	// Enable Interrupt for Pin 1
-	NVIC_EnableIRQ(EXTI1_IRQn);
+	buttonInit(ENCODER_PORT, ENCODER_CLK_PIN, EXTI_BOTH, encoderEdge);
 }
 
 /*
@@ -104,188 +81,139 @@ void encoderCLK_Init(void)
  */
 void encoderDT_Init(void)
 {
+	buttonInit(ENCODER_PORT, ENCODER_DT_PIN, EXTI_BOTH, encoderEdge);
 
-	// Set GPIOC Clock
-	RCC->AHB1ENR |= Bclk;
-
-	// GPIOC Initilization
-	GPIOB->MODER &= ~(0b11 << (PIN2 * 2));
-	GPIOB->MODER |= (0b00 << (PIN2 * 2));
-	// GPIOC->PUPDR |= (0b01 << (PIN2 * 2));
+	/* Start the decoder from the resting state */
+	encoderState = ENCODER_AB();
+	encoderDetentStep = encoderSteps;
 }
 
 /*
- * @brief EXTI0 Interrupt Handler for Rotary Encoder SW pin
+ * @brief Function that handles a debounced press of the Rotary Encoder SW pin
  * @param None
  * @return None
  */
-extern void EXTI0_IRQHandler(void)
+void encoderSwitchPressed(void)
 {
+	flagSet(FLAG_ENCODER_SW);
+	blinkMenuFlag++;
 
-	/* Debounce pin when interrupt occurs */
-	if (debounceButton(PORTB, PIN0))
+	if (state == TIMESTATE)
 	{
-
-		encoderSW_Flag = 1;
-		blinkMenuFlag++;
-
-		if (state == TIMESTATE)
-		{
-			changeTimeFlag = 1;
-			changeTimeCount++;
-		}
-
-		if (state == DATESTATE)
-		{
-			changeDateFlag = 1;
-			changeDateCount++;
-		}
+		changeTimeFlag = 1;
+		changeTimeCount++;
 	}
 
-	/* Reset EXTI0 interrupt flag  */
-	EXTI->PR |= (0b1 << PIN0);
+	if (state == DATESTATE)
+	{
+		changeDateFlag = 1;
+		changeDateCount++;
+	}
 }
 
 /*
- * @brief EXTI1 Interrupt Handler for Rotary Encoder CLK pin
+ * @brief Function that decodes one edge of either encoder pin (EXTI1, EXTI2)
+ * @details The previous and current A/B levels index the Gray-code table. Invalid
+ * 			jumps (both pins changed, contact bounce) count as 0, so a bounce cancels itself.
  * @param None
  * @return None
  */
-extern void EXTI1_IRQHandler(void)
+RAMFUNC void encoderEdge(void)
 {
+	encoderState = ((encoderState << 2) | ENCODER_AB()) & 0xF;
+	encoderSteps += encoderTable[encoderState];
+}
 
-	/* Determine the direction of the turn */
-	/* Checks Rotary Encoder DT pin value is 0 (Port C Pin 2) */
-	if (!(PORTB->IDR & (0b1 << PIN2)))
-	{
-		delayMS(10);
+/*
+ * @brief Function that returns the step multiplier for a detent
+ * @param gapUs: time since the previous detent
+ * @return Multiplier
+ */
+static int encoderAccel(uint32_t gapUs)
+{
+	if (gapUs < ENCODER_FAST_US)
+		return ENCODER_FAST_STEP;
+	if (gapUs < ENCODER_MEDIUM_US)
+		return ENCODER_MEDIUM_STEP;
+	return 1;
+}
 
-		if (blinkMenuFlag)
-		{
-			CCW++;
-			if (CCW > 3)
-				CCW = 0;
-		}
+/*
+ * @brief Function that moves a value by delta inside [low, high] with wrap around
+ * @param value: current value
+ * @param delta: signed change
+ * @param low: lowest value
+ * @param high: highest value
+ * @return New value
+ */
+static int encoderWrap(int value, int delta, int low, int high)
+{
+	int span = high - low + 1;
 
-		if (state == TIMESTATE)
-		{
-			if (changeTimeCount == 1)
-			{
-				hour--;
-				if (hour < 1)
-					hour = 12;
-			}
+	value = (value - low + delta) % span;
+	if (value < 0)
+		value += span;
 
-			if (changeTimeCount == 2)
-			{
-				min--;
-				if (min < 1)
-					min = 59;
-			}
+	return value + low;
+}
 
-			if (changeTimeCount == 3)
-			{
-				ampmFlag--;
-				if (ampmFlag < 0)
-					ampmFlag = 1;
-			}
-		}
+/*
+ * @brief Function that applies the detents turned since the last call to the menu and editors
+ * @details Called from the main loop. The step count is read without locking: it is a single
+ * 			word written only by the decoder interrupt.
+ * @param None
+ * @return None
+ */
+void encoderService(void)
+{
+	int32_t steps = encoderSteps;
+	int detents = (steps - encoderDetentStep) / ENCODER_STEPS_PER_DETENT;
+	int fast;
+	uint32_t now;
 
-		if (state == DATESTATE)
-		{
+	if (detents == 0)
+		return;
 
-			/* change month */
-			if (changeDateCount == 1)
-			{
-				month--;
-				if (month < 1)
-					month = 12;
-			}
+	encoderDetentStep += detents * ENCODER_STEPS_PER_DETENT;
 
-			/* change date */
-			if (changeDateCount == 2)
-			{
-				date--;
-				if (date < 1)
-					date = 31;
-			}
+	/* Velocity from the time between detents */
+	now = getMicros();
+	fast = detents * encoderAccel((now - encoderLastDetent) / (detents < 0 ? -detents : detents));
+	encoderLastDetent = now;
 
-			/* change year */
-			if (changeDateCount == 3)
-			{
-				year--;
-				if (year < 1)
-					year = 99;
-			}
-		}
+	/* Menu cursor */
+	if (blinkMenuFlag)
+	{
+		if (detents < 0)
+			CCW = encoderWrap(CCW, -detents, 0, 3);
+		else
+			CW = encoderWrap(CW, detents, 0, 3);
 	}
 
-	/* Checks Rotary Encoder DT pin value is 1 (Port C Pin 2) */
-	else if (PORTB->IDR & (0b1 << PIN2))
+	if (state == TIMESTATE)
 	{
-		delayMS(10);
-
-		if (blinkMenuFlag)
-		{
-			CW++;
-			if (CW > 3)
-				CW = 0;
-		}
+		if (changeTimeCount == 1)
+			hour = encoderWrap(hour, fast, 1, 12);
 
-		/* New shit */
-		if (state == TIMESTATE)
-		{
-			if (changeTimeCount == 1)
-			{
-				hour++;
-				if (hour > 12)
-					hour = 1;
-			}
+		if (changeTimeCount == 2)
+			min = encoderWrap(min, fast, 1, 59);
 
-			if (changeTimeCount == 2)
-			{
-				min++;
-				if (min > 59)
-					min = 1;
-			}
-
-			if (changeTimeCount == 3)
-			{
-				ampmFlag++;
-				if (ampmFlag > 1)
-					ampmFlag = 0;
-			}
-		}
-
-		if (state == DATESTATE)
-		{
+		if (changeTimeCount == 3)
+			ampmFlag = encoderWrap(ampmFlag, detents, 0, 1);
+	}
 
-			/* change month */
-			if (changeDateCount == 1)
-			{
-				month++;
-				if (month > 12)
-					month = 1;
-			}
+	if (state == DATESTATE)
+	{
+		/* change month */
+		if (changeDateCount == 1)
+			month = encoderWrap(month, fast, 1, 12);
 
-			/* change date */
-			if (changeDateCount == 2)
-			{
-				date++;
-				if (date > 31)
-					date = 1;
-			}
+		/* change date */
+		if (changeDateCount == 2)
+			date = encoderWrap(date, fast, 1, 31);
 
-			/* change year */
-			if (changeDateCount == 3)
-			{
-				year++;
-				if (year > 99)
-					year = 1;
-			}
-		}
+		/* change year */
+		if (changeDateCount == 3)
+			year = encoderWrap(year, fast, 1, 99);
 	}
-
-	/* Reset EXTI0 interrupt flag  */
-	EXTI->PR |= (0b1 << PIN1);
 }
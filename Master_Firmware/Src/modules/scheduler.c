@@ -0,0 +1,224 @@
+/*
+ * @file 	scheduler.c
+ * @brief 	Cooperative rate based task scheduler for the main loop
+ * @details Every task is released by its rate or by an event from an interrupt and runs
+ * 			to completion. One pass of schedulerRun() walks the table in priority order.
+ * 			Run time and overruns are kept per task. The UI state only changes what the
+ * 			UI and RTC tasks draw, the sensor pipeline is the same in every screen.
+ * 			Software timers are serviced at the start of every pass.
+ * 			The bus task has no rate: it is released by a link change, a queued I2C write,
+ * 			the TIM7 tick and the I2C scheduler's own soft timer while a write waits.
+ * 			When nothing is released the CPU sleeps (WFI) until the next release, the
+ * 			next software timer or any interrupt: buttons, encoder, sonar, hall, DMA and
+ * 			the TIM5 wake-up.
+ *
+ * @author: Aeron Lahoylahoy
+ * @date: June 27, 2024
+ */
+#include "stm32f4xx.h"
+#include "scheduler.h"
+#include "timebase.h"
+#include "soft_timer.h"
+#include "profiler.h"
+#include "display.h"
+#include "eeprom.h"
+#include "sonar.h"
+#include "link.h"
+#include "i2c_scheduler.h"
+#include "watchdog.h"
+
+static void taskBus(void);
+
+_Static_assert(PROF_ZONE_TASK_RTC - PROF_ZONE_TASK_BUS == SCHED_TASK_RTC - SCHED_TASK_BUS, "profiler task zones out of step with the task table");
+
+SchedTask schedTasks[SCHED_TASK_COUNT] = {
+	[SCHED_TASK_BUS] = {taskBus, SCHED_EVENT, 0},
+	[SCHED_TASK_SPEED] = {readMiles, SCHED_EVENT, 0},
+	[SCHED_TASK_CONTROLS] = {sendMessages, SCHED_PERIODIC, SCHED_PERIOD_CONTROLS},
+	[SCHED_TASK_SONAR] = {checkWarningSignal, SCHED_PERIODIC, SCHED_PERIOD_SONAR},
+	[SCHED_TASK_UI] = {displayUpdate, SCHED_PERIODIC, SCHED_PERIOD_UI},
+	[SCHED_TASK_RTC] = {displayClock, SCHED_PERIODIC, SCHED_PERIOD_RTC},
+};
+
+volatile uint32_t schedPending = 0; /* event tasks released by interrupts */
+
+/* Utilisation */
+uint32_t schedSleepUs = 0;
+uint32_t schedSleeps = 0;
+uint8_t schedCpuLoad = 100;
+static uint32_t loadWindowStart = 0;
+static uint32_t loadWindowSleep = 0;
+
+/*
+ * @brief Function that sends what changed to the slave and runs queued I2C writes, urgent first
+ * @param None
+ * @return None
+ */
+static void taskBus(void)
+{
+	linkService();
+	i2cService();
+	watchDogCheckIn(WDG_TASK_I2C);
+}
+
+/*
+ * @brief Function that releases every periodic task now and clears the statistics
+ * @param None
+ * @return None
+ */
+void schedulerInit(void)
+{
+	uint32_t now = getMicros();
+
+	for (int i = 0; i < SCHED_TASK_COUNT; i++)
+	{
+		schedTasks[i].next = now;
+		schedTasks[i].runs = 0;
+		schedTasks[i].runLast = 0;
+		schedTasks[i].runMax = 0;
+		schedTasks[i].overruns = 0;
+	}
+	schedPending = 0;
+}
+
+/*
+ * @brief Function that releases an event task. Safe from interrupts.
+ * @param task: SCHED_TASK_x
+ * @return None
+ */
+void schedulerSignal(int task)
+{
+	uint32_t primask = __get_PRIMASK();
+
+	__disable_irq();
+	schedPending |= (0b1 << task);
+	__set_PRIMASK(primask);
+}
+
+/*
+ * @brief Function that fires the due software timers, then runs every released task once, in table order
+ * @param None
+ * @return None
+ */
+void schedulerRun(void)
+{
+	{
+		PROFILE_ZONE(PROF_ZONE_SOFT_TIMERS);
+		softTimerService();
+	}
+
+	for (int i = 0; i < SCHED_TASK_COUNT; i++)
+	{
+		SchedTask *t = &schedTasks[i];
+		uint32_t start = getMicros();
+		uint32_t primask;
+
+		if (t->kind == SCHED_EVENT)
+		{
+			if (!(schedPending & (0b1 << i)))
+				continue;
+
+			primask = __get_PRIMASK();
+			__disable_irq();
+			schedPending &= ~(0b1 << i);
+			__set_PRIMASK(primask);
+		}
+		else if (t->period)
+		{
+			if ((int32_t)(start - t->next) < 0)
+				continue;
+
+			/* Keep the rate, but don't run a backlog of missed periods */
+			if (start - t->next >= t->period)
+			{
+				t->overruns++;
+				t->next = start + t->period;
+			}
+			else
+				t->next += t->period;
+		}
+
+		PROFILE_BEGIN();
+		t->run();
+		PROFILE_END(PROF_ZONE_TASK_BUS + i);
+
+		t->runLast = getMicros() - start;
+		if (t->runLast > t->runMax)
+			t->runMax = t->runLast;
+		if (t->period && t->runLast > t->period)
+			t->overruns++;
+		t->runs++;
+	}
+}
+
+/*
+ * @brief Function that sleeps until the next task release when nothing is pending
+ * @details Interrupts are masked while deciding, so an event raised after the check
+ * 			still ends the WFI. Pending interrupts run when the mask is lifted. An
+ * 			interrupt that released nothing (the 1 kHz TIM6 debounce tick) goes straight
+ * 			back to sleep: whatever it queued is read by a task at its next release.
+ * @param None
+ * @return None
+ */
+void schedulerIdle(void)
+{
+	uint32_t now;
+	uint32_t wake;
+	uint32_t start;
+	uint32_t slept;
+	uint32_t timerLeft;
+	int32_t until;
+	int32_t earliest = SCHED_LOAD_WINDOW_US;
+
+	__disable_irq();
+	now = getMicros();
+
+	for (int i = 0; i < SCHED_TASK_COUNT && !schedPending; i++)
+	{
+		if (schedTasks[i].kind != SCHED_PERIODIC)
+			continue;
+
+		until = (int32_t)(schedTasks[i].next - now);
+		if (!schedTasks[i].period)
+			until = 0;
+		if (until < earliest)
+			earliest = until;
+	}
+
+	/* Wake for the next software timer too */
+	timerLeft = deadlineRemaining(softTimerNextDue());
+	if (earliest > 0 && timerLeft < (uint32_t)earliest)
+		earliest = timerLeft;
+
+	if (!schedPending && earliest > SCHED_IDLE_MIN_US)
+	{
+		wake = now + earliest;
+		timebaseWakeAt(wake);
+
+		do
+		{
+			start = getMicros();
+			__DSB();
+			__WFI();
+
+			slept = getMicros() - start;
+			schedSleepUs += slept;
+			loadWindowSleep += slept;
+			schedSleeps++;
+
+			/* Run the interrupt that woke the core */
+			__enable_irq();
+			__disable_irq();
+		} while (!schedPending && (int32_t)(wake - getMicros()) > SCHED_IDLE_MIN_US);
+	}
+	__enable_irq();
+
+	/* Busy share of the last window */
+	now = getMicros();
+	if (now - loadWindowStart >= SCHED_LOAD_WINDOW_US)
+	{
+		schedCpuLoad = 100 - (loadWindowSleep * 100) / (now - loadWindowStart);
+		loadWindowStart = now;
+		loadWindowSleep = 0;
+	}
+}
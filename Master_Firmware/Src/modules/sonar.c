@@ -1,143 +1,491 @@
 /*
  * @file sonar.c
- * @brief Sonar module for distance measurement using ultrasonic sensor
- * @details This module provides functions to initialize the sonar sensor,
- * 
+ * @brief Sonar module for distance measurement using ultrasonic sensors
+ * @details This module drives an array of up to four ultrasonic sensors.
+ * 			TIM2 divides time into SONAR_SLOT_US listening windows. At the start of each
+ * 			window the slot interrupt triggers the sensors that are due (at most one per
+ * 			group, so sensors that can hear each other never listen at the same time) and
+ * 			closes the previous window. Echo edges are timestamped by input capture:
+ * 			TIM3 CH1, TIM12 CH1/CH2 and TIM9 CH1.
+ *
+ * 			Every sensor has its own median-of-N then exponential filter (Q8). The nearest
+ * 			valid sensor drives the warning, which has separate on/off thresholds and a
+ * 			minimum dwell so noise around the threshold does not toggle it.
+ *
  * @author: Aeron Lahoylahoy
  * @date: June 27, 2024
  */
 #include "stm32f4xx.h"
 #include "sonar.h"
 #include "i2c_master.h"
+#include "link.h"
+#include "timebase.h"
+#include "watchdog.h"
+#include "clock.h"
+#include "profiler.h"
+
+/* Sensor Table */
+const SonarConfig sonarConfig[SONAR_COUNT] = {
+	{SONAR_TRIG_PORT, SONAR_TRIG_PIN, SONAR_ECHO_PORT, SONAR_ECHO_PIN, 0, 1},
+#if SONAR_COUNT > 1
+	{SONAR1_TRIG_PORT, SONAR1_TRIG_PIN, SONAR1_ECHO_PORT, SONAR1_ECHO_PIN, 0, 1},
+#endif
+#if SONAR_COUNT > 2
+	{SONAR2_TRIG_PORT, SONAR2_TRIG_PIN, SONAR2_ECHO_PORT, SONAR2_ECHO_PIN, 0, 1},
+#endif
+#if SONAR_COUNT > 3
+	{SONAR3_TRIG_PORT, SONAR3_TRIG_PIN, SONAR3_ECHO_PORT, SONAR3_ECHO_PIN, 0, 1},
+#endif
+};
 
 /* Sonar Global Variables */
-double current = 0;
-double last = 0;
-double timeElapsed = 0;
-double distance = 0;
+SonarSensor sonarSensors[SONAR_COUNT];
+uint32_t sonarSlot = 0;
+int sonarNext = 0; // round robin start
+
+int distance = SONAR_NO_ECHO; // nearest, tenths of an inch
+int sonarNearest = -1;
 
 int checkDistance = 0;
 
+/* Timer Overflows (echo edge extension) */
+uint32_t tim3Overflows = 0;
+uint32_t tim12Overflows = 0;
+uint32_t tim9Overflows = 0;
+
+/* Warning State */
+int sonarWarning = 0;
+uint32_t sonarWarningSince = 0;
+uint32_t sonarWarningToggles = 0;
+
 /*
- * @brief Function to check warning signal based on sonar distance
+ * @brief Function to check warning signal based on the nearest sonar distance
  * @param None
  * @return None
  */
 void checkWarningSignal(void){
-	readEcho();
-	calculateDistance(timeElapsed);
-	if (distance < 10){
-		I2C1_byteWrite(slave, 0, 0x61);
+	int nearest = SONAR_NO_ECHO;
+	int index = -1;
+
+	for (int i = 0; i < SONAR_COUNT; i++)
+	{
+		SonarSensor *sn = &sonarSensors[i];
+		uint32_t seq;
+		int raw;
+
+		/* Reread if the ISR published in between */
+		do
+		{
+			seq = sn->seq;
+			raw = sn->raw;
+		} while (seq != sn->seq);
+
+		if (seq != sn->seqSeen)
+		{
+			sn->seqSeen = seq;
+			calculateDistance(i, raw);
+			watchDogCheckIn(WDG_TASK_SONAR);
+		}
+
+		if (sn->valid && sn->distance < nearest)
+		{
+			nearest = sn->distance;
+			index = i;
+		}
+	}
+
+	distance = nearest;
+	sonarNearest = index;
+
+	/* Only a state change marks the link dirty */
+	linkSetWarning(sonarWarningUpdate());
+}
+
+/*
+ * @brief Function that handles one echo edge of a sensor. Called from the capture interrupts.
+ * @param sensor: sensor index
+ * @param high: timer overflows at the edge
+ * @param low: captured counter value
+ * @param period: timer period (ARR + 1)
+ * @return None
+ */
+static void sonarEdge(int sensor, uint32_t high, uint32_t low, uint32_t period)
+{
+	SonarSensor *sn = &sonarSensors[sensor];
+	const SonarConfig *cfg = &sonarConfig[sensor];
+
+	/* Outside its own window the edge is crosstalk or a late echo */
+	if (!sn->listening)
+		return;
+
+	if (cfg->echoPort->IDR & (0b1 << cfg->echoPin))
+	{
+		/* Rising edge, echo starts */
+		sn->riseHigh = high;
+		sn->riseLow = low;
+		sn->armed = 1;
+	}
+	else if (sn->armed)
+	{
+		/* Falling edge, echo ends */
+		uint32_t width = (high - sn->riseHigh) * period + low - sn->riseLow;
+
+		sn->echoUs = width;
+		sn->raw = (int)(width * 68 / 1000) - 10; /* 0.034 cm/us / 2 / 2.5 cm/in, minus 1 in */
+		sn->seq++;
+		sn->armed = 0;
+		sn->listening = 0;
 	}
-	else I2C1_byteWrite(slave, 0, 0x60);
 }
 
 /*
-* @brief Function to read the echo from the sonar sensor
+ * @brief Function that extends a capture with the timer overflow count
+ * @param sr: timer status register at entry
+ * @param overflows: overflows counted so far
+ * @param low: captured counter value
+ * @param period: timer period (ARR + 1)
+ * @return Overflow count that belongs to the capture
+ */
+static uint32_t sonarHigh(uint32_t sr, uint32_t overflows, uint32_t low, uint32_t period)
+{
+	/* Overflow not counted yet but the capture came after it */
+	if ((sr & 0b1) && low < period / 2)
+		return overflows + 1;
+
+	return overflows;
+}
+
+/*
+ * @brief Interrupt handler for TIM3: echo of sensor 0 on CH1
+ * @details TIM3 also drives the backlight PWM on CH2, so the counter period is ARR + 1
+ * 			(not 65536) and the edges are extended with the number of update events.
  * @param None
  * @return None
  */
-void readEcho(void)
+void TIM3_IRQHandler(void)
 {
-    // Wait for a rising edge
-    while ((TIM3->SR & 2) == 0);
-    current = TIM3->CCR1;         // Log the current timestamp of the rising edge
-    timeElapsed = current - last; // difference from the last recorded reading
-    last = current;               // set the current reading as the last reading
+	PROFILE_ZONE(PROF_ZONE_ISR_SONAR_ECHO);
+
+	uint32_t sr = TIM3->SR;
+	uint32_t period = TIM3->ARR + 1;
+
+	/* Overcapture, an edge was lost */
+	if (sr & (0b1 << 9))
+	{
+		TIM3->SR = ~(0b1 << 9);
+		sonarSensors[0].armed = 0;
+	}
+
+	if (sr & (0b1 << 1))
+	{
+		uint32_t low = TIM3->CCR1; /*Clears CC1IF*/
+		sonarEdge(0, sonarHigh(sr, tim3Overflows, low, period), low, period);
+	}
+
+	/* Overflow */
+	if (sr & 0b1)
+	{
+		TIM3->SR = ~0b1;
+		tim3Overflows++;
+	}
 }
 
+#if SONAR_COUNT > 1
 /*
- * @brief Function to calculate the distance based on the time elapsed
- * @param time Time elapsed in microseconds
+ * @brief Interrupt handler for TIM12: echoes of sensor 1 on CH1 and sensor 2 on CH2
+ * @param None
  * @return None
  */
-void calculateDistance(double time)
+void TIM8_BRK_TIM12_IRQHandler(void)
 {
-    double prev = distance;
+	PROFILE_ZONE(PROF_ZONE_ISR_SONAR_ECHO);
 
-    // Convert pulse width from time to distance
-    distance = (0.034 * time) / 2; // cm
+	uint32_t sr = TIM12->SR;
 
-    // convert to inches
-    distance = distance / 2.5;
+	if (sr & ((0b1 << 9) | (0b1 << 10)))
+	{
+		TIM12->SR = ~((0b1 << 9) | (0b1 << 10));
+		if (sr & (0b1 << 9))
+			sonarSensors[1].armed = 0;
+#if SONAR_COUNT > 2
+		if (sr & (0b1 << 10))
+			sonarSensors[2].armed = 0;
+#endif
+	}
 
-    // Taking into account that the sonar has corrupted values below 1 inches
-    distance = distance - 1;
+	if (sr & (0b1 << 1))
+	{
+		uint32_t low = TIM12->CCR1;
+		sonarEdge(1, sonarHigh(sr, tim12Overflows, low, 65536), low, 65536);
+	}
 
-    // limit the distance reading to positive distance
-    if (distance < 0)
-        distance = prev;
+#if SONAR_COUNT > 2
+	if (sr & (0b1 << 2))
+	{
+		uint32_t low = TIM12->CCR2;
+		sonarEdge(2, sonarHigh(sr, tim12Overflows, low, 65536), low, 65536);
+	}
+#endif
 
-    // limit corrupted readings
-    if (distance > 100)
-        distance = prev;
+	if (sr & 0b1)
+	{
+		TIM12->SR = ~0b1;
+		tim12Overflows++;
+	}
 }
+#endif
 
+#if SONAR_COUNT > 3
 /*
- * @brief Function to initialize the sonar sensor
+ * @brief Interrupt handler for TIM9: echo of sensor 3 on CH1
  * @param None
  * @return None
  */
-void sonarInit(void){
+void TIM1_BRK_TIM9_IRQHandler(void)
+{
+	PROFILE_ZONE(PROF_ZONE_ISR_SONAR_ECHO);
 
-	sonarTrigger_Init();
-	sonarEcho_Init();
+	uint32_t sr = TIM9->SR;
+
+	if (sr & (0b1 << 9))
+	{
+		TIM9->SR = ~(0b1 << 9);
+		sonarSensors[3].armed = 0;
+	}
 
+	if (sr & (0b1 << 1))
+	{
+		uint32_t low = TIM9->CCR1;
+		sonarEdge(3, sonarHigh(sr, tim9Overflows, low, 65536), low, 65536);
+	}
+
+	if (sr & 0b1)
+	{
+		TIM9->SR = ~0b1;
+		tim9Overflows++;
+	}
 }
+#endif
 
 /*
- * @brief Function to initialize the sonar trigger pin
+ * @brief Interrupt handler for TIM2: slot start (update) and end of trigger pulse (CC1)
+ * @details Runs at the same priority as the capture interrupts, so it never preempts them.
  * @param None
  * @return None
  */
-void sonarTrigger_Init(void){
+void TIM2_IRQHandler(void)
+{
+	PROFILE_ZONE(PROF_ZONE_ISR_SONAR_SLOT);
+
+	uint32_t sr = TIM2->SR;
+
+	/* End of trigger pulse */
+	if (sr & (0b1 << 1))
+	{
+		TIM2->SR = ~(0b1 << 1);
+		for (int i = 0; i < SONAR_COUNT; i++)
+			sonarConfig[i].trigPort->BSRR = (0b1 << (sonarConfig[i].trigPin + 16));
+	}
+
+	/* New slot */
+	if (sr & 0b1)
+	{
+		uint8_t groupsUsed = 0;
+
+		TIM2->SR = ~0b1;
+		sonarSlot++;
+
+		/* Close the previous windows */
+		for (int i = 0; i < SONAR_COUNT; i++)
+		{
+			SonarSensor *sn = &sonarSensors[i];
+
+			if (sn->listening)
+			{
+				sn->raw = SONAR_NO_ECHO;
+				sn->seq++;
+				sn->listening = 0;
+				sn->armed = 0;
+			}
+		}
+
+		/* Round robin over the sensors that are due, one per group */
+		for (int k = 0; k < SONAR_COUNT; k++)
+		{
+			int i = (sonarNext + k) % SONAR_COUNT;
+			SonarSensor *sn = &sonarSensors[i];
+			const SonarConfig *cfg = &sonarConfig[i];
+
+			if ((groupsUsed & (0b1 << cfg->group)) || (int32_t)(sonarSlot - sn->nextSlot) < 0)
+				continue;
+
+			groupsUsed |= (0b1 << cfg->group);
+			sn->nextSlot = sonarSlot + cfg->interval;
+			sn->listening = 1;
+			sn->pings++;
+			cfg->trigPort->BSRR = (0b1 << cfg->trigPin);
+			sonarNext = (i + 1) % SONAR_COUNT;
+		}
+	}
+}
+
+/*
+ * @brief Function to filter a distance reading: plausibility, median of SONAR_MEDIAN_LEN, then EMA
+ * @param sensor Sensor index
+ * @param raw Distance in tenths of an inch, or SONAR_NO_ECHO
+ * @return None
+ */
+void calculateDistance(int sensor, int raw)
+{
+    SonarSensor *sn = &sonarSensors[sensor];
+    int sorted[SONAR_MEDIAN_LEN];
+    int n;
+    int median;
+
+    // drop readings below the sensor's corrupted range
+    if (raw < 0)
+        return;
+
+    // nothing in range, start over
+    if (raw > SONAR_MAX_DISTANCE)
+    {
+        sn->windowCount = 0;
+        sn->windowIndex = 0;
+        sn->valid = 0;
+        return;
+    }
+
+    sn->window[sn->windowIndex] = raw;
+    sn->windowIndex = (sn->windowIndex + 1) % SONAR_MEDIAN_LEN;
+    if (sn->windowCount < SONAR_MEDIAN_LEN)
+        sn->windowCount++;
+
+    // insertion sort of the (small) window
+    n = sn->windowCount;
+    for (int i = 0; i < n; i++)
+    {
+        int v = sn->window[i];
+        int j = i;
+        while (j > 0 && sorted[j - 1] > v)
+        {
+            sorted[j] = sorted[j - 1];
+            j--;
+        }
+        sorted[j] = v;
+    }
+    median = sorted[n / 2];
+
+    // exponential filter, seeded with the first median
+    if (n == 1)
+        sn->filterQ8 = median << 8;
+    else
+        sn->filterQ8 += ((median << 8) - sn->filterQ8) >> SONAR_EMA_SHIFT;
 
-	    /* GPIO PA5 PWM Output Initilization */
-    RCC->AHB1ENR |= SONAR_TRIG_CLK;
-    SONAR_TRIG_PORT->MODER &= ~(0b11 << (SONAR_TRIG_PIN * 2)); // Clear
-    SONAR_TRIG_PORT->MODER |= (0b10 << (SONAR_TRIG_PIN * 2));  // Set Pin 5 to alternate
+    sn->distance = sn->filterQ8 >> 8;
+    sn->valid = 1;
+}
+
+/*
+ * @brief Function that updates the warning state from the nearest distance
+ * @param None
+ * @return 1 if the warning is active, 0 otherwise
+ */
+int sonarWarningUpdate(void)
+{
+    uint32_t now = getMicros();
+    int next = sonarWarning;
+
+    if (!sonarWarning && distance < SONAR_WARN_ON)
+        next = 1;
+    else if (sonarWarning && distance > SONAR_WARN_OFF)
+        next = 0;
+
+    if (next != sonarWarning && (now - sonarWarningSince) >= SONAR_MIN_DWELL_US)
+    {
+        sonarWarning = next;
+        sonarWarningSince = now;
+        sonarWarningToggles++;
+    }
+
+    return sonarWarning;
+}
+
+/*
+ * @brief Function to initialize the sonar sensors
+ * @param None
+ * @return None
+ */
+void sonarInit(void){
 
-    /* Initilize TIM2 CH 1 */
-    // AFR[0] = includes Pins 0-7
-    // AFR[1] = includes PIns 8-15
-    // Each Pin has 4 bits to set which AFR 0-15
-    SONAR_TRIG_PORT->AFR[0] &= ~0x00F00000; // Clear
-    SONAR_TRIG_PORT->AFR[0] |= 0x00100000;  // 0b0001 = 1 (AF1) on Pin 5
+	sonarTrigger_Init();
+	sonarEcho_Init();
 
-    /* Enable TIM3 Clocks */
-    RCC->APB1ENR |= SONAR_TRIG_CLK;     // TIM2 Clock
-    TIM2->PSC = 16 - 1;    // Scale down to 1Mhz
-    TIM2->ARR = 65000 - 1; // Reload with a count of 650000 (65ms)
+}
 
-    /* Set PWM */
-    TIM2->CNT = 0;          // Clear
-    TIM2->CCMR1 |= 0x60;    // PWM Mode 1 (0b110)
-    TIM2->CCER |= (1 << 0); // enable PWM output
-    TIM2->CCR1 = 65000 - 5; // Pulse width (CCR1/ARR) = Duty Cycle
-    TIM2->CR1 |= (1 << 0);  // Enable timer
+/*
+ * @brief Function to initialize the trigger pins and the TIM2 slot timer
+ * @param None
+ * @return None
+ */
+void sonarTrigger_Init(void){
 
+    /* Trigger pins are outputs (low) from boardInit(), pulsed from the slot interrupt */
+    for (int i = 0; i < SONAR_COUNT; i++)
+        sonarSensors[i].nextSlot = 0;
 
+    /* TIM2: one update per slot, CC1 ends the trigger pulse */
+    RCC->APB1ENR |= (0b1 << 0);     // TIM2 Clock
+    TIM2->CR1 = 0;
+    TIM2->PSC = CLOCK_APB1_PSC_1MHZ; // Scale down to 1Mhz
+    TIM2->ARR = SONAR_SLOT_US - 1;   // One listening window
+    TIM2->CCR1 = SONAR_TRIG_US;      // Trigger pulse width
+    TIM2->CNT = 0;
+    TIM2->EGR = 1;
+    TIM2->SR = 0;
+    TIM2->DIER = (1 << 1) | (1 << 0); // CC1 and update interrupt
+    NVIC_EnableIRQ(TIM2_IRQn);
+    TIM2->CR1 |= (1 << 0);           // Enable timer
 }
 
 /*
- * @brief Function to initialize the sonar echo pin
+ * @brief Function to initialize the echo pins and capture timers
  * @param None
  * @return None
  */
 void sonarEcho_Init(void){
 
-	RCC->AHB1ENR |= SONAR_ECHO_CLK;		// Set Clock
-	SONAR_ECHO_PORT->MODER &= ~(0b11 << (SONAR_ECHO_PIN * 2));		// Clear
-	SONAR_ECHO_PORT->MODER |= (0b10 << (SONAR_ECHO_PIN * 2));			// Set Pin 4 Alternate Function
+	/* Echo pins are set up by boardInit() */
 
-	/* Initilize TIM3 Channel 1 */
-	SONAR_ECHO_PORT->AFR[0] &= ~0x000F0000;							// Clear
-	SONAR_ECHO_PORT->AFR[0] |= 0x00020000;								// 0b0010 = 2 (AF2) on pin
+	/* Sensor 0: PB4, TIM3 CH1. The TIM3 base is shared with the backlight, only CH1 is touched */
+	TIM3->CCMR1 = (TIM3->CCMR1 & ~0x00FF) | 0xC1;	// CH1 Input Capture, sample/16 N = 8
+	TIM3->CCER = (TIM3->CCER & ~0x000F) | 0x0B;	// Enable Capture both edges
+	TIM3->SR = ~((0b1 << 1) | (0b1 << 0));
+	TIM3->DIER |= (1 << 1) | (1 << 0);	// CC1 and update interrupt
+	NVIC_EnableIRQ(TIM3_IRQn);
 
-	RCC->APB1ENR |= SONAR_ECHO_CLK;		// TIM3 Clock
-	TIM3->PSC = 16 - 1;		// Scale down to 1Mhz
-	TIM3->CCMR1 = 0xC1;		// CH1 Input Capture, sample/16 N = 8
-	TIM3->CCER = 0x0B;		// Enable Capture both edges
-	TIM3->CR1 = 1; 				// Enable TIM3
+#if SONAR_COUNT > 1
+	/* Sensors 1 and 2: PB14, PB15, TIM12 CH1 and CH2 */
+	RCC->APB1ENR |= (0b1 << 6);		// TIM12 Clock
+	TIM12->PSC = CLOCK_APB1_PSC_1MHZ;	// Scale down to 1Mhz
+	TIM12->ARR = 0xFFFF;
+	TIM12->CCMR1 = 0xC1C1;		// CH1 and CH2 Input Capture, sample/16 N = 8
+	TIM12->CCER = (SONAR_COUNT > 2) ? 0xBB : 0x0B;	// Capture both edges
+	TIM12->SR = 0;
+	TIM12->DIER = ((SONAR_COUNT > 2) ? (1 << 2) : 0) | (1 << 1) | (1 << 0);
+	TIM12->CR1 = 1;
+	NVIC_EnableIRQ(TIM8_BRK_TIM12_IRQn);
+#endif
 
+#if SONAR_COUNT > 3
+	/* Sensor 3: PA2, TIM9 CH1 */
+	RCC->APB2ENR |= (0b1 << 16);		// TIM9 Clock
+	TIM9->PSC = CLOCK_APB2_PSC_1MHZ;	// Scale down to 1Mhz
+	TIM9->ARR = 0xFFFF;
+	TIM9->CCMR1 = 0xC1;		// CH1 Input Capture, sample/16 N = 8
+	TIM9->CCER = 0x0B;		// Capture both edges
+	TIM9->SR = 0;
+	TIM9->DIER = (1 << 1) | (1 << 0);
+	TIM9->CR1 = 1;
+	NVIC_EnableIRQ(TIM1_BRK_TIM9_IRQn);
+#endif
 }
@@ -1,120 +1,232 @@
 /*
  * @file speed_sensor.c
  * @brief Speed sensor module for RPM and MPH calculation
- * 
+ * @details The hall sensor on PB6 (TIM4 CH1) is timestamped by input capture at 1 MHz.
+ * 			The 16-bit counter is extended to 32 bits by counting update (overflow) events,
+ * 			so every pulse period is measured in hardware regardless of main loop latency.
+ *
+ * 			Capture stays on over the whole gauge: at 100 mph that is about 31 interrupts
+ * 			a second, each period still resolved to 1 us. Counting pulses per TIM7 window
+ * 			instead would leave only 6 or 7 pulses per window there, an error of one pulse
+ * 			per window (about 16%) on the reading.
+ *
+ * 			Every period goes into a HALL_FILTER_LEN moving average kept as a running sum,
+ * 			so the filter costs the same on every pulse. calculateRPM() turns the average
+ * 			into Q16 rpm and mph with one integer division each.
+ *
+ * 			Distance is the pulse count itself: odometerPulses and tripPulses are 64-bit
+ * 			counters bumped in the capture path and only converted to 0.1 mile when read.
+ *
  * @author: Aeron Lahoylahoy
  * @date: June 27, 2024
  */
 
 #include "speed_sensor.h"
+#include "scheduler.h"
+#include "profiler.h"
 
 /* Variables */
-int hallEffectFlag = 0;
-float rpm;
-float mph;
-float cumulativeMiles = 0;
-float rpmAverage = 0;
-float rpmSum = 0;
-int rpmSumCounter = 0;
-int resetMilesFlag = 0;
+uint32_t speedRpmQ16 = 0;
+uint32_t speedMphQ16 = 0;
+
+/* Hall Capture */
+volatile uint32_t hallPeriodUs = 0;	  /* us per pulse, 0 = stopped */
+volatile uint64_t odometerPulses = 0; /* pulses since the stored miles, cleared by reset */
+volatile uint64_t tripPulses = 0;	  /* pulses since power up */
+uint32_t hallOverflows = 0;
+uint32_t hallLastCapture = 0;
+int hallHaveEdge = 0;
+
+/* Period Filter */
+uint32_t hallFilter[HALL_FILTER_LEN];
+volatile uint32_t hallFilterSum = 0;
+volatile int hallFilterCount = 0;
+int hallFilterIndex = 0;
 
-int mileCounter = 0;
-int mileFlag = 0;
-
-int speedVal[20] = {0, 5, 10, 15, 20, 25, 30, 35, 40,
-                    50, 55, 60, 65, 70, 75, 80, 85, 90, 95, 100};
+/*
+ * @brief Function that adds one period to the moving average
+ * @param period: pulse period in us
+ * @return None
+ */
+static void hallFilterPush(uint32_t period)
+{
+	if (hallFilterCount < HALL_FILTER_LEN)
+		hallFilterCount++;
+	else
+		hallFilterSum -= hallFilter[hallFilterIndex];
 
-int speedIndex = 0;
+	hallFilter[hallFilterIndex] = period;
+	hallFilterSum += period;
+	hallFilterIndex = (hallFilterIndex + 1) & (HALL_FILTER_LEN - 1);
+}
 
 /*
- * @brief Function to detect hall effect sensor signal
+ * @brief Function that empties the moving average (wheel stopped)
  * @param None
  * @return None
  */
-void speedSensorHallDetected(void){
-	hallEffectFlag++;
-	if(hallEffectFlag > 2) hallEffectFlag = 2;
+static void hallFilterClear(void)
+{
+	hallFilterSum = 0;
+	hallFilterCount = 0;
+	hallFilterIndex = 0;
 }
 
 /*
- * @brief Function to initialize the RPM reader
+ * @brief Function to initialize the RPM reader (TIM4 CH1 input capture on PB6)
  * @param None
  * @return None
  */
 void rpmReaderInit(void)
 {
-
-	RCC->AHB1ENR |= Bclk;
-	GPIOB->MODER &= ~(0b11 << (6 * 2));
-	GPIOB->MODER |= (0b01 << (6 * 2));
-
-	GPIOB->AFR[0] &= ~0x0F000000;
-	GPIOB->AFR[0] |= 0x02000000;
-
+	/* PB6 (AF2, pull up) is set up by boardInit() */
 	RCC->APB1ENR |= 4;
-	TIM4->PSC = 1600;
-	// TIM4->ARR = 250;
-	TIM4->CCMR1 = 0x30;
-	TIM4->CCR1 = 0;
-	TIM4->CCER |= 1;
-	TIM4->CNT = 0;
 	TIM4->CR1 = 0;
+	TIM4->ARR = 0xFFFF;
+	TIM4->CCMR1 = 0xF1;				 /*CC1 input on TI1, filter fDTS/32 N=8*/
+	TIM4->CCER &= ~((0b1 << 1) | (0b1 << 3)); /*Rising edge*/
+	TIM4->PSC = HALL_PSC;			 /*1 MHz*/
+	TIM4->EGR = 1;					 /*Load prescaler, clear counter*/
+	TIM4->SR = 0;
+	hallOverflows = 0;
+	hallHaveEdge = 0;
+	hallPeriodUs = 0;
+	hallFilterClear();
+	TIM4->CCER |= (0b1 << 0);		 /*Capture enable*/
+	TIM4->DIER = (0b1 << 1) | (0b1 << 0); /*CC1 and update interrupt*/
+
+	NVIC_EnableIRQ(TIM4_IRQn);
+	TIM4->CR1 = 1;
 }
 
 /*
- * @brief Function to calculate RPM
+ * @brief Interrupt handler for TIM4: pulse capture and counter overflow
  * @param None
  * @return None
  */
-void calculateRPM(void){
-	double timeElapsed = 0;
-	float rpmPrev = rpm;
-	rpmSumCounter++;
+RAMFUNC void TIM4_IRQHandler(void)
+{
+	PROFILE_ZONE(PROF_ZONE_ISR_HALL);
 
-	timeElapsed = endTime;
+	uint32_t sr = TIM4->SR;
 
-	if (timeElapsed == 0)
+	/* Pulse */
+	if (sr & (0b1 << 1))
 	{
-		rpmAverage = 0;
-		calculateMPH();
+		uint32_t high = hallOverflows;
+		uint16_t ccr = TIM4->CCR1; /*Clears CC1IF*/
+		uint32_t stamp;
+
+		/* Overflow not counted yet but the capture came after it */
+		if ((sr & 0b1) && ccr < 0x8000)
+			high++;
+		stamp = (high << 16) | ccr;
+
+		if (hallHaveEdge)
+		{
+			hallPeriodUs = stamp - hallLastCapture;
+			hallFilterPush(hallPeriodUs);
+			schedulerSignal(SCHED_TASK_SPEED);
+		}
+		hallLastCapture = stamp;
+		hallHaveEdge = 1;
+		odometerPulses++;
+		tripPulses++;
 	}
-	else
-	{
-
-		rpm = 60 / ((timeElapsed / 10000) * 2);
-	}
-	rpmSum = rpm + rpmSum;
 
-	if (rpmSumCounter == 7)
+	/* Overflow */
+	if (sr & 0b1)
 	{
-		rpmAverage = rpmSum / rpmSumCounter;
-		calculateMPH();
-		rpmSum = 0;
-		rpmSumCounter = 0;
+		TIM4->SR = ~0b1;
+		hallOverflows++;
+
+		/* No pulse for too long */
+		if (hallHaveEdge && ((hallOverflows << 16) - hallLastCapture) > HALL_STALL_US)
+		{
+			hallPeriodUs = 0;
+			hallHaveEdge = 0;
+			hallFilterClear();
+			schedulerSignal(SCHED_TASK_SPEED);
+		}
 	}
 }
 
 /*
- * @brief Function to calculate MPH
+ * @brief Function to calculate RPM and MPH (Q16) from the filtered pulse period
  * @param None
  * @return None
  */
-void calculateMPH(void){
-	static int sumCounter;
-	float mphPrev = mph;
+void calculateRPM(void){
+	uint32_t primask;
+	uint32_t sum;
+	int count;
+	uint32_t period;
+	uint64_t mphQ16;
+
+	primask = __get_PRIMASK();
+	__disable_irq();
+	sum = hallFilterSum;
+	count = hallFilterCount;
+	__set_PRIMASK(primask);
+
+	if (count == 0)
+	{
+		speedRpmQ16 = 0;
+		speedMphQ16 = 0;
+		return;
+	}
+
+	period = sum / count;
+	if (period == 0)
+		return;
 
-	mph = ((rpmAverage * 2 * 3.145 * 1.5 * 60) / 5280);
+	/* Reject readings above the gauge range, before narrowing: a period under 50 us
+	   would wrap the 32-bit quotient back into range */
+	mphQ16 = HALL_MPH_K_Q16 / period;
+	if (mphQ16 > SPEED_MAX_MPH_Q16)
+		return;
 
-	if (mph > 100)
-		mph = mphPrev;
+	speedRpmQ16 = (uint32_t)(HALL_RPM_K_Q16 / period);
+	speedMphQ16 = (uint32_t)mphQ16;
 }
 
 /*
- * @brief Function to update cumulative miles
- * @param None
+ * @brief Function that reads a 64-bit pulse counter without tearing
+ * @param counter: odometerPulses or tripPulses
+ * @return Pulse count
+ */
+uint64_t speedReadPulses(volatile uint64_t *counter)
+{
+	uint32_t primask = __get_PRIMASK();
+	uint64_t pulses;
+
+	__disable_irq();
+	pulses = *counter;
+	__set_PRIMASK(primask);
+
+	return pulses;
+}
+
+/*
+ * @brief Function that clears a 64-bit pulse counter
+ * @param counter: odometerPulses or tripPulses
  * @return None
  */
-void updateCumulativeMiles(void){
-	cumulativeMiles = ((mph / 3600) + cumulativeMiles);
+void speedResetPulses(volatile uint64_t *counter)
+{
+	uint32_t primask = __get_PRIMASK();
+
+	__disable_irq();
+	*counter = 0;
+	__set_PRIMASK(primask);
 }
 
+/*
+ * @brief Function that converts hall pulses to distance
+ * @param pulses: pulse count
+ * @return Distance in 0.1 mile, rounded down
+ */
+uint32_t pulsesToTenths(uint64_t pulses)
+{
+	return (uint32_t)(pulses * WHEEL_CIRCUMFERENCE_UFT / (TENTH_MILE_UFT * HALL_PULSES_PER_REV));
+}
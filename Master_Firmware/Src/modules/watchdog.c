@@ -0,0 +1,119 @@
+/*
+ * @file 	watchdog.c
+ * @brief 	Watchdog supervisor for the periodic tasks
+ * @details Each periodic task registers a budget and checks in when it runs. The
+ * 			supervisor refreshes the IWDG only when every registered task has checked
+ * 			in within its budget, so one stalled task is enough to reset the chip.
+ * 			The longest interval seen per task is kept for diagnostics.
+ *
+ * @author: Aeron Lahoylahoy
+ * @date: June 27, 2024
+ */
+#include "stm32f4xx.h"
+#include "stm32f446xx.h"
+#include "watchdog.h"
+#include "timebase.h"
+#include "flags.h"
+#include "controls.h"
+#include "link.h"
+
+WatchDogTask watchDogTasks[WDG_TASK_COUNT];
+uint32_t watchDogKicks = 0;
+uint32_t watchDogHolds = 0;
+
+/*
+ * @brief Function that starts the IWDG with a 1 second timeout.
+ * @details Check-in times restart here so the time spent in start up isn't counted.
+ * @param None
+ * @return None
+ */
+void watchDogInit(void)
+{
+	uint32_t now = getMicros();
+
+	for (int i = 0; i < WDG_TASK_COUNT; i++)
+		watchDogTasks[i].last = now;
+
+	IWDG->KR = 0x5555;		   // config key for watchdog timer
+	IWDG->PR = WDG_PRESCALER;  // set 8 divider
+	IWDG->RLR = WDG_RELOAD;	   // resets 1 second
+	IWDG->KR = 0xAAAA;		   // load the counter
+	IWDG->KR = 0xCCCC;		   // enable watchdog timer
+}
+
+/*
+ * @brief Function that adds a task to the supervisor.
+ * @param task: WDG_TASK_x
+ * @param budgetUs: longest allowed time between check-ins
+ * @return None
+ */
+void watchDogRegister(int task, uint32_t budgetUs)
+{
+	WatchDogTask *t = &watchDogTasks[task];
+
+	t->last = getMicros();
+	t->worst = 0;
+	t->checkins = 0;
+	t->overruns = 0;
+	t->budget = budgetUs;
+}
+
+/*
+ * @brief Function that records a task run. Safe from interrupts.
+ * @param task: WDG_TASK_x
+ * @return None
+ */
+void watchDogCheckIn(int task)
+{
+	WatchDogTask *t = &watchDogTasks[task];
+	uint32_t now = getMicros();
+	uint32_t interval = now - t->last;
+
+	if (interval > t->worst)
+		t->worst = interval;
+	t->last = now;
+	t->checkins++;
+}
+
+/*
+ * @brief Function that refreshes the IWDG when every task is within its budget.
+ * @details The Watch Dog button holds the refresh to demonstrate a reset.
+ * @param None
+ * @return None
+ */
+void watchDogCheck(void)
+{
+	uint32_t now = getMicros();
+	int late = 0;
+
+	if (flagTest(FLAG_WATCHDOG))
+	{
+		if (!(linkState.flags & LINK_FLAG_WATCHDOG))
+		{
+			linkState.flags |= LINK_FLAG_WATCHDOG;
+			linkDirty = 1;
+		}
+		watchDogHolds++;
+		return;
+	}
+
+	for (int i = 0; i < WDG_TASK_COUNT; i++)
+	{
+		WatchDogTask *t = &watchDogTasks[i];
+
+		if (t->budget && (now - t->last) > t->budget)
+		{
+			t->overruns++;
+			late = 1;
+		}
+	}
+
+	if (late)
+	{
+		watchDogHolds++;
+		return;
+	}
+
+	IWDG->KR = 0xAAAA; // refresh watchdog timer
+	watchDogKicks++;
+}
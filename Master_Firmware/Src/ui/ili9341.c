@@ -11,6 +11,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include "bitmap_typedefs.h"
+#include "soft_timer.h"
 
 // standard ascii 5x7 font
 // originally from glcdfont.c from Adafruit project
@@ -276,31 +277,16 @@ static uint16_t ILI_TFTwidth   = TFT_WIDTH;
 static uint16_t ILI_TFTheight  = TFT_HEIGHT;
 static uint8_t ILI_Orientation = 0;
 
+/* Power-up sequence, run from a soft timer instead of busy delays */
+#define ILI_INIT_WAIT_US 50000
+static SoftTimer ILI_InitTimer;
+static uint8_t ILI_InitStep = 0;
+static volatile uint8_t ILI_Ready = 0;
+
 
 /*****************************************************************************/
 //                          USER FUNCTION DEFINITIONS
 /*****************************************************************************/
-void SysTick_Init(void)
-{
-  SysTick->CTRL = 0;
-  SysTick->LOAD = 0x00FFFFFF;
-  SysTick->VAL  = 0;
-  SysTick->CTRL |= 5;
-}
-
-void delayMS(uint16_t n)
-{
-  SysTick->LOAD = ((n * 16000) - 1);
-  SysTick->VAL  = 0;
-  while ((SysTick->CTRL & 0x00010000) == 0) {}
-}
-
-void delayMicroS(uint16_t n)
-{
-	SysTick->LOAD = ((n * 16) - 1);
-	SysTick->VAL 	= 0;
-	while ((SysTick->CTRL & 0x00010000) == 0) {}
-}
 //------------ST7735_DrawString------------
 // String draw function.
 // 16 rows (0 to 15) and 21 characters (0 to 20)
@@ -576,7 +562,7 @@ void Draw_Bitmap(uint16_t x, uint16_t y, const tImage16bit *bitmap)
 }
 // Send two bytes of data, most significant byte first
 // Requires 2 bytes of transmission
-void static pushColor(uint16_t color) {
+RAMFUNC void static pushColor(uint16_t color) {
   ILI_8Bit_Data((uint8_t)(color >> 8));
   ILI_8Bit_Data((uint8_t)color);
 }
@@ -782,7 +768,7 @@ void Draw_Line(uint16_t x0, uint16_t y0, uint16_t x1, uint16_t y1,
 //               must be less than 320
 //               319 is near the wires, 0 is the side opposite the wires
 // Output: none
-void Draw_Pixel(uint16_t x, uint16_t y, uint16_t color)
+RAMFUNC void Draw_Pixel(uint16_t x, uint16_t y, uint16_t color)
 {
   RESET_LCD_CS;
   Set_Address_Window(x, y, x, y);
@@ -864,16 +850,9 @@ void Rotate_Display(uint8_t rotation)
   SET_LCD_CS;
 }
 
-void Display_Init(void)
+/* Register setup sent after the reset pulse, ends with Sleep Out */
+static void ILI_Configure(void)
 {
-  GPIO_PinMode_Setup();
-
-  SET_LCD_RST;
-  delayMS(50);
-  RESET_LCD_RST;
-  delayMS(50);
-  SET_LCD_RST;
-
   RESET_LCD_CS;
   ILI_8Bit_Command(0xEF);
   ILI_8Bit_Data(0x03);
@@ -979,57 +958,50 @@ void Display_Init(void)
   ILI_8Bit_Data(0x0F);
 
   ILI_8Bit_Command(ILI_SLPOUT); // Wake Up Display
-  delayMS(50);
-  ILI_8Bit_Command(ILI_DISPON); // Display On
-  delayMS(50);
-  SET_LCD_CS;
+}
 
-  Fill_Screen(BLACK); // Begin black screen, Portrait mode
-  Rotate_Display(0);
+/* One step of the power-up sequence per ILI_INIT_WAIT_US */
+static void ILI_InitNext(void)
+{
+  switch (ILI_InitStep++)
+  {
+  case 0:
+    RESET_LCD_RST;
+    break;
+
+  case 1:
+    SET_LCD_RST;
+    ILI_Configure();
+    break;
+
+  case 2:
+    ILI_8Bit_Command(ILI_DISPON); // Display On
+    break;
+
+  default:
+    SET_LCD_CS;
+    Fill_Screen(BLACK); // Begin black screen, Portrait mode
+    Rotate_Display(0);
+    ILI_Ready = 1;
+    return;
+  }
+  softTimerStart(&ILI_InitTimer, ILI_INIT_WAIT_US, 0, ILI_InitNext);
 }
 
-void GPIO_PinMode_Setup(void)
+void Display_Init(void)
 {
-  RCC->AHB1ENR |= 1 | 2 | 4;
-
-  /* Clear pin modes */
-  LCD_RST_PORT->MODER &= ~(3 << (LCD_RST * 2));
-  LCD_CS_PORT->MODER &= ~(3 << (LCD_CS * 2));
-  LCD_RS_PORT->MODER &= ~(3 << (LCD_RS * 2));
-  LCD_WR_PORT->MODER &= ~(3 << (LCD_WR * 2));
-  LCD_RD_PORT->MODER &= ~(3 << (LCD_RD * 2));
-  LCD_D0_PORT->MODER &= ~(3 << (LCD_D0 * 2));
-  LCD_D1_PORT->MODER &= ~(3 << (LCD_D1 * 2));
-  LCD_D2_PORT->MODER &= ~(3 << (LCD_D2 * 2));
-  LCD_D3_PORT->MODER &= ~(3 << (LCD_D3 * 2));
-  LCD_D4_PORT->MODER &= ~(3 << (LCD_D4 * 2));
-  LCD_D5_PORT->MODER &= ~(3 << (LCD_D5 * 2));
-  LCD_D6_PORT->MODER &= ~(3 << (LCD_D6 * 2));
-  LCD_D7_PORT->MODER &= ~(3 << (LCD_D7 * 2));
-
-  /* Set pin modes to output */
-  LCD_RST_PORT->MODER |= (1 << (LCD_RST * 2));
-  LCD_CS_PORT->MODER |= (1 << (LCD_CS * 2));
-  LCD_RS_PORT->MODER |= (1 << (LCD_RS * 2));
-  LCD_WR_PORT->MODER |= (1 << (LCD_WR * 2));
-  LCD_RD_PORT->MODER |= (1 << (LCD_RD * 2));
-  LCD_D0_PORT->MODER |= (1 << (LCD_D0 * 2));
-  LCD_D1_PORT->MODER |= (1 << (LCD_D1 * 2));
-  LCD_D2_PORT->MODER |= (1 << (LCD_D2 * 2));
-  LCD_D3_PORT->MODER |= (1 << (LCD_D3 * 2));
-  LCD_D4_PORT->MODER |= (1 << (LCD_D4 * 2));
-  LCD_D5_PORT->MODER |= (1 << (LCD_D5 * 2));
-  LCD_D6_PORT->MODER |= (1 << (LCD_D6 * 2));
-  LCD_D7_PORT->MODER |= (1 << (LCD_D7 * 2));
-
-  /* Pull control pins to HIGH (idle state) */
-  SET_LCD_CS;
-  SET_LCD_RS;
-  SET_LCD_WR;
-  SET_LCD_RD;
+  ILI_Ready = 0;
+  ILI_InitStep = 0;
+  SET_LCD_RST;
+  softTimerStart(&ILI_InitTimer, ILI_INIT_WAIT_US, 0, ILI_InitNext);
+}
+
+uint8_t Display_Ready(void)
+{
+  return ILI_Ready;
 }
 
-void ILI_8Bit_Command(uint8_t command)
+RAMFUNC void ILI_8Bit_Command(uint8_t command)
 {
   RESET_LCD_RS; // RS->0 for Command
 
@@ -1051,12 +1023,12 @@ void ILI_8Bit_Command(uint8_t command)
   LCD_D5_PORT->ODR |= ((command & 0x20) >> 5) << LCD_D5;
   LCD_D6_PORT->ODR |= ((command & 0x40) >> 6) << LCD_D6;
   LCD_D7_PORT->ODR |= ((command & 0x80) >> 7) << LCD_D7;
-	delayMicroS(1);
+  LCD_DATA_SETUP;
   RESET_LCD_WR; // Pulse Write Pin
   SET_LCD_WR;
 }
 
-void ILI_8Bit_Data(uint8_t data)
+RAMFUNC void ILI_8Bit_Data(uint8_t data)
 {
   SET_LCD_RS; // RS->1 for Data
 
@@ -1078,7 +1050,7 @@ void ILI_8Bit_Data(uint8_t data)
   LCD_D5_PORT->BSRR |= ((data & 0x20) >> 5) << LCD_D5;
   LCD_D6_PORT->BSRR |= ((data & 0x40) >> 6) << LCD_D6;
   LCD_D7_PORT->BSRR |= ((data & 0x80) >> 7) << LCD_D7;
-	delayMicroS(5);
+  LCD_DATA_SETUP;
   RESET_LCD_WR; // Pulse Write pin
   SET_LCD_WR;
 }
@@ -1117,7 +1089,7 @@ void Set_Address_Window(uint16_t x0, uint16_t y0, uint16_t x1, uint16_t y1)
   ILI_8Bit_Command(ILI_RAMWR);
 }
 
-void Fill_Color(uint16_t color, uint32_t len)
+RAMFUNC void Fill_Color(uint16_t color, uint32_t len)
 {
   /* This draws using 8x8 squares of the image at a time */
   uint16_t blocks = (uint16_t)(len / 64); // 64 pixels/block
@@ -39,6 +39,12 @@ defined in linker script */
 .word  _sdata
 /* end address for the .data section. defined in linker script */
 .word  _edata
+/* start address for the RAM function initialisers (RAMFUNC) in flash. defined in linker script */
+.word  _siramfunc
+/* start address for the RAM functions in SRAM. defined in linker script */
+.word  _sramfunc
+/* end address for the RAM functions in SRAM. defined in linker script */
+.word  _eramfunc
 /* start address for the .bss section. defined in linker script */
 .word  _sbss
 /* end address for the .bss section. defined in linker script */
@@ -63,6 +69,23 @@ Reset_Handler:
 /* Call the clock system initialization function.*/
   bl  SystemInit  
 
+/* Copy the RAM functions (RAMFUNC) from flash to SRAM, before anything calls them */
+  ldr r0, =_sramfunc
+  ldr r1, =_eramfunc
+  ldr r2, =_siramfunc
+  movs r3, #0
+  b LoopCopyRamfuncInit
+
+CopyRamfuncInit:
+  ldr r4, [r2, r3]
+  str r4, [r0, r3]
+  adds r3, r3, #4
+
+LoopCopyRamfuncInit:
+  adds r4, r0, r3
+  cmp r4, r1
+  bcc CopyRamfuncInit
+
 /* Copy the data segment initializers from flash to SRAM */  
   ldr r0, =_sdata
   ldr r1, =_edata
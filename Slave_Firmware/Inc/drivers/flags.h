@@ -0,0 +1,35 @@
+/*
+* @file flags.h
+* @brief Event flags shared between the interrupts and the main loop
+* @details This module provides the flag bits and the bit-band access macros for the flag word.
+*
+* @author Aeron Lahoylahoy
+* @date June 27, 2024
+*/
+#ifndef _FLAGS_H_
+#define _FLAGS_H_
+
+#include "stm32f4xx.h"
+
+/*Flag Bits*/
+#define FLAG_LED_TICK 0		/*TIM7: blink phase changed, main loop refreshes the LEDs*/
+#define FLAG_TURN_LEFT 1
+#define FLAG_TURN_RIGHT 2
+#define FLAG_WARNING 3
+#define FLAG_COUNT 4
+
+/*Bit-band alias of one bit in SRAM: each bit has its own word, written in one bus cycle*/
+#define BITBAND_SRAM(addr, bit) (*(volatile uint32_t *)(SRAM1_BB_BASE + (((uint32_t)(addr) - SRAM1_BASE) << 5) + ((bit) << 2)))
+#define FLAG_BIT(flag) BITBAND_SRAM(&flagWord, (flag))
+
+/*Single bit access, atomic against any interrupt without masking*/
+#define flagSet(flag) (FLAG_BIT(flag) = 1)
+#define flagClear(flag) (FLAG_BIT(flag) = 0)
+#define flagTest(flag) (FLAG_BIT(flag))
+
+extern volatile uint32_t flagWord;
+
+extern int flagTake(int flag);
+extern uint32_t flagTakeAll(uint32_t mask);
+
+#endif /* _FLAGS_H_ */
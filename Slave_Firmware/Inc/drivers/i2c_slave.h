@@ -10,17 +10,39 @@
 #define _I2C_H_
 
 #include "port_pin_define.h"
+#include "link.h"
+#include "clock.h"
 
 #define SLAVE PORTB
 #define CLOCK_SLAVE Bclk
 #define SDA PIN9 /*Slave SDA*/
 #define SCL PIN8 /*Slave SCL*/
 
-extern char data; /* I2C Variables */
-extern int temp;  /*Temporary Value - I2C*/
-extern int dataFlag;
+/* Peripheral timing from APB1 */
+#define I2C_FREQ_MHZ (CLOCK_PCLK1_HZ / 1000000)
+#define I2C_CCR_VALUE (CLOCK_PCLK1_HZ / (2 * 100000)) /* 100 kHz standard mode */
+_Static_assert(I2C_FREQ_MHZ >= 2 && I2C_FREQ_MHZ <= 50, "I2C peripheral clock out of range");
+
+#define RX_BUFFER_SIZE (LINK_FRAME_MAX + 1) /* Register pointer + frame */
+#define RX_SLOTS 8							/* Transactions buffered between main loop passes */
+
+/* One write transaction from the master */
+typedef struct
+{
+	int count;
+	char bytes[RX_BUFFER_SIZE];
+} RxSlot;
+
+extern RxSlot rxRing[RX_SLOTS]; /* I2C Variables */
+extern volatile int rxHead;
+extern volatile int rxTail;
+extern volatile int rxOverrunCount;
+extern volatile int rxTruncatedCount;
+extern volatile int rxBusErrorCount;
 
 void slaveConfig(void); /* I2C Slave Functions */
-void get_data(void);	/*Receive Data from Master*/
+int get_data(char *buf); /*Receive Data from Master*/
+void I2C1_EV_IRQHandler(void);
+void I2C1_ER_IRQHandler(void);
 
 #endif /* _I2C_H_ */
\ No newline at end of file
@@ -0,0 +1,88 @@
+/*
+* @file profiler.h
+* @brief Cycle counting profiler for the interrupts and main loop work
+* @details This module provides the zones, hooks and function prototypes of the profiler.
+* 		   Build with -DPROFILE=1 to enable; otherwise every hook expands to nothing.
+* 		   The counter source is DWT CYCCNT. A host build defines PROFILE_CYCLES(),
+* 		   PROFILE_COUNTER_INIT(), PROFILE_CLOCK_HZ and PROFILE_PUTC(c) before this header.
+*
+* @author Aeron Lahoylahoy
+* @date June 27, 2024
+*/
+#ifndef _PROFILER_H_
+#define _PROFILER_H_
+
+#include <stdint.h>
+
+#ifndef PROFILE
+#define PROFILE 0
+#endif
+
+/*Zones*/
+#define PROF_ZONE_ISR_STEP 0		/*SysTick: needle steps*/
+#define PROF_ZONE_ISR_I2C 1			/*I2C1 events*/
+#define PROF_ZONE_ISR_LED_TICK 2	/*TIM7*/
+#define PROF_ZONE_ISR_WATCHDOG 3	/*EXTI15_10 button*/
+#define PROF_ZONE_APPLY_STATE 4		/*new snapshot to segments, needles and LEDs*/
+#define PROF_ZONE_LED_REFRESH 5
+#define PROF_ZONE_COUNT 6
+
+#if PROFILE
+
+/* Counter Source */
+#ifndef PROFILE_CYCLES
+#include "stm32f4xx.h"
+#include "clock.h"
+#define PROFILE_CYCLES() (DWT->CYCCNT)
+#define PROFILE_COUNTER_INIT() \
+	(CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk, DWT->CYCCNT = 0, DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk)
+#define PROFILE_CLOCK_HZ CLOCK_HCLK_HZ
+#define PROFILE_PUTC(c) ITM_SendChar(c)
+#endif
+
+/* Histogram: bin 0 < 64 cycles, then one bin per power of two, the last one open */
+#define PROFILE_HIST_SHIFT 6
+#define PROFILE_HIST_BINS 18
+
+/* Per Zone Counters */
+typedef struct
+{
+	uint32_t count;
+	uint32_t min; /* cycles */
+	uint32_t max;
+	uint64_t total;
+	uint16_t hist[PROFILE_HIST_BINS];
+} ProfileZone;
+
+/* Scoped Zone */
+typedef struct
+{
+	uint8_t zone;
+	uint32_t start;
+} ProfileScope;
+
+extern ProfileZone profileZones[PROF_ZONE_COUNT];
+extern uint32_t profileSince;
+extern int profileDumpFlag;
+
+extern void profileInit(void);
+extern void profileReset(void);
+extern void profileRecord(int zone, uint32_t cycles);
+extern void profileScopeEnd(ProfileScope *scope);
+extern void profileDump(void);
+
+/* Hooks */
+#define PROFILE_ZONE(zone) \
+	ProfileScope profileScope __attribute__((cleanup(profileScopeEnd))) = {(zone), PROFILE_CYCLES()}
+#define PROFILE_BEGIN() uint32_t profileStart = PROFILE_CYCLES()
+#define PROFILE_END(zone) profileRecord((zone), PROFILE_CYCLES() - profileStart)
+
+#else
+
+#define PROFILE_ZONE(zone)
+#define PROFILE_BEGIN()
+#define PROFILE_END(zone) ((void)0)
+
+#endif /* PROFILE */
+
+#endif /* _PROFILER_H_ */
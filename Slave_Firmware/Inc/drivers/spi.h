@@ -12,6 +12,18 @@
 #include "stm32f4xx.h"
 #include "stm32f446xx.h"
 #include "port_pin_define.h"
+#include "clock.h"
+
+/* Baud rate: smallest PCLK2 divider (2 to 256) that stays at or below SPI1_SPEED_HZ */
+#define SPI1_SPEED_HZ 1000000 /* MAX7219 allows 10 MHz */
+#define SPI1_BR (CLOCK_PCLK2_HZ / 2 <= SPI1_SPEED_HZ ? 0	\
+			   : CLOCK_PCLK2_HZ / 4 <= SPI1_SPEED_HZ ? 1	\
+			   : CLOCK_PCLK2_HZ / 8 <= SPI1_SPEED_HZ ? 2	\
+			   : CLOCK_PCLK2_HZ / 16 <= SPI1_SPEED_HZ ? 3	\
+			   : CLOCK_PCLK2_HZ / 32 <= SPI1_SPEED_HZ ? 4	\
+			   : CLOCK_PCLK2_HZ / 64 <= SPI1_SPEED_HZ ? 5	\
+			   : CLOCK_PCLK2_HZ / 128 <= SPI1_SPEED_HZ ? 6 : 7)
+_Static_assert(CLOCK_PCLK2_HZ / 256 <= SPI1_SPEED_HZ, "SPI1 can't divide down to SPI1_SPEED_HZ");
 
 extern void SPI1_Init(void);
 extern void SPI1_Write_16bit(unsigned char MSB, unsigned char LSB);
@@ -0,0 +1,17 @@
+/*
+* @file timebase.h
+* @brief Free-running microsecond timebase
+* @details This module provides function prototypes for the TIM5 microsecond counter.
+*
+* @author Aeron Lahoylahoy
+* @date June 27, 2024
+*/
+#ifndef _TIMEBASE_H_
+#define _TIMEBASE_H_
+
+#include "stm32f4xx.h"
+
+extern void timebaseInit(void);
+extern uint32_t getMicros(void);
+
+#endif /* _TIMEBASE_H_ */
@@ -0,0 +1,22 @@
+/*
+* @file idle.h
+* @brief Idle module header file
+* @details This module provides function prototypes for sleeping when no work is pending.
+*
+* @author Aeron Lahoylahoy
+* @date June 27, 2024
+*/
+#ifndef _IDLE_H_
+#define _IDLE_H_
+
+#include "stm32f4xx.h"
+
+#define IDLE_LOAD_WINDOW_US 1000000 /* utilisation window */
+
+extern uint32_t idleSleepUs; /* total time asleep */
+extern uint32_t idleSleeps;	 /* WFI entries */
+extern uint8_t cpuLoad;		 /* percent busy over the last window */
+
+extern void idleWait(void);
+
+#endif /* _IDLE_H_ */
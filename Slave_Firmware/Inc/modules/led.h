@@ -26,11 +26,7 @@
 #define RIGHT_LED 1
 #define WARNING_LED 3
 
-extern int turnLeftFlag;
-extern int turnRightFlag;
-extern int turnOffFlag;
 extern int blinkCount;
-extern int warningFlag;
 extern int warningCount;
 
 extern void ledInit(void); /*LEDs Initialization*/
@@ -0,0 +1,76 @@
+/*
+* @file link.h
+* @brief Master/slave link protocol header file
+* @details Every update from the master is one framed I2C write to register LINK_REG_FRAME:
+*
+* 			| LEN | TYPE | SEQ | PAYLOAD ... | CHK |
+*
+* 			LEN counts TYPE, SEQ and PAYLOAD. CHK makes the byte sum of LEN..CHK zero.
+* 			Multi-byte fields are little endian. Must match Master_Firmware/Inc/modules/link.h
+*
+* @author Aeron Lahoylahoy
+* @date June 27, 2024
+*/
+#ifndef _LINK_H_
+#define _LINK_H_
+
+#include "stm32f4xx.h"
+
+#define LINK_VERSION 1
+
+/* Slave Registers */
+#define LINK_REG_FRAME 0x00	 /* write: frames */
+#define LINK_REG_STATUS 0x10 /* read: status register file */
+
+/* Status Register File (offsets from LINK_REG_STATUS, little endian) */
+#define LINK_STATUS_VERSION 0
+#define LINK_STATUS_LAST_SEQ 1
+#define LINK_STATUS_NEEDLE_RPM 2  /* speedCount1, 2 bytes */
+#define LINK_STATUS_NEEDLE_MPH 4  /* speedCount2, 2 bytes */
+#define LINK_STATUS_TARGET_RPM 6  /* rpm, 2 bytes */
+#define LINK_STATUS_TARGET_MPH 8  /* mph, 2 bytes */
+#define LINK_STATUS_FRAME_ERRORS 10
+#define LINK_STATUS_OVERRUNS 11
+#define LINK_STATUS_BUS_ERRORS 12
+#define LINK_STATUS_RESET_CAUSE 13 /* RCC->CSR[31:24] at boot */
+#define LINK_STATUS_CPU_LOAD 14  /* percent busy over the last second */
+#define LINK_STATUS_SIZE 15
+
+/* Message Types */
+#define LINK_MSG_STATE 0x01
+
+/* Frame Sizes */
+#define LINK_HEADER_SIZE 3	/* LEN, TYPE, SEQ */
+#define LINK_STATE_SIZE 11	/* speed(2) rpm(2) turn(1) warning(1) flags(1) odometer(4) */
+#define LINK_FRAME_MAX 16
+
+/* Turn State */
+#define LINK_TURN_NONE 0
+#define LINK_TURN_RIGHT 1
+#define LINK_TURN_LEFT 2
+
+/* Flags */
+#define LINK_FLAG_WATCHDOG 0x01 /* Watch dog test requested on the master */
+
+/* Dashboard State Snapshot */
+typedef struct
+{
+	uint16_t speed;	   /* 0.1 mph */
+	uint16_t rpm;	   /* wheel rpm */
+	uint8_t turn;	   /* LINK_TURN_x */
+	uint8_t warning;   /* 1 = obstacle close */
+	uint8_t flags;	   /* LINK_FLAG_x */
+	uint32_t odometer; /* 0.1 mile */
+} LinkState;
+
+extern LinkState linkState;
+extern uint8_t linkLastSeq;
+extern int linkErrorCount;
+extern uint8_t linkResetCause;
+
+extern char linkChecksum(char *buf, int n);
+extern int linkParse(char *frame, int n);
+extern void linkStatusInit(void);
+extern void linkStatusSnapshot(uint8_t *regs);
+
+#endif /* _LINK_H_ */
@@ -35,10 +35,12 @@
 #define STEP3 0x4
 #define STEP4 0x8
 
+/* Needle Scale */
+#define MPH_STEPS_PER_MPH 4 /* Motor 2 steps per mph */
+#define RPM_STEPS_NUM 3		/* Motor 1 steps per wheel rpm (3/8, 1 mph = 9.34 rpm) */
+#define RPM_STEPS_DEN 8
+
 /* Motor */
-extern int speedMPH[20];
-extern int speedRPM[20];
-extern int speedIndex;
 extern int speedCount1;
 extern int speedCount2;
 extern int current;
@@ -34,5 +34,6 @@ extern int val[10];
 extern void setDefaultVal(void);
 extern void Seven_Segment_Init(void);
 extern void Seven_Segment_Write(void);
+extern void setSegCounter(void);
 
 #endif /* _SEVENSEGMENT_H_ */
@@ -0,0 +1,43 @@
+/*
+* @file flags.c
+* @brief Event flags shared between the interrupts and the main loop
+* @details All flags live in one word in SRAM and are set, cleared and tested through the
+* 		   bit-band alias. Taking a flag (test and clear) is an exclusive load/store on the
+* 		   word, retried if an interrupt ran in between.
+*
+* @author: Aeron Lahoylahoy
+* @date:   June 27, 2024
+*/
+#include "stm32f4xx.h"
+#include "flags.h"
+
+_Static_assert(FLAG_COUNT <= 32, "flags must fit in one word");
+
+volatile uint32_t flagWord = 0;
+
+/*
+* @brief Function that returns a flag and clears it in one atomic step
+* @param flag: FLAG_x bit
+* @return 1 if the flag was set
+*/
+int flagTake(int flag)
+{
+	return flagTakeAll(1U << flag) != 0;
+}
+
+/*
+* @brief Function that returns and clears a group of flags in one atomic step
+* @param mask: FLAG_x bits to take
+* @return The bits of mask that were set
+*/
+uint32_t flagTakeAll(uint32_t mask)
+{
+	uint32_t old;
+
+	do
+	{
+		old = __LDREXW(&flagWord);
+	} while (__STREXW(old & ~mask, &flagWord));
+
+	return old & mask;
+}
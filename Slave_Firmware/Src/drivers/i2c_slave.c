@@ -1,38 +1,138 @@
 #include "stm32f4xx.h"
 #include "i2c_slave.h"
+#include "profiler.h"
 
-char data; /* I2C Variables */
-int temp;  /*Temporary Value - I2C*/
-int dataFlag;
+/* Received transactions: the I2C1 ISR fills rxRing[rxHead], the main loop drains from rxTail */
+RxSlot rxRing[RX_SLOTS];
+volatile int rxHead = 0;
+volatile int rxTail = 0;
+int rxIndex = 0;
+
+/* Status reads: register pointer from the last write, image latched at the read address match */
+int regPointer = LINK_REG_STATUS;
+int txIndex = 0;
+uint8_t txBuffer[LINK_STATUS_SIZE];
+
+/* Error Counters */
+volatile int rxOverrunCount = 0;   /* transactions dropped, ring full */
+volatile int rxTruncatedCount = 0; /* bytes dropped, frame too long */
+volatile int rxBusErrorCount = 0;  /* bus error, arbitration lost, DR overrun */
 
 /*
-* @brief Function that retrieves data from the I2C bus when addressed by the master
+* @brief Function that copies the oldest received transaction out of the ring buffer
+* @param buf: buffer of at least RX_BUFFER_SIZE bytes (register pointer followed by the frame)
+* @return Number of bytes copied, 0 if nothing is pending
+*/
+int get_data(char *buf)
+{
+	int tail = rxTail;
+	int n;
+
+	if (tail == rxHead)
+		return 0;
+
+	n = rxRing[tail].count;
+	for (int i = 0; i < n; i++)
+		buf[i] = rxRing[tail].bytes[i];
+
+	/* Hand the slot back to the ISR */
+	__DMB();
+	rxTail = (tail + 1) % RX_SLOTS;
+
+	return n;
+}
+
+/*
+* @brief I2C1 Event Interrupt Handler, stores each write transaction from the master
+* 		 and answers status register reads
 * @param None
 * @return None
 */
-void get_data(void)
+RAMFUNC void I2C1_EV_IRQHandler(void)
 {
-	if ((I2C1->SR1 & 2))
+	PROFILE_ZONE(PROF_ZONE_ISR_I2C);
+
+	volatile int temp;
+	int sr1 = I2C1->SR1;
+	int next;
+
+	/* Address matched, start of a new transaction */
+	if (sr1 & 2)
+	{
+		temp = I2C1->SR2; /* SR1 then SR2 clears ADDR */
+
+		/* Master reads (TRA), latch the register file so multi-byte fields are consistent */
+		if (temp & (0b1 << 2))
+		{
+			linkStatusSnapshot(txBuffer);
+			txIndex = regPointer - LINK_REG_STATUS;
+		}
+		rxIndex = 0;
+	}
+
+	/* Data received, rxRing[rxHead] is never read by the main loop */
+	if (sr1 & (0b1 << 6))
 	{
-		temp = I2C1->SR1;
-		temp = I2C1->SR2;
+		temp = I2C1->DR;
+		if (rxIndex == 0)
+			regPointer = temp;
+
+		if (rxIndex < RX_BUFFER_SIZE)
+			rxRing[rxHead].bytes[rxIndex++] = temp;
+		else
+			rxTruncatedCount++;
 	}
 
-	if ((I2C1->SR1 & (0b1 << 6)))
+	/* Transmit register empty, send the next status register (0xFF past the end) */
+	if (sr1 & (0b1 << 7))
 	{
-	data = I2C1->DR;
+		if ((txIndex >= 0) && (txIndex < LINK_STATUS_SIZE))
+			I2C1->DR = txBuffer[txIndex];
+		else
+			I2C1->DR = 0xFF;
+		txIndex++;
 	}
 
-	if ((I2C1->SR1 & (0b1 << 4)))
+	/* Stop, the transaction is complete */
+	if (sr1 & (0b1 << 4))
 	{
-	temp = I2C1->SR1;
-	I2C1->CR1 = 0x401; // Clear
+		I2C1->CR1 |= 0x1; /* SR1 then CR1 write clears STOPF */
+
+		/* A lone register pointer only selects what the next read returns */
+		if (rxIndex > 1)
+		{
+			next = (rxHead + 1) % RX_SLOTS;
+			if (next == rxTail)
+				rxOverrunCount++;
+			else
+			{
+				rxRing[rxHead].count = rxIndex;
+				__DMB();
+				rxHead = next;
+			}
+		}
+		rxIndex = 0;
 	}
+}
 
-	if (data != 0)
-		dataFlag = 1;
-	else
-		dataFlag = 0;
+/*
+* @brief I2C1 Error Interrupt Handler, counts and clears bus errors
+* @param None
+* @return None
+*/
+void I2C1_ER_IRQHandler(void)
+{
+	int sr1 = I2C1->SR1;
+
+	/* BERR, ARLO, OVR */
+	if (sr1 & ((0b1 << 8) | (0b1 << 9) | (0b1 << 11)))
+	{
+		rxBusErrorCount++;
+		rxIndex = 0;
+	}
+
+	/* AF ends a slave transmission, nothing to count */
+	I2C1->SR1 = ~(sr1 & ((0b1 << 8) | (0b1 << 9) | (0b1 << 10) | (0b1 << 11))) & 0xFFFF;
 }
 
 /*
@@ -61,9 +161,13 @@ void slaveConfig(void)
 	RCC->APB1ENR |= 0x200000; /*Bit 21 to enable I2C1 clock*/
 	I2C1->CR1 = 0x8000;		  /*Reset*/
 	I2C1->CR1 &= ~0x8000;	  /*Clear reset*/
-	I2C1->CCR = 80;			  /*Standard mode*/
-	I2C1->CR2 = 42U;
+	I2C1->CCR = I2C_CCR_VALUE;  /*Standard mode*/
+	I2C1->CR2 = I2C_FREQ_MHZ;	/*Peripheral clock in MHz*/
 	I2C1->OAR1 |= (0x32 << 1); /*Slave Address*/
+	I2C1->CR2 |= (1 << 8) | (1 << 9) | (1 << 10); /*Error, event and buffer interrupts*/
 	I2C1->CR1 |= 0x1;		   /*Enable I2C*/
 	I2C1->CR1 |= (1 << 10);
+
+	NVIC_EnableIRQ(I2C1_EV_IRQn);
+	NVIC_EnableIRQ(I2C1_ER_IRQn);
 }
\ No newline at end of file
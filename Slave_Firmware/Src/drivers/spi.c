@@ -26,7 +26,7 @@ void SPI1_Init(void)
     GPIOA->MODER |= 0x004;  // set pin as output
 
     /* SPI Initilization */
-    SPI1->CR1 = 0x31C; // set baud rate, 8 bit data frame (CLK dile @ 1)
+    SPI1->CR1 = 0x304 | (SPI1_BR << 3); // set baud rate, 8 bit data frame (CLK dile @ 1)
     SPI1->CR2 = 0;
     SPI1->CR1 |= 0x40; // Enable SPI
 }
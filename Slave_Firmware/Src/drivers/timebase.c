@@ -0,0 +1,38 @@
+/*
+* @file timebase.c
+* @brief Free-running microsecond timebase
+* @details TIM5 (32-bit) counts microseconds and keeps counting while the CPU sleeps,
+* 		   so idle time can be measured without a periodic tick.
+*
+* @author: Aeron Lahoylahoy
+* @date:   June 27, 2024
+*/
+#include "stm32f4xx.h"
+#include "timebase.h"
+#include "clock.h"
+
+/*
+* @brief Function that starts TIM5 as a free-running 1 MHz counter
+* @param None
+* @return None
+*/
+void timebaseInit(void)
+{
+	RCC->APB1ENR |= (0b1 << 3); /*TIM5 Clock*/
+	TIM5->CR1 = 0;
+	TIM5->PSC = CLOCK_APB1_PSC_1MHZ; /*Scale down to 1MHz*/
+	TIM5->ARR = 0xFFFFFFFF;		/*Full 32-bit range*/
+	TIM5->CNT = 0;
+	TIM5->EGR = 1;				/*Load prescaler*/
+	TIM5->CR1 |= (1 << 0);		/*Enable Timer*/
+}
+
+/*
+* @brief Function that returns the current time
+* @param None
+* @return Microseconds since timebaseInit()
+*/
+uint32_t getMicros(void)
+{
+	return TIM5->CNT;
+}
@@ -13,14 +13,35 @@
 #include "seven_segment.h"
 #include "watchdog.h"
 #include "led.h"
+#include "link.h"
+#include "timebase.h"
+#include "clock.h"
+#include "idle.h"
+#include "flags.h"
+#include "profiler.h"
 #include "math.h"
 #include "stdlib.h"
 
+void applyState(void);
+void setNeedles(void);
+
+/* Last snapshot shown on the dashboard */
+LinkState shownState = {0xFFFF, 0xFFFF, 0xFF, 0xFF, 0, 0xFFFFFFFF};
+
 int main(void)
 {
+	char rxFrame[RX_BUFFER_SIZE];
+	int rxCount;
+
 	__disable_irq();
 
 	/*SLAVE INITIALIZATION*/
+	clockInit();	  /*180 MHz PLL, flash wait states and caches*/
+	linkStatusInit(); /*Latch reset cause*/
+	timebaseInit();	  /*Microsecond Timebase*/
+#if PROFILE
+	profileInit(); /*Cycle Counter*/
+#endif
 	slaveConfig(); /*Slave Initialization*/
 	ledInit();	   /*LEDs Initialization*/
 
@@ -65,146 +86,143 @@ int main(void)
 
 	while (1)
 	{
-		get_data();
-
-		if (dataFlag == 1)
+		/* Drain every transaction received since the last pass */
+		while ((rxCount = get_data(rxFrame)) > 0)
 		{
-			/* MESSAGE # 3 and 5: Motor 1 and 2 */
-			if ((data & 0xF0) == 0x30)
-			{
-				for (int i = 0; i < 10; i++)
-				{
-					if ((data & 0x0F) == i)
-					{
-						// SysTick_Init_Interrupt(40);	/*Set Speed Movement*/
-						/*Display Seven Segment*/
-						SPI1_Write(seg1Address, val[i]);
-						SPI1_Write(seg2Address, val[5]);
-						SPI1_Write(seg5Address, val[speedMPH[i] & 0xF0 >> 4]);
-						SPI1_Write(seg6Address, val[speedMPH[1] & 0x0F]);
-						/*Set Position of Motors*/
-						speedIndex = i;
-						mph = speedMPH[speedIndex] * 4;
-						rpm = speedMPH[speedIndex] * 3.5;
-
-						SysTick_Init_Interrupt(5);
-
-						/*Speedometer - RPM*/
-
-						if (abs(prevRpm - rpm) == 0)
-						{
-							forwardFlag1 = 0;
-							reverseFlag1 = 0;
-						}
-						else
-						{
-							if ((rpm > prevRpm))
-								forwardFlag1 = 1;
-							else
-								reverseFlag1 = 1;
-						}
-
-						prevMph = mph;
-						prevRpm = rpm;
-						break;
-					}
-				}
-			}
-			if ((data & 0xF0) == 0x50)
+			/* Frames are written to register LINK_REG_FRAME */
+			if ((rxCount > 1) && (rxFrame[0] == LINK_REG_FRAME))
 			{
-				for (int i = 0; i < 10; i++)
+				if (linkParse(&rxFrame[1], rxCount - 1) == LINK_MSG_STATE)
 				{
-					if ((data & 0x0F) == i)
-					{
-						SysTick_Init_Interrupt(40); /*Set Speed Movement*/
-						/*Display Seven Segment*/
-						SPI1_Write(seg1Address, val[i]);
-						SPI1_Write(seg2Address, val[5]);
-						SPI1_Write(seg5Address, val[speedMPH[i] & 0xF0 >> 4]);
-						SPI1_Write(seg6Address, val[speedMPH[1] & 0x0F]);
-						/*Set Position of Motors*/
-						speedIndex = 10 + i;
-						mph = speedMPH[speedIndex] * 4;
-						rpm = speedMPH[speedIndex] * 3.5;
-
-						SysTick_Init_Interrupt(5);
-
-						if (abs(prevRpm - rpm) == 0)
-						{
-							forwardFlag1 = 0;
-							reverseFlag1 = 0;
-						}
-						else
-						{
-							if ((rpm > prevRpm))
-								forwardFlag1 = 1;
-							else
-								reverseFlag1 = 1;
-						}
-						break;
-					}
+					PROFILE_BEGIN();
+					applyState();
+					PROFILE_END(PROF_ZONE_APPLY_STATE);
 				}
 			}
-			/*MESSAGE #4: Turn Signal */
-			if ((data & 0xF0) == 0x40)
-			{
-				TIM7->CR1 |= 0b1;
-				/* Turn Right */
-				if ((data & 0x0F) == 0x01)
-				{
-					/* Debug Purposes */
-					SPI1_Write(seg1Address, val[1]);
-					SPI1_Write(seg2Address, val[4]);
+		}
 
-					turnRightFlag = 1;
-					turnLeftFlag = 0;
-				}
+		/* LEDs only change on a TIM7 tick or a new snapshot */
+		if (flagTake(FLAG_LED_TICK))
+		{
+			PROFILE_BEGIN();
 
-				/* Turn Left */
-				else if ((data & 0x0F) == 0x02)
-				{
-					/* Debug Purposes */
-					SPI1_Write(seg1Address, val[2]);
-					SPI1_Write(seg2Address, val[4]);
-					turnLeftFlag = 1;
-					turnRightFlag = 0;
-				}
+			/* Turn Signal */
+			turnSignalOn();
 
-				else
-				{
-					SPI1_Write(seg1Address, val[3]);
-					SPI1_Write(seg2Address, val[4]);
-					turnRightFlag = 0;
-					turnLeftFlag = 0;
-					turnSignalOff();
-				}
-			}
+			/* Warning */
+			warningOn();
 
-			/* MESSAGE #6: Sonar */
-			if ((data & 0xF0) == 0x60)
-			{
-				TIM7->CR1 |= 0b1;
-				/* Warning Signal */
-				if ((data & 0x0F) == 0x01)
-				{
-					warningFlag = 1;
-				}
+			PROFILE_END(PROF_ZONE_LED_REFRESH);
+		}
 
-				if ((data & 0x0F) == 0x00)
-				{
-					warningOff();
-					warningFlag = 0;
-				}
-			}
+#if PROFILE
+		/* Profiler Dump (set from the debugger) */
+		if (profileDumpFlag)
+		{
+			profileDumpFlag = 0;
+			profileDump();
+			profileReset();
+		}
+#endif
+
+		/* Sleep until the next interrupt */
+		idleWait();
+	}
+}
 
-			dataFlag = 0;
-			data = 0;
+/*
+* @brief Function that applies the fields of a new snapshot that changed since the last one
+* @param None
+* @return None
+*/
+void applyState(void)
+{
+	int value;
+
+	/* Speedometer - Seven Segment and Needles */
+	if ((linkState.speed != shownState.speed) || (linkState.rpm != shownState.rpm))
+	{
+		value = linkState.speed / 10;
+		SPI1_Write(seg1Address, val[(value / 100) % 10]);
+		SPI1_Write(seg2Address, val[(value / 10) % 10]);
+		SPI1_Write(seg3Address, val[value % 10]);
+
+		mph = (linkState.speed * MPH_STEPS_PER_MPH) / 10;
+		rpm = (linkState.rpm * RPM_STEPS_NUM) / RPM_STEPS_DEN;
+		setNeedles();
+	}
+
+	/* Odometer - whole miles on segments 5-8 */
+	if (linkState.odometer / 10 != shownState.odometer / 10)
+	{
+		value = (linkState.odometer / 10) % 10000;
+		seg5 = val[value / 1000];
+		seg6 = val[(value / 100) % 10];
+		seg7 = val[(value / 10) % 10];
+		seg8 = val[value % 10];
+		setSegCounter();
+	}
+
+	/* Turn Signal */
+	if (linkState.turn != shownState.turn)
+	{
+		TIM7->CR1 |= 0b1;
+
+		if (linkState.turn == LINK_TURN_RIGHT)
+		{
+			flagSet(FLAG_TURN_RIGHT);
+			flagClear(FLAG_TURN_LEFT);
+		}
+		else if (linkState.turn == LINK_TURN_LEFT)
+		{
+			flagSet(FLAG_TURN_LEFT);
+			flagClear(FLAG_TURN_RIGHT);
+		}
+		else
+		{
+			flagClear(FLAG_TURN_RIGHT);
+			flagClear(FLAG_TURN_LEFT);
 		}
+		turnSignalOff();
+	}
 
-		/* Turn Signal */
-		turnSignalOn();
+	/* Sonar Warning */
+	if (linkState.warning != shownState.warning)
+	{
+		TIM7->CR1 |= 0b1;
 
-		/* Warning */
-		warningOn();
+		if (linkState.warning)
+			flagSet(FLAG_WARNING);
+		else
+		{
+			warningOff();
+			flagClear(FLAG_WARNING);
+		}
 	}
+
+	shownState = linkState;
+	flagSet(FLAG_LED_TICK);
+}
+
+/*
+* @brief Function that starts the needles towards the new rpm and mph targets
+* @param None
+* @return None
+*/
+void setNeedles(void)
+{
+	/*Speedometer - RPM*/
+	if (rpm > prevRpm)
+	{
+		reverseFlag1 = 0;
+		forwardFlag1 = 1;
+	}
+	else if (rpm < prevRpm)
+	{
+		forwardFlag1 = 0;
+		reverseFlag1 = 1;
+	}
+
+	prevMph = mph;
+	prevRpm = rpm;
 }
@@ -0,0 +1,60 @@
+/*
+* @file idle.c
+* @brief Idle module that sleeps when no work is pending
+* @details The main loop only has work after an I2C transaction or a TIM7 LED tick.
+* 		   Until then the core waits in Sleep mode (WFI). Stop mode isn't used: I2C1 can't
+* 		   wake the chip from Stop on an address match and SysTick steps the needles.
+* 		   Wake sources are the I2C1 events, TIM7, SysTick and the watchdog button EXTI.
+*
+* @author: Aeron Lahoylahoy
+* @date:   June 27, 2024
+*/
+#include "stm32f4xx.h"
+#include "idle.h"
+#include "timebase.h"
+#include "i2c_slave.h"
+#include "led.h"
+#include "flags.h"
+
+uint32_t idleSleepUs = 0;
+uint32_t idleSleeps = 0;
+uint8_t cpuLoad = 100;
+
+static uint32_t loadWindowStart = 0;
+static uint32_t loadWindowSleep = 0;
+
+/*
+* @brief Function that sleeps until an interrupt when no transaction or LED tick is pending
+* @details Interrupts are masked while deciding, so one arriving after the check still ends the WFI.
+* @param None
+* @return None
+*/
+void idleWait(void)
+{
+	uint32_t start;
+	uint32_t slept;
+	uint32_t now;
+
+	__disable_irq();
+	if ((rxHead == rxTail) && !flagTest(FLAG_LED_TICK))
+	{
+		start = getMicros();
+		__DSB();
+		__WFI();
+
+		slept = getMicros() - start;
+		idleSleepUs += slept;
+		loadWindowSleep += slept;
+		idleSleeps++;
+	}
+	__enable_irq();
+
+	/* Busy share of the last window */
+	now = getMicros();
+	if (now - loadWindowStart >= IDLE_LOAD_WINDOW_US)
+	{
+		cpuLoad = 100 - (loadWindowSleep * 100) / (now - loadWindowStart);
+		loadWindowStart = now;
+		loadWindowSleep = 0;
+	}
+}
@@ -8,11 +8,10 @@
 */
 #include "stm32f4xx.h"
 #include "led.h"
+#include "clock.h"
+#include "flags.h"
+#include "profiler.h"
 
-int turnLeftFlag = 0;
-int turnRightFlag = 0;
-int turnOffFlag = 0;
-int warningFlag = 0;
 int warningCount = 0;
 int blinkCount = 0;
 
@@ -23,7 +22,7 @@ int blinkCount = 0;
 */
 void warningOn(void){
 	if(warningCount == 1){
-		if(warningFlag) ledOn(WARNING_LED);
+		if(flagTest(FLAG_WARNING)) ledOn(WARNING_LED);
 	}
 	
 	if(warningCount == 2){
@@ -48,20 +47,20 @@ void warningOff(void){
 void turnSignalOn(void)
 {
 	if(blinkCount == 1){
-		if(turnRightFlag){
+		if(flagTest(FLAG_TURN_RIGHT)){
 		GPIOA->ODR &= ~(0b1 << PIN9);
 		ledOn(RIGHT_LED);
 		}
 		
-		if(turnLeftFlag){
+		if(flagTest(FLAG_TURN_LEFT)){
 		GPIOA->ODR &= ~(0b1 << PIN8);
 		ledOn(LEFT_LED);
 		}
 	}
 	
 	if(blinkCount == 2){
-		if(turnRightFlag) GPIOA->ODR &= ~(0b1 << PIN8);
-		if(turnLeftFlag) GPIOA->ODR &= ~(0b1 << PIN9);
+		if(flagTest(FLAG_TURN_RIGHT)) GPIOA->ODR &= ~(0b1 << PIN8);
+		if(flagTest(FLAG_TURN_LEFT)) GPIOA->ODR &= ~(0b1 << PIN9);
 	}
 	
 }
@@ -118,8 +117,8 @@ void TIM7_Init(void)
 	TIM7->DIER |= 1U;
 
 	TIM7->CNT = 0;
-	TIM7->PSC = 16000 - 1;
-	TIM7->ARR = 250 - 1;
+	TIM7->PSC = CLOCK_APB1_PSC_10KHZ; /*10 kHz*/
+	TIM7->ARR = 2500 - 1;			  /*250 ms*/
 
 	 TIM7->CR1 |= 0b1;
 
@@ -133,17 +132,20 @@ void TIM7_Init(void)
 */
 void TIM7_IRQHandler(void)
 {
-	
-	if(turnRightFlag || turnLeftFlag){
+	PROFILE_ZONE(PROF_ZONE_ISR_LED_TICK);
+
+	if(flagTest(FLAG_TURN_RIGHT) || flagTest(FLAG_TURN_LEFT)){
 	blinkCount++;
 	if(blinkCount > 2) blinkCount = 0;
 	}
 	
-	if(warningFlag){
+	if(flagTest(FLAG_WARNING)){
 		warningCount++;
 		if(warningCount > 2) warningCount = 0;
 	}
 
+	flagSet(FLAG_LED_TICK);
+
 	TIM7->SR &= ~0b1;
 }
 
@@ -0,0 +1,116 @@
+/*
+* @file link.c
+* @brief Slave side of the master/slave link protocol
+* @details This module validates frames received from the master and decodes the state snapshot
+*
+* @author: Aeron Lahoylahoy
+* @date:   June 27, 2024
+*/
+#include "stm32f4xx.h"
+#include "link.h"
+#include "i2c_slave.h"
+#include "motor.h"
+#include "idle.h"
+
+LinkState linkState = {0, 0, LINK_TURN_NONE, 0, 0, 0};
+uint8_t linkLastSeq = 0;
+int linkErrorCount = 0;
+uint8_t linkResetCause = 0;
+
+/*
+* @brief Function that computes the frame checksum
+* @param buf: bytes to sum
+* @param n: number of bytes
+* @return Byte that makes the sum of buf and itself zero
+*/
+char linkChecksum(char *buf, int n)
+{
+	char sum = 0;
+
+	for (int i = 0; i < n; i++)
+		sum += buf[i];
+
+	return -sum;
+}
+
+/*
+* @brief Function that validates a frame and decodes it into linkState
+* @param frame: received bytes starting at LEN
+* @param n: number of received bytes
+* @return Message type of a valid frame, 0 if the frame was rejected
+*/
+int linkParse(char *frame, int n)
+{
+	uint8_t *b = (uint8_t *)frame;
+	int type = b[1];
+
+	/* Length, then checksum over LEN..CHK */
+	if ((n < LINK_HEADER_SIZE + 1) || (b[0] + 2 != n) || (linkChecksum(frame, n) != 0))
+	{
+		linkErrorCount++;
+		return 0;
+	}
+
+	switch (type)
+	{
+	case LINK_MSG_STATE:
+		if (b[0] != LINK_HEADER_SIZE - 1 + LINK_STATE_SIZE)
+		{
+			linkErrorCount++;
+			return 0;
+		}
+
+		b = b + LINK_HEADER_SIZE;
+		linkState.speed = b[0] | (b[1] << 8);
+		linkState.rpm = b[2] | (b[3] << 8);
+		linkState.turn = b[4];
+		linkState.warning = b[5];
+		linkState.flags = b[6];
+		linkState.odometer = b[7] | (b[8] << 8) | (b[9] << 16) | ((uint32_t)b[10] << 24);
+		break;
+
+	default:
+		linkErrorCount++;
+		return 0;
+	}
+
+	linkLastSeq = ((uint8_t *)frame)[2];
+	return type;
+}
+
+/*
+* @brief Function that latches the reset cause flags and clears them for the next reset
+* @param None
+* @return None
+*/
+void linkStatusInit(void)
+{
+	linkResetCause = RCC->CSR >> 24;
+	RCC->CSR |= RCC_CSR_RMVF;
+}
+
+/*
+* @brief Function that fills the status register file the master reads back
+* @param regs: buffer of LINK_STATUS_SIZE bytes
+* @return None
+*/
+void linkStatusSnapshot(uint8_t *regs)
+{
+	regs[LINK_STATUS_VERSION] = LINK_VERSION;
+	regs[LINK_STATUS_LAST_SEQ] = linkLastSeq;
+	regs[LINK_STATUS_NEEDLE_RPM] = speedCount1 & 0xFF;
+	regs[LINK_STATUS_NEEDLE_RPM + 1] = (speedCount1 >> 8) & 0xFF;
+	regs[LINK_STATUS_NEEDLE_MPH] = speedCount2 & 0xFF;
+	regs[LINK_STATUS_NEEDLE_MPH + 1] = (speedCount2 >> 8) & 0xFF;
+	regs[LINK_STATUS_TARGET_RPM] = rpm & 0xFF;
+	regs[LINK_STATUS_TARGET_RPM + 1] = (rpm >> 8) & 0xFF;
+	regs[LINK_STATUS_TARGET_MPH] = mph & 0xFF;
+	regs[LINK_STATUS_TARGET_MPH + 1] = (mph >> 8) & 0xFF;
+
+	/* Counters saturate at 255 */
+	regs[LINK_STATUS_FRAME_ERRORS] = (linkErrorCount > 255) ? 255 : linkErrorCount;
+	regs[LINK_STATUS_OVERRUNS] = (rxOverrunCount + rxTruncatedCount > 255) ? 255 : rxOverrunCount + rxTruncatedCount;
+	regs[LINK_STATUS_BUS_ERRORS] = (rxBusErrorCount > 255) ? 255 : rxBusErrorCount;
+	regs[LINK_STATUS_RESET_CAUSE] = linkResetCause;
+	regs[LINK_STATUS_CPU_LOAD] = cpuLoad;
+}
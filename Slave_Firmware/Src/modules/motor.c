@@ -8,12 +8,9 @@
 */
 #include "stm32f4xx.h"
 #include "motor.h"
+#include "clock.h"
+#include "profiler.h"
 
-//									0 1  2  3  4  5  6  7  8  9 10 11 12 13 14 15 16 17 18 19 
-int speedMPH[20] = {0,5,10,15,20,25,30,35,40,50,55,60,65,70,75,80,85,90,95,100};
-//									0 1  2  3  4  5  6  7  8  9   10  11  12  13  14  15  16  17 18 19 				
-int speedRPM[20] = {0,12,23,35,47,58,70,82,93,117,128,140,152,163,175,187,198,210,222,233};
-int speedIndex = 0;
 int speedCount1 = 0;
 int speedCount2 = 0;
 int forwardFlag1 = 0;
@@ -69,7 +66,7 @@ void motorInit(void)
 * @param steps: Number of steps for the motor to move
 * @return None
 */
-void forwardControl_M1(int steps)
+RAMFUNC void forwardControl_M1(int steps)
 {
 	//steps = steps * 40;
 	
@@ -107,7 +104,7 @@ void forwardControl_M1(int steps)
 * @param steps: Number of steps for the motor to move
 * @return None
 */
-void reverseControl_M1(int steps)
+RAMFUNC void reverseControl_M1(int steps)
 {	
 	for (int i = 0; i < steps; i++)
 	{
@@ -143,7 +140,7 @@ void reverseControl_M1(int steps)
 * @param steps: Number of steps for the motor to move
 * @return None
 */
-void forwardControl_M2(int steps)
+RAMFUNC void forwardControl_M2(int steps)
 {	
 	for (int i = 0; i < steps; i++)
 	{
@@ -179,7 +176,7 @@ void forwardControl_M2(int steps)
 * @param steps: Number of steps for the motor to move
 * @return None
 */
-void reverseControl_M2(int steps)
+RAMFUNC void reverseControl_M2(int steps)
 {
 
 	for (int i = 0; i < steps; i++)
@@ -220,9 +217,9 @@ void reverseControl_M2(int steps)
 void SysTick_Init_Interrupt(int n)
 {
 	SysTick->CTRL = 0;
-	SysTick->LOAD = n * 16000; /* 1 MilliSeconds @ 16Mhz */
+	SysTick->LOAD = n * CLOCK_TICKS_PER_MS; /* n MilliSeconds */
 	SysTick->VAL = 0;
-	SysTick->CTRL = 0x07; /* Enable Systick, interrupt, 16Mhz */
+	SysTick->CTRL = 0x07; /* Enable Systick, interrupt, HCLK */
 }
 
 /*
@@ -230,8 +227,9 @@ void SysTick_Init_Interrupt(int n)
 * @param None
 * @return None
 */
-void SysTick_Handler(void)
+RAMFUNC void SysTick_Handler(void)
 {
+	PROFILE_ZONE(PROF_ZONE_ISR_STEP);
 	
 	/*Controlling First Motor*/
 	if((speedCount1 > rpm) && forwardFlag1){	/*RPM*/
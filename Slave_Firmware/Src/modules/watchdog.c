@@ -1,6 +1,7 @@
 #include "stm32f4xx.h"
 #include "stm32f446xx.h"
 #include "watchdog.h"
+#include "profiler.h"
 
 /* Watch Dog Timers */
 /* Function: Initilizes the watchdog timer for a 1 second */
@@ -20,6 +21,8 @@ void watchDogInit(void)
 */
 extern void EXTI15_10_IRQHandler(void)
 {
+	PROFILE_ZONE(PROF_ZONE_ISR_WATCHDOG);
+
 	/*Turn Signal Interrupt*/
 	if (WDG_PIN)
 	{
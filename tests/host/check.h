@@ -0,0 +1,51 @@
+/*
+ * @file check.h
+ * @brief Assertions for the host tests
+ * @details A failed CHECK prints where and what, and the test carries on so one run shows
+ * 			every failure. checkExit() turns the count into the process exit status.
+ *
+ * @author: Aeron Lahoylahoy
+ * @date: June 27, 2024
+ */
+
+#ifndef CHECK_H_
+#define CHECK_H_
+
+#include <stdio.h>
+
+static int checkFailures = 0;
+
+#define CHECK(cond)                                                            \
+	do                                                                         \
+	{                                                                          \
+		if (!(cond))                                                           \
+		{                                                                      \
+			printf("%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, #cond);    \
+			checkFailures++;                                                   \
+		}                                                                      \
+	} while (0)
+
+#define CHECK_EQ(a, b)                                                         \
+	do                                                                         \
+	{                                                                          \
+		long long checkA = (long long)(a), checkB = (long long)(b);            \
+		if (checkA != checkB)                                                  \
+		{                                                                      \
+			printf("%s:%d: CHECK failed: %s == %s (%lld != %lld)\n", __FILE__, \
+				   __LINE__, #a, #b, checkA, checkB);                          \
+			checkFailures++;                                                   \
+		}                                                                      \
+	} while (0)
+
+/*
+ * @brief Function that reports the result of a test program
+ * @param name: test name
+ * @return Process exit status
+ */
+static inline int checkExit(const char *name)
+{
+	printf("%s: %s\n", name, checkFailures ? "FAILED" : "ok");
+	return checkFailures != 0;
+}
+
+#endif /* CHECK_H_ */
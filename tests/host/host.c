@@ -0,0 +1,201 @@
+/*
+ * @file 	host.c
+ * @brief 	Host side of the register map and core intrinsics
+ * @details Maps anonymous memory at the STM32F446 peripheral (0x40000000) and Cortex-M
+ * 			private peripheral (0xE0000000) addresses before main(), so the CMSIS register
+ * 			pointers used by the firmware work unchanged in a Linux process.
+ *
+ * 			The SRAM1 bit-band alias (flags.h) is mapped too and trapped (mmio.c): each alias
+ * 			word reads and writes one bit of the host's data segment, which stands in for
+ * 			SRAM1 (see SRAM1_BASE in stm32f4xx.h).
+ *
+ * 			Time is virtual. hostNowNs only moves when a model charges for bus or register
+ * 			time, or a test advances it. hostTimebaseTrap() puts TIM5's counter (timebase.c)
+ * 			on that clock.
+ *
+ * @author: Aeron Lahoylahoy
+ * @date: June 27, 2024
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include "stm32f4xx.h"
+#include "mmio.h"
+
+/* Register Regions */
+#define HOST_PERIPH_SIZE 0x80000  /* APB1, APB2 and AHB1 */
+#define HOST_CORE_BASE 0xE0000000 /* ITM, DWT, SCS */
+#define HOST_CORE_SIZE 0x100000
+#define HOST_PAGE 4096
+
+/* Timer Page: TIM2, TIM3, TIM4 and TIM5 */
+#define HOST_TIMER_BASE TIM2_BASE
+#define HOST_TIMER_READ_NS 20 /* one counter read */
+
+/* Data segment, SRAM1 on the host */
+extern char __data_start[];
+extern char _end[];
+
+uint32_t hostPrimask = 0;
+uint32_t hostWfiCount = 0;
+void (*hostOnWfi)(void) = 0;
+uint64_t hostNowNs = 0;
+
+static uint32_t hostTimerRegs[HOST_PAGE / 4];
+static uint32_t hostTimebaseOffset = 0; /* TIM5->CNT = us - offset */
+
+/*
+ * @brief Function that maps anonymous memory at a fixed address
+ * @param base: address
+ * @param size: bytes
+ * @return None, exits if the address is taken
+ */
+static void hostMapFixed(uintptr_t base, size_t size)
+{
+	void *p = mmap((void *)base, size, PROT_READ | PROT_WRITE,
+				   MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE, -1, 0);
+
+	if (p != (void *)base)
+	{
+		fprintf(stderr, "host: can't map registers at 0x%08lx\n", (unsigned long)base);
+		exit(2);
+	}
+}
+
+/*
+ * @brief Bit-band alias read: one bit of the data segment
+ */
+static uint32_t hostBitBandRead(void *ctx, uintptr_t addr, int effects)
+{
+	uintptr_t offset = addr - SRAM1_BB_BASE;
+
+	return (__data_start[offset >> 5] >> ((offset >> 2) & 7)) & 1;
+}
+
+/*
+ * @brief Bit-band alias write: bit 0 of the value sets or clears one bit of the data segment
+ */
+static void hostBitBandWrite(void *ctx, uintptr_t addr, uint32_t value)
+{
+	uintptr_t offset = addr - SRAM1_BB_BASE;
+	char bit = 1 << ((offset >> 2) & 7);
+
+	if (value & 1)
+		__data_start[offset >> 5] |= bit;
+	else
+		__data_start[offset >> 5] &= ~bit;
+}
+
+/*
+ * @brief Function that maps the register regions and the bit-band alias, runs before main()
+ * @param None
+ * @return None
+ */
+__attribute__((constructor)) static void hostRegistersMap(void)
+{
+	size_t alias = ((_end - __data_start) * 32 + HOST_PAGE - 1) & ~(size_t)(HOST_PAGE - 1);
+
+	hostMapFixed(PERIPH_BASE, HOST_PERIPH_SIZE);
+	hostMapFixed(HOST_CORE_BASE, HOST_CORE_SIZE);
+
+	/* flags.h truncates SRAM addresses to 32 bits */
+	if ((uintptr_t)_end > 0xFFFFFFFF)
+	{
+		fprintf(stderr, "host: data segment above 4 GB, link with -no-pie\n");
+		exit(2);
+	}
+	hostMapFixed(SRAM1_BB_BASE, alias);
+	mmioTrap(SRAM1_BB_BASE, alias, hostBitBandRead, hostBitBandWrite, 0);
+}
+
+/*
+ * @brief Function that zeroes every peripheral and core register not behind a model
+ * @param None
+ * @return None
+ */
+void hostRegistersReset(void)
+{
+	for (uintptr_t page = PERIPH_BASE; page < PERIPH_BASE + HOST_PERIPH_SIZE; page += HOST_PAGE)
+	{
+		if (!mmioTrapped(page))
+			memset((void *)page, 0, HOST_PAGE);
+	}
+	memset((void *)HOST_CORE_BASE, 0, HOST_CORE_SIZE);
+	memset(hostTimerRegs, 0, sizeof(hostTimerRegs));
+	hostPrimask = 0;
+}
+
+/*
+ * @brief Timer page read: TIM5->CNT runs on the virtual clock, one microsecond per count
+ */
+static uint32_t hostTimerRead(void *ctx, uintptr_t addr, int effects)
+{
+	if (addr == (uintptr_t)&TIM5->CNT)
+	{
+		if (effects)
+			hostNowNs += HOST_TIMER_READ_NS;
+		return (uint32_t)(hostNowNs / 1000) - hostTimebaseOffset;
+	}
+
+	return hostTimerRegs[(addr - HOST_TIMER_BASE) / 4];
+}
+
+/*
+ * @brief Timer page write: loading TIM5->CNT moves its offset, TIM5->SR flags clear on
+ * 		  written zeros (rc_w0), the rest is plain memory
+ */
+static void hostTimerWrite(void *ctx, uintptr_t addr, uint32_t value)
+{
+	if (addr == (uintptr_t)&TIM5->CNT)
+		hostTimebaseOffset = (uint32_t)(hostNowNs / 1000) - value;
+	else if (addr == (uintptr_t)&TIM5->SR)
+		hostTimerRegs[(addr - HOST_TIMER_BASE) / 4] &= value;
+	else
+		hostTimerRegs[(addr - HOST_TIMER_BASE) / 4] = value;
+}
+
+/*
+ * @brief Function that runs the timebase (TIM5 counter) on the virtual clock
+ * @details Traps the whole timer page; TIM2 to TIM4 keep working as plain registers.
+ * @param None
+ * @return None
+ */
+void hostTimebaseTrap(void)
+{
+	memcpy(hostTimerRegs, (void *)HOST_TIMER_BASE, HOST_PAGE);
+	mmioTrap(HOST_TIMER_BASE, HOST_PAGE, hostTimerRead, hostTimerWrite, 0);
+}
+
+/*
+ * @brief Function that raises TIM5 status flags, as the counter would
+ * @param flags: TIM5->SR bits (UIF, CC1IF)
+ * @return None
+ */
+void hostTimebaseEvent(uint32_t flags)
+{
+	hostTimerRegs[((uintptr_t)&TIM5->SR - HOST_TIMER_BASE) / 4] |= flags;
+}
+
+/*
+ * @brief Function that moves the virtual clock forward
+ * @param ns: nanoseconds
+ * @return None
+ */
+void hostAdvance(uint64_t ns)
+{
+	hostNowNs += ns;
+}
+
+/*
+ * @brief Function that stands in for WFI
+ * @details The hook plays the part of the interrupt that ends the sleep.
+ * @param None
+ * @return None
+ */
+void hostWfi(void)
+{
+	hostWfiCount++;
+	if (hostOnWfi)
+		hostOnWfi();
+}
@@ -0,0 +1,428 @@
+/*
+ * @file 	i2c_devices.c
+ * @brief 	Models of the devices on the dashboard's I2C bus
+ * @details Attach to the simulated I2C1 (i2c_sim.c):
+ *
+ * 			DS3231: register file 0x00-0x12 with a register pointer that auto-increments
+ * 			and wraps. Time and date are BCD and advance once a second of virtual time,
+ * 			in 12-hour mode (hour bit 6, PM bit 5) or 24-hour mode, with day, month, leap
+ * 			year and century carries. Temperature is the two's complement MSB (0x11) and
+ * 			quarter degrees in bits 7:6 of the LSB (0x12).
+ *
+ * 			AT24C32: 4 KB behind a 16-bit address sent high byte first. Written bytes are
+ * 			latched into the 32-byte page buffer, wrapping inside the page, and programmed
+ * 			at the STOP; for the write cycle (tWR) the device doesn't acknowledge its
+ * 			address. Reads are sequential and roll over at the end of the memory.
+ *
+ * 			Slave STM32 at 0x32: frames written to register 0x00 are checked (LEN, sum to
+ * 			zero) and counted, reads from 0x10 return the status register file.
+ *
+ * @author: Aeron Lahoylahoy
+ * @date: June 27, 2024
+ */
+#include <string.h>
+#include "stm32f4xx.h"
+#include "i2c_devices.h"
+
+#define NS_PER_SECOND 1000000000ULL
+
+/* Slave Registers (link.h) */
+#define LINK_SLAVE_REG_FRAME 0x00
+#define LINK_SLAVE_REG_STATUS 0x10
+#define LINK_SLAVE_STATUS_LAST_SEQ 1
+
+/*
+ * @brief Function that converts a BCD byte to binary
+ * @param v: BCD
+ * @return Binary
+ */
+static int fromBcd(uint8_t v)
+{
+	return (v >> 4) * 10 + (v & 0x0F);
+}
+
+/*
+ * @brief Function that converts binary to a BCD byte
+ * @param v: 0 to 99
+ * @return BCD
+ */
+static uint8_t toBcd(int v)
+{
+	return ((v / 10) << 4) | (v % 10);
+}
+
+/*
+ * @brief Function that returns the days in a month
+ * @param month: 1 to 12
+ * @param year: 0 to 99, every fourth is a leap year (DS3231 rule)
+ * @return Days
+ */
+static int ds3231DaysIn(int month, int year)
+{
+	static const uint8_t days[12] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+
+	if (month == 2 && (year % 4) == 0)
+		return 29;
+
+	return days[(month - 1) % 12];
+}
+
+/*
+ * @brief Function that advances the clock by one second with every carry
+ * @param rtc: device
+ * @return None
+ */
+static void ds3231Second(DS3231 *rtc)
+{
+	uint8_t *r = rtc->regs;
+	int value;
+	int month;
+	int year;
+
+	if ((value = fromBcd(r[0] & 0x7F) + 1) < 60)
+	{
+		r[0] = toBcd(value);
+		return;
+	}
+	r[0] = 0;
+
+	if ((value = fromBcd(r[1] & 0x7F) + 1) < 60)
+	{
+		r[1] = toBcd(value);
+		return;
+	}
+	r[1] = 0;
+
+	if (r[2] & DS3231_HOUR_12)
+	{
+		/* 11 -> 12 flips AM/PM, 12 -> 1; the day ends at 12 AM */
+		int pm = r[2] & DS3231_HOUR_PM;
+
+		value = fromBcd(r[2] & 0x1F) % 12 + 1;
+		if (value == 12)
+			pm ^= DS3231_HOUR_PM;
+		r[2] = DS3231_HOUR_12 | pm | toBcd(value);
+		if (value != 12 || pm)
+			return;
+	}
+	else
+	{
+		if ((value = fromBcd(r[2] & 0x3F) + 1) < 24)
+		{
+			r[2] = toBcd(value);
+			return;
+		}
+		r[2] = 0;
+	}
+
+	r[3] = r[3] % 7 + 1;
+
+	month = fromBcd(r[5] & 0x1F);
+	year = fromBcd(r[6]);
+	if ((value = fromBcd(r[4] & 0x3F) + 1) <= ds3231DaysIn(month, year))
+	{
+		r[4] = toBcd(value);
+		return;
+	}
+	r[4] = 0x01;
+
+	if (++month <= 12)
+	{
+		r[5] = (r[5] & 0x80) | toBcd(month);
+		return;
+	}
+
+	/* Century bit toggles when the year rolls over */
+	year = (year + 1) % 100;
+	r[5] = ((r[5] & 0x80) ^ (year == 0 ? 0x80 : 0)) | 0x01;
+	r[6] = toBcd(year);
+}
+
+/*
+ * @brief DS3231 address phase: catch the clock up to now
+ */
+static int ds3231Start(I2CSimDevice *dev, int read, uint64_t t)
+{
+	DS3231 *rtc = (DS3231 *)dev;
+
+	while (t >= rtc->tick)
+	{
+		ds3231Second(rtc);
+		rtc->tick += NS_PER_SECOND;
+	}
+
+	if (!read)
+		rtc->pointerNext = 1;
+
+	return 1;
+}
+
+/*
+ * @brief DS3231 write: register pointer, then registers; writing seconds restarts the countdown
+ */
+static int ds3231Write(I2CSimDevice *dev, uint8_t byte, uint64_t t)
+{
+	DS3231 *rtc = (DS3231 *)dev;
+
+	if (rtc->pointerNext)
+	{
+		rtc->pointer = byte % DS3231_REGS;
+		rtc->pointerNext = 0;
+		return 1;
+	}
+
+	if (rtc->pointer < DS3231_REG_TEMP_MSB)
+		rtc->regs[rtc->pointer] = byte;
+	if (rtc->pointer == 0)
+		rtc->tick = t + NS_PER_SECOND;
+	rtc->pointer = (rtc->pointer + 1) % DS3231_REGS;
+
+	return 1;
+}
+
+/*
+ * @brief DS3231 read
+ */
+static uint8_t ds3231Read(I2CSimDevice *dev, uint64_t t)
+{
+	DS3231 *rtc = (DS3231 *)dev;
+	uint8_t value = rtc->regs[rtc->pointer];
+
+	rtc->pointer = (rtc->pointer + 1) % DS3231_REGS;
+
+	return value;
+}
+
+/*
+ * @brief Function that resets the RTC to 12:00:00 AM, Monday 01/01/00, 24-hour mode
+ * @param rtc: device
+ * @return None
+ */
+void ds3231Init(DS3231 *rtc)
+{
+	memset(rtc, 0, sizeof(*rtc));
+	rtc->dev.addr = DS3231_ADDR;
+	rtc->dev.name = "DS3231";
+	rtc->dev.start = ds3231Start;
+	rtc->dev.write = ds3231Write;
+	rtc->dev.read = ds3231Read;
+	rtc->regs[3] = 0x02;
+	rtc->regs[4] = 0x01;
+	rtc->regs[5] = 0x01;
+	rtc->tick = hostNowNs + NS_PER_SECOND;
+}
+
+/*
+ * @brief Function that sets the die temperature
+ * @param rtc: device
+ * @param quarterDegrees: temperature in 0.25 C
+ * @return None
+ */
+void ds3231SetTemp(DS3231 *rtc, int quarterDegrees)
+{
+	rtc->regs[DS3231_REG_TEMP_MSB] = (uint8_t)(quarterDegrees >> 2);
+	rtc->regs[DS3231_REG_TEMP_LSB] = (quarterDegrees & 3) << 6;
+}
+
+/*
+ * @brief AT24C32 address phase: NACK during the write cycle
+ */
+static int at24c32Start(I2CSimDevice *dev, int read, uint64_t t)
+{
+	AT24C32 *eeprom = (AT24C32 *)dev;
+
+	if (t < eeprom->busyUntil)
+	{
+		eeprom->busyNacks++;
+		return 0;
+	}
+
+	/* A repeated start abandons a page write that wasn't stopped */
+	eeprom->latched = 0;
+	if (!read)
+		eeprom->addrBytes = 0;
+
+	return 1;
+}
+
+/*
+ * @brief AT24C32 write: address high, address low, then data into the page buffer
+ */
+static int at24c32Write(I2CSimDevice *dev, uint8_t byte, uint64_t t)
+{
+	AT24C32 *eeprom = (AT24C32 *)dev;
+	int offset;
+
+	if (eeprom->addrBytes == 0)
+	{
+		eeprom->pointer = (byte & 0x0F) << 8;
+		eeprom->addrBytes = 1;
+	}
+	else if (eeprom->addrBytes == 1)
+	{
+		eeprom->pointer |= byte;
+		eeprom->addrBytes = 2;
+	}
+	else
+	{
+		/* Page roll-over: the low five bits wrap, the page stays */
+		offset = eeprom->pointer & (AT24C32_PAGE - 1);
+		eeprom->latch[offset] = byte;
+		eeprom->latched |= 1U << offset;
+		eeprom->pointer = (eeprom->pointer & ~(AT24C32_PAGE - 1)) | ((offset + 1) & (AT24C32_PAGE - 1));
+	}
+
+	return 1;
+}
+
+/*
+ * @brief AT24C32 sequential read
+ */
+static uint8_t at24c32Read(I2CSimDevice *dev, uint64_t t)
+{
+	AT24C32 *eeprom = (AT24C32 *)dev;
+	uint8_t value = eeprom->mem[eeprom->pointer];
+
+	eeprom->pointer = (eeprom->pointer + 1) % AT24C32_SIZE;
+
+	return value;
+}
+
+/*
+ * @brief AT24C32 STOP: program the latched bytes and start the write cycle
+ */
+static void at24c32Stop(I2CSimDevice *dev, uint64_t t)
+{
+	AT24C32 *eeprom = (AT24C32 *)dev;
+	int page = eeprom->pointer & ~(AT24C32_PAGE - 1);
+
+	if (eeprom->latched)
+	{
+		for (int i = 0; i < AT24C32_PAGE; i++)
+		{
+			if (eeprom->latched & (1U << i))
+				eeprom->mem[page + i] = eeprom->latch[i];
+		}
+		eeprom->latched = 0;
+		eeprom->busyUntil = t + AT24C32_WRITE_NS;
+		eeprom->writeCycles++;
+	}
+	eeprom->addrBytes = 0;
+}
+
+/*
+ * @brief Function that resets the EEPROM to erased (0xFF)
+ * @param eeprom: device
+ * @return None
+ */
+void at24c32Init(AT24C32 *eeprom)
+{
+	memset(eeprom, 0, sizeof(*eeprom));
+	memset(eeprom->mem, 0xFF, sizeof(eeprom->mem));
+	eeprom->dev.addr = AT24C32_ADDR;
+	eeprom->dev.name = "AT24C32";
+	eeprom->dev.start = at24c32Start;
+	eeprom->dev.write = at24c32Write;
+	eeprom->dev.read = at24c32Read;
+	eeprom->dev.stop = at24c32Stop;
+}
+
+/*
+ * @brief Slave address phase
+ */
+static int linkSlaveStart(I2CSimDevice *dev, int read, uint64_t t)
+{
+	LinkSlave *slave = (LinkSlave *)dev;
+
+	if (slave->offline)
+		return 0;
+
+	if (!read)
+	{
+		slave->pointerNext = 1;
+		slave->rxCount = 0;
+	}
+
+	return 1;
+}
+
+/*
+ * @brief Slave write: register pointer, then frame bytes
+ */
+static int linkSlaveWrite(I2CSimDevice *dev, uint8_t byte, uint64_t t)
+{
+	LinkSlave *slave = (LinkSlave *)dev;
+
+	if (slave->pointerNext)
+	{
+		slave->pointer = byte;
+		slave->pointerNext = 0;
+	}
+	else if (slave->pointer == LINK_SLAVE_REG_FRAME && slave->rxCount < LINK_SLAVE_FRAME_MAX)
+	{
+		slave->rx[slave->rxCount++] = byte;
+	}
+
+	return 1;
+}
+
+/*
+ * @brief Slave read: status register file
+ */
+static uint8_t linkSlaveRead(I2CSimDevice *dev, uint64_t t)
+{
+	LinkSlave *slave = (LinkSlave *)dev;
+	int index = slave->pointer - LINK_SLAVE_REG_STATUS;
+
+	slave->pointer++;
+	if (index < 0 || index >= (int)sizeof(slave->status))
+		return 0xFF;
+
+	return slave->status[index];
+}
+
+/*
+ * @brief Slave STOP: check and count a frame
+ */
+static void linkSlaveStop(I2CSimDevice *dev, uint64_t t)
+{
+	LinkSlave *slave = (LinkSlave *)dev;
+	uint8_t sum = 0;
+
+	if (slave->pointer != LINK_SLAVE_REG_FRAME || slave->rxCount == 0)
+		return;
+
+	for (int i = 0; i < slave->rxCount; i++)
+		sum += slave->rx[i];
+
+	if (slave->rxCount == slave->rx[0] + 2 && sum == 0)
+	{
+		slave->frames++;
+		memcpy(slave->lastFrame, slave->rx, slave->rxCount);
+		slave->lastFrameLen = slave->rxCount;
+		slave->lastFrameNs = t;
+		slave->status[LINK_SLAVE_STATUS_LAST_SEQ] = slave->rx[2];
+	}
+	else
+	{
+		slave->badFrames++;
+	}
+	slave->rxCount = 0;
+}
+
+/*
+ * @brief Function that resets the slave: no frames, status version 1
+ * @param slave: device
+ * @return None
+ */
+void linkSlaveInit(LinkSlave *slave)
+{
+	memset(slave, 0, sizeof(*slave));
+	slave->dev.addr = LINK_SLAVE_ADDR;
+	slave->dev.name = "slave";
+	slave->dev.start = linkSlaveStart;
+	slave->dev.write = linkSlaveWrite;
+	slave->dev.read = linkSlaveRead;
+	slave->dev.stop = linkSlaveStop;
+	slave->status[0] = 1;
+}
@@ -0,0 +1,79 @@
+/*
+ * @file i2c_devices.h
+ * @brief Models of the devices on the dashboard's I2C bus
+ * @details This module is the header file for the i2c_devices.c module
+ *
+ * @author: Aeron Lahoylahoy
+ * @date: June 27, 2024
+ */
+
+#ifndef I2C_DEVICES_H_
+#define I2C_DEVICES_H_
+
+#include <stdint.h>
+#include "i2c_sim.h"
+
+/* DS3231 Real-Time Clock */
+#define DS3231_ADDR 0x68
+#define DS3231_REGS 0x13
+#define DS3231_REG_HOUR 0x02
+#define DS3231_REG_TEMP_MSB 0x11
+#define DS3231_REG_TEMP_LSB 0x12
+#define DS3231_HOUR_12 0x40 /* 12-hour mode */
+#define DS3231_HOUR_PM 0x20
+
+typedef struct
+{
+	I2CSimDevice dev;
+	uint8_t regs[DS3231_REGS];
+	uint8_t pointer;
+	int pointerNext; /* next written byte is the register pointer */
+	uint64_t tick;	 /* hostNowNs of the next seconds increment */
+} DS3231;
+
+/* AT24C32 EEPROM: 4 KB, 32-byte pages, 16-bit addresses */
+#define AT24C32_ADDR 0x57
+#define AT24C32_SIZE 4096
+#define AT24C32_PAGE 32
+#define AT24C32_WRITE_NS 5000000 /* tWR */
+
+typedef struct
+{
+	I2CSimDevice dev;
+	uint8_t mem[AT24C32_SIZE];
+	uint16_t pointer;
+	int addrBytes;				 /* address bytes received in this write */
+	uint8_t latch[AT24C32_PAGE]; /* page buffer */
+	uint32_t latched;			 /* bit per latched byte */
+	uint64_t busyUntil;			 /* end of the write cycle */
+	uint32_t writeCycles;
+	uint32_t busyNacks; /* addressed during a write cycle */
+} AT24C32;
+
+/* Slave STM32 (link.h register map) */
+#define LINK_SLAVE_ADDR 0x32
+#define LINK_SLAVE_FRAME_MAX 32
+
+typedef struct
+{
+	I2CSimDevice dev;
+	uint8_t pointer;
+	int pointerNext;
+	uint8_t rx[LINK_SLAVE_FRAME_MAX];
+	int rxCount;
+	uint8_t status[16]; /* LINK_REG_STATUS register file */
+	uint32_t frames;	/* frames with a good checksum */
+	uint32_t badFrames;
+	uint8_t lastFrame[LINK_SLAVE_FRAME_MAX];
+	int lastFrameLen;
+	uint64_t lastFrameNs;
+	int offline; /* NACKs its address */
+} LinkSlave;
+
+/* Device Functions */
+void ds3231Init(DS3231 *rtc);
+void ds3231SetTemp(DS3231 *rtc, int quarterDegrees);
+void at24c32Init(AT24C32 *eeprom);
+void linkSlaveInit(LinkSlave *slave);
+
+#endif /* I2C_DEVICES_H_ */
@@ -0,0 +1,664 @@
+/*
+ * @file 	i2c_sim.c
+ * @brief 	Simulated I2C1 master peripheral and bus for the host tests
+ * @details Stands behind the I2C1 registers (mmio.c), so i2c_master.c runs unmodified against
+ * 			device models on a simulated bus.
+ *
+ * 			The peripheral follows RM0390 for master mode: SB, ADDR (cleared by SR1 then
+ * 			SR2), TXE, RXNE, BTF, AF, START and STOP taking effect after the byte on the
+ * 			wire, and the receiver's double buffer, where a byte waits in the shift register
+ * 			with SCL stretched (BTF) while DR is full. ACK is sampled at the end of each
+ * 			byte; with POS set the value sampled at the end of the previous byte (or of
+ * 			the address) applies, which is what the two byte read relies on.
+ *
+ * 			Bus time is virtual (hostNowNs). The bit time comes from the CCR and CR2 the
+ * 			firmware programmed, so a build with another I2C_SPEED_HZ is timed at that
+ * 			clock. START and STOP take one bit, a byte with its ACK nine. Every register
+ * 			access costs I2C_SIM_ACCESS_NS, and a status poll that sees no change jumps to
+ * 			the end of the byte on the wire, so polling loops cost two accesses, not
+ * 			millions. i2cSimPreempt() adds random interrupt delays between accesses
+ * 			(never while PRIMASK is set) to shake out ordering bugs.
+ *
+ * 			Ways a transfer goes wrong on a real bus are counted, not hidden: a STOP
+ * 			requested after the last byte was ACKed (the slave drives its next bit, the
+ * 			STOP is lost), bytes clocked out of a slave that the firmware never read, and a
+ * 			STOP bit set on an idle bus (a read-modify-write of CR1 that raced the STOP).
+ *
+ * @author: Aeron Lahoylahoy
+ * @date: June 27, 2024
+ */
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "stm32f4xx.h"
+#include "mmio.h"
+#include "i2c_sim.h"
+
+#define I2C_SIM_PAGE (I2C1_BASE & ~0xFFFUL) /* shared with UART4, UART5, I2C2, I2C3 */
+#define I2C_SIM_PAGE_SIZE 4096
+#define I2C_SIM_BIT_NS_DEFAULT 10000 /* before the firmware sets CCR */
+#define I2C_SIM_SPIN_LIMIT 1000000   /* unchanged polls with nothing on the wire */
+
+/* Register Bits */
+#define CR1_START (1 << 8)
+#define CR1_STOP (1 << 9)
+#define CR1_ACK (1 << 10)
+#define CR1_POS (1 << 11)
+#define CR1_SWRST (1 << 15)
+#define SR1_SB (1 << 0)
+#define SR1_ADDR (1 << 1)
+#define SR1_BTF (1 << 2)
+#define SR1_RXNE (1 << 6)
+#define SR1_TXE (1 << 7)
+#define SR1_AF (1 << 10)
+#define SR1_RC_W0 0xDF00 /* error flags, cleared by writing 0 */
+
+/* Bus Operations */
+enum
+{
+	OP_NONE, /* SCL stretched or bus idle */
+	OP_START,
+	OP_ADDR,
+	OP_TX,
+	OP_RX,
+	OP_STOP,
+};
+
+I2CSimStats i2cSimStats;
+
+static I2CSimDevice *simDevices[I2C_SIM_DEVICES];
+static int simDeviceCount = 0;
+static int simTrapped = 0;
+static uint32_t simPage[I2C_SIM_PAGE_SIZE / 4]; /* the page's other registers */
+
+/* Interrupt Delays */
+static int simPreemptPercent = 0;
+static uint32_t simPreemptMaxNs = 0;
+static uint32_t simRandom = 1;
+
+/* Peripheral State */
+static struct
+{
+	uint32_t cr1, cr2, oar1, oar2, ccr, trise, fltr;
+	uint32_t flags; /* SB, ADDR, BTF, AF */
+	int msl, tra;
+	int sbSeen, addrSeen; /* SR1 read while SB / ADDR set */
+
+	/* Wire */
+	int op;
+	uint64_t opEnd;
+	uint8_t shift;
+	int startPending, stopPending;
+	I2CSimDevice *dev;
+	uint64_t txnStart;
+
+	/* Transmitter */
+	int txPhase; /* ADDR cleared after a write address */
+	uint8_t txDr;
+	int txFull;
+	int txNacked;
+
+	/* Receiver */
+	int rxPhase; /* ADDR cleared after a read address */
+	int rxDone;	 /* last byte NACKed */
+	int lastAck;
+	int ackLatch; /* POS: ACK for the next byte */
+	uint8_t rxDr, rxShift;
+	int rxFull, rxShiftFull;
+
+	/* Polling */
+	uintptr_t lastAddr;
+	uint32_t lastValue;
+	uint32_t spins;
+} sim;
+
+/*
+ * @brief Function that returns the SCL period the firmware configured
+ * @param None
+ * @return Nanoseconds per bit
+ */
+uint32_t i2cSimBitNs(void)
+{
+	uint32_t freq = sim.cr2 & 0x3F;
+	uint32_t ccr = sim.ccr & 0xFFF;
+	uint32_t periods;
+
+	if (!freq || !ccr)
+		return I2C_SIM_BIT_NS_DEFAULT;
+
+	if (sim.ccr & 0x8000)
+		periods = (sim.ccr & 0x4000) ? 25 * ccr : 3 * ccr; /* fast mode, DUTY */
+	else
+		periods = 2 * ccr;
+
+	return periods * 1000 / freq;
+}
+
+/*
+ * @brief Function that puts an operation on the wire
+ * @param op: OP_x
+ * @param t: start time
+ * @return None
+ */
+static void simBegin(int op, uint64_t t)
+{
+	uint32_t bit = i2cSimBitNs();
+
+	sim.op = op;
+	sim.opEnd = t + ((op == OP_START || op == OP_STOP) ? bit : 9 * bit);
+}
+
+/*
+ * @brief Function that counts bytes a slave sent that the firmware left unread
+ * @param None
+ * @return None
+ */
+static void simDropUnread(void)
+{
+	i2cSimStats.extraBytes += sim.rxFull + sim.rxShiftFull;
+	sim.rxFull = sim.rxShiftFull = 0;
+}
+
+/*
+ * @brief Function that starts whatever the peripheral does next once the wire is free
+ * @param t: time the wire became free
+ * @return None
+ */
+static void simNext(uint64_t t)
+{
+	if (sim.op != OP_NONE || !sim.msl)
+		return;
+
+	if (sim.stopPending)
+	{
+		if (sim.rxPhase && !sim.rxDone && sim.lastAck)
+			i2cSimStats.ackedBeforeStop++;
+		simBegin(OP_STOP, t);
+	}
+	else if (sim.startPending)
+	{
+		simBegin(OP_START, t);
+	}
+	else if (sim.rxPhase)
+	{
+		/* Next byte goes to the shift register while DR waits; both full stretches SCL */
+		if (!sim.rxDone && !sim.rxShiftFull)
+			simBegin(OP_RX, t);
+	}
+	else if (sim.txPhase && sim.txFull && !sim.txNacked)
+	{
+		sim.shift = sim.txDr;
+		sim.txFull = 0;
+		sim.flags &= ~SR1_BTF;
+		simBegin(OP_TX, t);
+	}
+}
+
+/*
+ * @brief Function that finishes the operation on the wire
+ * @param None
+ * @return None
+ */
+static void simComplete(void)
+{
+	uint64_t t = sim.opEnd;
+	int op = sim.op;
+	int ack;
+
+	sim.op = OP_NONE;
+
+	switch (op)
+	{
+	case OP_START:
+		sim.cr1 &= ~CR1_START;
+		sim.startPending = 0;
+		sim.flags = SR1_SB;
+		sim.sbSeen = 0;
+		sim.txPhase = sim.rxPhase = 0;
+		sim.txFull = sim.txNacked = 0;
+		sim.rxDone = 0;
+		break;
+
+	case OP_ADDR:
+		i2cSimStats.bytes++;
+		sim.dev = 0;
+		for (int i = 0; i < simDeviceCount; i++)
+		{
+			if (simDevices[i]->addr == (sim.shift >> 1))
+				sim.dev = simDevices[i];
+		}
+		ack = sim.dev && sim.dev->start(sim.dev, sim.shift & 1, t);
+		if (ack)
+		{
+			sim.flags |= SR1_ADDR;
+			sim.addrSeen = 0;
+			sim.tra = !(sim.shift & 1);
+			sim.ackLatch = (sim.cr1 & CR1_ACK) != 0;
+		}
+		else
+		{
+			sim.flags |= SR1_AF;
+			sim.dev = 0;
+			i2cSimStats.nacks++;
+		}
+		break;
+
+	case OP_TX:
+		i2cSimStats.bytes++;
+		if (!sim.dev->write(sim.dev, sim.shift, t))
+		{
+			sim.flags |= SR1_AF;
+			sim.txNacked = 1;
+			i2cSimStats.nacks++;
+		}
+		else if (!sim.txFull)
+		{
+			sim.flags |= SR1_BTF;
+		}
+		break;
+
+	case OP_RX:
+		i2cSimStats.bytes++;
+		if (sim.cr1 & CR1_POS)
+		{
+			ack = sim.ackLatch;
+			sim.ackLatch = (sim.cr1 & CR1_ACK) != 0;
+		}
+		else
+		{
+			ack = (sim.cr1 & CR1_ACK) != 0;
+		}
+		sim.lastAck = ack;
+		sim.rxDone = !ack;
+
+		if (!sim.rxFull)
+		{
+			sim.rxDr = sim.dev->read(sim.dev, t);
+			sim.rxFull = 1;
+		}
+		else
+		{
+			sim.rxShift = sim.dev->read(sim.dev, t);
+			sim.rxShiftFull = 1;
+			sim.flags |= SR1_BTF;
+		}
+		break;
+
+	case OP_STOP:
+		sim.cr1 &= ~CR1_STOP;
+		sim.stopPending = 0;
+		sim.msl = sim.tra = 0;
+		sim.flags &= SR1_AF;
+		sim.txPhase = sim.rxPhase = 0;
+		if (sim.dev && sim.dev->stop)
+			sim.dev->stop(sim.dev, t);
+		sim.dev = 0;
+		i2cSimStats.busyNs += t - sim.txnStart;
+
+		/* START requested while the STOP was on the wire */
+		if (sim.startPending)
+		{
+			sim.msl = 1;
+			sim.txnStart = t;
+			i2cSimStats.transactions++;
+		}
+		break;
+	}
+
+	simNext(t);
+}
+
+/*
+ * @brief Function that plays the wire up to a point in time
+ * @param t: time
+ * @return None
+ */
+static void simRun(uint64_t t)
+{
+	while (sim.op != OP_NONE && sim.opEnd <= t)
+		simComplete();
+}
+
+/*
+ * @brief Function that charges one register access, with a random interrupt delay
+ * @param None
+ * @return None
+ */
+static void simAccess(void)
+{
+	if (simPreemptPercent && !hostPrimask)
+	{
+		simRandom = simRandom * 1103515245 + 12345;
+		if ((simRandom >> 16) % 100 < (uint32_t)simPreemptPercent)
+		{
+			simRandom = simRandom * 1103515245 + 12345;
+			hostNowNs += (simRandom >> 8) % simPreemptMaxNs;
+		}
+	}
+
+	hostNowNs += I2C_SIM_ACCESS_NS;
+	simRun(hostNowNs);
+}
+
+/*
+ * @brief Function that returns SR1 as the firmware sees it
+ * @param None
+ * @return SR1
+ */
+static uint32_t simSr1(void)
+{
+	uint32_t sr1 = sim.flags;
+
+	if (sim.rxFull)
+		sr1 |= SR1_RXNE;
+	if (sim.txPhase && !sim.txFull)
+		sr1 |= SR1_TXE;
+
+	return sr1;
+}
+
+/*
+ * @brief Function that returns SR2 as the firmware sees it
+ * @param None
+ * @return SR2
+ */
+static uint32_t simSr2(void)
+{
+	int busy = sim.msl || sim.op != OP_NONE;
+
+	return sim.msl | (busy << 1) | (sim.tra << 2);
+}
+
+/*
+ * @brief Function that reads a status register, skipping ahead while the firmware polls
+ * @param addr: SR1 or SR2
+ * @return Value
+ */
+static uint32_t simStatus(uintptr_t addr)
+{
+	int sr1 = addr == (uintptr_t)&I2C1->SR1;
+	uint32_t value = sr1 ? simSr1() : simSr2();
+
+	if (addr == sim.lastAddr && value == sim.lastValue)
+	{
+		if (sim.op != OP_NONE)
+		{
+			hostNowNs = sim.opEnd;
+			simRun(hostNowNs);
+			value = sr1 ? simSr1() : simSr2();
+		}
+		else if (++sim.spins > I2C_SIM_SPIN_LIMIT)
+		{
+			fprintf(stderr, "i2c_sim: firmware stuck polling %s = 0x%04x, nothing on the bus\n",
+					sr1 ? "SR1" : "SR2", (unsigned)value);
+			exit(1);
+		}
+	}
+	else
+	{
+		sim.spins = 0;
+	}
+
+	sim.lastAddr = addr;
+	sim.lastValue = value;
+
+	return value;
+}
+
+/*
+ * @brief Function that returns a register without side effects
+ * @param addr: I2C1 register
+ * @return Value
+ */
+static uint32_t simPeek(uintptr_t addr)
+{
+	if (addr == (uintptr_t)&I2C1->CR1)
+		return sim.cr1;
+	if (addr == (uintptr_t)&I2C1->CR2)
+		return sim.cr2;
+	if (addr == (uintptr_t)&I2C1->OAR1)
+		return sim.oar1;
+	if (addr == (uintptr_t)&I2C1->OAR2)
+		return sim.oar2;
+	if (addr == (uintptr_t)&I2C1->DR)
+		return sim.rxDr;
+	if (addr == (uintptr_t)&I2C1->SR1)
+		return simSr1();
+	if (addr == (uintptr_t)&I2C1->SR2)
+		return simSr2();
+	if (addr == (uintptr_t)&I2C1->CCR)
+		return sim.ccr;
+	if (addr == (uintptr_t)&I2C1->TRISE)
+		return sim.trise;
+
+	return sim.fltr;
+}
+
+/*
+ * @brief I2C page read
+ */
+static uint32_t simRead(void *ctx, uintptr_t addr, int effects)
+{
+	uint32_t value;
+
+	if (addr < I2C1_BASE || addr >= I2C1_BASE + sizeof(I2C_TypeDef))
+		return simPage[(addr - I2C_SIM_PAGE) / 4];
+
+	/* Read half of a store or read-modify-write */
+	if (!effects)
+		return simPeek(addr);
+
+	simAccess();
+
+	if (addr == (uintptr_t)&I2C1->SR1)
+	{
+		value = simStatus(addr);
+		if (value & SR1_SB)
+			sim.sbSeen = 1;
+		if (value & SR1_ADDR)
+			sim.addrSeen = 1;
+		return value;
+	}
+
+	if (addr == (uintptr_t)&I2C1->SR2)
+	{
+		value = simStatus(addr);
+
+		/* SR1 then SR2 clears ADDR and releases SCL */
+		if ((sim.flags & SR1_ADDR) && sim.addrSeen)
+		{
+			sim.flags &= ~SR1_ADDR;
+			if (sim.tra)
+				sim.txPhase = 1;
+			else
+				sim.rxPhase = 1;
+			simNext(hostNowNs);
+		}
+		return value;
+	}
+
+	sim.lastAddr = 0;
+
+	if (addr == (uintptr_t)&I2C1->DR && sim.rxFull)
+	{
+		value = sim.rxDr;
+		sim.rxFull = 0;
+		if (sim.rxShiftFull)
+		{
+			sim.rxDr = sim.rxShift;
+			sim.rxFull = 1;
+			sim.rxShiftFull = 0;
+			sim.flags &= ~SR1_BTF;
+		}
+		simNext(hostNowNs);
+		return value;
+	}
+
+	return simPeek(addr);
+}
+
+/*
+ * @brief Function that handles a write to CR1
+ * @param value: new CR1
+ * @return None
+ */
+static void simControl(uint32_t value)
+{
+	uint32_t old = sim.cr1;
+
+	if (value & CR1_SWRST)
+	{
+		I2CSimDevice *dev = sim.dev;
+		memset(&sim, 0, sizeof(sim));
+		sim.cr1 = value;
+		if (dev && dev->stop)
+			dev->stop(dev, hostNowNs);
+		return;
+	}
+
+	sim.cr1 = value;
+
+	if ((value & CR1_START) && !(old & CR1_START))
+	{
+		sim.startPending = 1;
+		if (!sim.msl && sim.op == OP_NONE)
+		{
+			/* Bus idle: new transaction */
+			simDropUnread();
+			sim.msl = 1;
+			sim.txnStart = hostNowNs;
+			i2cSimStats.transactions++;
+		}
+		if (sim.op == OP_NONE)
+			simDropUnread();
+	}
+
+	/* A STOP bit written back after the STOP went out would end the next transaction
+	   right after its START; counted, not played */
+	if ((value & CR1_STOP) && !(old & CR1_STOP))
+	{
+		if (sim.msl)
+			sim.stopPending = 1;
+		else
+		{
+			sim.cr1 &= ~CR1_STOP;
+			i2cSimStats.strayStops++;
+		}
+	}
+
+	simNext(hostNowNs);
+}
+
+/*
+ * @brief I2C page write
+ */
+static void simWrite(void *ctx, uintptr_t addr, uint32_t value)
+{
+	if (addr < I2C1_BASE || addr >= I2C1_BASE + sizeof(I2C_TypeDef))
+	{
+		simPage[(addr - I2C_SIM_PAGE) / 4] = value;
+		return;
+	}
+
+	simAccess();
+	sim.lastAddr = 0;
+
+	if (addr == (uintptr_t)&I2C1->CR1)
+		simControl(value & 0xBFFF);
+	else if (addr == (uintptr_t)&I2C1->CR2)
+		sim.cr2 = value & 0x1F3F;
+	else if (addr == (uintptr_t)&I2C1->OAR1)
+		sim.oar1 = value;
+	else if (addr == (uintptr_t)&I2C1->OAR2)
+		sim.oar2 = value;
+	else if (addr == (uintptr_t)&I2C1->CCR)
+		sim.ccr = value & 0xCFFF;
+	else if (addr == (uintptr_t)&I2C1->TRISE)
+		sim.trise = value & 0x3F;
+	else if (addr == (uintptr_t)&I2C1->FLTR)
+		sim.fltr = value & 0x1F;
+	else if (addr == (uintptr_t)&I2C1->SR1)
+		sim.flags &= value | ~SR1_RC_W0;
+	else if (addr == (uintptr_t)&I2C1->DR)
+	{
+		value &= 0xFF;
+		if ((sim.flags & SR1_SB) && sim.sbSeen)
+		{
+			/* SR1 read then DR write clears SB and sends the address */
+			sim.flags &= ~SR1_SB;
+			sim.shift = value;
+			simBegin(OP_ADDR, hostNowNs);
+		}
+		else if (sim.txPhase)
+		{
+			sim.txDr = value;
+			sim.txFull = 1;
+			simNext(hostNowNs);
+		}
+	}
+}
+
+/*
+ * @brief Function that resets the peripheral, detaches every device and clears the statistics
+ * @details Traps the I2C1 page on first use.
+ * @param None
+ * @return None
+ */
+void i2cSimInit(void)
+{
+	if (!simTrapped)
+	{
+		memcpy(simPage, (void *)I2C_SIM_PAGE, sizeof(simPage));
+		mmioTrap(I2C_SIM_PAGE, I2C_SIM_PAGE_SIZE, simRead, simWrite, 0);
+		simTrapped = 1;
+	}
+
+	memset(&sim, 0, sizeof(sim));
+	memset(&i2cSimStats, 0, sizeof(i2cSimStats));
+	simDeviceCount = 0;
+	simPreemptPercent = 0;
+}
+
+/*
+ * @brief Function that lets the wire finish what the firmware left on it (the last STOP)
+ * @details Moves the virtual clock to the end of the operation; the firmware sees the same
+ * 			when it next waits for the bus.
+ * @param None
+ * @return None
+ */
+void i2cSimSettle(void)
+{
+	simRun(hostNowNs);
+	while (sim.op != OP_NONE)
+	{
+		if (sim.opEnd > hostNowNs)
+			hostNowNs = sim.opEnd;
+		simRun(hostNowNs);
+	}
+}
+
+/*
+ * @brief Function that connects a device model to the bus
+ * @param dev: device
+ * @return None
+ */
+void i2cSimAttach(I2CSimDevice *dev)
+{
+	if (simDeviceCount < I2C_SIM_DEVICES)
+		simDevices[simDeviceCount++] = dev;
+}
+
+/*
+ * @brief Function that delays register accesses at random, as interrupts would
+ * @param percent: chance of a delay before each access with interrupts enabled
+ * @param maxNs: longest delay
+ * @param seed: random sequence
+ * @return None
+ */
+void i2cSimPreempt(int percent, uint32_t maxNs, uint32_t seed)
+{
+	simPreemptPercent = percent;
+	simPreemptMaxNs = maxNs ? maxNs : 1;
+	simRandom = seed;
+}
@@ -0,0 +1,54 @@
+/*
+ * @file i2c_sim.h
+ * @brief Simulated I2C1 master peripheral and bus for the host tests
+ * @details This module is the header file for the i2c_sim.c module
+ *
+ * @author: Aeron Lahoylahoy
+ * @date: June 27, 2024
+ */
+
+#ifndef I2C_SIM_H_
+#define I2C_SIM_H_
+
+#include <stdint.h>
+
+#define I2C_SIM_DEVICES 4
+#define I2C_SIM_ACCESS_NS 40 /* one I2C register access from the CPU (APB1) */
+
+/* Device on the bus. Models embed this as their first member; t is the bus time (ns)
+   of the event, which can be behind hostNowNs while the wire catches up. */
+typedef struct I2CSimDevice I2CSimDevice;
+struct I2CSimDevice
+{
+	uint8_t addr; /* 7-bit */
+	const char *name;
+	int (*start)(I2CSimDevice *dev, int read, uint64_t t); /* address phase, returns 1 to ACK */
+	int (*write)(I2CSimDevice *dev, uint8_t byte, uint64_t t); /* returns 1 to ACK */
+	uint8_t (*read)(I2CSimDevice *dev, uint64_t t);
+	void (*stop)(I2CSimDevice *dev, uint64_t t);
+};
+
+/* Bus Statistics */
+typedef struct
+{
+	uint32_t transactions; /* START to STOP */
+	uint32_t bytes;		   /* address and data bytes clocked */
+	uint32_t nacks;
+	uint64_t busyNs; /* START to STOP, summed */
+
+	/* Protocol violations */
+	uint32_t ackedBeforeStop; /* last byte of a read ACKed, the slave still drives SDA at the STOP */
+	uint32_t extraBytes;	  /* bytes clocked out of a slave that the firmware never read */
+	uint32_t strayStops;	  /* STOP set with the bus idle, ends the next transaction early */
+} I2CSimStats;
+
+extern I2CSimStats i2cSimStats;
+
+/* Simulator Functions */
+void i2cSimInit(void);
+void i2cSimAttach(I2CSimDevice *dev);
+void i2cSimPreempt(int percent, uint32_t maxNs, uint32_t seed);
+void i2cSimSettle(void);
+uint32_t i2cSimBitNs(void);
+
+#endif /* I2C_SIM_H_ */
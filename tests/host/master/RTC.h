@@ -0,0 +1,8 @@
+/*
+ * @file RTC.h
+ * @brief Include name used by the firmware, for case-sensitive host file systems
+ *
+ * @author: Aeron Lahoylahoy
+ * @date: June 27, 2024
+ */
+#include "rtc.h"
@@ -0,0 +1,8 @@
+/*
+ * @file iLI9341.h
+ * @brief Include name used by the firmware, for case-sensitive host file systems
+ *
+ * @author: Aeron Lahoylahoy
+ * @date: June 27, 2024
+ */
+#include "ili9341.h"
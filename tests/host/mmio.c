@@ -0,0 +1,198 @@
+/*
+ * @file 	mmio.c
+ * @brief 	Trapped register pages for the host tests
+ * @details Lets a model stand behind a page of the host register map, so firmware that
+ * 			polls and writes the registers runs unmodified against it.
+ *
+ * 			A trapped page is kept inaccessible. Each access faults (SIGSEGV); the handler
+ * 			asks the model for the register's current value, opens the page and single-steps
+ * 			the faulting instruction (x86-64 trap flag). The debug trap that follows
+ * 			(SIGTRAP) hands a store to the model and closes the page again. The fault's
+ * 			error code tells a store (or read-modify-write) from a plain load, so read side
+ * 			effects such as clearing a flag on a status read only happen on real reads.
+ *
+ * @note 	Linux x86-64 only. Accesses are word-granular: a byte access gets the whole word.
+ *
+ * @author: Aeron Lahoylahoy
+ * @date: June 27, 2024
+ */
+#define _GNU_SOURCE
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <ucontext.h>
+#include "mmio.h"
+
+#define MMIO_PAGE 4096
+#define MMIO_REGIONS 8
+#define MMIO_TRAP_FLAG 0x100 /* EFLAGS.TF */
+#define MMIO_ERR_WRITE 0x2	 /* page fault error code: write access */
+
+/* Trapped Region */
+typedef struct
+{
+	uintptr_t base;
+	size_t size;
+	MmioRead read;
+	MmioWrite write;
+	void *ctx;
+} MmioRegion;
+
+static MmioRegion mmioRegions[MMIO_REGIONS];
+static int mmioRegionCount = 0;
+static int mmioInstalled = 0;
+static uint32_t mmioAccessCount = 0;
+
+/* Access being single-stepped */
+static MmioRegion *mmioPending = 0;
+static uintptr_t mmioPendingAddr;
+static int mmioPendingWrite;
+
+/*
+ * @brief Function that finds the region of an address
+ * @param addr: faulting address
+ * @return Region, or 0 if the fault isn't ours
+ */
+static MmioRegion *mmioFind(uintptr_t addr)
+{
+	for (int i = 0; i < mmioRegionCount; i++)
+	{
+		if (addr >= mmioRegions[i].base && addr < mmioRegions[i].base + mmioRegions[i].size)
+			return &mmioRegions[i];
+	}
+
+	return 0;
+}
+
+/*
+ * @brief Function that restores the default action and re-raises a fault that isn't ours
+ * @param sig: signal number
+ * @return None
+ */
+static void mmioPassOn(int sig)
+{
+	signal(sig, SIG_DFL);
+	raise(sig);
+}
+
+/*
+ * @brief SIGSEGV handler: fills the register from the model and steps the access
+ */
+static void mmioFault(int sig, siginfo_t *info, void *context)
+{
+	ucontext_t *uc = context;
+	uintptr_t addr = (uintptr_t)info->si_addr & ~(uintptr_t)3;
+	MmioRegion *r = mmioFind(addr);
+
+	if (!r || mmioPending)
+	{
+		mmioPassOn(sig);
+		return;
+	}
+
+	mmioAccessCount++;
+	mmioPending = r;
+	mmioPendingAddr = addr;
+	mmioPendingWrite = (uc->uc_mcontext.gregs[REG_ERR] & MMIO_ERR_WRITE) != 0;
+
+	mprotect((void *)r->base, r->size, PROT_READ | PROT_WRITE);
+	*(volatile uint32_t *)addr = r->read(r->ctx, addr, !mmioPendingWrite);
+	uc->uc_mcontext.gregs[REG_EFL] |= MMIO_TRAP_FLAG;
+}
+
+/*
+ * @brief SIGTRAP handler: hands a store to the model and closes the page
+ */
+static void mmioStep(int sig, siginfo_t *info, void *context)
+{
+	ucontext_t *uc = context;
+	MmioRegion *r = mmioPending;
+
+	if (!r)
+	{
+		mmioPassOn(sig);
+		return;
+	}
+
+	uc->uc_mcontext.gregs[REG_EFL] &= ~MMIO_TRAP_FLAG;
+	mmioPending = 0;
+
+	if (mmioPendingWrite)
+		r->write(r->ctx, mmioPendingAddr, *(volatile uint32_t *)mmioPendingAddr);
+	mprotect((void *)r->base, r->size, PROT_NONE);
+}
+
+/*
+ * @brief Function that puts a model behind a page-aligned range of the register map
+ * @param base: first address, page aligned
+ * @param size: bytes, a multiple of the page size
+ * @param read: returns a register's value
+ * @param write: takes a stored value
+ * @param ctx: passed to the callbacks
+ * @return None
+ */
+void mmioTrap(uintptr_t base, size_t size, MmioRead read, MmioWrite write, void *ctx)
+{
+	struct sigaction sa;
+
+	if ((base | size) & (MMIO_PAGE - 1) || mmioRegionCount >= MMIO_REGIONS)
+	{
+		fprintf(stderr, "mmio: bad region 0x%08lx+%lu\n", (unsigned long)base, (unsigned long)size);
+		exit(2);
+	}
+
+	if (!mmioInstalled)
+	{
+		memset(&sa, 0, sizeof(sa));
+		sa.sa_flags = SA_SIGINFO | SA_NODEFER;
+		sigemptyset(&sa.sa_mask);
+		sa.sa_sigaction = mmioFault;
+		sigaction(SIGSEGV, &sa, 0);
+		sa.sa_sigaction = mmioStep;
+		sigaction(SIGTRAP, &sa, 0);
+		mmioInstalled = 1;
+	}
+
+	mmioRegions[mmioRegionCount++] = (MmioRegion){base, size, read, write, ctx};
+	mprotect((void *)base, size, PROT_NONE);
+}
+
+/*
+ * @brief Function that turns a trapped range back into plain memory
+ * @param base: first address given to mmioTrap()
+ * @return None
+ */
+void mmioRelease(uintptr_t base)
+{
+	for (int i = 0; i < mmioRegionCount; i++)
+	{
+		if (mmioRegions[i].base == base)
+		{
+			mprotect((void *)base, mmioRegions[i].size, PROT_READ | PROT_WRITE);
+			mmioRegions[i] = mmioRegions[--mmioRegionCount];
+			return;
+		}
+	}
+}
+
+/*
+ * @brief Function that tells whether an address is behind a model
+ * @param addr: address
+ * @return 1 if trapped, 0 if plain memory
+ */
+int mmioTrapped(uintptr_t addr)
+{
+	return mmioFind(addr) != 0;
+}
+
+/*
+ * @brief Function that returns the number of trapped accesses so far
+ * @param None
+ * @return Accesses
+ */
+uint32_t mmioAccesses(void)
+{
+	return mmioAccessCount;
+}
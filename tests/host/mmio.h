@@ -0,0 +1,27 @@
+/*
+ * @file mmio.h
+ * @brief Trapped register pages for the host tests
+ * @details This module is the header file for the mmio.c module
+ *
+ * @author: Aeron Lahoylahoy
+ * @date: June 27, 2024
+ */
+
+#ifndef MMIO_H_
+#define MMIO_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Register Callbacks: addr is the word address, read() is called with effects = 0 for
+   the read half of a read-modify-write, which must not change the model's state */
+typedef uint32_t (*MmioRead)(void *ctx, uintptr_t addr, int effects);
+typedef void (*MmioWrite)(void *ctx, uintptr_t addr, uint32_t value);
+
+/* MMIO Functions */
+void mmioTrap(uintptr_t base, size_t size, MmioRead read, MmioWrite write, void *ctx);
+void mmioRelease(uintptr_t base);
+int mmioTrapped(uintptr_t addr);
+uint32_t mmioAccesses(void);
+
+#endif /* MMIO_H_ */
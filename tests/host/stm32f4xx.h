@@ -0,0 +1,90 @@
+/*
+ * @file stm32f4xx.h
+ * @brief Host stand-in for the CMSIS device header
+ * @details Firmware sources include "stm32f4xx.h"; the tests put this directory first on the
+ * 			include path so they get the real STM32F446 register map with the ARM-only
+ * 			intrinsics replaced by host versions.
+ *
+ * 			The peripheral and core register blocks are mapped at their real addresses by
+ * 			host.c, so every GPIOx, TIMx, NVIC etc. in the firmware is ordinary host memory
+ * 			that a test can set up, inspect, or hand to a device model.
+ *
+ * 			Interrupts don't preempt anything on the host: a test calls the IRQ handler
+ * 			itself at the point the hardware would take it.
+ *
+ * @author: Aeron Lahoylahoy
+ * @date: June 27, 2024
+ */
+
+#ifndef HOST_STM32F4XX_H_
+#define HOST_STM32F4XX_H_
+
+#include <stdint.h>
+
+#ifndef STM32F446xx
+#define STM32F446xx
+#endif
+
+/* Keep cmsis_gcc.h (ARM inline assembly) out, core_cm4.h gets the host versions below */
+#define __CMSIS_GCC_H
+
+#define __ASM __asm
+#define __INLINE inline
+#define __STATIC_INLINE static inline
+#define __STATIC_FORCEINLINE __attribute__((always_inline)) static inline
+#define __NO_RETURN __attribute__((__noreturn__))
+#define __USED __attribute__((used))
+#define __WEAK __attribute__((weak))
+#define __PACKED __attribute__((packed, aligned(1)))
+#define __PACKED_STRUCT struct __attribute__((packed, aligned(1)))
+#define __PACKED_UNION union __attribute__((packed, aligned(1)))
+#define __ALIGNED(x) __attribute__((aligned(x)))
+#define __RESTRICT __restrict
+#define __COMPILER_BARRIER() __asm volatile("" ::: "memory")
+
+/* Host Core State */
+extern uint32_t hostPrimask; /* 1 while the firmware has interrupts masked */
+extern uint32_t hostWfiCount;
+extern void (*hostOnWfi)(void); /* test hook, runs what would wake the core */
+void hostWfi(void);
+
+/* Intrinsics */
+__STATIC_FORCEINLINE void __enable_irq(void) { hostPrimask = 0; }
+__STATIC_FORCEINLINE void __disable_irq(void) { hostPrimask = 1; }
+__STATIC_FORCEINLINE uint32_t __get_PRIMASK(void) { return hostPrimask; }
+__STATIC_FORCEINLINE void __set_PRIMASK(uint32_t primask) { hostPrimask = primask & 1; }
+__STATIC_FORCEINLINE void __NOP(void) { __COMPILER_BARRIER(); }
+__STATIC_FORCEINLINE void __DSB(void) { __sync_synchronize(); }
+__STATIC_FORCEINLINE void __DMB(void) { __sync_synchronize(); }
+__STATIC_FORCEINLINE void __ISB(void) { __sync_synchronize(); }
+__STATIC_FORCEINLINE void __WFI(void) { hostWfi(); }
+__STATIC_FORCEINLINE void __WFE(void) { hostWfi(); }
+__STATIC_FORCEINLINE uint8_t __CLZ(uint32_t value) { return value ? __builtin_clz(value) : 32; }
+
+/* Exclusive access: nothing runs between the two on the host, the store always succeeds */
+__STATIC_FORCEINLINE uint32_t __LDREXW(volatile uint32_t *addr) { return *addr; }
+__STATIC_FORCEINLINE uint32_t __STREXW(uint32_t value, volatile uint32_t *addr)
+{
+	*addr = value;
+	return 0;
+}
+__STATIC_FORCEINLINE void __CLREX(void) {}
+
+#include "stm32f446xx.h"
+
+/* SRAM1 is the host's data segment, so BITBAND_SRAM() (flags.h) lands in the alias
+   host.c traps. Needs a non-PIE build: the firmware truncates addresses to 32 bits. */
+extern char __data_start[];
+#undef SRAM1_BASE
+#define SRAM1_BASE ((uint32_t)(uintptr_t)__data_start)
+
+/* Host Register Map */
+void hostRegistersReset(void); /* zero every peripheral and core register not behind a model */
+
+/* Virtual Time */
+extern uint64_t hostNowNs;
+void hostAdvance(uint64_t ns);
+void hostTimebaseTrap(void); /* TIM5->CNT follows hostNowNs */
+void hostTimebaseEvent(uint32_t flags); /* TIM5->SR is rc_w0, this sets flags */
+
+#endif /* HOST_STM32F4XX_H_ */
@@ -0,0 +1,292 @@
+/*
+ * @file 	test_buttons.c
+ * @brief 	Vertical counter debouncer: bounce patterns, parallel pins and the event queue
+ * @details Drives the unmodified TIM6 sampler of button_functions.c one millisecond at a
+ * 			time with the button levels in GPIO IDR. Buttons are active low.
+ *
+ * @author: Aeron Lahoylahoy
+ * @date: June 27, 2024
+ */
+#include <string.h>
+#include "check.h"
+#include "stm32f4xx.h"
+#include "button_functions.h"
+
+void TIM6_DAC_IRQHandler(void);
+
+/* button_functions.c internals */
+extern uint16_t buttonMask[BUTTON_PORTS];
+extern uint16_t buttonCnt0[BUTTON_PORTS];
+extern uint16_t buttonCnt1[BUTTON_PORTS];
+extern volatile int buttonHead;
+extern volatile int buttonTail;
+
+#define SAMPLES 4 /* equal samples to change state */
+
+/*
+ * @brief Function that starts the sampler with every button released
+ * @param None
+ * @return None
+ */
+static void setup(void)
+{
+	hostRegistersReset();
+	memset(buttonMask, 0, sizeof(buttonMask));
+	memset(buttonState, 0, sizeof(buttonState));
+	memset(buttonCnt0, 0, sizeof(buttonCnt0));
+	memset(buttonCnt1, 0, sizeof(buttonCnt1));
+	buttonHead = buttonTail = 0;
+	buttonEventsLost = 0;
+	buttonTicks = 0;
+
+	GPIOA->IDR = 0xFFFF;
+	GPIOB->IDR = 0xFFFF;
+	GPIOC->IDR = 0xFFFF;
+	buttonInputInit(GPIOA, 0);
+	buttonInputInit(GPIOA, 6);
+	buttonInputInit(GPIOB, 1);
+	buttonInputInit(GPIOC, 13);
+	debounceInit();
+}
+
+/*
+ * @brief Function that sets a button level
+ * @param port: GPIO port
+ * @param pin: pin
+ * @param pressed: 1 = pressed (low)
+ * @return None
+ */
+static void level(GPIO_TypeDef *port, int pin, int pressed)
+{
+	if (pressed)
+		port->IDR &= ~(0b1 << pin);
+	else
+		port->IDR |= 0b1 << pin;
+}
+
+/*
+ * @brief Function that runs the sampler for a number of milliseconds
+ * @param ms: TIM6 updates
+ * @return None
+ */
+static void tick(int ms)
+{
+	while (ms--)
+	{
+		TIM6->SR = 1;
+		TIM6_DAC_IRQHandler();
+	}
+}
+
+/*
+ * @brief Function that plays a bounce pattern on one pin, one character per millisecond
+ * @param port: GPIO port
+ * @param pin: pin
+ * @param pattern: '1' pressed (low), '0' released
+ * @return None
+ */
+static void play(GPIO_TypeDef *port, int pin, const char *pattern)
+{
+	for (; *pattern; pattern++)
+	{
+		level(port, pin, *pattern == '1');
+		tick(1);
+	}
+}
+
+/*
+ * @brief Function that counts the queued events, emptying the queue
+ * @param last: location of the last event, or 0
+ * @return Events taken
+ */
+static int drain(ButtonEvent *last)
+{
+	ButtonEvent event;
+	int n = 0;
+
+	while (buttonGetEvent(&event))
+	{
+		n++;
+		if (last)
+			*last = event;
+	}
+	return n;
+}
+
+/*
+ * @brief Contact bounce on press and release gives one event each, stamped when the level settled
+ */
+static void testBounce(void)
+{
+	static const char *const presses[] = {
+		"1111",				/* clean */
+		"10101111",			/* fast chatter */
+		"1101110110011101111",	/* three sample runs don't count */
+		"100110111011101111",
+	};
+	ButtonEvent event;
+
+	for (unsigned int i = 0; i < sizeof(presses) / sizeof(presses[0]); i++)
+	{
+		uint32_t settled;
+
+		setup();
+		tick(10);
+		play(GPIOA, 6, presses[i]);
+		settled = buttonTicks;
+		tick(20);
+
+		CHECK_EQ(drain(&event), 1);
+		CHECK_EQ(event.port, 0);
+		CHECK_EQ(event.pin, 6);
+		CHECK_EQ(event.pressed, 1);
+		CHECK_EQ(event.time, settled);
+		CHECK_EQ(debounceButton(GPIOA, 6), 1);
+
+		/* Release with the mirrored bounce */
+		for (const char *p = presses[i]; *p; p++)
+		{
+			level(GPIOA, 6, *p == '0');
+			tick(1);
+		}
+		settled = buttonTicks;
+		tick(20);
+		CHECK_EQ(drain(&event), 1);
+		CHECK_EQ(event.pressed, 0);
+		CHECK_EQ(event.time, settled);
+		CHECK_EQ(debounceButton(GPIOA, 6), 0);
+	}
+}
+
+/*
+ * @brief Glitches shorter than SAMPLES milliseconds never change the state
+ */
+static void testGlitch(void)
+{
+	setup();
+	for (int width = 1; width < SAMPLES; width++)
+	{
+		level(GPIOB, 1, 1);
+		tick(width);
+		level(GPIOB, 1, 0);
+		tick(10);
+	}
+	CHECK_EQ(drain(0), 0);
+	CHECK_EQ(debounceButton(GPIOB, 1), 0);
+
+	/* Periodic noise: never SAMPLES equal samples in a row */
+	play(GPIOB, 1, "11101110111011101110111011101110");
+	tick(10);
+	CHECK_EQ(drain(0), 0);
+}
+
+/*
+ * @brief Pins on every port bounce at once: debounced in parallel, one event each, same tick
+ */
+static void testParallel(void)
+{
+	ButtonEvent events[8];
+	ButtonEvent event;
+	int n = 0;
+	const char *pattern = "1011011111";
+
+	setup();
+	tick(5);
+	for (const char *p = pattern; *p; p++)
+	{
+		level(GPIOA, 0, *p == '1');
+		level(GPIOA, 6, *p == '1');
+		level(GPIOB, 1, *p == '1');
+		level(GPIOC, 13, *p == '1');
+		tick(1);
+	}
+	tick(10);
+
+	while (n < 8 && buttonGetEvent(&event))
+		events[n++] = event;
+
+	CHECK_EQ(n, 4);
+	for (int i = 0; i < n; i++)
+	{
+		CHECK_EQ(events[i].pressed, 1);
+		CHECK_EQ(events[i].time, events[0].time);
+	}
+	CHECK(events[0].port == 0 && events[1].port == 0 && events[2].port == 1 && events[3].port == 2);
+	CHECK_EQ(events[3].pin, 13);
+
+	/* Pins nobody registered don't make events */
+	level(GPIOA, 1, 1);
+	level(GPIOC, 0, 1);
+	tick(20);
+	CHECK_EQ(drain(0), 0);
+}
+
+/*
+ * @brief Random bounce: each press and release gives exactly one event, SAMPLES ms after the last bounce
+ */
+static void testRandomBounce(void)
+{
+	uint32_t seed = 777;
+	int events = 0;
+	int wrongTime = 0;
+
+	setup();
+	for (int press = 0; press < 500; press++)
+	{
+		int target = !(press & 1);
+		int bounces = seed % 12;
+		uint32_t settled;
+		ButtonEvent event;
+
+		/* Chatter, ending on the opposite level so the settle time is known */
+		for (int b = 0; b < bounces; b++)
+		{
+			seed = seed * 1103515245 + 12345;
+			level(GPIOC, 13, (b & 1) ? !target : target);
+			tick(1 + (seed >> 16) % (SAMPLES - 1));
+		}
+		level(GPIOC, 13, !target);
+		tick(1);
+		level(GPIOC, 13, target);
+		tick(SAMPLES);
+		settled = buttonTicks;
+		tick(5 + seed % 7);
+
+		events += drain(&event);
+		wrongTime += event.time != settled || event.pressed != target;
+	}
+
+	CHECK_EQ(events, 500);
+	CHECK_EQ(wrongTime, 0);
+	CHECK_EQ(buttonEventsLost, 0);
+}
+
+/*
+ * @brief A full queue counts the lost events and keeps the queued ones
+ */
+static void testQueueFull(void)
+{
+	ButtonEvent event;
+
+	setup();
+	for (int i = 0; i < BUTTON_EVENTS + 4; i++)
+	{
+		level(GPIOA, 0, !(i & 1));
+		tick(SAMPLES);
+	}
+
+	CHECK_EQ(drain(&event), BUTTON_EVENTS - 1);
+	CHECK_EQ(buttonEventsLost, 5);
+	CHECK_EQ(event.time, (BUTTON_EVENTS - 1) * SAMPLES);
+}
+
+int main(void)
+{
+	testBounce();
+	testGlitch();
+	testParallel();
+	testRandomBounce();
+	testQueueFull();
+
+	return checkExit("test_buttons");
+}
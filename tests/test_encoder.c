@@ -0,0 +1,292 @@
+/*
+ * @file 	test_encoder.c
+ * @brief 	Rotary encoder: Gray-code decoder, detents and acceleration
+ * @details Drives the unmodified EXTI1/EXTI2 handlers with A/B waveforms: CLK and DT
+ * 			levels in GPIOB IDR and the changed lines pending in EXTI PR, the way the
+ * 			pins present them. encoderService() then runs from the "main loop" with
+ * 			TIM5 time advanced between edges.
+ *
+ * @author: Aeron Lahoylahoy
+ * @date: June 27, 2024
+ */
+#include <string.h>
+#include "check.h"
+#include "stm32f4xx.h"
+#include "timebase.h"
+#include "display.h"
+#include "rtc.h"
+#include "rotary_encoder.h"
+
+/* display.c and rtc.c state the encoder edits */
+int state = MENUSTATE;
+int blinkMenuFlag = 0;
+int changeTimeFlag = 0;
+int changeDateFlag = 0;
+int changeTimeCount = 0;
+int changeDateCount = 0;
+int hour;
+int min;
+int ampmFlag;
+int month;
+int date;
+int year;
+
+/* rotary_encoder.c internals */
+extern uint8_t encoderState;
+extern int32_t encoderDetentStep;
+extern uint32_t encoderLastDetent;
+
+void EXTI1_IRQHandler(void);
+void EXTI2_IRQHandler(void);
+
+#define US 1000ULL
+#define MS 1000000ULL
+
+/* AB (CLK << 1 | DT) sequences of one detent from the 11 resting state */
+static const uint8_t clockwise[4] = {0b01, 0b00, 0b10, 0b11};
+static const uint8_t counterClockwise[4] = {0b10, 0b00, 0b01, 0b11};
+
+/*
+ * @brief Function that starts the decoder with the knob resting at 11
+ * @param None
+ * @return None
+ */
+static void setup(void)
+{
+	hostRegistersReset();
+	GPIOB->IDR = 0xFFFF;
+	encoderSteps = 0;
+	encoderLastDetent = getMicros();
+	rotaryEncoderInit();
+
+	state = TIMESTATE;
+	blinkMenuFlag = 0;
+	changeTimeCount = 1;
+	changeDateCount = 0;
+	hour = 12;
+	min = 30;
+	month = 6;
+}
+
+/*
+ * @brief Function that sets the A/B levels and runs the EXTI handlers of the lines that changed
+ * @param ab: CLK << 1 | DT
+ * @return None
+ */
+static void setAB(int ab)
+{
+	uint32_t old = GPIOB->IDR;
+	uint32_t idr = (old & ~((0b1 << ENCODER_CLK_PIN) | (0b1 << ENCODER_DT_PIN))) |
+				   ((ab >> 1) & 0b1) << ENCODER_CLK_PIN | (ab & 0b1) << ENCODER_DT_PIN;
+	uint32_t changed = (old ^ idr) & EXTI->IMR;
+
+	GPIOB->IDR = idr;
+	EXTI->PR = changed;
+	if (changed & (0b1 << ENCODER_CLK_PIN))
+		EXTI1_IRQHandler();
+	if (changed & (0b1 << ENCODER_DT_PIN))
+		EXTI2_IRQHandler();
+	EXTI->PR = 0; /* write 1 to clear on the target */
+}
+
+/*
+ * @brief Function that turns one detent, the edges spread over the gap
+ * @param direction: 1 clockwise, -1 counterclockwise
+ * @param gapUs: time for the detent
+ * @return None
+ */
+static void detent(int direction, uint32_t gapUs)
+{
+	const uint8_t *sequence = direction > 0 ? clockwise : counterClockwise;
+
+	for (int i = 0; i < 4; i++)
+	{
+		hostAdvance(gapUs / 4 * US);
+		setAB(sequence[i]);
+	}
+}
+
+/*
+ * @brief Every entry of the Gray-code table: one step per valid edge, nothing for a double jump
+ */
+static void testGrayTable(void)
+{
+	setup();
+
+	for (int previous = 0; previous < 4; previous++)
+	{
+		for (int current = 0; current < 4; current++)
+		{
+			int change = previous ^ current;
+			int expected = 0;
+			int32_t before;
+
+			/* Clockwise order is 11 01 00 10 */
+			for (int i = 0; i < 4; i++)
+			{
+				if (clockwise[(i + 3) % 4] == previous && clockwise[i] == current)
+					expected = 1;
+				if (counterClockwise[(i + 3) % 4] == previous && counterClockwise[i] == current)
+					expected = -1;
+			}
+
+			setAB(previous);
+			before = encoderSteps;
+			setAB(current);
+
+			CHECK_EQ(encoderSteps - before, expected);
+			if (change == 0b11)
+				CHECK_EQ(expected, 0);
+		}
+	}
+}
+
+/*
+ * @brief A/B waveform with contact bounce on every edge: bounces cancel, detents are exact
+ */
+static void testBouncyWaveform(void)
+{
+	uint32_t seed = 2024;
+	int net = 0;
+	int expectedHour;
+
+	setup();
+	for (int run = 0; run < 60; run++)
+	{
+		int direction = (seed >> 20) & 1 ? 1 : -1;
+		int length = 1 + (seed >> 8) % 6;
+		const uint8_t *sequence = direction > 0 ? clockwise : counterClockwise;
+
+		for (int d = 0; d < length; d++)
+		{
+			int ab = 0b11;
+
+			for (int i = 0; i < 4; i++)
+			{
+				int bounces;
+
+				seed = seed * 1103515245 + 12345;
+				bounces = (seed >> 16) % 4;
+
+				/* The changing pin chatters between the old and new level */
+				for (int b = 0; b < bounces; b++)
+				{
+					hostAdvance(50 * US);
+					setAB(sequence[i]);
+					hostAdvance(50 * US);
+					setAB(ab);
+				}
+				hostAdvance(50 * MS);
+				setAB(sequence[i]);
+				ab = sequence[i];
+			}
+			encoderService();
+		}
+		net += direction * length;
+		seed = seed * 1103515245 + 12345;
+	}
+
+	CHECK_EQ(encoderSteps, net * ENCODER_STEPS_PER_DETENT);
+	expectedHour = ((12 - 1 + net) % 12 + 12) % 12 + 1;
+	CHECK_EQ(hour, expectedHour);
+}
+
+/*
+ * @brief Half a detent and back changes nothing; the service only applies whole detents
+ */
+static void testHalfDetent(void)
+{
+	setup();
+	hostAdvance(500 * MS);
+
+	setAB(clockwise[0]);
+	setAB(clockwise[1]);
+	encoderService();
+	CHECK_EQ(encoderSteps, 2);
+	CHECK_EQ(hour, 12);
+
+	setAB(clockwise[0]);
+	setAB(0b11);
+	encoderService();
+	CHECK_EQ(encoderSteps, 0);
+	CHECK_EQ(hour, 12);
+
+	/* Finishing the detent late still counts once */
+	setAB(clockwise[0]);
+	setAB(clockwise[1]);
+	encoderService();
+	setAB(clockwise[2]);
+	setAB(clockwise[3]);
+	encoderService();
+	CHECK_EQ(hour, 1);
+}
+
+/*
+ * @brief Detents less than ENCODER_MEDIUM_US or ENCODER_FAST_US apart move 2 or 5 for every field
+ */
+static void testAcceleration(void)
+{
+	static const struct
+	{
+		uint32_t gapUs;
+		int step;
+	} speeds[] = {
+		{200000, 1},
+		{ENCODER_MEDIUM_US - 10000, ENCODER_MEDIUM_STEP},
+		{ENCODER_FAST_US - 10000, ENCODER_FAST_STEP},
+	};
+
+	for (unsigned int i = 0; i < sizeof(speeds) / sizeof(speeds[0]); i++)
+	{
+		/* Hours */
+		setup();
+		detent(1, 500000);
+		encoderService();
+		hour = 1;
+		detent(1, speeds[i].gapUs);
+		encoderService();
+		CHECK_EQ(hour, 1 + speeds[i].step);
+		detent(-1, speeds[i].gapUs);
+		encoderService();
+		CHECK_EQ(hour, 1);
+		detent(-1, speeds[i].gapUs);
+		encoderService();
+		CHECK_EQ(hour, 13 - speeds[i].step);
+
+		/* Minutes */
+		changeTimeCount = 2;
+		detent(1, speeds[i].gapUs);
+		encoderService();
+		CHECK_EQ(min, 30 + speeds[i].step);
+
+		/* Months */
+		state = DATESTATE;
+		changeDateCount = 1;
+		month = 12;
+		detent(1, speeds[i].gapUs);
+		encoderService();
+		CHECK_EQ(month, speeds[i].step);
+	}
+
+	/* Two detents in one service call: the gap is shared between them */
+	setup();
+	detent(1, 500000);
+	encoderService();
+	hour = 1;
+	detent(1, 2 * (ENCODER_FAST_US - 10000));
+	detent(1, 0);
+	encoderService();
+	CHECK_EQ(hour, 1 + 2 * ENCODER_FAST_STEP);
+}
+
+int main(void)
+{
+	hostTimebaseTrap();
+
+	testGrayTable();
+	testBouncyWaveform();
+	testHalfDetent();
+	testAcceleration();
+
+	return checkExit("test_encoder");
+}
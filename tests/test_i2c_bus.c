@@ -0,0 +1,525 @@
+/*
+ * @file 	test_i2c_bus.c
+ * @brief 	Master I2C traffic on a simulated bus: RTC, EEPROM, slave link and sonar warning
+ * @details Runs the unmodified rtc.c, eeprom.c, sonar.c, link.c, i2c_scheduler.c and
+ * 			i2c_master.c against the simulated I2C1 (host/i2c_sim.c) with a DS3231, an
+ * 			AT24C32 and the slave STM32 on the bus, then reports how long each function
+ * 			holds the bus at the clock the firmware configured (I2C_SPEED_HZ).
+ *
+ * 			Every test also checks the bus itself: no read ends with an ACKed byte before
+ * 			the STOP, no byte is clocked out of a slave without being read, and no STOP is
+ * 			requested on an idle bus.
+ *
+ * @author: Aeron Lahoylahoy
+ * @date: June 27, 2024
+ */
+#include <string.h>
+#include "check.h"
+#include "stm32f4xx.h"
+#include "i2c_sim.h"
+#include "i2c_devices.h"
+#include "i2c_master.h"
+#include "i2c_scheduler.h"
+#include "timebase.h"
+#include "flags.h"
+#include "rtc.h"
+#include "eeprom.h"
+#include "display.h"
+#include "controls.h"
+#include "link.h"
+#include "sonar.h"
+#include "speed_sensor.h"
+
+/* Master state eeprom.c reaches into (display.c, controls.c, rotary_encoder.c, ili9341.c) */
+int state = -1;
+int menuScreen = 0;
+int bluetoothEnable = 0;
+int bluetoothDisplay = 0;
+int bluetoothCounter = 0;
+int menuShown = 0;
+void displayMenu(void) { menuShown++; }
+void displayBluetooth(int show) {}
+void handleButtons(void) {}
+void encoderService(void) {}
+int debounceButton(GPIO_TypeDef *port, int pin) { return 0; }
+void Fill_Rect(unsigned int x, unsigned int y, unsigned int w, unsigned int h, unsigned int color) {}
+void schedulerSignal(int task) {} /* speed_sensor.c, TIM4 */
+
+#define US 1000ULL
+#define MS 1000000ULL
+
+/* Devices */
+static DS3231 rtc;
+static AT24C32 eeprom;
+static LinkSlave slaveNode;
+
+/* Bus occupancy of one function */
+typedef struct
+{
+	const char *name;
+	void (*fn)(void);
+	uint32_t calls;
+	uint32_t transactions;
+	uint32_t bytes;
+	uint64_t busNs;
+	uint64_t elapsedNs;
+} Occupancy;
+
+static Occupancy occGetTime = {"getTime", getTime};
+static Occupancy occReadTemp = {"readTemp", readTemp};
+static Occupancy occReadSaved = {"readSavedData", readSavedData};
+static Occupancy occStoreMiles = {"storeMiles + i2cService", 0};
+static Occupancy occWarning = {"checkWarningSignal + linkService", 0};
+static Occupancy occLinkPoll = {"linkPollStatus", 0};
+static Occupancy occEepromRead = {"I2C1_burstRead (AT24C32, 1-15)", 0};
+
+/* Read for occEepromRead */
+static int readAddr;
+static int readLength;
+static char readBuf[32];
+
+/*
+ * @brief Function that runs a function and charges its bus traffic, up to its last STOP, to it
+ * @param occ: record
+ * @param fn: function, or 0 to use occ->fn
+ * @return None
+ */
+static void measure(Occupancy *occ, void (*fn)(void))
+{
+	I2CSimStats before;
+	uint64_t start;
+
+	i2cSimSettle();
+	before = i2cSimStats;
+	start = hostNowNs;
+
+	(fn ? fn : occ->fn)();
+	i2cSimSettle();
+
+	occ->calls++;
+	occ->transactions += i2cSimStats.transactions - before.transactions;
+	occ->bytes += i2cSimStats.bytes - before.bytes;
+	occ->busNs += i2cSimStats.busyNs - before.busyNs;
+	occ->elapsedNs += hostNowNs - start;
+}
+
+/*
+ * @brief Function that puts the three devices on a fresh bus and starts the master side
+ * @param None
+ * @return None
+ */
+static void setup(void)
+{
+	hostRegistersReset();
+	i2cSimInit();
+	ds3231Init(&rtc);
+	at24c32Init(&eeprom);
+	linkSlaveInit(&slaveNode);
+	i2cSimAttach(&rtc.dev);
+	i2cSimAttach(&eeprom.dev);
+	i2cSimAttach(&slaveNode.dev);
+
+	timebaseInit();
+	masterConfig();
+	i2cSchedulerInit();
+	i2cRegisterDevice(mileEEPROM);
+	memset(&linkState, 0, sizeof(linkState));
+	linkDirty = 0;
+	linkUrgent = I2C_TAG_NONE;
+}
+
+/*
+ * @brief Function that checks the bus saw no protocol violation
+ * @param None
+ * @return None
+ */
+static void checkBusClean(void)
+{
+	CHECK_EQ(i2cSimStats.ackedBeforeStop, 0);
+	CHECK_EQ(i2cSimStats.extraBytes, 0);
+	CHECK_EQ(i2cSimStats.strayStops, 0);
+}
+
+/*
+ * @brief Function that runs the bus task until the queue is empty or a time limit passes
+ * @param limitNs: virtual time limit
+ * @return None
+ */
+static void serviceFor(uint64_t limitNs)
+{
+	uint64_t end = hostNowNs + limitNs;
+
+	while (hostNowNs < end)
+	{
+		i2cService();
+		i2cSimSettle();
+		hostAdvance(100 * US);
+	}
+}
+
+/*
+ * @brief getTime() across midnight on New Year's Eve in 12-hour mode
+ */
+static void testRtcTime(void)
+{
+	setup();
+
+	rtc.regs[0] = 0x58;
+	rtc.regs[1] = 0x59;
+	rtc.regs[DS3231_REG_HOUR] = DS3231_HOUR_12 | DS3231_HOUR_PM | 0x11;
+	rtc.regs[3] = 7;
+	rtc.regs[4] = 0x31;
+	rtc.regs[5] = 0x12;
+	rtc.regs[6] = 0x99;
+
+	measure(&occGetTime, 0);
+	CHECK_EQ(hour, 11);
+	CHECK_EQ(min, 59);
+	CHECK_EQ(sec, 58);
+	CHECK_EQ(ampmFlag, PM);
+	CHECK_EQ(date, 31);
+	CHECK_EQ(month, 12);
+	CHECK_EQ(year, 99);
+	CHECK(strcmp(*dayS, "Saturday\n") == 0);
+
+	hostAdvance(2000 * MS);
+	measure(&occGetTime, 0);
+	CHECK_EQ(hour, 12);
+	CHECK_EQ(min, 0);
+	CHECK_EQ(sec, 0);
+	CHECK_EQ(ampmFlag, AM);
+	CHECK_EQ(date, 1);
+	CHECK_EQ(month, 1);
+	CHECK_EQ(year, 0);
+	CHECK(strcmp(*dayS, "Sunday\n") == 0);
+	CHECK(rtc.regs[5] & 0x80); /* century */
+
+	/* Noon: 11 AM -> 12 PM */
+	rtc.regs[0] = 0x59;
+	rtc.regs[1] = 0x59;
+	rtc.regs[DS3231_REG_HOUR] = DS3231_HOUR_12 | 0x11;
+	hostAdvance(1000 * MS);
+	measure(&occGetTime, 0);
+	CHECK_EQ(hour, 12);
+	CHECK_EQ(ampmFlag, PM);
+	CHECK_EQ(date, 1);
+
+	/* Seven one byte reads, each START, address, register, restart, address, data, STOP */
+	CHECK_EQ(i2cSimStats.transactions, 3 * 7);
+	CHECK(occGetTime.busNs >= 3 * 7 * 39ULL * i2cSimBitNs());
+	CHECK(occGetTime.busNs < 3 * 7 * (39ULL * i2cSimBitNs() + 5 * US));
+	checkBusClean();
+}
+
+/*
+ * @brief readTemp() of the two temperature registers
+ */
+static void testRtcTemp(void)
+{
+	setup();
+
+	ds3231SetTemp(&rtc, 25 * 4 + 3);
+	measure(&occReadTemp, 0);
+	CHECK_EQ(rtcTempArray[0], 25);
+	CHECK_EQ(rtcTempArray[1], 75);
+
+	ds3231SetTemp(&rtc, -5 * 4);
+	measure(&occReadTemp, 0);
+	CHECK_EQ(rtcTempArray[0], -5);
+	CHECK_EQ(rtcTempArray[1], 0);
+
+	checkBusClean();
+}
+
+/*
+ * @brief readSavedData() restores turn, display, bluetooth and miles, then one frame to the slave
+ */
+static void testEepromRestore(void)
+{
+	setup();
+
+	eeprom.mem[0] = 0x42; /* left */
+	eeprom.mem[1] = MENUSTATE;
+	eeprom.mem[2] = 0;
+	eeprom.mem[4] = 0x42; /* 42 miles, BCD */
+	eeprom.mem[0x104] = 0x99; /* what an 8-bit address would read */
+
+	measure(&occReadSaved, 0);
+	CHECK_EQ(linkState.turn, LINK_TURN_LEFT);
+	CHECK_EQ(state, MENUSTATE);
+	CHECK_EQ(menuShown, 1);
+	CHECK_EQ(traveledMiles, 42);
+	CHECK_EQ(storedMiles, 42);
+
+	/* The restored snapshot reached the slave as one frame */
+	CHECK_EQ(slaveNode.frames, 1);
+	CHECK_EQ(slaveNode.badFrames, 0);
+	CHECK_EQ(slaveNode.lastFrame[7], LINK_TURN_LEFT);
+	CHECK_EQ(slaveNode.lastFrame[10] | (slaveNode.lastFrame[11] << 8), 420);
+	checkBusClean();
+}
+
+/*
+ * @brief Two EEPROM writes: the second waits out the first write cycle by ACK polling
+ */
+static void testEepromWriteCycle(void)
+{
+	uint64_t start;
+
+	setup();
+
+	traveledMiles = 43;
+	storedMiles = 42;
+	start = hostNowNs;
+	measure(&occStoreMiles, storeMiles);
+	eepromWrite(0, 0x41);
+	measure(&occStoreMiles, i2cService);
+	CHECK_EQ(eeprom.mem[4], 0x43);
+	CHECK_EQ(eeprom.writeCycles, 1);
+
+	/* Turn byte stays queued until the write cycle is over */
+	while (eeprom.writeCycles < 2 && hostNowNs - start < 50 * MS)
+	{
+		measure(&occStoreMiles, i2cService);
+		hostAdvance(100 * US);
+	}
+	CHECK_EQ(eeprom.mem[0], 0x41);
+	CHECK_EQ(eeprom.writeCycles, 2);
+	CHECK(eeprom.busyNacks >= 4);
+	CHECK(hostNowNs - start >= AT24C32_WRITE_NS);
+	CHECK(hostNowNs - start < AT24C32_WRITE_NS + I2C_BUSY_POLL_US * US + 2 * MS);
+	CHECK_EQ(i2cStats[I2C_PRIO_BACKGROUND].count, 2);
+
+	/* Same miles: nothing written */
+	storeMiles();
+	serviceFor(10 * MS);
+	CHECK_EQ(eeprom.writeCycles, 2);
+	checkBusClean();
+}
+
+/*
+ * @brief Function that publishes a sonar reading the way the capture interrupt does
+ * @param raw: tenths of an inch
+ * @return None
+ */
+static void sonarPublish(int raw)
+{
+	sonarSensors[0].raw = raw;
+	sonarSensors[0].seq++;
+}
+
+/*
+ * @brief Function that runs one pass of the warning path: filter, link, bus
+ * @param None
+ * @return None
+ */
+static void warningPass(void)
+{
+	checkWarningSignal();
+	linkService();
+	i2cService();
+}
+
+/*
+ * @brief An obstacle closing in raises the warning, one urgent frame; it clears once
+ */
+static void testSonarWarning(void)
+{
+	uint32_t frames;
+	uint32_t toggles = sonarWarningToggles;
+
+	setup();
+	memset(sonarSensors, 0, sizeof(sonarSensors));
+	sonarWarning = 0;
+
+	/* Far away: nothing to send */
+	for (int i = 0; i < 10; i++)
+	{
+		hostAdvance(SONAR_SLOT_US * US);
+		sonarPublish(300);
+		measure(&occWarning, warningPass);
+	}
+	CHECK_EQ(slaveNode.frames, 0);
+
+	/* Closing in */
+	for (int i = 0; i < 30 && !linkState.warning; i++)
+	{
+		hostAdvance(SONAR_SLOT_US * US);
+		sonarPublish(300 - 20 * i > 40 ? 300 - 20 * i : 40);
+		measure(&occWarning, warningPass);
+	}
+	CHECK_EQ(linkState.warning, 1);
+	CHECK_EQ(slaveNode.frames, 1);
+	CHECK_EQ(slaveNode.lastFrame[8], 1);
+	CHECK_EQ(i2cStats[I2C_PRIO_URGENT].count, 1);
+	CHECK_EQ(i2cStats[I2C_PRIO_URGENT].missed, 0);
+
+	/* Staying close sends nothing more */
+	frames = slaveNode.frames;
+	for (int i = 0; i < 20; i++)
+	{
+		hostAdvance(SONAR_SLOT_US * US);
+		sonarPublish(40 + (i & 1) * 60); /* noise around the on threshold */
+		measure(&occWarning, warningPass);
+	}
+	CHECK_EQ(slaveNode.frames, frames);
+
+	/* Gone */
+	for (int i = 0; i < 30 && linkState.warning; i++)
+	{
+		hostAdvance(SONAR_SLOT_US * US);
+		sonarPublish(400);
+		measure(&occWarning, warningPass);
+	}
+	CHECK_EQ(linkState.warning, 0);
+	CHECK_EQ(slaveNode.frames, frames + 1);
+	CHECK_EQ(slaveNode.lastFrame[8], 0);
+	CHECK_EQ(sonarWarningToggles - toggles, 2);
+	checkBusClean();
+}
+
+/*
+ * @brief The slave stops answering: polls and frames end with a STOP and count as resyncs
+ */
+static void testSlaveOffline(void)
+{
+	int resyncs;
+	uint64_t start;
+	uint64_t longest = 0;
+
+	setup();
+	resyncs = linkResyncCount;
+	slaveNode.offline = 1;
+
+	for (int i = 0; i < 4; i++)
+	{
+		start = hostNowNs;
+		flagSet(FLAG_LINK_POLL);
+		linkService();
+		i2cService();
+		i2cSimSettle();
+		if (hostNowNs - start > longest)
+			longest = hostNowNs - start;
+		hostAdvance(250 * MS);
+	}
+	CHECK_EQ(linkResyncCount - resyncs, 4);
+	CHECK_EQ(i2cStats[I2C_PRIO_NORMAL].count, 4);
+	CHECK_EQ(i2cStats[I2C_PRIO_NORMAL].failed, 4);
+	CHECK_EQ(i2cSimStats.nacks, 8);
+	CHECK_EQ(slaveNode.frames, 0);
+	CHECK(longest < 10 * I2C_BYTE_US * US); /* two address NACKs, not I2C_TIMEOUT_US */
+	CHECK_EQ(I2C1->SR2 & 2, 0);
+	CHECK_EQ(I2C1->SR1 & 0x400, 0);
+
+	/* Back: the next poll sees the frames it missed, one frame catches it up */
+	slaveNode.offline = 0;
+	for (int i = 0; i < 2; i++)
+	{
+		flagSet(FLAG_LINK_POLL);
+		linkService();
+		serviceFor(1 * MS);
+	}
+	CHECK_EQ(linkResyncCount - resyncs, 5);
+	CHECK_EQ(slaveNode.frames, 1);
+	CHECK_EQ(slaveNode.status[LINK_STATUS_LAST_SEQ], linkSeq);
+	checkBusClean();
+}
+
+/*
+ * @brief Function that reads readLength bytes of the EEPROM at readAddr into readBuf
+ * @param None
+ * @return None
+ */
+static void eepromRead(void)
+{
+	I2C1_burstRead(AT24C32_ADDR, I2C_MADDR16(readAddr), readLength, readBuf);
+}
+
+/*
+ * @brief Function that reads the slave status register file
+ * @param None
+ * @return None
+ */
+static void linkPoll(void)
+{
+	linkPollStatus();
+}
+
+/*
+ * @brief Reads of every length with interrupts delaying the firmware at random
+ */
+static void testBurstReadPreempted(void)
+{
+	static const int lengths[] = {1, 2, 3, 4, 15, 2, 1};
+	int bad = 0;
+
+	setup();
+	for (int i = 0; i < 0x200; i++)
+		eeprom.mem[i] = i * 7 + 3;
+	for (int i = 0; i < LINK_STATUS_SIZE; i++)
+		slaveNode.status[i] = 0x40 + i;
+
+	/* Delays up to three byte times at 30% of the accesses */
+	i2cSimPreempt(30, 27 * i2cSimBitNs(), 1234);
+
+	for (int pass = 0; pass < 200; pass++)
+	{
+		for (unsigned int k = 0; k < sizeof(lengths) / sizeof(lengths[0]); k++)
+		{
+			readLength = lengths[k];
+			readAddr = (pass * 13 + k * 31) & 0x1FF;
+			memset(readBuf, 0, sizeof(readBuf));
+			measure(&occEepromRead, eepromRead);
+			for (int i = 0; i < readLength; i++)
+				bad += (uint8_t)readBuf[i] != eeprom.mem[(readAddr + i) & 0xFFF];
+
+			measure(&occLinkPoll, linkPoll);
+			bad += linkStatus.cpuLoad != 0x40 + LINK_STATUS_CPU_LOAD;
+		}
+	}
+
+	CHECK_EQ(bad, 0);
+	CHECK_EQ(i2cSimStats.nacks, 0);
+	checkBusClean();
+	i2cSimPreempt(0, 0, 0);
+}
+
+/*
+ * @brief Function that prints the bus time of every measured function
+ * @param None
+ * @return None
+ */
+static void report(void)
+{
+	Occupancy *occ[] = {&occGetTime, &occReadTemp, &occReadSaved, &occStoreMiles,
+						&occWarning, &occLinkPoll, &occEepromRead};
+
+	printf("bus occupancy at %u kHz (I2C_SPEED_HZ %d), preempted reads included\n",
+		   (unsigned)(1000000 / i2cSimBitNs()), I2C_SPEED_HZ);
+	printf("  %-34s %6s %6s %6s %12s %12s %6s\n", "function", "calls", "txns", "bytes",
+		   "bus us/call", "call us/call", "busy");
+	for (unsigned int i = 0; i < sizeof(occ) / sizeof(occ[0]); i++)
+	{
+		Occupancy *o = occ[i];
+		printf("  %-34s %6u %6u %6u %12.1f %12.1f %5.0f%%\n", o->name, o->calls, o->transactions,
+			   o->bytes, o->busNs / 1000.0 / o->calls, o->elapsedNs / 1000.0 / o->calls,
+			   o->elapsedNs ? 100.0 * o->busNs / o->elapsedNs : 0.0);
+	}
+}
+
+int main(void)
+{
+	hostTimebaseTrap();
+
+	testRtcTime();
+	testRtcTemp();
+	testEepromRestore();
+	testEepromWriteCycle();
+	testSonarWarning();
+	testSlaveOffline();
+	testBurstReadPreempted();
+
+	report();
+
+	return checkExit("test_i2c_bus");
+}
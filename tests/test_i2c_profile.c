@@ -0,0 +1,436 @@
+/*
+ * @file 	test_i2c_profile.c
+ * @brief 	I2C profiler (-DI2C_PROFILE=1) on the simulated bus
+ * @details Runs getTime, readTemp, the sonar warning path and sendMessages against the
+ * 			simulated I2C1 under different UI states, the way the main loop sets the
+ * 			profiler context, and checks the per tag, per device and per state counters
+ * 			against what the bus saw. i2cProfileDump() is read back through a model of
+ * 			the ITM stimulus port.
+ *
+ * @author: Aeron Lahoylahoy
+ * @date: June 27, 2024
+ */
+#include <string.h>
+#include "check.h"
+#include "stm32f4xx.h"
+#include "mmio.h"
+#include "i2c_sim.h"
+#include "i2c_devices.h"
+#include "i2c_master.h"
+#include "i2c_scheduler.h"
+#include "i2c_profiler.h"
+#include "timebase.h"
+#include "flags.h"
+#include "rtc.h"
+#include "eeprom.h"
+#include "display.h"
+#include "controls.h"
+#include "link.h"
+#include "sonar.h"
+
+/* Master state eeprom.c reaches into (display.c, controls.c, rotary_encoder.c, ili9341.c) */
+int state = -1;
+int menuScreen = 0;
+int bluetoothEnable = 0;
+int bluetoothDisplay = 0;
+int bluetoothCounter = 0;
+void displayMenu(void) {}
+static int bluetoothDraws = 0;
+static int fillRects = 0;
+void displayBluetooth(int show) { bluetoothDraws++; }
+void handleButtons(void) {}
+void encoderService(void) {}
+void Fill_Rect(unsigned int x, unsigned int y, unsigned int w, unsigned int h, unsigned int color) { fillRects++; }
+void schedulerSignal(int task) {} /* speed_sensor.c, TIM4 */
+
+/* Pressed button pin for debounceButton() */
+static int pressedPin = -1;
+int debounceButton(GPIO_TypeDef *port, int pin) { return pin == pressedPin; }
+
+#define US 1000ULL
+#define MS 1000000ULL
+
+/* Devices */
+static DS3231 rtc;
+static AT24C32 eeprom;
+static LinkSlave slaveNode;
+
+/* ITM stimulus port 0 */
+#define ITM_PAGE 0x1000
+static char itmOut[4096];
+static int itmCount = 0;
+
+/*
+ * @brief Function that models the ITM registers ITM_SendChar() reads: enabled, port 0 ready
+ * @param ctx: unused
+ * @param addr: register address
+ * @param effects: unused
+ * @return Register value
+ */
+static uint32_t itmRead(void *ctx, uintptr_t addr, int effects)
+{
+	if (addr == (uintptr_t)&ITM->TCR)
+		return ITM_TCR_ITMENA_Msk;
+	if (addr == (uintptr_t)&ITM->TER)
+		return 1;
+	if (addr == (uintptr_t)&ITM->PORT[0])
+		return 1; /* FIFO ready */
+	return 0;
+}
+
+/*
+ * @brief Function that collects the characters written to stimulus port 0
+ * @param ctx: unused
+ * @param addr: register address
+ * @param value: written word, the character in the low byte
+ * @return None
+ */
+static void itmWrite(void *ctx, uintptr_t addr, uint32_t value)
+{
+	if (addr == (uintptr_t)&ITM->PORT[0] && itmCount < (int)sizeof(itmOut) - 1)
+		itmOut[itmCount++] = value & 0xFF;
+}
+
+/*
+ * @brief Function that puts the three devices on a fresh bus and clears the profiler
+ * @param None
+ * @return None
+ */
+static void setup(void)
+{
+	hostRegistersReset();
+	i2cSimInit();
+	ds3231Init(&rtc);
+	at24c32Init(&eeprom);
+	linkSlaveInit(&slaveNode);
+	i2cSimAttach(&rtc.dev);
+	i2cSimAttach(&eeprom.dev);
+	i2cSimAttach(&slaveNode.dev);
+
+	timebaseInit();
+	masterConfig();
+	i2cSchedulerInit();
+	i2cRegisterDevice(mileEEPROM);
+	memset(&linkState, 0, sizeof(linkState));
+	linkDirty = 0;
+	linkUrgent = I2C_TAG_NONE;
+
+	i2cProfileReset();
+}
+
+/*
+ * @brief Function that finds the profiler slot of a device
+ * @param saddr: 7-bit address
+ * @return Counters, or 0 if the device never showed up
+ */
+static I2CProfileStats *deviceStats(uint8_t saddr)
+{
+	for (int i = 0; i < I2C_PROFILE_DEVICES; i++)
+	{
+		if (i2cProfileDeviceAddr[i] == saddr)
+			return &i2cProfileDevice[i];
+	}
+	return 0;
+}
+
+/*
+ * @brief Function that sums the busy time of one tag over the UI states
+ * @param tag: I2C_TAG_x
+ * @return Busy time (us)
+ */
+static uint32_t busyAllStates(int tag)
+{
+	uint32_t us = 0;
+
+	for (int c = 0; c < I2C_PROFILE_CONTEXTS; c++)
+		us += i2cProfileBusy[c][tag];
+	return us;
+}
+
+/*
+ * @brief Function that returns the histogram bin the profiler puts a duration in
+ * @param us: duration
+ * @return Bin
+ */
+static int histBin(uint32_t us)
+{
+	int bin = 0;
+
+	for (us >>= 6; us; us >>= 1)
+		bin++;
+	return bin < I2C_HIST_BINS ? bin : I2C_HIST_BINS - 1;
+}
+
+/*
+ * @brief Function that runs the bus task until the queue is empty or a time limit passes
+ * @param limitNs: virtual time limit
+ * @return None
+ */
+static void serviceFor(uint64_t limitNs)
+{
+	uint64_t end = hostNowNs + limitNs;
+
+	while (hostNowNs < end)
+	{
+		i2cService();
+		i2cSimSettle();
+		hostAdvance(100 * US);
+	}
+}
+
+/*
+ * @brief getTime in the time screen and readTemp in the menu, attributed per tag, device and state
+ */
+static void testRtcPerState(void)
+{
+	uint64_t busNs;
+	uint32_t timeStateUs;
+	I2CProfileRecord *last;
+	I2CProfileStats *ds;
+
+	setup();
+	ds3231SetTemp(&rtc, 21 * 4);
+
+	I2C_PROFILE_CONTEXT(TIMESTATE);
+	for (int i = 0; i < 3; i++)
+	{
+		getTime();
+		hostAdvance(100 * MS);
+	}
+
+	timeStateUs = i2cProfileTagStats[I2C_TAG_GET_TIME].busyUs;
+
+	I2C_PROFILE_CONTEXT(MENUSTATE);
+	readTemp();
+
+	/* Before the screen is known (state -1): counted per tag, not per state */
+	I2C_PROFILE_CONTEXT(-1);
+	getTime();
+	i2cSimSettle();
+
+	/* Seven one byte reads per getTime, two per readTemp */
+	CHECK_EQ(i2cProfileTagStats[I2C_TAG_GET_TIME].count, 4 * 7);
+	CHECK_EQ(i2cProfileTagStats[I2C_TAG_GET_TIME].bytes, 4 * 7);
+	CHECK_EQ(i2cProfileTagStats[I2C_TAG_GET_TIME].nacks, 0);
+	CHECK_EQ(i2cProfileTagStats[I2C_TAG_GET_TIME].wireUs, 4 * 7 * 4 * I2C_BYTE_US);
+	CHECK_EQ(i2cProfileTagStats[I2C_TAG_READ_TEMP].count, 2);
+	CHECK_EQ(i2cProfileTagStats[I2C_TAG_NONE].count, 0);
+
+	/* One device, every read in the bin of its bus time */
+	ds = deviceStats(DS3231_ADDR);
+	CHECK(ds != 0);
+	CHECK_EQ(ds->count, 4 * 7 + 2);
+	CHECK_EQ(ds->hist[histBin(39 * i2cSimBitNs() / 1000)], 4 * 7 + 2);
+	CHECK(ds->maxUs >= 39 * i2cSimBitNs() / 1000);
+
+	/* Per state */
+	CHECK_EQ(i2cProfileBusy[TIMESTATE][I2C_TAG_GET_TIME], timeStateUs);
+	CHECK_EQ(i2cProfileBusy[MENUSTATE][I2C_TAG_GET_TIME], 0);
+	CHECK_EQ(i2cProfileBusy[MENUSTATE][I2C_TAG_READ_TEMP], i2cProfileTagStats[I2C_TAG_READ_TEMP].busyUs);
+	CHECK_EQ(busyAllStates(I2C_TAG_GET_TIME), i2cProfileBusy[TIMESTATE][I2C_TAG_GET_TIME]);
+
+	/* Busy time is the bus time to within the STOP bit of each transaction */
+	busNs = i2cSimStats.busyNs;
+	CHECK(ds->busyUs + ds->count * i2cSimBitNs() / 1000 >= busNs / 1000);
+	CHECK(ds->busyUs <= busNs / 1000 + ds->count * 10);
+
+	/* Log: the last read is the year register, outside any state */
+	last = &i2cProfileLog[(i2cProfileHead + I2C_PROFILE_LOG - 1) % I2C_PROFILE_LOG];
+	CHECK_EQ(last->saddr, DS3231_ADDR);
+	CHECK_EQ(last->maddr, 6);
+	CHECK_EQ(last->dir, I2C_DIR_READ);
+	CHECK_EQ(last->tag, I2C_TAG_GET_TIME);
+	CHECK_EQ(last->context, 0xFF);
+	CHECK_EQ(last->result, I2C_RESULT_OK);
+}
+
+/*
+ * @brief Function that publishes a sonar reading the way the capture interrupt does
+ * @param raw: tenths of an inch
+ * @return None
+ */
+static void sonarPublish(int raw)
+{
+	sonarSensors[0].raw = raw;
+	sonarSensors[0].seq++;
+}
+
+/*
+ * @brief Warning frames sent while the date screen is up are charged to the warning tag and the slave
+ */
+static void testWarningPerState(void)
+{
+	I2CProfileStats *sl;
+
+	setup();
+	memset(sonarSensors, 0, sizeof(sonarSensors));
+	sonarWarning = 0;
+
+	I2C_PROFILE_CONTEXT(DATESTATE);
+	for (int i = 0; i < 60; i++)
+	{
+		hostAdvance(SONAR_SLOT_US * US);
+		sonarPublish(i < 30 ? 40 : 400);
+		checkWarningSignal();
+		linkService();
+		i2cService();
+		i2cSimSettle();
+	}
+
+	/* On, then off: two urgent frames */
+	CHECK_EQ(slaveNode.frames, 2);
+	CHECK_EQ(i2cProfileTagStats[I2C_TAG_WARNING].count, 2);
+	CHECK_EQ(i2cProfileTagStats[I2C_TAG_WARNING].bytes, 2 * slaveNode.lastFrameLen);
+	CHECK_EQ(i2cProfileTagStats[I2C_TAG_WARNING].wireUs, 2 * (2 + slaveNode.lastFrameLen) * I2C_BYTE_US);
+
+	sl = deviceStats(LINK_SLAVE_ADDR);
+	CHECK(sl != 0);
+	CHECK_EQ(sl->count, i2cProfileTagStats[I2C_TAG_WARNING].count + i2cProfileTagStats[I2C_TAG_LINK_POLL].count);
+	CHECK_EQ(deviceStats(DS3231_ADDR), 0);
+
+	CHECK(i2cProfileBusy[DATESTATE][I2C_TAG_WARNING] > 0);
+	CHECK_EQ(busyAllStates(I2C_TAG_WARNING), i2cProfileBusy[DATESTATE][I2C_TAG_WARNING]);
+}
+
+/*
+ * @brief A turn signal in the temperature screen: urgent frame, EEPROM write and its ACK polls
+ */
+static void testSendMessagesPerState(void)
+{
+	I2CProfileStats *ee;
+	I2CProfileStats *poll = &i2cProfileTagStats[I2C_TAG_EEPROM_POLL];
+
+	/* Bluetooth on and already saved: no bluetooth writes */
+	setup();
+	bluetoothEnable = 1;
+	bluetoothCounter = 0;
+	sendMessages();
+	serviceFor(20 * MS);
+	i2cProfileReset();
+
+	I2C_PROFILE_CONTEXT(TEMPSTATE);
+	pressedPin = TURN_RIGHT_PIN;
+	flagSet(FLAG_TURN);
+	sendMessages();
+	linkService();
+	serviceFor(20 * MS);
+	pressedPin = -1;
+
+	CHECK_EQ(slaveNode.lastFrame[7], LINK_TURN_RIGHT);
+	CHECK_EQ(eeprom.mem[0], 0x41);
+
+	CHECK_EQ(i2cProfileTagStats[I2C_TAG_TURN].count, 1);
+	CHECK_EQ(i2cProfileTagStats[I2C_TAG_EEPROM].count, 1);
+	CHECK_EQ(i2cProfileTagStats[I2C_TAG_EEPROM].wireUs, (2 + 1 + 1) * I2C_BYTE_US); /* 16-bit address */
+
+	/* Probes NACK through the write cycle, the last one ACKs */
+	CHECK(poll->count >= AT24C32_WRITE_NS / (I2C_BUSY_POLL_US * US));
+	CHECK_EQ(poll->nacks, poll->count - 1);
+	CHECK_EQ(poll->bytes, 0);
+	CHECK_EQ(poll->wireUs, poll->count * I2C_BYTE_US);
+
+	ee = deviceStats(AT24C32_ADDR);
+	CHECK(ee != 0);
+	CHECK_EQ(ee->count, 1 + poll->count);
+	CHECK_EQ(ee->nacks, poll->nacks);
+
+	CHECK(i2cProfileBusy[TEMPSTATE][I2C_TAG_TURN] > 0);
+	CHECK(i2cProfileBusy[TEMPSTATE][I2C_TAG_EEPROM] > 0);
+	CHECK_EQ(i2cProfileBusy[TEMPSTATE][I2C_TAG_EEPROM_POLL], poll->busyUs);
+	bluetoothEnable = 0;
+}
+
+/*
+ * @brief A second of the 100 Hz controls task: the bluetooth setting is written, and the icon
+ * 		  cleared, once per change
+ */
+static void testBluetoothSetting(void)
+{
+	I2CProfileStats *ee = &i2cProfileTagStats[I2C_TAG_EEPROM];
+
+	setup();
+	bluetoothEnable = 1;
+	bluetoothCounter = 0;
+	sendMessages();
+	serviceFor(20 * MS);
+	i2cProfileReset();
+
+	/* Off */
+	bluetoothEnable = 0;
+	fillRects = 0;
+	for (int n = 0; n < 100; n++)
+	{
+		sendMessages();
+		serviceFor(10 * MS);
+	}
+	CHECK_EQ(ee->count, 1);
+	CHECK_EQ(eeprom.mem[2], 0x00);
+	CHECK_EQ(fillRects, 1);
+
+	/* On, with the TIM7 blink on its first tick for 250 ms */
+	bluetoothEnable = 1;
+	bluetoothCounter = 1;
+	bluetoothDraws = 0;
+	for (int n = 0; n < 25; n++)
+	{
+		sendMessages();
+		serviceFor(10 * MS);
+	}
+	CHECK_EQ(ee->count, 2);
+	CHECK_EQ(eeprom.mem[2], 0x01);
+	CHECK_EQ(bluetoothDraws, 1);
+
+	/* Next blink draws again */
+	bluetoothCounter = 2;
+	sendMessages();
+	bluetoothCounter = 1;
+	sendMessages();
+	serviceFor(10 * MS);
+	CHECK_EQ(bluetoothDraws, 2);
+	CHECK_EQ(ee->count, 2);
+
+	bluetoothEnable = 0;
+	bluetoothCounter = 0;
+}
+
+/*
+ * @brief i2cProfileDump() over ITM: utilisation line, one row per device and tag, one per state
+ */
+static void testDump(void)
+{
+	char expect[64];
+
+	setup();
+	I2C_PROFILE_CONTEXT(TIMESTATE);
+	getTime();
+	i2cSimSettle();
+	hostAdvance(10 * MS);
+
+	mmioTrap(ITM_BASE, ITM_PAGE, itmRead, itmWrite, 0);
+	itmCount = 0;
+	i2cProfileDump();
+	mmioRelease(ITM_BASE);
+	itmOut[itmCount] = 0;
+
+	CHECK(strncmp(itmOut, "I2C busy ", 9) == 0);
+	CHECK(strstr(itmOut, "0x68     n=7 B=7 ") != 0);
+	CHECK(strstr(itmOut, "time     n=7 B=7 ") != 0);
+	sprintf(expect, "state %d: time=%uus\n", TIMESTATE, (unsigned)i2cProfileBusy[TIMESTATE][I2C_TAG_GET_TIME]);
+	CHECK(strstr(itmOut, expect) != 0);
+	sprintf(expect, "state %d:\n", MENUSTATE);
+	CHECK(strstr(itmOut, expect) != 0);
+	CHECK(strstr(itmOut, "temp ") == 0);
+}
+
+int main(void)
+{
+	hostTimebaseTrap();
+
+	testRtcPerState();
+	testWarningPerState();
+	testSendMessagesPerState();
+	testBluetoothSetting();
+	testDump();
+
+	return checkExit("test_i2c_profile");
+}
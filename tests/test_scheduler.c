@@ -0,0 +1,401 @@
+/*
+ * @file 	test_scheduler.c
+ * @brief 	Scheduler sleep residency with the event released bus task
+ * @details Runs the unmodified scheduler, soft timers, I2C queue and link for simulated
+ * 			seconds of an idle dashboard. WFI jumps virtual time to the next interrupt:
+ * 			the TIM6 debounce tick (1 kHz), the TIM7 UI tick (4 Hz) or the TIM5 wake-up
+ * 			compare. The controls task is the real sendMessages() (eeprom.c), with its
+ * 			EEPROM writes through the queue and its LCD fills charged per pixel. The other
+ * 			tasks and the blocking I2C master are stand-ins that take a modelled time, the
+ * 			EEPROM holds off ACKs for its write cycle.
+ *
+ * 			The same run with the bus task back on the former 1 kHz rate is the reference.
+ * 			Residency is the time spent in WFI up to the interrupt; schedSleepUs also counts
+ * 			the ISRs. The current figure is a two state model (awake, asleep) with assumed
+ * 			currents, to compare the two runs, not to predict the board.
+ *
+ * @author: Aeron Lahoylahoy
+ * @date: June 27, 2024
+ */
+#include <stdio.h>
+#include <string.h>
+#include "check.h"
+#include "stm32f4xx.h"
+#include "timebase.h"
+#include "soft_timer.h"
+#include "scheduler.h"
+#include "i2c_master.h"
+#include "i2c_scheduler.h"
+#include "link.h"
+#include "flags.h"
+#include "watchdog.h"
+
+void TIM5_IRQHandler(void);
+
+#define US 1000ULL
+#define MS 1000000ULL
+
+/* Interrupts */
+#define TIM6_PERIOD (1 * MS)
+#define TIM7_PERIOD (250 * MS)
+
+/* Modelled costs */
+#define WAKE_NS 1000		/* exception entry, the ISR and the return to the WFI loop */
+#define PASS_NS 2000		/* one main loop pass: soft timers, the task table, the idle decision */
+#define I2C_BIT_NS 10000	/* 100 kHz */
+#define EEPROM_ADDR 0x57
+#define EEPROM_WRITE_US 5000
+#define LCD_PIXEL_NS 500	/* assumed, 16 bits on the bit-banged 8-bit bus */
+#define RUN_MA 40.0			/* assumed, awake at 180 MHz */
+#define SLEEP_MA 15.0		/* assumed, WFI with the peripherals clocked */
+
+/* i2c_master.c stand-in: the bus time of each transaction, EEPROM write cycle */
+char slave = 0x32;
+static uint64_t eepromReadyNs = 0;
+static uint32_t busWrites = 0;
+static uint32_t eepromWrites = 0;
+
+int I2C1_burstWrite(char saddr, int maddr, int n, char *data)
+{
+	hostAdvance((uint64_t)(n + 3) * 9 * I2C_BIT_NS);
+	if (saddr == EEPROM_ADDR)
+	{
+		eepromReadyNs = hostNowNs + EEPROM_WRITE_US * US;
+		eepromWrites++;
+	}
+	busWrites++;
+	return 0;
+}
+
+int I2C1_burstRead(char saddr, int maddr, int n, char *data)
+{
+	hostAdvance((uint64_t)(n + 4) * 9 * I2C_BIT_NS);
+	memset(data, 0, n);
+	data[LINK_STATUS_VERSION] = LINK_VERSION;
+	data[LINK_STATUS_LAST_SEQ] = linkSeq;
+	return 0;
+}
+
+int I2C1_byteRead(char saddr, int maddr, char *data)
+{
+	return I2C1_burstRead(saddr, maddr, 1, data);
+}
+
+int I2C1_probe(char saddr)
+{
+	hostAdvance(10 * I2C_BIT_NS);
+	return hostNowNs >= eepromReadyNs;
+}
+
+/* Master state eeprom.c reaches into (display.c, controls.c, button_functions.c) */
+int state = 0;
+int menuScreen = 0;
+int bluetoothEnable = 0;
+int bluetoothDisplay = 0;
+int bluetoothCounter = 0;
+static uint32_t lcdPixels = 0;
+void displayMenu(void) {}
+void handleButtons(void) { hostAdvance(2 * US); }
+void encoderService(void) { hostAdvance(1 * US); }
+int debounceButton(GPIO_TypeDef *port, int pin) { return 0; }
+void Fill_Rect(unsigned int x, unsigned int y, unsigned int w, unsigned int h, unsigned int color)
+{
+	lcdPixels += w * h;
+	hostAdvance((uint64_t)w * h * LCD_PIXEL_NS);
+}
+void displayBluetooth(int n) { Fill_Rect(0, 0, 9 * 20, 21, 0); } /* 9 characters at scale 3 */
+
+/* Task stand-ins */
+static int warningToggle = 0;
+void checkWarningSignal(void)
+{
+	hostAdvance(5 * US);
+	if (warningToggle)
+		linkSetWarning(!linkState.warning);
+}
+void displayUpdate(void) { hostAdvance(500 * US); }
+void displayClock(void) { hostAdvance(2000 * US); }
+
+/* Watchdog: longest gap between I2C check-ins */
+static uint64_t i2cCheckInNs;
+static uint64_t i2cCheckInGapNs;
+void watchDogCheckIn(int task)
+{
+	if (task != WDG_TASK_I2C)
+		return;
+	if (hostNowNs - i2cCheckInNs > i2cCheckInGapNs)
+		i2cCheckInGapNs = hostNowNs - i2cCheckInNs;
+	i2cCheckInNs = hostNowNs;
+}
+
+/* Interrupt sources */
+static uint64_t tim6Next;
+static uint64_t tim7Next;
+static int tim7Count;
+static int tim7Miles;
+static int tim7Eeprom; /* TIM7 queues an EEPROM write (storeMiles) */
+static int busPeriodic; /* reference run: the former tree, no bus signals */
+static uint64_t asleepNs; /* core in WFI, the ISRs not included */
+
+static void tim7Tick(void)
+{
+	/* display.c TIM7 */
+	if (++tim7Count >= LINK_POLL_TICKS)
+	{
+		flagSet(FLAG_LINK_POLL);
+		tim7Count = 0;
+	}
+	if (++tim7Miles == 4)
+	{
+		flagSet(FLAG_MILE);
+		tim7Miles = 0;
+	}
+	if (!busPeriodic)
+		schedulerSignal(SCHED_TASK_BUS);
+
+	if (tim7Eeprom)
+	{
+		char miles[4] = {1, 2, 3, 4};
+		i2cSubmitWrite(EEPROM_ADDR, I2C_MADDR16(0x0100), 4, miles, I2C_PRIO_BACKGROUND, I2C_TAG_NONE);
+	}
+}
+
+/*
+ * @brief WFI: jumps to the next interrupt and runs it
+ */
+static void onWfi(void)
+{
+	uint64_t next = tim6Next < tim7Next ? tim6Next : tim7Next;
+	uint64_t wake = ~0ULL;
+
+	if (TIM5->DIER & (0b1 << 1))
+	{
+		uint32_t left = TIM5->CCR1 - getMicros();
+		wake = hostNowNs + (uint64_t)left * US;
+		if (wake < next)
+			next = wake;
+	}
+
+	if (next > hostNowNs)
+	{
+		asleepNs += next - hostNowNs;
+		hostAdvance(next - hostNowNs);
+	}
+
+	if (next == tim6Next)
+		tim6Next += TIM6_PERIOD;
+	else if (next == tim7Next)
+	{
+		tim7Next += TIM7_PERIOD;
+		tim7Tick();
+	}
+	else
+	{
+		hostTimebaseEvent(0b1 << 1);
+		TIM5_IRQHandler();
+	}
+	hostAdvance(WAKE_NS);
+}
+
+/* One run */
+typedef struct
+{
+	const char *name;
+	double seconds;
+	uint32_t passes;
+	uint32_t sleeps;
+	uint32_t busRuns;
+	uint64_t idleMaxNs; /* longest stay in schedulerIdle() */
+	uint32_t eepromWrites;
+	uint32_t lcdPixels;
+	double residency;
+	double currentMa;
+} Run;
+
+/*
+ * @brief Function that starts everything from scratch
+ * @param periodicBus: 1 for the former 1 kHz bus rate
+ * @return None
+ */
+static void setup(int periodicBus)
+{
+	hostRegistersReset();
+	i2cSchedulerInit();
+	i2cRegisterDevice(EEPROM_ADDR);
+	flagWord = 0;
+	linkDirty = 0;
+	linkState.warning = 0;
+	warningToggle = 0;
+	tim7Eeprom = 0;
+	tim7Count = 0;
+	tim7Miles = 0;
+	busPeriodic = periodicBus;
+	busWrites = 0;
+	eepromReadyNs = 0;
+	schedSleepUs = 0;
+	schedSleeps = 0;
+
+	schedTasks[SCHED_TASK_BUS].kind = periodicBus ? SCHED_PERIODIC : SCHED_EVENT;
+	schedTasks[SCHED_TASK_BUS].period = periodicBus ? 1000 : 0;
+	schedulerInit();
+
+	tim6Next = hostNowNs + TIM6_PERIOD;
+	tim7Next = hostNowNs + TIM7_PERIOD;
+	i2cCheckInNs = hostNowNs;
+	i2cCheckInGapNs = 0;
+}
+
+/*
+ * @brief Function that runs the main loop for a while
+ * @param run: statistics
+ * @param ns: how long
+ * @return None
+ */
+static void loop(Run *run, uint64_t ns)
+{
+	uint64_t start = hostNowNs;
+	uint64_t asleepStart = asleepNs;
+	uint32_t sleepsStart = schedSleeps;
+	uint32_t busStart = schedTasks[SCHED_TASK_BUS].runs;
+	uint32_t eepromStart = eepromWrites;
+	uint32_t lcdStart = lcdPixels;
+
+	while (hostNowNs - start < ns)
+	{
+		uint64_t idle;
+
+		run->passes++;
+		schedulerRun();
+		hostAdvance(PASS_NS);
+		if (busPeriodic)
+			schedPending &= ~(0b1 << SCHED_TASK_BUS); /* nothing released it before */
+		idle = hostNowNs;
+		schedulerIdle();
+		if (hostNowNs - idle > run->idleMaxNs)
+			run->idleMaxNs = hostNowNs - idle;
+	}
+
+	run->seconds = (double)(hostNowNs - start) / 1e9;
+	run->sleeps = schedSleeps - sleepsStart;
+	run->busRuns = schedTasks[SCHED_TASK_BUS].runs - busStart;
+	run->eepromWrites = eepromWrites - eepromStart;
+	run->lcdPixels = lcdPixels - lcdStart;
+	run->residency = (double)(asleepNs - asleepStart) / (hostNowNs - start);
+	run->currentMa = run->residency * SLEEP_MA + (1 - run->residency) * RUN_MA;
+}
+
+static void print(const Run *r)
+{
+	printf("%-16s WFI %5.0f/s, loop passes %5.0f/s, bus task %5.0f/s, EEPROM writes %3.0f/s, LCD %6.0f px/s, "
+		   "longest idle %5.2f ms, asleep %5.2f%%, model %5.2f mA\n",
+		   r->name, r->sleeps / r->seconds, r->passes / r->seconds, r->busRuns / r->seconds,
+		   r->eepromWrites / r->seconds, r->lcdPixels / r->seconds, r->idleMaxNs / 1e6,
+		   r->residency * 100, r->currentMa);
+}
+
+/*
+ * @brief Idle dashboard: the bus task no longer runs at 1 kHz, the core stays asleep longer
+ */
+static void testIdleResidency(void)
+{
+	Run former = {"bus at 1 kHz"};
+	Run event = {"bus on events"};
+
+	setup(1);
+	loop(&former, 5000 * MS);
+	print(&former);
+
+	setup(0);
+	loop(&event, 5000 * MS);
+	print(&event);
+
+	/* Only the periodic tasks and TIM7 reach the main loop */
+	CHECK(former.passes / former.seconds >= 1000);
+	CHECK(event.passes / event.seconds < 140);
+	CHECK(event.busRuns / event.seconds <= 1000000000.0 / TIM7_PERIOD + 1);
+	CHECK(event.idleMaxNs >= SCHED_PERIOD_CONTROLS * US * 9 / 10);
+	CHECK(former.idleMaxNs <= 1000 * US + 2 * WAKE_NS);
+	CHECK(event.residency > former.residency);
+
+	/* The controls task at 100 Hz neither writes the EEPROM nor draws while nothing changes */
+	CHECK(former.eepromWrites <= 1); /* the bluetooth setting, saved once */
+	CHECK_EQ(event.eepromWrites, 0);
+	CHECK_EQ(event.lcdPixels, 0);
+	CHECK(event.currentMa < former.currentMa);
+
+	/* The TIM7 tick keeps the I2C watchdog check-in well inside its budget */
+	CHECK(i2cCheckInGapNs <= TIM7_PERIOD + SCHED_PERIOD_CONTROLS * US);
+	CHECK(i2cCheckInGapNs < WDG_BUDGET_I2C * US);
+}
+
+/*
+ * @brief Warning changes still reach the slave inside the urgent deadline
+ */
+static void testUrgentLatency(void)
+{
+	Run run = {"warning toggling"};
+
+	setup(0);
+	warningToggle = 1;
+	loop(&run, 2000 * MS);
+	print(&run);
+
+	CHECK(i2cStats[I2C_PRIO_URGENT].count >= 25);
+	CHECK_EQ(i2cStats[I2C_PRIO_URGENT].missed, 0);
+	CHECK(i2cStats[I2C_PRIO_URGENT].latencyMax < I2C_DEADLINE_URGENT);
+}
+
+/*
+ * @brief EEPROM writes behind a write cycle: the soft timer polls, the core sleeps in between
+ */
+static void testBusyPoll(void)
+{
+	Run run = {"EEPROM backlog"};
+	char data[4] = {0};
+	uint32_t sleepsBefore;
+	uint32_t busBefore;
+
+	setup(0);
+	loop(&run, 20 * MS);
+
+	/* Four writes to different pages: one per write cycle */
+	sleepsBefore = schedSleeps;
+	for (int i = 0; i < 4; i++)
+		i2cSubmitWrite(EEPROM_ADDR, I2C_MADDR16(0x0200 + i * 32), 4, data, I2C_PRIO_BACKGROUND, I2C_TAG_NONE);
+
+	memset(&run, 0, sizeof(run));
+	run.name = "EEPROM backlog";
+	busBefore = busWrites;
+	loop(&run, 40 * MS);
+	print(&run);
+
+	CHECK_EQ(busWrites - busBefore, 4);
+	CHECK_EQ(i2cStats[I2C_PRIO_BACKGROUND].count, 4);
+	CHECK(i2cStats[I2C_PRIO_BACKGROUND].latencyMax < 3 * (EEPROM_WRITE_US + 2 * I2C_BUSY_POLL_US) + 1000);
+	CHECK(schedSleeps - sleepsBefore >= 30); /* asleep between polls, not spinning */
+
+	/* Queue empty: the soft timer is stopped, the bus task is back to TIM7 only */
+	busBefore = schedTasks[SCHED_TASK_BUS].runs;
+	loop(&run, 1000 * MS);
+	CHECK(schedTasks[SCHED_TASK_BUS].runs - busBefore <= 5);
+	CHECK_EQ(softTimerNextDue() == SOFT_TIMER_NONE, 1);
+
+	/* A write queued by an interrupt wakes the bus task too */
+	tim7Eeprom = 1;
+	busBefore = busWrites;
+	loop(&run, 1000 * MS);
+	CHECK(busWrites - busBefore >= 4);
+	CHECK_EQ(i2cStats[I2C_PRIO_BACKGROUND].missed, 0);
+}
+
+int main(void)
+{
+	hostTimebaseTrap();
+	hostOnWfi = onWfi;
+
+	testIdleResidency();
+	testUrgentLatency();
+	testBusyPoll();
+
+	return checkExit("test_scheduler");
+}
@@ -0,0 +1,237 @@
+/*
+ * @file 	test_slave_i2c.c
+ * @brief 	Slave I2C receive ring and link frames under a burst of master writes
+ * @details Drives the slave's I2C1 event ISR the way the peripheral does (ADDR, one RXNE per
+ * 			byte, STOPF) and drains it with the main loop's get_data()/linkParse() pass.
+ * 			A burst of 200 state frames with the main loop running only every 1 to
+ * 			RX_SLOTS - 1 transactions must arrive complete and in order; a longer stall must
+ * 			show up in rxOverrunCount, never as a silent loss.
+ *
+ * @author: Aeron Lahoylahoy
+ * @date: June 27, 2024
+ */
+#include <string.h>
+#include "check.h"
+#include "stm32f4xx.h"
+#include "i2c_slave.h"
+#include "link.h"
+
+/* Slave state read by link.c (motor.c, idle.c) */
+int speedCount1, speedCount2, mph, rpm;
+uint8_t cpuLoad;
+
+#define BURST_FRAMES 200
+#define BYTE_US 90 /* 9 clocks at 100 kHz */
+
+/* What the main loop saw */
+static int received;
+static int receivedSeq[BURST_FRAMES + RX_SLOTS * 4];
+static int receivedSpeed[BURST_FRAMES + RX_SLOTS * 4];
+
+/*
+ * @brief Function that plays one master write transaction into the slave ISR
+ * @param bytes: register pointer followed by the frame
+ * @param n: number of bytes
+ * @return None
+ */
+static void busWrite(const uint8_t *bytes, int n)
+{
+	I2C1->SR1 = I2C_SR1_ADDR;
+	I2C1->SR2 = I2C_SR2_BUSY; /* TRA clear, master writes */
+	I2C1_EV_IRQHandler();
+
+	for (int i = 0; i < n; i++)
+	{
+		I2C1->SR1 = I2C_SR1_RXNE;
+		I2C1->DR = bytes[i];
+		I2C1_EV_IRQHandler();
+	}
+
+	I2C1->SR1 = I2C_SR1_STOPF;
+	I2C1_EV_IRQHandler();
+	I2C1->SR1 = 0;
+}
+
+/*
+ * @brief Function that builds a state frame as the master sends it
+ * @param out: register pointer + frame, LINK_FRAME_MAX + 1 bytes
+ * @param seq: sequence number
+ * @param speed: 0.1 mph
+ * @return Number of bytes
+ */
+static int stateFrame(uint8_t *out, int seq, int speed)
+{
+	uint8_t *f = out + 1;
+	int n = LINK_HEADER_SIZE + LINK_STATE_SIZE;
+
+	memset(out, 0, LINK_FRAME_MAX + 1);
+	out[0] = LINK_REG_FRAME;
+	f[0] = LINK_HEADER_SIZE - 1 + LINK_STATE_SIZE;
+	f[1] = LINK_MSG_STATE;
+	f[2] = seq;
+	f[3] = speed & 0xFF;
+	f[4] = speed >> 8;
+	f[3 + 4] = LINK_TURN_LEFT;
+	f[3 + 7] = seq; /* odometer */
+	f[n] = linkChecksum((char *)f, n);
+
+	return n + 2;
+}
+
+/*
+ * @brief Function that runs one main loop pass: drain every pending transaction
+ * @param None
+ * @return Number of transactions drained
+ */
+static int mainLoopPass(void)
+{
+	char rxFrame[RX_BUFFER_SIZE];
+	int rxCount;
+	int drained = 0;
+
+	while ((rxCount = get_data(rxFrame)) > 0)
+	{
+		drained++;
+		if ((rxCount > 1) && (rxFrame[0] == LINK_REG_FRAME))
+		{
+			if (linkParse(&rxFrame[1], rxCount - 1) == LINK_MSG_STATE)
+			{
+				receivedSeq[received] = linkLastSeq;
+				receivedSpeed[received] = linkState.speed;
+				received++;
+			}
+		}
+	}
+
+	return drained;
+}
+
+/*
+ * @brief Function that clears the ring, the counters and the record
+ * @param None
+ * @return None
+ */
+static void reset(void)
+{
+	hostRegistersReset();
+	rxHead = rxTail = 0;
+	rxOverrunCount = rxTruncatedCount = rxBusErrorCount = 0;
+	linkErrorCount = 0;
+	received = 0;
+}
+
+/*
+ * @brief Burst with the main loop lagging up to RX_SLOTS - 1 transactions: zero loss
+ */
+static void testBurstNoLoss(void)
+{
+	uint8_t frame[LINK_FRAME_MAX + 1];
+	uint8_t pointer[1] = {LINK_REG_STATUS};
+	unsigned int lcg = 12345;
+	int pending = 0;
+	int lag = 1;
+	int maxLag = 0;
+	int n = 0;
+
+	reset();
+
+	for (int i = 0; i < BURST_FRAMES; i++)
+	{
+		n = stateFrame(frame, i & 0xFF, 10 * i);
+		busWrite(frame, n);
+
+		/* Status pointer writes in between are not transactions for the main loop */
+		if (i % 10 == 0)
+			busWrite(pointer, 1);
+
+		if (++pending >= lag)
+		{
+			CHECK_EQ(mainLoopPass(), pending);
+			if (pending > maxLag)
+				maxLag = pending;
+			pending = 0;
+			lcg = lcg * 1103515245 + 12345;
+			lag = 1 + (lcg >> 16) % (RX_SLOTS - 1);
+		}
+	}
+	mainLoopPass();
+
+	CHECK_EQ(received, BURST_FRAMES);
+	CHECK_EQ(rxOverrunCount, 0);
+	CHECK_EQ(rxTruncatedCount, 0);
+	CHECK_EQ(linkErrorCount, 0);
+	for (int i = 0; i < received; i++)
+	{
+		CHECK_EQ(receivedSeq[i], i & 0xFF);
+		CHECK_EQ(receivedSpeed[i], 10 * i);
+	}
+	CHECK_EQ(maxLag, RX_SLOTS - 1);
+	CHECK_EQ(linkState.turn, LINK_TURN_LEFT);
+
+	printf("burst: %d frames, 0 lost, main loop may stall %d frames (%d us at 100 kHz)\n",
+		   received, RX_SLOTS - 1, (RX_SLOTS - 1) * (n + 1) * BYTE_US);
+}
+
+/*
+ * @brief Main loop stalled past the ring: every dropped frame is counted
+ */
+static void testStallCountsOverruns(void)
+{
+	uint8_t frame[LINK_FRAME_MAX + 1];
+	uint8_t regs[LINK_STATUS_SIZE];
+	int sent = RX_SLOTS + 5;
+
+	reset();
+
+	for (int i = 0; i < sent; i++)
+		busWrite(frame, stateFrame(frame, i, i));
+	mainLoopPass();
+
+	CHECK_EQ(received, RX_SLOTS - 1);
+	CHECK_EQ(received + rxOverrunCount, sent);
+	for (int i = 0; i < received; i++)
+		CHECK_EQ(receivedSeq[i], i);
+
+	/* The master sees the loss in the status register file */
+	linkStatusSnapshot(regs);
+	CHECK_EQ(regs[LINK_STATUS_OVERRUNS], sent - (RX_SLOTS - 1));
+	CHECK_EQ(regs[LINK_STATUS_LAST_SEQ], RX_SLOTS - 2);
+
+	/* Ring works again after the stall */
+	busWrite(frame, stateFrame(frame, 77, 770));
+	mainLoopPass();
+	CHECK_EQ(receivedSeq[received - 1], 77);
+}
+
+/*
+ * @brief Corrupt and oversized frames are rejected and counted
+ */
+static void testBadFrames(void)
+{
+	uint8_t frame[LINK_FRAME_MAX + 8];
+	int n;
+
+	reset();
+
+	n = stateFrame(frame, 1, 100);
+	frame[5] ^= 0x10; /* payload bit flip */
+	busWrite(frame, n);
+
+	memset(frame, 0x55, sizeof(frame));
+	frame[0] = LINK_REG_FRAME;
+	busWrite(frame, sizeof(frame));
+
+	mainLoopPass();
+	CHECK_EQ(received, 0);
+	CHECK_EQ(linkErrorCount, 2);
+	CHECK_EQ(rxTruncatedCount, sizeof(frame) - RX_BUFFER_SIZE);
+}
+
+int main(void)
+{
+	testBurstNoLoss();
+	testStallCountsOverruns();
+	testBadFrames();
+
+	return checkExit("test_slave_i2c");
+}
@@ -0,0 +1,349 @@
+/*
+ * @file 	test_soft_timer.c
+ * @brief 	Soft timer wheel: firing times, later turns, periods, callbacks and the TIM5 wrap
+ * @details Runs the unmodified wheel on the virtual clock. A "main loop" advances time
+ * 			and calls softTimerService(), the way the scheduler does every pass. When TIM5
+ * 			wraps the update flag is raised and its interrupt runs after the pass, so the
+ * 			pending flag path of getMicros64() is used too.
+ *
+ * @author: Aeron Lahoylahoy
+ * @date: June 27, 2024
+ */
+#include <string.h>
+#include "check.h"
+#include "stm32f4xx.h"
+#include "timebase.h"
+#include "soft_timer.h"
+
+#define US 1000ULL
+#define TICK SOFT_TIMER_TICK_US
+
+/* Callback bookkeeping */
+static int fired;
+static uint64_t firedAt;
+
+static void onFire(void)
+{
+	fired++;
+	firedAt = getMicros64();
+}
+
+/*
+ * @brief Function that moves time forward and runs one main loop pass
+ * @param us: time since the last pass
+ * @return None
+ */
+static void step(uint32_t us)
+{
+	static uint32_t lastCnt;
+	uint32_t cnt;
+
+	hostAdvance(us * US);
+	cnt = TIM5->CNT;
+	if (cnt < lastCnt)
+		hostTimebaseEvent(0b1);
+	lastCnt = cnt;
+
+	softTimerService();
+
+	if (TIM5->SR & 0b1)
+		TIM5_IRQHandler();
+}
+
+/*
+ * @brief A one-shot fires once, on the first tick after its expiry, when softTimerNextDue() said
+ */
+static void testOneShot(void)
+{
+	static SoftTimer t;
+	uint32_t delays[] = {0, 1, 999, 1000, 2500, 31000};
+
+	for (unsigned int i = 0; i < sizeof(delays) / sizeof(delays[0]); i++)
+	{
+		uint64_t due;
+
+		step(TICK / 3);
+		fired = 0;
+		softTimerStart(&t, delays[i], 0, onFire);
+		due = softTimerNextDue();
+		CHECK_EQ(due, (t.expiry / TICK + 1) * TICK);
+
+		while (!fired && getMicros64() < t.expiry + 2 * TICK)
+			step(100);
+
+		CHECK_EQ(fired, 1);
+		CHECK(firedAt >= t.expiry);
+		CHECK(firedAt >= due && firedAt < due + 100);
+		CHECK_EQ(softTimerNextDue() == SOFT_TIMER_NONE, 1);
+
+		for (int n = 0; n < 100; n++)
+			step(1000);
+		CHECK_EQ(fired, 1);
+	}
+
+	/* Stopping a timer that isn't running, twice */
+	softTimerStop(&t);
+	softTimerStop(&t);
+	CHECK_EQ(softTimerNextDue() == SOFT_TIMER_NONE, 1);
+}
+
+/*
+ * @brief Timers a turn or more away share slots with near ones and still don't fire early
+ */
+static void testLaterTurns(void)
+{
+	static SoftTimer timers[8];
+	static const uint32_t delays[8] = {5000, 31000, 32000, 33000, 37000, 64000, 100000, 1000000};
+	uint64_t firedTime[8] = {0};
+	int count = 0;
+
+	step(TICK / 2);
+	fired = 0;
+	for (int i = 0; i < 8; i++)
+		softTimerStart(&timers[i], delays[i], 0, onFire);
+
+	while (count < 8 && getMicros64() < timers[7].expiry + 2 * TICK)
+	{
+		step(250);
+		for (int i = 0; i < 8; i++)
+		{
+			if (!timers[i].active && !firedTime[i])
+			{
+				firedTime[i] = getMicros64();
+				count++;
+			}
+		}
+	}
+
+	CHECK_EQ(fired, 8);
+	for (int i = 0; i < 8; i++)
+	{
+		CHECK(firedTime[i] >= timers[i].expiry);
+		CHECK(firedTime[i] < timers[i].expiry + TICK + 250);
+	}
+}
+
+/*
+ * @brief A periodic timer keeps its rate without drift and fires once, not a backlog, after a gap
+ */
+static void testPeriodic(void)
+{
+	static SoftTimer t;
+	uint64_t start;
+	int late = 0;
+
+	step(TICK / 4);
+	fired = 0;
+	start = getMicros64();
+	softTimerStart(&t, 10000, 10000, onFire);
+
+	/* Two seconds of passes every 300 us */
+	while (getMicros64() < start + 2000000)
+	{
+		int before = fired;
+
+		step(300);
+		if (fired != before)
+		{
+			uint64_t nominal = start + (uint64_t)fired * 10000;
+
+			late += firedAt < nominal || firedAt >= nominal + TICK + 300;
+		}
+	}
+	CHECK(fired >= 199 && fired <= 200);
+	CHECK_EQ(late, 0);
+
+	/* The main loop stalls for 95 ms */
+	fired = 0;
+	step(95000);
+	CHECK_EQ(fired, 1);
+	CHECK(t.expiry > getMicros64());
+	CHECK(t.expiry <= getMicros64() + 10000);
+
+	/* Back on a 10 ms rate */
+	for (int n = 0; n < 334; n++)
+		step(300);
+	CHECK(fired >= 10 && fired <= 11);
+
+	softTimerStop(&t);
+	CHECK_EQ(softTimerNextDue() == SOFT_TIMER_NONE, 1);
+}
+
+/* Timers edited from a callback, all in one slot */
+static SoftTimer editA;
+static SoftTimer editB;
+static SoftTimer editC;
+static SoftTimer editSelf;
+static int firedA;
+static int firedB;
+static int firedC;
+static int firedSelf;
+
+static void onA(void)
+{
+	firedA++;
+	softTimerStop(&editB);
+	softTimerStart(&editC, 5000, 0, onFire);
+}
+
+static void onB(void) { firedB++; }
+static void onC(void) { firedC++; }
+
+static void onSelf(void)
+{
+	if (++firedSelf == 3)
+		softTimerStop(&editSelf);
+}
+
+/*
+ * @brief A callback stops and restarts other timers of the slot being fired
+ */
+static void testCallbackEdits(void)
+{
+	step(TICK / 2);
+	firedA = firedB = firedC = firedSelf = 0;
+	fired = 0;
+
+	/* A is started last, so it is first in the slot */
+	softTimerStart(&editC, 3000, 0, onC);
+	softTimerStart(&editB, 3000, 0, onB);
+	softTimerStart(&editA, 3000, 0, onA);
+
+	for (int n = 0; n < 40; n++)
+		step(250);
+
+	CHECK_EQ(firedA, 1);
+	CHECK_EQ(firedB, 0);
+	CHECK_EQ(firedC, 0);
+	CHECK_EQ(fired, 1); /* C restarted on onFire */
+	CHECK_EQ(editB.active, 0);
+	CHECK_EQ(softTimerNextDue() == SOFT_TIMER_NONE, 1);
+
+	/* A periodic timer that stops itself */
+	softTimerStart(&editSelf, 1000, 1000, onSelf);
+	for (int n = 0; n < 40; n++)
+		step(250);
+	CHECK_EQ(firedSelf, 3);
+	CHECK_EQ(softTimerNextDue() == SOFT_TIMER_NONE, 1);
+}
+
+/*
+ * @brief Random delays, random pass gaps, restarts: each start fires once, never early
+ */
+static void testRandom(void)
+{
+	static SoftTimer timers[64];
+	uint64_t expiry[64];
+	int starts = 0;
+	int early = 0;
+	int late = 0;
+	int wrongDue = 0;
+	uint32_t seed = 49;
+
+	fired = 0;
+	for (int i = 0; i < 64; i++)
+	{
+		seed = seed * 1103515245 + 12345;
+		softTimerStart(&timers[i], (seed >> 8) % 200000, 0, onFire);
+		expiry[i] = timers[i].expiry;
+		starts++;
+	}
+
+	for (int pass = 0; pass < 20000; pass++)
+	{
+		uint32_t gap;
+		uint64_t first = SOFT_TIMER_NONE;
+		uint64_t now;
+
+		for (int i = 0; i < 64; i++)
+		{
+			if (timers[i].active && expiry[i] < first)
+				first = expiry[i];
+		}
+		if (first != SOFT_TIMER_NONE)
+			wrongDue += softTimerNextDue() != (first / TICK + 1) * TICK;
+
+		seed = seed * 1103515245 + 12345;
+		gap = 1 + (seed >> 8) % 3000;
+		step(gap);
+		now = getMicros64();
+
+		for (int i = 0; i < 64; i++)
+		{
+			if (timers[i].active || !expiry[i])
+				continue;
+
+			/* Fired on this pass */
+			early += now < expiry[i];
+			late += now >= expiry[i] + TICK + gap;
+			expiry[i] = 0;
+
+			/* Half of them start again */
+			seed = seed * 1103515245 + 12345;
+			if (pass < 15000 && (seed & 0x100))
+			{
+				softTimerStart(&timers[i], (seed >> 12) % 100000, 0, onFire);
+				expiry[i] = timers[i].expiry;
+				starts++;
+			}
+		}
+	}
+
+	CHECK_EQ(fired, starts);
+	CHECK_EQ(early, 0);
+	CHECK_EQ(late, 0);
+	CHECK_EQ(wrongDue, 0);
+	CHECK_EQ(softTimerNextDue() == SOFT_TIMER_NONE, 1);
+}
+
+/*
+ * @brief Timers across the TIM5 wrap fire on time, with the update interrupt still pending
+ */
+static void testWrap(void)
+{
+	static SoftTimer timers[3];
+	static const uint32_t delays[3] = {10000, 30000, 50000};
+	uint64_t firedTime[3] = {0};
+	uint64_t before;
+
+	TIM5->CNT = 0xFFFFFFFF - 20000;
+	step(0);
+	before = getMicros64();
+
+	fired = 0;
+	for (int i = 0; i < 3; i++)
+		softTimerStart(&timers[i], delays[i], 0, onFire);
+
+	for (int n = 0; n < 300; n++)
+	{
+		step(250);
+		for (int i = 0; i < 3; i++)
+		{
+			if (!timers[i].active && !firedTime[i])
+				firedTime[i] = getMicros64();
+		}
+	}
+
+	CHECK(getMicros64() > before);
+	CHECK(getMicros64() >> 32 == (before >> 32) + 1);
+	CHECK_EQ(fired, 3);
+	for (int i = 0; i < 3; i++)
+	{
+		CHECK(firedTime[i] >= before + delays[i]);
+		CHECK(firedTime[i] < before + delays[i] + TICK + 250 + 50);
+	}
+}
+
+int main(void)
+{
+	hostTimebaseTrap();
+
+	testOneShot();
+	testLaterTurns();
+	testPeriodic();
+	testCallbackEdits();
+	testRandom();
+	testWrap();
+
+	return checkExit("test_soft_timer");
+}
@@ -0,0 +1,492 @@
+/*
+ * @file 	test_sonar.c
+ * @brief 	Sonar echo capture, distance filter and warning
+ * @details Drives the unmodified capture interrupt of sonar.c with echo edges: the echo
+ * 			pin level in GPIO IDR, the captured count in CCR1 and the flags in SR, the way
+ * 			the timer presents them. TIM3's counter runs over the backlight PWM period, so
+ * 			echoes cross update events.
+ *
+ * 			The echo replay parks against an obstacle with noisy, spurious and missing echoes
+ * 			and compares the warning with the former one: distance in double, previous value
+ * 			kept on an implausible reading, warning below 10 in and an I2C write per echo.
+ *
+ * @author: Aeron Lahoylahoy
+ * @date: June 27, 2024
+ */
+#include <math.h>
+#include <string.h>
+#include "check.h"
+#include "stm32f4xx.h"
+#include "timebase.h"
+#include "board.h"
+#include "sonar.h"
+
+/* Link and watchdog, counted */
+static int linkWarning = 0;
+static uint32_t linkWarningChanges = 0;
+void linkSetWarning(int warning)
+{
+	linkWarningChanges += warning != linkWarning;
+	linkWarning = warning;
+}
+void watchDogCheckIn(int task) {}
+
+/* sonar.c internals */
+extern uint32_t tim3Overflows;
+void TIM2_IRQHandler(void);
+void TIM3_IRQHandler(void);
+
+#define US 1000ULL
+#define MS 1000000ULL
+
+/* TIM3 counter time (us) of the echo edges */
+static uint64_t tim3Now;
+
+/*
+ * @brief Function that starts the slot and capture timers with every sensor idle
+ * @param None
+ * @return None
+ */
+static void setup(void)
+{
+	hostRegistersReset();
+	memset(sonarSensors, 0, sizeof(sonarSensors));
+	sonarSlot = 0;
+	sonarWarning = 0;
+	linkWarning = 0;
+	linkWarningChanges = 0;
+	tim3Overflows = 0;
+	tim3Now = 0;
+
+	TIM3->ARR = BOARD_TIM3_PERIOD - 1; /* backlight PWM, boardInit() */
+	sonarInit();
+}
+
+/*
+ * @brief Function that starts the next TIM2 slot and ends its trigger pulse
+ * @param None
+ * @return None
+ */
+static void slot(void)
+{
+	hostAdvance(SONAR_SLOT_US * US);
+	TIM2->SR = 0b1;
+	TIM2_IRQHandler();
+	TIM2->SR = 0b1 << 1; /* end of trigger pulse */
+	TIM2_IRQHandler();
+}
+
+/*
+ * @brief Function that runs TIM2 slots until sensor 0 is listening
+ * @param None
+ * @return None
+ */
+static void slotStart(void)
+{
+	do
+	{
+		slot();
+	} while (!sonarSensors[0].listening);
+}
+
+/*
+ * @brief Function that delivers TIM3 update events up to a counter time
+ * @param us: TIM3 time
+ * @return None
+ */
+static void tim3Overflow(uint64_t us)
+{
+	while (tim3Overflows < us / BOARD_TIM3_PERIOD)
+	{
+		TIM3->SR = 0b1;
+		TIM3_IRQHandler();
+	}
+}
+
+/*
+ * @brief Function that delivers one echo edge of sensor 0 to TIM3_IRQHandler
+ * @param us: TIM3 time of the edge
+ * @param level: echo pin level after the edge
+ * @param pendingUpdate: 1 to let the edge arrive with the update event that came before
+ * 		  it still pending, as when both happen between two interrupt entries
+ * @return None
+ */
+static void echoEdge(uint64_t us, int level, int pendingUpdate)
+{
+	tim3Overflow(pendingUpdate ? us - us % BOARD_TIM3_PERIOD - 1 : us);
+	tim3Now = us;
+
+	if (level)
+		GPIOB->IDR |= 0b1 << SONAR_ECHO_PIN;
+	else
+		GPIOB->IDR &= ~(0b1 << SONAR_ECHO_PIN);
+	TIM3->CCR1 = us % BOARD_TIM3_PERIOD;
+	TIM3->SR = (0b1 << 1) | (pendingUpdate ? 0b1 : 0);
+	TIM3_IRQHandler();
+}
+
+/*
+ * @brief Function that delivers a complete echo of sensor 0
+ * @param startUs: TIM3 time of the rising edge
+ * @param widthUs: echo pulse width
+ * @return None
+ */
+static void echo(uint64_t startUs, uint32_t widthUs)
+{
+	echoEdge(startUs, 1, 0);
+	echoEdge(startUs + widthUs, 0, 0);
+}
+
+/*
+ * @brief Echo widths across TIM3 update events publish the right distance with a new sequence
+ */
+static void testEchoCapture(void)
+{
+	static const uint32_t widths[] = {150, 1470, 2940, 9999, 10000, 23530};
+	uint32_t seq;
+
+	setup();
+	for (unsigned int i = 0; i < sizeof(widths) / sizeof(widths[0]); i++)
+	{
+		slotStart();
+		seq = sonarSensors[0].seq;
+		echo(tim3Now + 9000 + i * 777, widths[i]);
+
+		CHECK_EQ(sonarSensors[0].seq, seq + 1);
+		CHECK_EQ(sonarSensors[0].echoUs, widths[i]);
+		CHECK_EQ(sonarSensors[0].raw, (int)(widths[i] * 68 / 1000) - 10);
+		CHECK_EQ(sonarSensors[0].listening, 0);
+		tim3Now += SONAR_SLOT_US;
+	}
+}
+
+/*
+ * @brief A falling edge captured just after an update event the interrupt hasn't counted yet
+ */
+static void testPendingUpdate(void)
+{
+	setup();
+	slotStart();
+	echoEdge(25000, 1, 0);
+	echoEdge(30000 + 20, 0, 1); /* update at 30000 still pending */
+	CHECK_EQ(sonarSensors[0].echoUs, 5020);
+	CHECK_EQ(tim3Overflows, 3);
+
+	/* Capture late in the period with the update pending: that update came after the capture */
+	slotStart();
+	echoEdge(40000 + 100, 1, 0);
+	tim3Overflow(49999);
+	GPIOB->IDR &= ~(0b1 << SONAR_ECHO_PIN);
+	TIM3->CCR1 = 9990;
+	TIM3->SR = (0b1 << 1) | 0b1;
+	TIM3_IRQHandler();
+	CHECK_EQ(sonarSensors[0].echoUs, 9890);
+}
+
+/*
+ * @brief Edges outside the window, a lost edge and a window with no echo
+ */
+static void testWindow(void)
+{
+	uint32_t seq;
+
+	setup();
+
+	/* No window open: crosstalk */
+	echo(1000, 1000);
+	CHECK_EQ(sonarSensors[0].seq, 0);
+
+	/* Overcapture between the edges drops the echo */
+	slotStart();
+	echoEdge(5000, 1, 0);
+	TIM3->SR = 0b1 << 9;
+	TIM3_IRQHandler();
+	echoEdge(6000, 0, 0);
+	CHECK_EQ(sonarSensors[0].seq, 0);
+
+	/* The window closes without a complete echo */
+	slotStart();
+	CHECK_EQ(sonarSensors[0].seq, 1);
+	CHECK_EQ(sonarSensors[0].raw, SONAR_NO_ECHO);
+
+	/* One echo per window: a second one is a late reflection */
+	echo(50000, 1000);
+	seq = sonarSensors[0].seq;
+	echo(55000, 2000);
+	CHECK_EQ(sonarSensors[0].seq, seq);
+	CHECK_EQ(sonarSensors[0].echoUs, 1000);
+}
+
+/*
+ * @brief The main loop reads the latest published distance without waiting on the timer
+ */
+static void testMainLoopDoesNotWait(void)
+{
+	uint64_t start;
+
+	setup();
+	slotStart();
+	echo(2000, 1470);
+
+	/* Nothing new: returns at once, no capture flag polled */
+	start = hostNowNs;
+	for (int i = 0; i < 1000; i++)
+		checkWarningSignal();
+	CHECK(hostNowNs - start < 1000 * US);
+	CHECK_EQ(sonarSensors[0].distance, 1470 * 68 / 1000 - 10);
+	CHECK_EQ(sonarSensors[0].seqSeen, sonarSensors[0].seq);
+	CHECK_EQ(distance, sonarSensors[0].distance);
+	CHECK_EQ(sonarNearest, 0);
+}
+
+/* Former calculateDistance() and checkWarningSignal() */
+static double formerDistance = 0;
+static int formerWarning = 0;
+static uint32_t formerToggles = 0;
+static uint32_t formerWrites = 0;
+
+/*
+ * @brief Function that runs the former distance conversion and warning on one echo
+ * @param widthUs: echo pulse width
+ * @return None
+ */
+static void formerEcho(uint32_t widthUs)
+{
+	double prev = formerDistance;
+	int warning;
+
+	formerDistance = (0.034 * widthUs) / 2;
+	formerDistance = formerDistance / 2.5;
+	formerDistance = formerDistance - 1;
+	if (formerDistance < 0)
+		formerDistance = prev;
+	if (formerDistance > 100)
+		formerDistance = prev;
+
+	warning = formerDistance < 10;
+	formerToggles += warning != formerWarning;
+	formerWarning = warning;
+	formerWrites++; /* 0x60 or 0x61 to the slave on every pass */
+}
+
+/*
+ * @brief Function that returns a uniform random number for the echo trace
+ * @param None
+ * @return 0 to 1
+ */
+static double traceRandom(void)
+{
+	static uint32_t state = 12345;
+
+	state = state * 1664525 + 1013904223;
+	return (state >> 8) / 16777216.0;
+}
+
+/*
+ * @brief Parking: approach, stand at 9.6 in with noise, back off; spurious and missing echoes throughout
+ */
+static void testEchoReplay(void)
+{
+	const int echoes = 750; /* one a slot for 60 s at SONAR_SLOT_US with the sensors taking turns */
+	uint32_t toggles;
+	int missing = 0;
+	int spurious = 0;
+
+	setup();
+	formerDistance = 0;
+	formerWarning = 0;
+	formerToggles = 0;
+	formerWrites = 0;
+	toggles = sonarWarningToggles;
+
+	for (int i = 0; i < echoes; i++)
+	{
+		double inches;
+		double r = traceRandom();
+
+		if (i < 250)
+			inches = 40 - 31.0 * i / 250; /* 40 in to 9 in */
+		else if (i < 500)
+			inches = 9.6 + 0.7 * sin(i * 1.7); /* standing, noise across the former 10 in threshold */
+		else
+			inches = 9.6 + 30.4 * (i - 500) / 250;
+
+		if (r < 0.03)
+		{
+			inches = traceRandom() < 0.5 ? 2 : 70; /* ground or side reflection */
+			spurious++;
+		}
+
+		slotStart();
+		if (r > 0.97)
+		{
+			missing++; /* no echo this window, the former code waited for the next one */
+		}
+		else
+		{
+			uint32_t width = (uint32_t)((inches + 1) * 2.5 * 2 / 0.034);
+
+			echo(tim3Now + 500, width);
+			formerEcho(width);
+		}
+		checkWarningSignal();
+	}
+
+	/* Let the last window close and the filter see it */
+	slotStart();
+	checkWarningSignal();
+
+	/* One on, one off, one urgent frame each */
+	CHECK_EQ(sonarWarningToggles - toggles, 2);
+	CHECK_EQ(linkWarningChanges, 2);
+	CHECK_EQ(sonarWarning, 0);
+	CHECK(formerToggles > 10 * (sonarWarningToggles - toggles));
+	CHECK(spurious > 0 && missing > 0);
+
+	printf("echo replay, %d echoes (%d spurious, %d missing): warning toggles %u (former %u), "
+		   "I2C writes %u (former %u)\n",
+		   echoes, spurious, missing, sonarWarningToggles - toggles, formerToggles,
+		   linkWarningChanges, formerWrites);
+}
+
+/*
+ * @brief Round robin over SONAR_COUNT sensors: one listening window at a time per group, even ping rate
+ */
+static void testSlotSchedule(void)
+{
+	const uint32_t slots = 100 * SONAR_COUNT;
+	uint32_t overlaps = 0;
+	uint32_t triggers = 0;
+
+	setup();
+	for (uint32_t n = 0; n < slots; n++)
+	{
+		uint8_t groups = 0;
+
+		for (int i = 0; i < SONAR_COUNT; i++)
+			sonarConfig[i].trigPort->BSRR = 0;
+
+		hostAdvance(SONAR_SLOT_US * US);
+		TIM2->SR = 0b1;
+		TIM2_IRQHandler();
+
+		for (int i = 0; i < SONAR_COUNT; i++)
+		{
+			const SonarConfig *cfg = &sonarConfig[i];
+
+			if (!sonarSensors[i].listening)
+				continue;
+			overlaps += (groups >> cfg->group) & 1;
+			groups |= 0b1 << cfg->group;
+			triggers += cfg->trigPort->BSRR == (0b1u << cfg->trigPin);
+		}
+
+		/* Trigger pulse ends on CC1 */
+		TIM2->SR = 0b1 << 1;
+		TIM2_IRQHandler();
+		for (int i = 0; i < SONAR_COUNT; i++)
+			CHECK_EQ(sonarConfig[i].trigPort->BSRR & 0xFFFF, 0);
+	}
+
+	CHECK_EQ(overlaps, 0);
+	for (int i = 0; i < SONAR_COUNT; i++)
+	{
+		CHECK(sonarSensors[i].pings * sonarConfig[i].interval * SONAR_COUNT >= slots - SONAR_COUNT);
+		CHECK(sonarSensors[i].pings * sonarConfig[i].interval * SONAR_COUNT <= slots + SONAR_COUNT);
+		triggers -= sonarSensors[i].pings;
+	}
+	CHECK_EQ(triggers, 0);
+
+	printf("%d sensor%s, %u ms slots: sensor 0 pings at %.2f Hz, %u overlapping windows\n", SONAR_COUNT,
+		   SONAR_COUNT > 1 ? "s" : "", SONAR_SLOT_US / 1000,
+		   sonarSensors[0].pings * 1e6 / ((double)slots * SONAR_SLOT_US), overlaps);
+}
+
+#if SONAR_COUNT > 1
+void TIM8_BRK_TIM12_IRQHandler(void);
+#endif
+#if SONAR_COUNT > 3
+void TIM1_BRK_TIM9_IRQHandler(void);
+#endif
+
+/*
+ * @brief Function that delivers a complete echo to sensors 1 to 3, inside one timer period
+ * @param sensor: 1 to 3
+ * @param widthUs: echo pulse width, below 60000
+ * @return None
+ */
+static void echoSensor(int sensor, uint32_t widthUs)
+{
+#if SONAR_COUNT > 1
+	const SonarConfig *cfg = &sonarConfig[sensor];
+	TIM_TypeDef *tim = sensor == 3 ? TIM9 : TIM12;
+	uint32_t flag = sensor == 2 ? 0b1 << 2 : 0b1 << 1;
+	volatile uint32_t *ccr = sensor == 2 ? &tim->CCR2 : &tim->CCR1;
+	void (*irq)(void) = 0;
+
+#if SONAR_COUNT > 3
+	irq = sensor == 3 ? TIM1_BRK_TIM9_IRQHandler : TIM8_BRK_TIM12_IRQHandler;
+#else
+	irq = TIM8_BRK_TIM12_IRQHandler;
+#endif
+
+	cfg->echoPort->IDR |= 0b1 << cfg->echoPin;
+	*ccr = 1000;
+	tim->SR = flag;
+	irq();
+	cfg->echoPort->IDR &= ~(0b1 << cfg->echoPin);
+	*ccr = 1000 + widthUs;
+	tim->SR = flag;
+	irq();
+#endif
+}
+
+/*
+ * @brief Every sensor echoes in its own window; the nearest valid one drives distance and the warning
+ */
+static void testNearest(void)
+{
+	static const int inches[] = {30, 8, 50, 20};
+
+	setup();
+	for (uint32_t n = 0; n < 3 * SONAR_COUNT; n++)
+	{
+		slot();
+		for (int i = 0; i < SONAR_COUNT; i++)
+		{
+			uint32_t width = (inches[i] * 10 + 10) * 1000 / 68 + 1;
+
+			if (!sonarSensors[i].listening)
+				continue;
+			if (i == 0)
+				echo(tim3Now + 500, width);
+			else
+				echoSensor(i, width);
+		}
+		checkWarningSignal();
+	}
+
+	for (int i = 0; i < SONAR_COUNT; i++)
+	{
+		CHECK(sonarSensors[i].valid);
+		CHECK_EQ(sonarSensors[i].distance, inches[i] * 10);
+	}
+	CHECK_EQ(sonarNearest, SONAR_COUNT > 1 ? 1 : 0);
+	CHECK_EQ(distance, (SONAR_COUNT > 1 ? inches[1] : inches[0]) * 10);
+	CHECK_EQ(sonarWarning, SONAR_COUNT > 1);
+}
+
+int main(void)
+{
+	hostTimebaseTrap();
+
+	testEchoCapture();
+	testPendingUpdate();
+	testWindow();
+	testMainLoopDoesNotWait();
+	testEchoReplay();
+	testSlotSchedule();
+	testNearest();
+
+	return checkExit(SONAR_COUNT > 1 ? "test_sonar_4" : "test_sonar");
+}
@@ -0,0 +1,446 @@
+/*
+ * @file 	test_speed_sensor.c
+ * @brief 	Hall speed filter and odometer against the former batch average and integrator
+ * @details Feeds hall pulse timestamps through the unmodified TIM4 capture interrupt of
+ * 			speed_sensor.c and runs calculateRPM() after each pulse, the way the speed task
+ * 			does when TIM4 signals it. The firmware's former calculateRPM() (seven periods
+ * 			averaged in double, then mph from the float formula) is kept here as the
+ * 			reference it replaced.
+ *
+ * 			The odometer replay drives an hour of stop and go traffic up to 90 mph and
+ * 			compares the pulse count odometer with the former once a second mph / 3600
+ * 			integration. At each 250 ms TIM7 tick the gauge reading is checked against
+ * 			the speed being driven.
+ *
+ * 			Host time per update is printed for both. It compares the two algorithms on
+ * 			this machine only: the M4F emulates double in software, which the host does
+ * 			not, so cycle counts on the target come from the profiler (PROFILE=1).
+ *
+ * @author: Aeron Lahoylahoy
+ * @date: June 27, 2024
+ */
+#include <math.h>
+#include <time.h>
+#include "check.h"
+#include "stm32f4xx.h"
+#include "timebase.h"
+#include "speed_sensor.h"
+
+void schedulerSignal(int task) {}
+
+/* speed_sensor.c internals */
+extern uint32_t hallOverflows;
+extern volatile uint32_t hallFilterSum;
+extern volatile int hallFilterCount;
+void TIM4_IRQHandler(void);
+
+/* Exact speed of a pulse period, from the same wheel as the firmware */
+#define EXACT_MPH(periodUs) (3600000000.0 * WHEEL_CIRCUMFERENCE_FT / (5280.0 * HALL_PULSES_PER_REV * (periodUs)))
+#define MPH_PERIOD_US(mph) ((uint32_t)(3600000000.0 * WHEEL_CIRCUMFERENCE_FT / (5280.0 * HALL_PULSES_PER_REV * (mph))))
+#define BATCH_LEN 7
+#define TICK_US 250000 /* TIM7 */
+
+/* Capture time of the last pulse (TIM4 at 1 MHz) */
+static uint32_t hallNowUs;
+
+/* Former calculateRPM()/calculateMPH() */
+static float batchRpm;
+static float batchMph;
+static float batchRpmSum;
+static int batchCount;
+
+/*
+ * @brief Function that runs the former batch average on one pulse period
+ * @param periodUs: pulse period
+ * @return None
+ */
+static void batchCalculate(uint32_t periodUs)
+{
+	double timeElapsed = periodUs;
+	float rpmAverage;
+	float mphPrev = batchMph;
+
+	batchRpm = 60 / ((timeElapsed / 1000000) * HALL_PULSES_PER_REV);
+	batchRpmSum = batchRpm + batchRpmSum;
+	if (++batchCount == BATCH_LEN)
+	{
+		rpmAverage = batchRpmSum / batchCount;
+		batchMph = ((rpmAverage * 2 * 3.145 * 1.5 * 60) / 5280);
+		if (batchMph > 100)
+			batchMph = mphPrev;
+		batchRpmSum = 0;
+		batchCount = 0;
+	}
+}
+
+/*
+ * @brief Function that starts capture mode with no pulse seen and both filters empty
+ * @param None
+ * @return None
+ */
+static void setup(void)
+{
+	hostRegistersReset();
+	rpmReaderInit();
+	calculateRPM();
+	hallNowUs = 1000;
+	batchMph = 0;
+	batchRpmSum = 0;
+	batchCount = 0;
+}
+
+/*
+ * @brief Function that delivers one hall edge to TIM4_IRQHandler, counter overflows first
+ * @param periodUs: time since the last edge
+ * @return None
+ */
+static void hallPulse(uint32_t periodUs)
+{
+	hallNowUs += periodUs;
+	while (hallOverflows < (hallNowUs >> 16))
+	{
+		TIM4->SR = 0b1;
+		TIM4_IRQHandler();
+	}
+	TIM4->CCR1 = hallNowUs & 0xFFFF;
+	TIM4->SR = 0b1 << 1;
+	TIM4_IRQHandler();
+}
+
+/*
+ * @brief Function that delivers a pulse and runs both speed calculations on it
+ * @param periodUs: time since the last edge
+ * @return None
+ */
+static void pulseAndCalculate(uint32_t periodUs)
+{
+	hallPulse(periodUs);
+	calculateRPM();
+	batchCalculate(periodUs);
+}
+
+/*
+ * @brief Steady speed: the Q16 result matches the exact formula
+ */
+static void testSteadySpeed(void)
+{
+	static const int speeds[] = {5, 12, 30, 55, 79};
+
+	for (unsigned int i = 0; i < sizeof(speeds) / sizeof(speeds[0]); i++)
+	{
+		uint32_t period = MPH_PERIOD_US(speeds[i]);
+		double mph;
+
+		setup();
+		for (int n = 0; n < 2 * BATCH_LEN + 1; n++)
+			pulseAndCalculate(period);
+
+		mph = speedMphQ16 / 65536.0;
+		CHECK(mph > EXACT_MPH(period) - 0.01 && mph < EXACT_MPH(period) + 0.01);
+		CHECK(speedRpmQ16 / 65536.0 > 60000000.0 / (HALL_PULSES_PER_REV * period) - 0.01);
+		CHECK(speedRpmQ16 / 65536.0 < 60000000.0 / (HALL_PULSES_PER_REV * period) + 0.01);
+	}
+}
+
+/*
+ * @brief Function that counts the pulses after a speed step until an output settles
+ * @param filter: 1 for the firmware's Q16 filter, 0 for the batch average
+ * @param phase: pulses into the batch when the step comes
+ * @param from: mph before the step
+ * @param to: mph after the step
+ * @return Pulses after the step until the output is within 1% of the new speed
+ */
+static int stepLatency(int filter, int phase, int from, int to)
+{
+	uint32_t period = MPH_PERIOD_US(from);
+
+	setup();
+	for (int n = 0; n < 3 * BATCH_LEN + phase; n++)
+		pulseAndCalculate(period);
+
+	period = MPH_PERIOD_US(to);
+	for (int n = 1; n < 100; n++)
+	{
+		double mph;
+
+		pulseAndCalculate(period);
+		mph = filter ? speedMphQ16 / 65536.0 : batchMph;
+		if (mph > to * 0.99 && mph < to * 1.01)
+			return n;
+	}
+	return 100;
+}
+
+/*
+ * @brief A 30 to 60 mph step reaches the output within HALL_FILTER_LEN pulses whatever the phase
+ */
+static void testStepLatency(void)
+{
+	int worstFilter = 0;
+	int worstBatch = 0;
+
+	for (int phase = 0; phase < BATCH_LEN; phase++)
+	{
+		int f = stepLatency(1, phase, 30, 60);
+		int b = stepLatency(0, phase, 30, 60);
+
+		worstFilter = f > worstFilter ? f : worstFilter;
+		worstBatch = b > worstBatch ? b : worstBatch;
+	}
+
+	CHECK_EQ(worstFilter, HALL_FILTER_LEN);
+	CHECK(worstBatch > worstFilter);
+	printf("30->60 mph step, worst case over batch phase: filter %d pulses (%u ms), batch %d pulses (%u ms)\n",
+		   worstFilter, (unsigned)(worstFilter * MPH_PERIOD_US(60) / 1000), worstBatch,
+		   (unsigned)(worstBatch * MPH_PERIOD_US(60) / 1000));
+}
+
+/*
+ * @brief Output changes on every pulse, not once per batch
+ */
+static void testUpdateRate(void)
+{
+	int filterUpdates = 0;
+	int batchUpdates = 0;
+
+	setup();
+	for (int n = 0; n < 70; n++)
+	{
+		uint32_t mph = speedMphQ16;
+		float prev = batchMph;
+
+		pulseAndCalculate(MPH_PERIOD_US(20 + n / 2.0));
+		filterUpdates += speedMphQ16 != mph;
+		batchUpdates += batchMph != prev;
+	}
+
+	CHECK_EQ(filterUpdates, 70 - 1); /* the first pulse only starts the period */
+	CHECK_EQ(batchUpdates, 70 / BATCH_LEN);
+}
+
+/*
+ * @brief Wheel stopped: no pulse for HALL_STALL_US empties the filter
+ */
+static void testStall(void)
+{
+	setup();
+	for (int n = 0; n < 10; n++)
+		pulseAndCalculate(MPH_PERIOD_US(30));
+	CHECK(speedMphQ16 != 0);
+
+	for (uint32_t t = 0; t <= HALL_STALL_US + 0x10000; t += 0x10000)
+	{
+		TIM4->SR = 0b1;
+		TIM4_IRQHandler();
+	}
+	calculateRPM();
+	CHECK_EQ(hallPeriodUs, 0);
+	CHECK_EQ(speedMphQ16, 0);
+	CHECK_EQ(speedRpmQ16, 0);
+}
+
+/*
+ * @brief A filtered period too short to be real doesn't wrap into the gauge range
+ */
+static void testShortPeriod(void)
+{
+	uint32_t mph;
+
+	setup();
+	for (int n = 0; n < 10; n++)
+		pulseAndCalculate(MPH_PERIOD_US(30));
+	mph = speedMphQ16;
+
+	/* 45 us: HALL_MPH_K_Q16 / 45 is above 32 bits and wrapped to about 13 mph */
+	hallFilterSum = 45 * HALL_FILTER_LEN;
+	hallFilterCount = HALL_FILTER_LEN;
+	calculateRPM();
+	CHECK_EQ(speedMphQ16, mph);
+
+	hallFilterSum = HALL_FILTER_LEN * (HALL_MPH_K_Q16 / SPEED_MAX_MPH_Q16 - 1);
+	calculateRPM();
+	CHECK_EQ(speedMphQ16, mph);
+}
+
+/*
+ * @brief Function that returns the speed of the replayed drive cycle
+ * @param t: seconds into the cycle
+ * @return mph
+ */
+static double driveCycle(double t)
+{
+	double c = fmod(t, 600);
+
+	if (c < 60)
+		return c; /* pull away to 60 */
+	if (c < 180)
+		return 60 + 5 * sin(c / 7); /* cruise */
+	if (c < 220)
+		return 60 + (c - 180) * 0.75; /* overtake to 90 */
+	if (c < 300)
+		return 90;
+	if (c < 400)
+		return 90 - (c - 300) * 0.7; /* down to 20 */
+	if (c < 520)
+		return 20 + 15 * fabs(sin(c / 5)); /* stop and go */
+	if (c < 560)
+		return 20 - (c - 520) / 2;
+	return 0; /* stopped */
+}
+
+/*
+ * @brief Function that moves the virtual clock up to a time
+ * @param us: microseconds since the replay started
+ * @return None
+ */
+static void replayClock(uint64_t us)
+{
+	if (us * 1000 > hostNowNs)
+		hostAdvance(us * 1000 - hostNowNs);
+}
+
+/*
+ * @brief Function that returns the next pulse of the drive cycle
+ * @param us: time of the last pulse, or of the last tick while stopped
+ * @return Time of the next pulse, 0 while stopped
+ */
+static uint64_t drivePulse(uint64_t us)
+{
+	double mph = driveCycle(us / 1e6);
+
+	return mph >= 1 ? us + MPH_PERIOD_US(mph) : 0;
+}
+
+/*
+ * @brief An hour of driving: the pulse count odometer is exact, the old integrator drifts,
+ * 		  and the reading stays on the driven speed at the top of the gauge
+ */
+static void testOdometerReplay(void)
+{
+	const uint64_t endUs = 3600ULL * 1000000;
+	uint64_t nextPulse = 0;
+	uint64_t lastPulse = 0;
+	uint64_t nextTick = TICK_US;
+	uint64_t pulses = 0;
+	uint32_t ticks = 0;
+	uint32_t fastTicks = 0;
+	double fastErrorMax = 0; /* mph, at 70 mph and above */
+	double cruiseMin = 1000; /* readings while holding 90 mph */
+	double cruiseMax = 0;
+	float cumulativeMiles = 0; /* former updateCumulativeMiles() */
+	double exactTenths;
+	uint32_t tenths;
+
+	setup();
+	hostNowNs = 0;
+	speedResetPulses(&tripPulses);
+	speedResetPulses(&odometerPulses);
+
+	while (nextTick <= endUs)
+	{
+		if (nextPulse && nextPulse < nextTick)
+		{
+			uint32_t period = nextPulse - lastPulse;
+
+			replayClock(nextPulse);
+			pulses++;
+			batchCalculate(period);
+			hallNowUs = nextPulse - period;
+			hallPulse(period);
+			lastPulse = nextPulse;
+			nextPulse = drivePulse(nextPulse);
+		}
+		else
+		{
+			/* TIM7 tick: speed task, and each second the former integrator */
+			double driven = driveCycle(nextTick / 1e6);
+			double mph;
+
+			replayClock(nextTick);
+			calculateRPM();
+			mph = speedMphQ16 / 65536.0;
+			if (driven >= 70)
+			{
+				fastTicks++;
+				if (fabs(mph - driven) > fastErrorMax)
+					fastErrorMax = fabs(mph - driven);
+			}
+			if (driven == 90 && fmod(nextTick / 1e6, 600) > 221)
+			{
+				cruiseMin = mph < cruiseMin ? mph : cruiseMin;
+				cruiseMax = mph > cruiseMax ? mph : cruiseMax;
+			}
+			if (++ticks % 4 == 0)
+				cumulativeMiles = ((batchMph / 3600) + cumulativeMiles);
+
+			if (!nextPulse)
+			{
+				nextPulse = drivePulse(nextTick);
+				lastPulse = nextTick;
+			}
+			nextTick += TICK_US;
+		}
+	}
+
+	exactTenths = pulses * WHEEL_CIRCUMFERENCE_FT * 10 / (5280.0 * HALL_PULSES_PER_REV);
+	tenths = pulsesToTenths(speedReadPulses(&tripPulses));
+
+	CHECK_EQ(speedReadPulses(&tripPulses), pulses);
+	CHECK_EQ(speedReadPulses(&odometerPulses), pulses);
+	CHECK_EQ(tenths, (uint32_t)exactTenths);
+	CHECK(fabs(cumulativeMiles * 10 - exactTenths) > 1);
+
+	/* Top of the gauge: on the driven speed, no window jitter */
+	CHECK(fastTicks > 0);
+	CHECK(fastErrorMax < 0.5);
+	CHECK(cruiseMin > 90 - 0.05 && cruiseMax < 90 + 0.05);
+
+	printf("1 h replay, %llu pulses: exact %.3f mi, pulse odometer %.1f mi, former integrator %.3f mi (%+.3f)\n",
+		   (unsigned long long)pulses, exactTenths / 10, tenths / 10.0, cumulativeMiles,
+		   cumulativeMiles - exactTenths / 10);
+	printf("  %u s at 70 mph or more: reading within %.3f mph, holding 90 mph %.3f to %.3f mph\n",
+		   fastTicks / 4, fastErrorMax, cruiseMin, cruiseMax);
+}
+
+/*
+ * @brief Function that returns the host time per call of a speed calculation
+ * @param filter: 1 for calculateRPM(), 0 for the batch average
+ * @return ns per call
+ */
+static double hostNsPerUpdate(int filter)
+{
+	struct timespec t0;
+	struct timespec t1;
+	const int n = 1000000;
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	for (int i = 0; i < n; i++)
+	{
+		if (filter)
+			calculateRPM();
+		else
+			batchCalculate(MPH_PERIOD_US(30) + (i & 0xFF));
+	}
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+
+	return ((t1.tv_sec - t0.tv_sec) * 1e9 + (t1.tv_nsec - t0.tv_nsec)) / n;
+}
+
+int main(void)
+{
+	hostTimebaseTrap();
+
+	testSteadySpeed();
+	testStepLatency();
+	testUpdateRate();
+	testStall();
+	testShortPeriod();
+	testOdometerReplay();
+
+	setup();
+	for (int n = 0; n < HALL_FILTER_LEN + 1; n++)
+		pulseAndCalculate(MPH_PERIOD_US(30));
+	printf("host ns per update: filter %.1f, batch (double) %.1f\n", hostNsPerUpdate(1), hostNsPerUpdate(0));
+
+	return checkExit("test_speed_sensor");
+}
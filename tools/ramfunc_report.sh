@@ -0,0 +1,77 @@
+#!/bin/sh
+# ramfunc_report.sh: which functions run from SRAM, and what it bought
+#
+#   tools/ramfunc_report.sh firmware.elf [before.log after.log]
+#
+# Lists the functions the linker put in .ramfunc (between _sramfunc and _eramfunc, see
+# STM32F446RETX_FLASH.ld) with their sizes, and counts the long branch veneers the
+# linker added for calls between flash and SRAM.
+#
+# before.log and after.log are profileDump() captures from SWO of a -DPROFILE=1 build
+# with -DRAMFUNC_IN_FLASH=1 and without it, taken over the same run (screen changes,
+# encoder turns, driving). Zone mean and max DWT cycles are printed side by side.
+#
+# NM defaults to arm-none-eabi-nm.
+
+NM=${NM:-arm-none-eabi-nm}
+
+if [ $# -ne 1 ] && [ $# -ne 3 ]; then
+	echo "usage: $0 firmware.elf [before.log after.log]" >&2
+	exit 2
+fi
+
+"$NM" -S -n "$1" | awk '
+	function hex(s,   i, v) {
+		v = 0
+		s = tolower(s)
+		for (i = 1; i <= length(s); i++)
+			v = v * 16 + index("0123456789abcdef", substr(s, i, 1)) - 1
+		return v
+	}
+	$NF == "_sramfunc" { start = $1 }
+	$NF == "_eramfunc" { end = $1 }
+	NF == 4 && ($3 == "T" || $3 == "t") { addr[++n] = $1; size[n] = $2; name[n] = $4 }
+	NF == 3 && $NF ~ /_veneer$/ { veneers++ }
+	END {
+		if (start == "" || end == "") {
+			print "no _sramfunc/_eramfunc: not linked with STM32F446RETX_FLASH.ld" > "/dev/stderr"
+			exit 1
+		}
+		printf "RAM functions (0x%s-0x%s)\n", start, end
+		for (i = 1; i <= n; i++)
+			if (hex(addr[i]) >= hex(start) && hex(addr[i]) < hex(end)) {
+				printf "  %-24s %6d bytes\n", name[i], hex(size[i])
+				total += hex(size[i])
+			}
+		printf "  %-24s %6d bytes\n", "total", total
+		printf "long branch veneers: %d\n", veneers
+	}'
+status=$?
+
+[ $# -eq 3 ] || exit $status
+
+echo
+echo "DWT cycles per zone, RAMFUNC in flash -> in SRAM"
+printf "  %-9s %10s %10s %7s %10s %10s\n" zone "mean flash" "mean sram" change "max flash" "max sram"
+awk '
+	function field(key,   i, kv) {
+		for (i = 2; i <= NF; i++) {
+			split($i, kv, "=")
+			if (kv[1] == key)
+				return kv[2] + 0
+		}
+		return -1
+	}
+	/ n=[0-9]+ min=/ {
+		if (FILENAME == ARGV[1]) { mean0[$1] = field("mean"); max0[$1] = field("max") }
+		else { mean1[$1] = field("mean"); max1[$1] = field("max"); order[++n] = $1 }
+	}
+	END {
+		for (i = 1; i <= n; i++) {
+			z = order[i]
+			if (!(z in mean0))
+				continue
+			change = mean0[z] ? (mean1[z] - mean0[z]) * 100 / mean0[z] : 0
+			printf "  %-9s %10d %10d %6.1f%% %10d %10d\n", z, mean0[z], mean1[z], change, max0[z], max1[z]
+		}
+	}' "$2" "$3"